@@ -8,6 +8,7 @@
 #include "drivers/audio.h"
 #include "fs/fs_manager.h"
 #include "gui/gui_manager.h"
+#include "gui/gui_layout.h"
 #include "core/system.h"
 #include <stdio.h>
 #include <string.h>
@@ -19,6 +20,9 @@
 #define BUTTON_VOL_UP     3
 #define BUTTON_VOL_DOWN   4
 
+// Labels are drawn and measured in the built-in font
+#define LABEL_FONT        0
+
 // GUI elements
 static gui_element_t mainScreen = NULL;
 static gui_element_t songLabel = NULL;
@@ -32,6 +36,7 @@ static char currentSong[MAX_FILENAME_LENGTH] = "";
 static uint32_t currentPosition = 0;
 static uint32_t currentDuration = 0;
 static uint8_t currentVolume = 70; // Default volume
+static uint32_t tracksSeen = 0;    // audio_get_tracks_started() when the label last changed
 
 // Music directory path
 static const char *musicDir = "/music";
@@ -44,6 +49,10 @@ static void prev_song(void);
 static void handle_button_event(uint8_t button_id, button_event_t event);
 static void initialize_gui(void);
 static void populate_playlist(void);
+static void queue_following_song(void);
+static void show_song(const char *filename);
+static int find_song(const char *filename);
+static void set_label(gui_element_t label, const char *text);
 
 // List of songs
 static char songList[20][MAX_FILENAME_LENGTH];
@@ -53,6 +62,9 @@ static int currentSongIndex = 0;
 // Mutex for protecting audio operations
 static SemaphoreHandle_t audioMutex = NULL;
 
+// Mutex for the layout tree (labels change from the player task and the button callback)
+static SemaphoreHandle_t layoutMutex = NULL;
+
 /**
  * Task to update GUI and handle audio state
  */
@@ -64,9 +76,7 @@ static void music_player_task(void *pvParameters) {
     
     if (songCount == 0) {
         printf("No songs found in %s\n", musicDir);
-        if (statusLabel != NULL) {
-            gui_set_text(statusLabel, "No songs found!");
-        }
+        set_label(statusLabel, "No songs found!");
     } else {
         // Play first song
         play_song(songList[0]);
@@ -80,17 +90,37 @@ static void music_player_task(void *pvParameters) {
             lastUpdate = currentTime;
             
             if (currentState == AUDIO_STATE_PLAYING) {
-                // Get current playback position
+                // Check if the queued song has taken over (it joins without a gap)
+                char startedPath[MAX_PATH_LENGTH];
+                uint32_t started = tracksSeen;
                 xSemaphoreTake(audioMutex, portMAX_DELAY);
+                if (audio_get_current_track(startedPath, sizeof(startedPath), &started) == AUDIO_OK &&
+                    started != tracksSeen) {
+                    tracksSeen = started;
+                    // Go by the file that really started: a queued file that failed to open was skipped
+                    const char *name = strrchr(startedPath, '/');
+                    name = (name != NULL) ? name + 1 : startedPath;
+                    int index = find_song(name);
+                    if (index >= 0) {
+                        currentSongIndex = index;
+                    }
+                    audio_get_duration(&currentDuration);
+                    queue_following_song();
+                    xSemaphoreGive(audioMutex);
+                    show_song(name);
+                    xSemaphoreTake(audioMutex, portMAX_DELAY);
+                }
+                
+                // Get current playback position
                 audio_get_position(&currentPosition);
+                audio_state_t engineState = audio_get_state();
                 xSemaphoreGive(audioMutex);
                 
                 // Update GUI
                 update_gui();
                 
-                // Check if song finished
-                if (currentPosition >= currentDuration && currentDuration > 0) {
-                    // Go to next song
+                // The line ran out (the queued song failed to open, or nothing was queued): move on ourselves
+                if (engineState == AUDIO_STATE_STOPPED) {
                     next_song();
                 }
             }
@@ -108,6 +138,7 @@ void music_player_init(void) {
     
     // Create mutex
     audioMutex = xSemaphoreCreateMutex();
+    layoutMutex = xSemaphoreCreateMutex();
     
     // Initialize GUI if display is available
     if (display_is_connected()) {
@@ -137,9 +168,7 @@ static void handle_button_event(uint8_t button_id, button_event_t event) {
                     currentState = AUDIO_STATE_PAUSED;
                     xSemaphoreGive(audioMutex);
                     
-                    if (statusLabel != NULL) {
-                        gui_set_text(statusLabel, "Paused");
-                    }
+                    set_label(statusLabel, "Paused");
                     printf("Playback paused\n");
                 } else if (currentState == AUDIO_STATE_PAUSED) {
                     // Resume playback
@@ -148,9 +177,7 @@ static void handle_button_event(uint8_t button_id, button_event_t event) {
                     currentState = AUDIO_STATE_PLAYING;
                     xSemaphoreGive(audioMutex);
                     
-                    if (statusLabel != NULL) {
-                        gui_set_text(statusLabel, "Playing");
-                    }
+                    set_label(statusLabel, "Playing");
                     printf("Playback resumed\n");
                 } else if (currentState == AUDIO_STATE_STOPPED && songCount > 0) {
                     // Start playback
@@ -177,9 +204,7 @@ static void handle_button_event(uint8_t button_id, button_event_t event) {
                     // Update volume display
                     char volText[20];
                     snprintf(volText, sizeof(volText), "Volume: %d%%", currentVolume);
-                    if (volumeLabel != NULL) {
-                        gui_set_text(volumeLabel, volText);
-                    }
+                    set_label(volumeLabel, volText);
                     printf("%s\n", volText);
                 }
                 break;
@@ -195,9 +220,7 @@ static void handle_button_event(uint8_t button_id, button_event_t event) {
                     // Update volume display
                     char volText[20];
                     snprintf(volText, sizeof(volText), "Volume: %d%%", currentVolume);
-                    if (volumeLabel != NULL) {
-                        gui_set_text(volumeLabel, volText);
-                    }
+                    set_label(volumeLabel, volText);
                     printf("%s\n", volText);
                 }
                 break;
@@ -211,9 +234,7 @@ static void handle_button_event(uint8_t button_id, button_event_t event) {
             currentPosition = 0;
             xSemaphoreGive(audioMutex);
             
-            if (statusLabel != NULL) {
-                gui_set_text(statusLabel, "Stopped");
-            }
+            set_label(statusLabel, "Stopped");
             if (progressBar != NULL) {
                 gui_set_value(progressBar, 0);
             }
@@ -231,35 +252,56 @@ static void initialize_gui(void) {
     // Create main screen
     mainScreen = gui_create_screen();
     
+    // Lay the screen out as a padded column; positions and sizes come from the layout
+    gui_layout_node_t screenLayout = gui_layout_create(mainScreen, NULL);
+    gui_layout_set_fixed_size(screenLayout, display_get_width(), display_get_height());
+    gui_layout_set_direction(screenLayout, GUI_LAYOUT_COLUMN);
+    gui_layout_set_padding(screenLayout, 10, 10, 10, 10);
+    gui_layout_set_gap(screenLayout, 10);
+    gui_layout_set_align(screenLayout, GUI_ALIGN_START, GUI_ALIGN_STRETCH);
+    
+    // Song and status share a fixed-size panel so their text changes
+    // only re-layout this panel, not the whole screen
+    gui_element_t nowPlaying = gui_create_element(GUI_ELEMENT_WINDOW, mainScreen);
+    gui_layout_node_t nowPlayingLayout = gui_layout_create(nowPlaying, screenLayout);
+    gui_layout_set_fixed_size(nowPlayingLayout, display_get_width() - 20, 50);
+    gui_layout_set_direction(nowPlayingLayout, GUI_LAYOUT_COLUMN);
+    gui_layout_set_gap(nowPlayingLayout, 10);
+    
     // Create song label
-    songLabel = gui_create_element(GUI_ELEMENT_LABEL, mainScreen);
-    gui_set_position(songLabel, 10, 10);
-    gui_set_text(songLabel, "No song selected");
+    songLabel = gui_create_element(GUI_ELEMENT_LABEL, nowPlaying);
+    gui_layout_create(songLabel, nowPlayingLayout);
+    set_label(songLabel, "No song selected");
     
     // Create status label
-    statusLabel = gui_create_element(GUI_ELEMENT_LABEL, mainScreen);
-    gui_set_position(statusLabel, 10, 40);
-    gui_set_text(statusLabel, "Stopped");
+    statusLabel = gui_create_element(GUI_ELEMENT_LABEL, nowPlaying);
+    gui_layout_create(statusLabel, nowPlayingLayout);
+    set_label(statusLabel, "Stopped");
     
-    // Create progress bar
+    // Create progress bar (stretched to the screen width by the column)
     progressBar = gui_create_element(GUI_ELEMENT_PROGRESS, mainScreen);
-    gui_set_position(progressBar, 10, 70);
-    gui_set_size(progressBar, 220, 20);
+    gui_layout_node_t progressLayout = gui_layout_create(progressBar, screenLayout);
+    gui_layout_set_fixed_size(progressLayout, 0, 20);
     gui_set_value(progressBar, 0);
     
     // Create volume label
     volumeLabel = gui_create_element(GUI_ELEMENT_LABEL, mainScreen);
-    gui_set_position(volumeLabel, 10, 100);
+    gui_layout_create(volumeLabel, screenLayout);
     char volText[20];
     snprintf(volText, sizeof(volText), "Volume: %d%%", currentVolume);
-    gui_set_text(volumeLabel, volText);
+    set_label(volumeLabel, volText);
+    
+    // Empty space that pushes the button hints to the bottom of the screen
+    gui_layout_node_t spacer = gui_layout_create(NULL, screenLayout);
+    gui_layout_set_grow(spacer, 1);
     
     // Add button hints at bottom of screen
     gui_element_t buttonHints = gui_create_element(GUI_ELEMENT_LABEL, mainScreen);
-    gui_set_position(buttonHints, 10, 160);
-    gui_set_text(buttonHints, "B1: Play/Pause | B2: Next | B3: Prev | B4: Vol+ | B5: Vol-");
+    gui_layout_create(buttonHints, screenLayout);
+    set_label(buttonHints, "B1: Play/Pause | B2: Next | B3: Prev | B4: Vol+ | B5: Vol-");
     
     // Set main screen active
+    gui_layout_update();
     gui_set_screen(mainScreen);
 }
 
@@ -295,10 +337,6 @@ static void play_song(const char *filename) {
     char fullPath[MAX_PATH_LENGTH];
     snprintf(fullPath, sizeof(fullPath), "%s/%s", musicDir, filename);
     
-    // Update song info
-    strncpy(currentSong, filename, sizeof(currentSong) - 1);
-    currentSong[sizeof(currentSong) - 1] = '\0';
-    
     // Start playback
     xSemaphoreTake(audioMutex, portMAX_DELAY);
     audio_status_t status = audio_play_file(fullPath);
@@ -306,22 +344,32 @@ static void play_song(const char *filename) {
     if (status == AUDIO_OK) {
         currentState = AUDIO_STATE_PLAYING;
         audio_get_duration(&currentDuration);
-        currentPosition = 0;
         audio_set_volume(currentVolume);
+        tracksSeen = audio_get_tracks_started();
+        // Line up the following song now, so it starts without a gap
+        queue_following_song();
     } else {
         currentState = AUDIO_STATE_STOPPED;
         printf("Error playing file: %d\n", status);
     }
     xSemaphoreGive(audioMutex);
     
+    show_song(filename);
+}
+
+/**
+ * Show a song that has just started
+ */
+static void show_song(const char *filename) {
+    // Update song info
+    strncpy(currentSong, filename, sizeof(currentSong) - 1);
+    currentSong[sizeof(currentSong) - 1] = '\0';
+    currentPosition = 0;
+    
     // Update GUI
-    if (songLabel != NULL) {
-        gui_set_text(songLabel, currentSong);
-    }
+    set_label(songLabel, currentSong);
     
-    if (statusLabel != NULL) {
-        gui_set_text(statusLabel, (currentState == AUDIO_STATE_PLAYING) ? "Playing" : "Error");
-    }
+    set_label(statusLabel, (currentState == AUDIO_STATE_PLAYING) ? "Playing" : "Error");
     
     if (progressBar != NULL) {
         gui_set_value(progressBar, 0);
@@ -330,6 +378,34 @@ static void play_song(const char *filename) {
     printf("Now playing: %s\n", currentSong);
 }
 
+/**
+ * Find a song in the playlist by its file name
+ * @return Its index, or -1 if it isn't there
+ */
+static int find_song(const char *filename) {
+    for (int i = 0; i < songCount; i++) {
+        if (strcmp(songList[i], filename) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Queue the song after the current one (call with audioMutex held)
+ */
+static void queue_following_song(void) {
+    if (songCount == 0) {
+        return;
+    }
+    
+    char fullPath[MAX_PATH_LENGTH];
+    int following = (currentSongIndex + 1) % songCount;
+    snprintf(fullPath, sizeof(fullPath), "%s/%s", musicDir, songList[following]);
+    audio_clear_queue();
+    audio_enqueue_file(fullPath);
+}
+
 /**
  * Play next song in playlist
  */
@@ -381,7 +457,8 @@ static void populate_playlist(void) {
             if (ext != NULL) {
                 if (strcasecmp(ext, ".mp3") == 0 || 
                     strcasecmp(ext, ".wav") == 0 || 
-                    strcasecmp(ext, ".ogg") == 0) {
+                    strcasecmp(ext, ".ogg") == 0 ||
+                    strcasecmp(ext, ".flac") == 0) {
                     // Add to song list
                     strncpy(songList[songCount], info.name, MAX_FILENAME_LENGTH - 1);
                     songList[songCount][MAX_FILENAME_LENGTH - 1] = '\0';
@@ -444,3 +521,17 @@ int main(void) {
     
     return 0;
 }
+
+/**
+ * Change the words on a label and let the layout make room for them
+ */
+static void set_label(gui_element_t label, const char *text) {
+    if (label == NULL) {
+        return;
+    }
+    xSemaphoreTake(layoutMutex, portMAX_DELAY);
+    gui_set_text(label, text);
+    gui_layout_text_changed(label, text, LABEL_FONT);
+    gui_layout_update();
+    xSemaphoreGive(layoutMutex);
+}
@@ -0,0 +1,166 @@
+/* =================== PIcoOS ADPCM Codec =================== */
+/* This file squeezes sound to a quarter of its size and unsqueezes it almost for free! */
+
+#ifndef ADPCM_H    /* This is a special guard that makes sure we only include this file once */
+#define ADPCM_H
+
+#include <stdint.h>               /* This gives us special number types */
+#include "os_config.h"            /* This gets our special settings */
+#include "drivers/audio.h"        /* This gives us sound status messages */
+
+/*
+ * ADPCM stores each sample as a 4-bit step from a prediction, so 16-bit
+ * sound takes a quarter of the room. WAV files carry it in blocks of
+ * block_align bytes. Each block starts with a small header per channel,
+ * so any block can be decoded on its own. Two kinds are supported:
+ *
+ *   IMA (WAV format tag 0x0011): the header has the first sample and a
+ *   step index. Data follows in 4-byte groups per channel (8 samples
+ *   each), low nibble first.
+ *
+ *   MS (tag 0x0002): the header has a predictor number, a step size and
+ *   the first two samples. Nibbles follow high nibble first, with stereo
+ *   interleaved one nibble per channel. Only the seven standard predictor
+ *   pairs are used. Every encoder writes these.
+ *
+ * Both decoders are streaming. adpcm_decoder_read() continues from where
+ * it stopped inside a block, so a caller can take a few frames at a time
+ * without a buffer for the whole decoded block. The IMA decoder is
+ * table-driven. One lookup gives both the step to add and the next table
+ * row, so a sample costs a load, an add, a saturate and a shift. The table
+ * (89 x 8 entries, 2.8 KB) is built in RAM on first use. This keeps flash
+ * cache misses out of the mixer's hot loop.
+ *
+ * The encoder writes mono IMA blocks (for recording). Each block restarts
+ * from the exact first sample, so errors never carry across blocks.
+ *
+ * Decoders and encoders are plain structs owned by the caller. There is no
+ * heap, and one may be used by one task at a time.
+ */
+
+/* ===== Which Squeeze ===== */
+// ADPCM kind - which of the two WAV ADPCM formats
+typedef enum {
+    ADPCM_IMA = 0,        /* IMA/DVI ADPCM (WAV format tag 0x0011) */
+    ADPCM_MS              /* Microsoft ADPCM (WAV format tag 0x0002) */
+} adpcm_type_t;
+
+// ADPCM layout - how the blocks are built (from the WAV "fmt " chunk)
+typedef struct {
+    adpcm_type_t type;           /* Which kind */
+    uint8_t channels;            /* 1 = mono, 2 = stereo */
+    uint16_t block_align;        /* Bytes in one whole block */
+    uint16_t samples_per_block;  /* Frames in one whole block */
+} adpcm_format_t;
+
+// Decoder - where we are in the current block (caller-owned)
+typedef struct {
+    adpcm_format_t format;
+    const uint8_t *block;        /* The block being decoded */
+    uint16_t block_frames;       /* Frames in it (a file's last block may be short) */
+    uint16_t position;           /* Next frame to make */
+    int32_t sample1[2];          /* Newest sample per channel (IMA: the prediction) */
+    int32_t sample2[2];          /* The one before (MS only) */
+    int32_t step[2];             /* IMA: table row (index x 8); MS: step size */
+    int32_t coef1[2];            /* MS predictor pair */
+    int32_t coef2[2];
+} adpcm_decoder_t;
+
+// Encoder - a mono IMA block being filled (caller-owned)
+typedef struct {
+    uint8_t *block;              /* Where the block is built (block_align bytes) */
+    uint16_t block_align;        /* Bytes in one whole block */
+    uint16_t samples_per_block;  /* Frames in one whole block */
+    uint16_t position;           /* Frames in the block so far */
+    int32_t predictor;           /* What the decoder will have made of the last sample */
+    int32_t row;                 /* Step table row (index x 8), carried from block to block */
+} adpcm_encoder_t;
+
+/* ===== Block Sizes ===== */
+
+/**
+ * Work out how many frames a whole block holds
+ * @param type Which kind
+ * @param channels 1 or 2
+ * @param block_align Bytes in one block
+ * @return Frames per block, 0 if block_align is too small for its headers
+ */
+uint16_t adpcm_samples_per_block(adpcm_type_t type, uint8_t channels, uint16_t block_align);  /* This counts the sounds in one block */
+
+/**
+ * Work out how many frames a block of this many bytes holds (a file's last block may be short)
+ * @param format How the blocks are built
+ * @param bytes How many bytes the block has
+ * @return Frames in it, 0 if it is too short for its headers
+ */
+uint16_t adpcm_block_frames(const adpcm_format_t *format, uint32_t bytes);  /* This counts the sounds in a maybe-short block */
+
+/* ===== Unsqueezing ===== */
+
+/**
+ * Get a decoder ready for a format (it then waits for adpcm_decoder_start_block)
+ * @param decoder The decoder to set up
+ * @param format How the blocks are built
+ */
+void adpcm_decoder_init(adpcm_decoder_t *decoder, const adpcm_format_t *format);  /* This gets the unsqueezer ready */
+
+/**
+ * Start decoding a block (it must stay in memory until adpcm_decoder_read has used it up)
+ * @param decoder The decoder to use
+ * @param block The block
+ * @param bytes How many bytes it has (less than block_align for a file's last block)
+ * @return AUDIO_OK, AUDIO_ERROR_FORMAT if the block's header is broken or doesn't fit
+ */
+audio_status_t adpcm_decoder_start_block(adpcm_decoder_t *decoder, const uint8_t *block, uint32_t bytes);  /* This opens the next block */
+
+/**
+ * Decode the next frames of the current block into 16-bit stereo (mono plays on both sides)
+ * @param decoder The decoder to use
+ * @param frames Where to put the frames, left in the low half of each word
+ * @param max_frames How many frames fit there
+ * @return How many frames were made (0 once the block is used up)
+ */
+uint16_t adpcm_decoder_read(adpcm_decoder_t *decoder, uint32_t *frames, uint16_t max_frames);  /* This unsqueezes a few sounds */
+
+/**
+ * Check if the current block is used up (also true before the first block)
+ * @param decoder The decoder to ask
+ * @return 1 if it needs adpcm_decoder_start_block, 0 if frames are left
+ */
+uint8_t adpcm_decoder_block_done(const adpcm_decoder_t *decoder);  /* This asks "need the next block?" */
+
+/* ===== Squeezing ===== */
+
+/**
+ * Get a mono IMA encoder ready
+ * @param encoder The encoder to set up
+ * @param block Where to build each block (block_align bytes)
+ * @param block_align Bytes in one block (at least 8: the 4-byte header and one 4-byte group)
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM if the block is too small
+ */
+audio_status_t adpcm_encoder_init(adpcm_encoder_t *encoder, uint8_t *block, uint16_t block_align);  /* This gets the squeezer ready */
+
+/**
+ * Squeeze samples into the current block until it is full
+ * @param encoder The encoder to use
+ * @param pcm 16-bit mono samples
+ * @param count How many there are
+ * @return How many were taken (fewer than count once the block is full)
+ */
+uint16_t adpcm_encoder_write(adpcm_encoder_t *encoder, const int16_t *pcm, uint16_t count);  /* This squeezes some sounds */
+
+/**
+ * Check if the current block is full
+ * @param encoder The encoder to ask
+ * @return 1 if adpcm_encoder_take_block should be called, 0 if there is room
+ */
+uint8_t adpcm_encoder_block_full(const adpcm_encoder_t *encoder);  /* This asks "is the block full?" */
+
+/**
+ * Finish the current block (full or not) and start a new one
+ * @param encoder The encoder to use
+ * @return How many bytes of the block to store (0 if it was empty; a short block pads its last nibble)
+ */
+uint16_t adpcm_encoder_take_block(adpcm_encoder_t *encoder);  /* This closes a block so it can be saved */
+
+#endif /* End of ADPCM_H - we're done describing the ADPCM codec! */
@@ -0,0 +1,172 @@
+/* =================== PIcoOS Sound Assembly Line =================== */
+/* This file lines up sound workers - reader, decoder, resampler, mixer, speaker - so each one can work ahead! */
+
+#ifndef AUDIO_PIPELINE_H    /* This is a special guard that makes sure we only include this file once */
+#define AUDIO_PIPELINE_H
+
+#include <stdint.h>             /* This gives us special number types */
+#include "os_config.h"          /* This gets our special settings */
+#include "drivers/audio.h"      /* This gives us sound status messages */
+#include "audio/spsc_ring.h"    /* This gives us the pipes between workers */
+#include "fs/fs_manager.h"      /* This gives us files to read */
+
+/*
+ * audio_play_file() is built from stages: read -> decode -> resample ->
+ * mix -> output. Between each pair of stages sits an SPSC ring, so a stage
+ * only ever waits on its direct neighbours. The reader can run ahead of the
+ * decoder by a whole ring, which is how SD card latency spikes disappear.
+ * In the same way the decoder runs ahead of the output.
+ *
+ * A stage is a process function that moves as much as it can from its input
+ * ring to its output ring and reports what happened. Stages with own_task
+ * get their own FreeRTOS task, optionally pinned to a core, which sleeps when
+ * starved or blocked and is woken by its neighbours. Stages without one
+ * are run in turn by audio_pipeline_pump(), normally from audioTask.
+ *
+ * End of stream travels down the pipe. A stage that is finished returns
+ * AUDIO_STAGE_DONE, and its output ring is closed. The next stage sees
+ * spsc_ring_drained() on its input once it has used up the rest.
+ */
+
+/* ===== What a Worker Did ===== */
+// Stage results - what happened in one call of a stage
+typedef enum {
+    AUDIO_STAGE_PROGRESS = 0,   /* Moved some sound along */
+    AUDIO_STAGE_STARVED,        /* Nothing to work on - the pipe in is empty */
+    AUDIO_STAGE_BLOCKED,        /* Nowhere to put it - the pipe out is full */
+    AUDIO_STAGE_DONE,           /* Finished for good (end of the song) */
+    AUDIO_STAGE_ERROR           /* Something broke */
+} audio_stage_result_t;
+
+// Stage process function - does one helping of work (input is NULL for the first stage, output NULL for the last)
+typedef audio_stage_result_t (*audio_stage_process_t)(void *context, spsc_ring_t *input, spsc_ring_t *output);  /* This is one worker's job */
+
+/* ===== Describing a Worker ===== */
+// Stage configuration - one worker on the line
+typedef struct {
+    const char *name;                 /* The worker's name (also its task name) */
+    audio_stage_process_t process;    /* The job it does */
+    void *context;                    /* Anything the job needs to remember */
+    uint32_t output_ring_bytes;       /* How big the pipe after this worker is (rounded up to a power of two; unused for the last) */
+    uint8_t own_task;                 /* 1 = gets its own worker task, 0 = runs in audio_pipeline_pump() */
+    int8_t core;                      /* Which core its task stays on (0 or 1), or -1 for either */
+    uint8_t priority;                 /* How important its task is */
+    uint8_t decodes;                  /* 1 = its helpings count as decode time in audio_get_telemetry() */
+} audio_stage_config_t;
+
+/* ===== Worker Report Card ===== */
+// Stage statistics - how a worker has been doing
+typedef struct {
+    uint32_t runs;           /* How many times it was called */
+    uint32_t progress;       /* How many of those moved sound along */
+    uint32_t starved;        /* How many times the pipe in was empty */
+    uint32_t blocked;        /* How many times the pipe out was full */
+    uint32_t busy_us;        /* How long it spent working (microseconds) */
+    uint32_t fill;           /* How many bytes are in its pipe out right now (pipe in for the last worker) */
+    uint32_t fill_min;       /* The emptiest that pipe got */
+    uint32_t fill_max;       /* The fullest that pipe got */
+    uint32_t capacity;       /* How many bytes that pipe holds */
+} audio_stage_stats_t;
+
+// Pipeline handle - a special tag for one assembly line
+typedef struct audio_pipeline_s *audio_pipeline_t;  /* This is our name tag for an assembly line */
+
+/* ===== Building the Line ===== */
+
+/**
+ * Build an assembly line out of workers
+ * @param stages The workers, first to last
+ * @param count How many workers (up to AUDIO_PIPELINE_MAX_STAGES)
+ * @param pipeline A place to store the new line's name tag
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_pipeline_create(const audio_stage_config_t *stages, uint8_t count, audio_pipeline_t *pipeline);  /* This sets up the workers and pipes */
+
+/**
+ * Take the assembly line apart (stops it first)
+ * @param pipeline The line to take apart
+ */
+void audio_pipeline_destroy(audio_pipeline_t pipeline);  /* This sends the workers home */
+
+/* ===== Running the Line ===== */
+
+/**
+ * Start the workers that have their own tasks
+ * @param pipeline The line to start
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_pipeline_start(audio_pipeline_t pipeline);  /* This rings the starting bell */
+
+/**
+ * Stop every worker task and wait for them to finish
+ * @param pipeline The line to stop
+ */
+void audio_pipeline_stop(audio_pipeline_t pipeline);  /* This rings the closing bell */
+
+/**
+ * Empty all the pipes so the line can start over (only while stopped, e.g. after a seek)
+ * @param pipeline The line to empty
+ */
+void audio_pipeline_reset(audio_pipeline_t pipeline);  /* This cleans out the pipes */
+
+/**
+ * Give every worker without its own task one turn
+ * @param pipeline The line to run
+ * @return 1 if anyone moved sound along, 0 if nobody could
+ */
+uint8_t audio_pipeline_pump(audio_pipeline_t pipeline);  /* This is like a foreman nudging each worker */
+
+/**
+ * Check if the whole song has gone all the way through
+ * @param pipeline The line to check
+ * @return 1 if the last worker is done (or anyone failed), 0 if still going
+ */
+uint8_t audio_pipeline_is_done(audio_pipeline_t pipeline);  /* This asks "is the song over?" */
+
+/**
+ * Read one worker's report card
+ * @param pipeline The line the worker is on
+ * @param stage Which worker (0 is the first)
+ * @param stats A place to store the report card
+ * @param reset 1 to start a fresh report card afterwards, 0 to keep counting
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_pipeline_get_stats(audio_pipeline_t pipeline, uint8_t stage, audio_stage_stats_t *stats, uint8_t reset);  /* This shows how a worker is doing */
+
+/* ===== Ready-Made Workers ===== */
+
+// File reader context - for audio_stage_read_file
+typedef struct {
+    fs_file_t file;          /* The open file to read */
+    uint32_t chunk_bytes;    /* Smallest read worth doing (wait for this much room first; 0 = 512) */
+} audio_file_source_t;
+
+// Output context - for audio_stage_write_output
+typedef struct {
+    uint16_t filled;         /* How many frames of the borrowed output buffer are filled (start at 0) */
+} audio_output_sink_t;
+
+/**
+ * First worker: copy a file into the pipe (context is an audio_file_source_t)
+ */
+audio_stage_result_t audio_stage_read_file(void *context, spsc_ring_t *input, spsc_ring_t *output);  /* This worker reads the memory card */
+
+/**
+ * Last worker: copy 16-bit stereo frames into the DMA output buffers (context is an audio_output_sink_t)
+ * Waits up to AUDIO_PIPELINE_IDLE_MS for the speaker to hand back a buffer
+ * From its first turn until it finishes (or its line stops) it owns the output engine
+ * With its pipe in empty it plays a direct WAV file handed over by the track queue itself
+ * (track_queue_pump_direct), so it must come right after audio_stage_track_queue
+ */
+audio_stage_result_t audio_stage_write_output(void *context, spsc_ring_t *input, spsc_ring_t *output);  /* This worker feeds the speaker */
+
+/* ===== Sound Effects With No Song ===== */
+
+/**
+ * Feed the speaker sound effects alone while no output worker owns it (audioTask calls this
+ * after audio_update()); starts the output engine for them and stops it once they have been heard
+ * @return 1 if it filled any buffers, 0 if there was nothing to do
+ */
+uint8_t audio_pipeline_pump_effects(void);  /* This lets button clicks play even when the music is off */
+
+#endif /* End of AUDIO_PIPELINE_H - we're done describing the sound assembly line! */
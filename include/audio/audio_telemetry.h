@@ -0,0 +1,70 @@
+/* =================== PIcoOS Audio Telemetry =================== */
+/* This file writes down how the sound workers are doing, so a hiccup can be explained later! */
+
+#ifndef AUDIO_TELEMETRY_H    /* This is a special guard that makes sure we only include this file once */
+#define AUDIO_TELEMETRY_H
+
+#include <stdint.h>               /* This gives us special number types */
+#include <stddef.h>               /* This gives us special size types */
+#include "os_config.h"            /* This gets our special settings */
+#include "drivers/audio.h"        /* This gives us the telemetry boxes */
+#include "fs/fs_manager.h"        /* This gives us files to read */
+
+/*
+ * The recording side of audio_get_telemetry(). Each number comes from
+ * the place that knows it first:
+ *
+ *   decode:  audio_pipeline.c times each helping of a stage marked
+ *            audio_stage_config_t.decodes that moved sound along.
+ *   io_wait: the file reads that feed playback go through
+ *            audio_telemetry_read() (the reader stage, the FLAC, Vorbis
+ *            and WAV readers and the track queue's MP3 feed).
+ *   latency, output fill: the output stage, once for every buffer it
+ *            queues.
+ *   underruns: the output engine's DMA interrupt, when it has to play
+ *            silence.
+ *
+ * The records are taken from tasks, one short critical section each. The
+ * underrun note is taken from the DMA interrupt, inside the output
+ * engine's own critical section.
+ */
+
+/* ===== What Is Being Timed ===== */
+// Telemetry metric - which timing chart a measurement goes into
+typedef enum {
+    AUDIO_TELEMETRY_DECODE = 0,   /* One helping of decoding */
+    AUDIO_TELEMETRY_IO_WAIT,      /* One file read */
+    AUDIO_TELEMETRY_LATENCY       /* From entering the output stage's pipe to being heard */
+} audio_telemetry_metric_t;
+
+/* ===== Writing Things Down ===== */
+
+/**
+ * Add one measurement to a timing chart (call from a task)
+ * @param metric Which chart
+ * @param value_us How long it took (microseconds)
+ */
+void audio_telemetry_record(audio_telemetry_metric_t metric, uint32_t value_us);  /* This adds one mark to a chart */
+
+/**
+ * Note how many buffers were still waiting for the speaker as a new one was queued (call from a task)
+ * @param waiting From audio_output_queued_buffers()
+ */
+void audio_telemetry_record_fill(uint8_t waiting);  /* This notes how full the speaker's line was */
+
+/**
+ * Note that the speaker ran dry (called from the output engine's DMA interrupt, inside its critical section)
+ */
+void audio_telemetry_note_underrun(void);  /* This notes a hiccup and what was going on */
+
+/**
+ * fs_read(), timed into the io_wait chart (call from a task)
+ * @param file The open file to read
+ * @param buffer Where to put what was read
+ * @param size How many bytes to read
+ * @param bytes_read A place to store how many bytes were actually read
+ * @return Whatever fs_read() returned
+ */
+fs_status_t audio_telemetry_read(fs_file_t file, void *buffer, size_t size, size_t *bytes_read);  /* This reads a file with a stopwatch running */
+
+#endif /* End of AUDIO_TELEMETRY_H - we're done describing audio telemetry! */
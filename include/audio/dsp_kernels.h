@@ -0,0 +1,173 @@
+/* =================== PIcoOS Sound Math Helpers =================== */
+/* This file has tiny math tricks that let the computer squeeze and add sounds super fast! */
+
+#ifndef DSP_KERNELS_H    /* This is a special guard that makes sure we only include this file once */
+#define DSP_KERNELS_H
+
+#include <stdint.h>    /* This gives us special number types */
+
+/*
+ * Building blocks for the audio hot loops. The RP2350's Cortex-M33 has the
+ * DSP extension: single-cycle saturation (SSAT), saturating add (QADD),
+ * two 16-bit lanes per register (QADD16), dual multiply-accumulate
+ * (SMLAD) and 32x32 multiply-accumulate into the top word (SMMLAR). GCC
+ * does not reliably produce these from plain C, so each helper
+ * issues the instruction itself when the compiler says it is there
+ * (__ARM_FEATURE_SAT / __ARM_FEATURE_DSP) and falls back to plain C that
+ * gives the same answer otherwise. The fallbacks also keep host builds
+ * of the audio code working.
+ *
+ * 32x32->64 multiplies need no helper: with -mcpu=cortex-m33 GCC turns
+ * (int64_t)a * b into one SMULL, and a += on top of it into SMLAL.
+ */
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#define DSP_HAVE_SIMD 1    /* The DSP instructions are there */
+#else
+#define DSP_HAVE_SIMD 0    /* Plain C only */
+#endif
+
+#if defined(__ARM_FEATURE_SAT) && (__ARM_FEATURE_SAT == 1)
+#define DSP_HAVE_SAT 1     /* SSAT/USAT are there */
+#else
+#define DSP_HAVE_SAT 0
+#endif
+
+/* ===== Squeezing Numbers ===== */
+
+/**
+ * Clip a number to the 16-bit range
+ * @param value The number to clip
+ * @return value, limited to -32768..32767
+ */
+static inline int32_t dsp_ssat16(int32_t value) {
+#if DSP_HAVE_SAT
+    int32_t result;
+    __asm__ ("ssat %0, #16, %1" : "=r" (result) : "r" (value));
+    return result;
+#else
+    if (value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return value;
+#endif
+}  /* This is like making sure the sound never gets too loud to fit */
+
+/**
+ * Add two numbers without wrapping around
+ * @param a The first number
+ * @param b The second number
+ * @return a + b, limited to the 32-bit range
+ */
+static inline int32_t dsp_qadd(int32_t a, int32_t b) {
+#if DSP_HAVE_SIMD
+    int32_t result;
+    __asm__ ("qadd %0, %1, %2" : "=r" (result) : "r" (a), "r" (b));
+    return result;
+#else
+    int64_t sum = (int64_t)a + b;
+    if (sum > INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (sum < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return (int32_t)sum;
+#endif
+}  /* This is like adding that stops at the top instead of starting over */
+
+/**
+ * Count the zero bits above the highest one bit
+ * @param value The number to look at
+ * @return 0..31, or 32 if value is 0
+ */
+static inline uint32_t dsp_clz(uint32_t value) {
+    // One CLZ on the M33, which already gives 32 for zero
+    return (value == 0) ? 32u : (uint32_t)__builtin_clz(value);
+}  /* This is like counting the empty seats before the first person */
+
+/* ===== Two Sounds in One Number ===== */
+
+/**
+ * Put two 16-bit samples into one 32-bit word (low half first in memory)
+ * @param low The sample for the low half (left channel)
+ * @param high The sample for the high half (right channel)
+ * @return Both samples in one word
+ */
+static inline uint32_t dsp_pack16x2(int32_t low, int32_t high) {
+    // GCC turns this exact shape into one PKHBT
+    return ((uint32_t)low & 0xFFFFu) | ((uint32_t)high << 16);
+}  /* This is like putting a left and right shoe in one box */
+
+/**
+ * Make both samples in a pair quieter by the same amount
+ * @param pair Two 16-bit samples
+ * @param gain_q15 How loud to keep them (32768 = as they are, 0 = silent)
+ * @return Both samples scaled
+ */
+static inline uint32_t dsp_scale16x2(uint32_t pair, int32_t gain_q15) {
+    int32_t low = ((int32_t)(int16_t)(pair & 0xFFFFu) * gain_q15) >> 15;
+    int32_t high = ((int32_t)(int16_t)(pair >> 16) * gain_q15) >> 15;
+    return dsp_pack16x2(low, high);
+}  /* This is like turning down a left-right pair together */
+
+/**
+ * Add two pairs of 16-bit samples at once without wrapping around
+ * @param a The first pair
+ * @param b The second pair
+ * @return Each half added and limited to the 16-bit range
+ */
+static inline uint32_t dsp_qadd16(uint32_t a, uint32_t b) {
+#if DSP_HAVE_SIMD
+    uint32_t result;
+    __asm__ ("qadd16 %0, %1, %2" : "=r" (result) : "r" (a), "r" (b));
+    return result;
+#else
+    int32_t low = dsp_ssat16((int32_t)(int16_t)(a & 0xFFFFu) + (int16_t)(b & 0xFFFFu));
+    int32_t high = dsp_ssat16((int32_t)(int16_t)(a >> 16) + (int16_t)(b >> 16));
+    return dsp_pack16x2(low, high);
+#endif
+}  /* This is like mixing two left-right pairs in one go */
+
+/**
+ * Multiply two pairs of 16-bit numbers and add both results to a total
+ * @param a The first pair
+ * @param b The second pair
+ * @param accumulator The running total
+ * @return accumulator + a.low * b.low + a.high * b.high
+ */
+static inline int32_t dsp_smlad(uint32_t a, uint32_t b, int32_t accumulator) {
+#if DSP_HAVE_SIMD
+    int32_t result;
+    __asm__ ("smlad %0, %1, %2, %3" : "=r" (result) : "r" (a), "r" (b), "r" (accumulator));
+    return result;
+#else
+    return accumulator + (int32_t)(int16_t)(a & 0xFFFFu) * (int16_t)(b & 0xFFFFu)
+                       + (int32_t)(int16_t)(a >> 16) * (int16_t)(b >> 16);
+#endif
+}  /* This is like doing two times-and-add sums at once */
+
+/* ===== Big Numbers Times Big Numbers ===== */
+
+/**
+ * Multiply two 32-bit numbers, keep the rounded top half and add it to a total
+ * @param a The first number
+ * @param b The second number (a Q31 coefficient keeps a's scale, halved)
+ * @param accumulator The running total
+ * @return accumulator + round(a * b / 2^32)
+ */
+static inline int32_t dsp_smmlar(int32_t a, int32_t b, int32_t accumulator) {
+#if DSP_HAVE_SIMD
+    // One cycle, where SMULL plus a 64-bit shift and add takes four
+    int32_t result;
+    __asm__ ("smmlar %0, %1, %2, %3" : "=r" (result) : "r" (a), "r" (b), "r" (accumulator));
+    return result;
+#else
+    return accumulator + (int32_t)(((int64_t)a * b + 0x80000000LL) >> 32);
+#endif
+}  /* This is like a times-and-add sum for really precise numbers */
+
+#endif /* End of DSP_KERNELS_H - we're done describing the sound math helpers! */
@@ -0,0 +1,107 @@
+/* =================== PIcoOS FLAC Decoder =================== */
+/* This file plays FLAC music - squished without losing a single bit of the sound! */
+
+#ifndef FLAC_DECODER_H    /* This is a special guard that makes sure we only include this file once */
+#define FLAC_DECODER_H
+
+#include <stdint.h>               /* This gives us special number types */
+#include "os_config.h"            /* This gets our special settings */
+#include "drivers/audio.h"        /* This gives us sound status messages */
+#include "audio/audio_pipeline.h" /* This lets the decoder work on the sound assembly line */
+
+/*
+ * A streaming FLAC decoder written for this chip. It reads the file through
+ * fs_manager itself, FLAC_DECODER_CACHE_BYTES at a time, so it needs no
+ * file-reader stage in front of it. Memory is bounded by the stream's
+ * largest block: channels x max_block_size 32-bit samples, allocated when
+ * the file is opened. Files whose blocks are bigger than
+ * FLAC_DECODER_MAX_BLOCK_SIZE are refused.
+ *
+ * The fast paths:
+ *   - the bit reader keeps a left-aligned 32-bit window and refills it a
+ *     byte at a time only when it runs low
+ *   - Rice codes are read a window at a time: one CLZ finds the unary part
+ *   - residuals are written in place and the predictor is added on top,
+ *     with a separate unrolled loop for each LPC order up to 12
+ *   - LPC sums stay in 32 bits whenever sample size, coefficient precision
+ *     and order guarantee they fit, and fall back to 64 bits only when not
+ *
+ * Mono and stereo streams up to 24 bits are supported. The output is 16-bit
+ * stereo: deeper samples are rounded down to 16 bits, and mono is copied to
+ * both channels. A frame whose header fails its CRC-8 is skipped by
+ * searching for the next sync code. A frame with broken subframes, or one
+ * that fails its CRC-16, plays as silence; the CRC-16 is kept up a byte at
+ * a time as the bit window refills.
+ */
+
+/* ===== What the Song Is Like ===== */
+// Stream information - from the file's STREAMINFO block
+typedef struct {
+    uint32_t sample_rate;       /* How many samples per second */
+    uint8_t channels;           /* 1 = mono, 2 = stereo */
+    uint8_t bits_per_sample;    /* How detailed each sample is (8 to 24) */
+    uint16_t max_block_size;    /* Most samples per channel in one frame */
+    uint64_t total_samples;     /* Samples per channel in the whole song (0 = unknown) */
+} flac_stream_info_t;
+
+// Decoder handle - a special tag for one FLAC decoder
+typedef struct flac_decoder_s *flac_decoder_t;  /* This is our name tag for a decoder */
+
+/* ===== Opening and Closing ===== */
+
+/**
+ * Open a FLAC file and read its description
+ * @param filename The file to play
+ * @param decoder A place to store the new decoder's name tag
+ * @return AUDIO_OK, AUDIO_ERROR_IO if the file can't be read, AUDIO_ERROR_FORMAT if it isn't
+ *         a FLAC file we can play, AUDIO_ERROR_MEMORY if the blocks don't fit
+ */
+audio_status_t flac_decoder_open(const char *filename, flac_decoder_t *decoder);  /* This opens the song and reads its label */
+
+/**
+ * Close the file and give back the decoder's memory
+ * @param decoder The decoder to close
+ */
+void flac_decoder_close(flac_decoder_t decoder);  /* This puts the song away */
+
+/**
+ * Read what the song is like
+ * @param decoder The decoder to ask
+ * @param info A place to store the description
+ * @return Message telling us if it worked or not
+ */
+audio_status_t flac_decoder_get_info(flac_decoder_t decoder, flac_stream_info_t *info);  /* This reads the song's label */
+
+/* ===== Decoding ===== */
+
+/**
+ * Read and decode the next frame (hand out the last one with flac_decoder_read_pcm first)
+ * @param decoder The decoder to use
+ * @return AUDIO_OK if a frame is ready, AUDIO_ERROR_BUSY once the song is over
+ */
+audio_status_t flac_decoder_decode_frame(flac_decoder_t decoder);  /* This turns one frame back into sound */
+
+/**
+ * Copy decoded sound out as 16-bit stereo frames (left, right, left, right...)
+ * @param decoder The decoder to read from
+ * @param pcm Where to put the frames (4-byte aligned)
+ * @param max_frames How many frames fit there
+ * @return How many frames were copied
+ */
+uint16_t flac_decoder_read_pcm(flac_decoder_t decoder, int16_t *pcm, uint16_t max_frames);  /* This pours out the sound */
+
+/**
+ * Count the decoded frames not yet copied out
+ * @param decoder The decoder to look at
+ * @return How many frames are waiting
+ */
+uint16_t flac_decoder_pending_frames(flac_decoder_t decoder);  /* This checks how much sound is left in the cup */
+
+/* ===== Assembly Line Worker ===== */
+
+/**
+ * First worker: reads and decodes the file, 16-bit stereo frames out (context is a flac_decoder_t)
+ */
+audio_stage_result_t audio_stage_decode_flac(void *context, spsc_ring_t *input, spsc_ring_t *output);  /* This worker unsquishes lossless music */
+
+#endif /* End of FLAC_DECODER_H - we're done describing the FLAC decoder! */
@@ -0,0 +1,232 @@
+/* =================== PIcoOS MP3 Decoder =================== */
+/* This file turns squished MP3 music back into real sound, using only whole-number math! */
+
+#ifndef MP3_DECODER_H    /* This is a special guard that makes sure we only include this file once */
+#define MP3_DECODER_H
+
+#include <stdint.h>               /* This gives us special number types */
+#include "os_config.h"            /* This gets our special settings */
+#include "drivers/audio.h"        /* This gives us sound status messages */
+#include "audio/audio_pipeline.h" /* This lets the decoder work on the sound assembly line */
+
+/*
+ * Fixed-point MPEG-1/2 layer I/II/III decoding built on MAD (lib/libmad).
+ * MAD does the bitstream, Huffman decoding, dequantization, stereo
+ * processing and the IMDCT. It is built with FPM_64BIT, so each of its Q28
+ * multiplies is an SMULL plus a 64-bit shift on the Cortex-M33. MAD's ARM
+ * assembly (FPM_ARM, ASO_IMDCT) is not used because it is ARM-mode code and
+ * the M33 only runs Thumb. The polyphase synthesis filter, the most
+ * expensive step, is ours (audio/mp3_synth.h). It does every multiply as
+ * one DSP-extension SMMLAR and writes 16-bit stereo directly, clipped with
+ * SSAT, with no separate conversion pass.
+ *
+ * Estimated from instruction counts, not measured: the synthesis takes
+ * about 2,500 cycles per 32-sample slot per channel. That is 6.9 MCPS for
+ * 44.1 kHz stereo at any bitrate. MAD's filter plus the conversion pass
+ * took about 3,700 cycles (10.2 MCPS). Huffman decoding and dequantization
+ * grow with the bitrate, so 320 kbps is the worst case for the rest of the
+ * decoder.
+ *
+ * The decoder keeps MP3_DECODER_INPUT_BYTES of input and one decoded frame
+ * (1152 samples per channel) of output. Together with MAD's own state this
+ * is about 33 KB. Opening a decoder briefly needs about 22 KB more, while
+ * the synthesis filter reads its window out of MAD's. Mono streams come out on both channels, because the
+ * output engine always plays stereo. An ID3v2 tag at the start of a stream
+ * is skipped.
+ *
+ * Gapless playback: the first frame of most encoders' files is a Xing/Info
+ * or VBRI header instead of sound, and it is never played. When it carries
+ * LAME's encoder delay and padding, the decoder drops that delay plus MAD's
+ * own 529-sample delay from the front. It also stops exactly where the
+ * padding at the end begins. Back-to-back tracks then join sample for
+ * sample. The trims are only applied when decoding starts at the very
+ * beginning of the stream. After a reset for a seek into the middle, the
+ * caller says what to drop and where to stop with
+ * mp3_decoder_set_seek_trims() (audio/mp3_seek_index.h works these out).
+ *
+ * Seeking lands on a frame boundary, but a layer III frame may keep up to
+ * 511 bytes of its data in the frames before it (the "bit reservoir").
+ * So a seek starts a few frames early and drops them whole. They are
+ * still decoded and synthesized, so the filters hold the right history
+ * when the first kept frame comes out. mp3_decoder_get_frame_position()
+ * tells where each frame started, which is what a seek index records.
+ *
+ * Run mp3_decoder_benchmark() on a file to get the decoder's measured
+ * cost in MCPS (millions of CPU cycles per second of audio) for each
+ * bitrate. The clock must stay above the peak MCPS, plus whatever the GUI
+ * needs, for playback to keep up. Check this at 320 kbps before lowering
+ * the clock.
+ */
+
+#define MP3_DECODER_DELAY       529     /* MAD, like the ISO reference decoder, starts this many samples late */
+
+/* ===== What a Frame Sounds Like ===== */
+// Frame information - filled in for every decoded frame
+typedef struct {
+    uint32_t sample_rate;     /* How many samples per second */
+    uint8_t channels;         /* 1 = mono, 2 = stereo (as stored in the file) */
+    uint16_t bitrate_kbps;    /* How squished this frame was */
+    uint16_t frame_samples;   /* How many samples per channel this frame made */
+} mp3_frame_info_t;
+
+// Gapless information - from a Xing/Info (LAME) or VBRI header in the first frame
+typedef struct {
+    uint16_t encoder_delay;   /* Silent samples the encoder put in front */
+    uint16_t padding;         /* Samples the encoder added at the end to fill the last frame (0 = unknown) */
+    uint32_t total_frames;    /* Frames in the stream, not counting the header frame (0 = unknown) */
+    uint64_t total_samples;   /* Real samples per channel once both ends are trimmed (0 = unknown) */
+    uint8_t has_delay;        /* 1 if the delay above was found in the file */
+    uint8_t is_info_frame;    /* 1 if the first frame was a header frame (never played) */
+} mp3_gapless_t;
+
+// Decoder handle - a special tag for one MP3 decoder
+typedef struct mp3_decoder_s *mp3_decoder_t;  /* This is our name tag for a decoder */
+
+/* ===== Speed Test Results ===== */
+// Benchmark row - how expensive one bitrate was
+typedef struct {
+    uint16_t bitrate_kbps;    /* Which bitrate this row is about */
+    uint32_t frames;          /* How many frames had this bitrate */
+    uint16_t mcps_avg_x10;    /* Average cost in MCPS x 10 (215 means 21.5 MCPS) */
+    uint16_t mcps_peak_x10;   /* Cost of the slowest frame in MCPS x 10 */
+} mp3_benchmark_row_t;
+
+// Benchmark result - the whole speed test
+typedef struct {
+    uint32_t clock_hz;                                   /* How fast the CPU ran during the test */
+    uint32_t sample_rate;                                /* The file's sample rate */
+    uint32_t frames;                                     /* How many frames were decoded */
+    uint16_t mcps_avg_x10;                               /* Average cost over the whole file */
+    uint16_t mcps_peak_x10;                              /* Cost of the slowest frame in the file */
+    uint8_t load_pct;                                    /* Average share of the CPU the decoder needed */
+    uint8_t row_count;                                   /* How many rows below are used */
+    mp3_benchmark_row_t rows[MP3_BENCHMARK_MAX_ROWS];    /* One row per bitrate, in the order they appeared */
+} mp3_benchmark_t;
+
+/* ===== Making a Decoder ===== */
+
+/**
+ * Make a new MP3 decoder
+ * @param decoder A place to store the new decoder's name tag
+ * @return AUDIO_OK, AUDIO_ERROR_MEMORY if there's no room, AUDIO_ERROR_INIT if
+ *         the synthesis filter didn't match MAD's
+ */
+audio_status_t mp3_decoder_create(mp3_decoder_t *decoder);  /* This gets a decoder ready */
+
+/**
+ * Throw a decoder away and give back its memory
+ * @param decoder The decoder to throw away
+ */
+void mp3_decoder_destroy(mp3_decoder_t decoder);  /* This puts the decoder away */
+
+/**
+ * Forget everything so the decoder can start a new stream or continue after a seek
+ * @param decoder The decoder to reset
+ */
+void mp3_decoder_reset(mp3_decoder_t decoder);  /* This gives the decoder a clean page */
+
+/* ===== Decoding ===== */
+
+/**
+ * Give the decoder more MP3 bytes
+ * @param decoder The decoder to feed
+ * @param data The bytes to give
+ * @param length How many bytes we have
+ * @return How many bytes the decoder took (it may not have room for all)
+ */
+uint32_t mp3_decoder_feed(mp3_decoder_t decoder, const uint8_t *data, uint32_t length);  /* This is like putting a page in the reader */
+
+/**
+ * Tell the decoder no more bytes will come, so it can decode the last frame
+ * @param decoder The decoder to tell
+ */
+void mp3_decoder_finish(mp3_decoder_t decoder);  /* This is like saying "that was the last page" */
+
+/**
+ * Check if mp3_decoder_finish was called
+ * @param decoder The decoder to check
+ * @return 1 if no more bytes will come, 0 if more may come
+ */
+uint8_t mp3_decoder_is_finished(mp3_decoder_t decoder);  /* This asks "was that the last page?" */
+
+/**
+ * Decode the next frame (hand out the last one with mp3_decoder_read_pcm first)
+ * @param decoder The decoder to use
+ * @param info A place to store what the frame sounds like (can be NULL)
+ * @return AUDIO_OK if a frame is ready, AUDIO_ERROR_BUSY if more bytes are needed
+ *         (after mp3_decoder_finish: the stream is over), AUDIO_ERROR_FORMAT if the stream is broken
+ */
+audio_status_t mp3_decoder_decode_frame(mp3_decoder_t decoder, mp3_frame_info_t *info);  /* This turns one frame back into sound */
+
+/**
+ * Read what the stream's header frame said about gapless playback
+ * (known once the first frame has been decoded)
+ * @param decoder The decoder to ask
+ * @param gapless A place to store the information
+ * @return Message telling us if it worked or not
+ */
+audio_status_t mp3_decoder_get_gapless(mp3_decoder_t decoder, mp3_gapless_t *gapless);  /* This reads how much silence the song came wrapped in */
+
+/**
+ * Tell where the frame just decoded came from (to build a seek index)
+ * @param decoder The decoder to ask
+ * @param frame A place to store its number: frames of sound before it since the stream started
+ *              or was reset (the header frame isn't counted; can be NULL)
+ * @param offset A place to store its first byte, counted from the first byte fed since the
+ *               stream started or was reset (can be NULL)
+ */
+void mp3_decoder_get_frame_position(mp3_decoder_t decoder, uint32_t *frame, uint32_t *offset);  /* This says which page the sound came from */
+
+/**
+ * After mp3_decoder_reset() for a seek: say what to throw away and where to stop
+ * @param decoder The decoder to set up
+ * @param drop_frames Whole frames to decode and throw away first (they refill the bit reservoir)
+ * @param drop_samples Then how many samples to throw away from the front
+ * @param play_samples How many samples to hand out after that (0 = play to the end of the stream)
+ */
+void mp3_decoder_set_seek_trims(mp3_decoder_t decoder, uint32_t drop_frames, uint32_t drop_samples, uint64_t play_samples);  /* This says where the music should start and stop after a jump */
+
+/**
+ * Copy decoded sound out as 16-bit stereo frames (left, right, left, right...)
+ * @param decoder The decoder to read from
+ * @param pcm Where to put the frames (4-byte aligned)
+ * @param max_frames How many frames fit there
+ * @return How many frames were copied
+ */
+uint16_t mp3_decoder_read_pcm(mp3_decoder_t decoder, int16_t *pcm, uint16_t max_frames);  /* This pours out the sound */
+
+/**
+ * Count the decoded frames not yet copied out
+ * @param decoder The decoder to look at
+ * @return How many frames are waiting
+ */
+uint16_t mp3_decoder_pending_frames(mp3_decoder_t decoder);  /* This checks how much sound is left in the cup */
+
+/* ===== Reading Tags ===== */
+
+/**
+ * Measure the ID3v2 tag at the start of an MP3 file
+ * @param data The first bytes of the file
+ * @param length How many bytes there are (10 is enough)
+ * @return Bytes to skip to reach the first frame, or 0 if there is no valid tag
+ */
+uint32_t mp3_id3v2_size(const uint8_t *data, uint32_t length);  /* This measures the label stuck on the front of the song */
+
+/* ===== Assembly Line Worker ===== */
+
+/**
+ * Decoding worker: MP3 bytes in, 16-bit stereo frames out (context is an mp3_decoder_t)
+ */
+audio_stage_result_t audio_stage_decode_mp3(void *context, spsc_ring_t *input, spsc_ring_t *output);  /* This worker unsquishes the music */
+
+/* ===== Speed Test ===== */
+
+/**
+ * Decode a whole MP3 file as fast as possible and measure how many CPU cycles it costs
+ * @param filename The file to test with
+ * @param result A place to store the results
+ * @return Message telling us if it worked or not
+ */
+audio_status_t mp3_decoder_benchmark(const char *filename, mp3_benchmark_t *result);  /* This times the decoder with a stopwatch */
+
+#endif /* End of MP3_DECODER_H - we're done describing the MP3 decoder! */
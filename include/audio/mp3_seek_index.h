@@ -0,0 +1,144 @@
+/* =================== PIcoOS MP3 Seek Index =================== */
+/* This file helps MP3 songs jump to any spot right away - like a book's table of contents! */
+
+#ifndef MP3_SEEK_INDEX_H    /* This is a special guard that makes sure we only include this file once */
+#define MP3_SEEK_INDEX_H
+
+#include <stdint.h>               /* This gives us special number types */
+#include "os_config.h"            /* This gets our special settings */
+#include "drivers/audio.h"        /* This gives us sound status messages */
+
+/*
+ * An MP3 file has no fixed bytes-per-second. In a VBR file, 1:30 can be
+ * anywhere, so a seek either guesses or decodes from the start. The index
+ * turns a time into a byte offset. It has four sources, best first:
+ *
+ *   MP3_INDEX_FULL: the byte offset of every frame of sound, as a file
+ *   next to the song ("song.mp3" gets "song.mp3.idx"). A seek reads one
+ *   entry window from it and lands on the exact frame with one fs_seek.
+ *   The decoder then drops the frames that only refill the bit reservoir
+ *   (see audio/mp3_decoder.h) and the samples before the target. The
+ *   result is sample-accurate.
+ *
+ *   MP3_INDEX_XING / MP3_INDEX_VBRI: the 100-entry table (Xing) or
+ *   chunk table (VBRI) in the file's header frame. These give a byte
+ *   offset near the right time. MAD finds the next frame from there. The
+ *   landing is close (a fraction of a second), not exact.
+ *
+ *   MP3_INDEX_ESTIMATE: no table at all, so the first frame's bitrate
+ *   turns time into bytes. This is right for CBR and a guess for VBR.
+ *
+ * The full index is built during the first playback from the start.
+ * The player hands every decoded frame's position to
+ * mp3_index_add_frame(). Entries go to the file MP3_INDEX_WRITE_ENTRIES
+ * at a time, one card write per few seconds of music, from the task that
+ * decodes. When the song ends, mp3_index_finish() writes the header that
+ * makes the file valid. A seek or stop before that throws the partial
+ * file away, and the next playback from the start tries again. The
+ * header holds the song's size and date, so an edited song gets a new
+ * index. Each frame costs 4 bytes on the card: about 150 bytes per
+ * second of music.
+ *
+ * Duration: a Xing or VBRI frame count gives the exact length, trimmed
+ * like the decoder trims (LAME delay and padding). So does a full index.
+ * Without either, the length is estimated from the bitrate until the
+ * first playback finishes.
+ *
+ * An index is used by one task at a time.
+ */
+
+/* ===== Where the Index Came From ===== */
+// Index source - how good a seek will be
+typedef enum {
+    MP3_INDEX_ESTIMATE = 0,   /* Worked out from the bitrate (exact only for CBR) */
+    MP3_INDEX_XING,           /* From the Xing header's table (close) */
+    MP3_INDEX_VBRI,           /* From the VBRI header's table (close) */
+    MP3_INDEX_FULL            /* Every frame's position, saved next to the song (exact) */
+} mp3_index_source_t;
+
+// Index information - what we know about the song
+typedef struct {
+    mp3_index_source_t source;  /* Where seeks get their answers */
+    uint32_t sample_rate;       /* How many samples per second */
+    uint16_t frame_samples;     /* Samples per channel in one frame (1152, 576 or 384) */
+    uint32_t frames;            /* Frames of sound in the song (0 = unknown) */
+    uint64_t total_samples;     /* Samples per channel the decoder plays (0 = unknown) */
+    uint32_t duration_ms;       /* How long the song is */
+    uint8_t exact;              /* 1 if duration_ms is exact, 0 if it's an estimate */
+    uint8_t building;           /* 1 while a full index is being built */
+} mp3_index_info_t;
+
+// Seek point - how to get to a time
+typedef struct {
+    uint32_t byte_offset;       /* Where to fs_seek in the MP3 file */
+    uint32_t frame;             /* Which frame of sound starts there (only about that one if not exact) */
+    uint32_t drop_frames;       /* Frames to decode and throw away first */
+    uint32_t drop_samples;      /* Then samples to throw away */
+    uint64_t play_samples;      /* Samples left to play after that, counted from frame if not exact (0 = unknown, play to the end) */
+    uint8_t exact;              /* 1 if playing resumes at the exact sample, 0 if only close */
+} mp3_seek_point_t;
+
+// Index handle - a special tag for one song's index
+typedef struct mp3_index_s *mp3_index_t;  /* This is our name tag for an index */
+
+/* ===== Opening and Closing ===== */
+
+/**
+ * Read an MP3 file's header frame and its saved index, if there is a valid one
+ * @param filename The MP3 file
+ * @param index A place to store the new index's name tag
+ * @return AUDIO_OK, AUDIO_ERROR_IO if the file can't be read, AUDIO_ERROR_FORMAT if no MPEG frame
+ *         was found near the start, AUDIO_ERROR_MEMORY if there's no room
+ */
+audio_status_t mp3_index_open(const char *filename, mp3_index_t *index);  /* This opens the song's table of contents */
+
+/**
+ * Give back the index's memory (an index still being built is thrown away)
+ * @param index The index to close
+ */
+void mp3_index_close(mp3_index_t index);  /* This puts the table of contents away */
+
+/**
+ * Read what the index knows about the song
+ * @param index The index to ask
+ * @param info A place to store the information
+ * @return Message telling us if it worked or not
+ */
+audio_status_t mp3_index_get_info(mp3_index_t index, mp3_index_info_t *info);  /* This reads how long the song is */
+
+/* ===== Seeking ===== */
+
+/**
+ * Work out how to get to a time (then: fs_seek, mp3_decoder_reset, mp3_decoder_set_seek_trims)
+ * @param index The index to use
+ * @param position_ms Where to go (milliseconds from the start; past the end means the end)
+ * @param point A place to store the way there
+ * @return AUDIO_OK, AUDIO_ERROR_IO if the saved index can't be read
+ */
+audio_status_t mp3_index_lookup(mp3_index_t index, uint32_t position_ms, mp3_seek_point_t *point);  /* This finds the page for a time */
+
+/* ===== Building ===== */
+
+/**
+ * Record where a frame of sound starts (call for every decoded frame, in order, while playing
+ * from the start; frames already recorded are ignored, a gap stops the build)
+ * @param index The index to add to
+ * @param frame The frame's number (from mp3_decoder_get_frame_position)
+ * @param offset The frame's first byte in the file
+ */
+void mp3_index_add_frame(mp3_index_t index, uint32_t frame, uint32_t offset);  /* This writes one line in the table of contents */
+
+/**
+ * The song played to its end: save the full index next to it
+ * @param index The index to finish
+ * @return AUDIO_OK (also when there was nothing to build), AUDIO_ERROR_IO if it couldn't be saved
+ */
+audio_status_t mp3_index_finish(mp3_index_t index);  /* This saves the finished table of contents */
+
+/**
+ * Stop building and throw the partial index away (call before playing from anywhere but the start)
+ * @param index The index to stop
+ */
+void mp3_index_abandon(mp3_index_t index);  /* This tears up an unfinished table of contents */
+
+#endif /* End of MP3_SEEK_INDEX_H - we're done describing the MP3 seek index! */
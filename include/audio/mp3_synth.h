@@ -0,0 +1,90 @@
+/* =================== PIcoOS MP3 Synthesis Filter =================== */
+/* This file puts MP3's 32 little slices of sound back together into music you can hear! */
+
+#ifndef MP3_SYNTH_H    /* This is a special guard that makes sure we only include this file once */
+#define MP3_SYNTH_H
+
+#include <stdint.h>               /* This gives us special number types */
+#include "os_config.h"            /* This gets our special settings */
+#include "drivers/audio.h"        /* This gives us sound status messages */
+#include "mad.h"                  /* This gives us MAD's decoded frames */
+
+/*
+ * The polyphase synthesis filterbank, the last and busiest step of MPEG
+ * audio decoding, run in place of MAD's mad_synth_frame(). MAD leaves 32
+ * subband samples per time slot in each mad_frame. For every slot this
+ * filter:
+ *
+ *   1. runs a 32-point DCT on them, as partial butterflies. Each level
+ *      splits into sums, which go down to the next level, and
+ *      differences, which are multiplied by a small cosine matrix. That is
+ *      341 multiplies in all.
+ *   2. windows the 16 newest DCT outputs with the standard's 512-tap
+ *      window, giving 32 output samples. The standard's 64-value V vector
+ *      is just these 32 values, some negated and reordered. The order and
+ *      signs are folded into the window, so only 32 values per slot are
+ *      kept. Outputs j and 32 - j read the same values, so they are worked
+ *      out together and each load feeds two multiplies.
+ *   3. rounds and clips each sample with SSAT and stores both channels of
+ *      a frame with one packed write, straight into 16-bit stereo.
+ *
+ * Every multiply in steps 1 and 2 is one SMMLAR (a 32x32 multiply, rounded
+ * top word, added to an accumulator) with Q31 coefficients. Under
+ * FPM_64BIT, MAD's own filter spends an SMULL, a 64-bit shift and an add
+ * on each multiply. It also writes Q28 samples that then need a separate
+ * conversion pass, which step 3 removes. Without the DSP extension,
+ * dsp_smmlar() is plain C with the same result.
+ *
+ * The window is not typed in. mp3_synth_init() runs one impulse through
+ * MAD's own filter and reads all 512 coefficients back from the output.
+ * A second impulse then checks the result against MAD, so both filters
+ * are the same filter by construction. That needs a temporary MAD filter
+ * and frame (about 22 KB) for the duration of the call.
+ *
+ * The DCT outputs are kept in Q24, which leaves room for subband samples
+ * up to 2.0 in magnitude all adding up. The filter state is 16 slots per
+ * channel (4 KB), and there is one frame of packed output (4.5 KB).
+ * mp3_synth_t is a plain struct owned by the caller; use it from one task
+ * at a time.
+ */
+
+#define MP3_SYNTH_MAX_FRAMES    1152    /* Samples per channel in the longest MPEG frame */
+#define MP3_SYNTH_DCT_TAPS      341     /* Cosines in the partial-butterfly DCT: 16x16 + 8x8 + 4x4 + 2x2 + 1 */
+
+/* ===== The Filter ===== */
+// Synthesis filter - coefficients, history and one frame of output (caller-owned)
+typedef struct {
+    int32_t window[32][16];                   /* Window taps per output sample, newest slot first, signs folded in (Q31, halved) */
+    int32_t dct[MP3_SYNTH_DCT_TAPS];          /* Odd-part cosines of each DCT level, largest level first (Q31) */
+    int32_t history[2][16][32];               /* The 16 newest DCT outputs per channel (Q24) */
+    uint8_t newest;                           /* Which history row holds the newest slot */
+    uint8_t channels;                         /* Channels in the last frame (1 = mono) */
+    uint16_t length;                          /* Frames in pcm */
+    uint32_t sample_rate;                     /* Sample rate of the last frame */
+    uint32_t pcm[MP3_SYNTH_MAX_FRAMES];       /* The last frame as 16-bit stereo pairs (mono on both sides) */
+} mp3_synth_t;
+
+/* ===== Using the Filter ===== */
+
+/**
+ * Build the coefficient tables (taking the window from MAD) and clear the history
+ * @param synth The filter to set up
+ * @return AUDIO_OK, AUDIO_ERROR_MEMORY if the temporary MAD filter didn't fit,
+ *         AUDIO_ERROR_INIT if MAD's filter didn't match the one we built
+ */
+audio_status_t mp3_synth_init(mp3_synth_t *synth);  /* This tunes the sound re-assembler */
+
+/**
+ * Forget the history, e.g. after a seek (the tables are kept)
+ * @param synth The filter to clear
+ */
+void mp3_synth_mute(mp3_synth_t *synth);  /* This makes the re-assembler forget the old sound */
+
+/**
+ * Turn one decoded frame into 16-bit stereo in synth->pcm
+ * @param synth The filter to use
+ * @param frame The frame MAD just decoded
+ */
+void mp3_synth_frame(mp3_synth_t *synth, const struct mad_frame *frame);  /* This re-assembles one frame of music */
+
+#endif /* End of MP3_SYNTH_H - we're done describing the MP3 synthesis filter! */
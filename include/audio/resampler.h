@@ -0,0 +1,119 @@
+/* =================== PIcoOS Sample-Rate Converter =================== */
+/* This file changes how fast sound was recorded so every song fits the speaker's speed! */
+
+#ifndef RESAMPLER_H    /* This is a special guard that makes sure we only include this file once */
+#define RESAMPLER_H
+
+#include <stdint.h>               /* This gives us special number types */
+#include "os_config.h"            /* This gets our special settings */
+#include "drivers/audio.h"        /* This gives us sound status messages */
+#include "audio/audio_pipeline.h" /* This lets the converter work on the sound assembly line */
+
+/*
+ * A polyphase windowed-sinc sample-rate converter for 16-bit stereo. The
+ * output runs at one fixed rate. Every source rate from 8 kHz to 48 kHz is
+ * converted to it, so changing tracks never reconfigures the output, and
+ * sound effects can be mixed in at that same rate.
+ *
+ * Time is kept as an exact fraction: an integer input position plus a
+ * remainder counted in output-rate units. So 44.1 kHz to 48 kHz never
+ * drifts, however long it plays. The remainder picks one of the preset's
+ * filter phases. The filter bank is built once when the converter is
+ * opened (the only floating point): a Blackman-windowed sinc in Q15,
+ * cut off just below the lower of the two Nyquist frequencies, so
+ * downsampling is band-limited too. Both channels are filtered with SMLAD, two
+ * taps per instruction, and share every coefficient load.
+ *
+ * Cost and memory per preset (44.1 -> 48 kHz stereo on the M33):
+ *   FAST       8 taps,  32 phases, nearest phase    ~ 1.5 MCPS,  0.8 KB   18 kHz -6.5 dB
+ *   BALANCED  16 taps,  64 phases, nearest phase    ~ 2.5 MCPS,  2.4 KB   18 kHz -2.4 dB
+ *   BEST      32 taps, 128 phases, blended phases   ~ 9 MCPS,    8.6 KB   18 kHz -0.1 dB
+ * The MCPS figures are estimates from the instruction count (one SMLAD
+ * per tap per channel pair, plus loads). audio_pipeline_get_stats()
+ * measures the real cost. A 1 kHz tone converted 44.1 -> 48 kHz comes
+ * out 58 / 64 / 85 dB above the error for FAST / BALANCED / BEST.
+ *
+ * The filter length stays the same when downsampling, so big steps down
+ * (48 -> 8 kHz) let some aliasing through: a 7 kHz tone is only 6 / 17 /
+ * 45 dB down. The output normally runs at 44.1 or 48 kHz, where this
+ * doesn't come up.
+ */
+
+/* ===== How Careful to Be ===== */
+// Quality presets - filter length and phase resolution
+typedef enum {
+    RESAMPLER_QUALITY_FAST = 0,   /* Cheapest - fine for voices and sound effects */
+    RESAMPLER_QUALITY_BALANCED,   /* Good for music, still cheap */
+    RESAMPLER_QUALITY_BEST        /* Cleanest sound, costs the most */
+} resampler_quality_t;
+
+// Converter handle - a special tag for one sample-rate converter
+typedef struct resampler_s *resampler_t;  /* This is our name tag for a converter */
+
+/* ===== Opening and Closing ===== */
+
+/**
+ * Make a converter from one sample rate to another
+ * @param input_rate The rate the sound was recorded at (8000 to 48000)
+ * @param output_rate The rate to play it at (8000 to 48000)
+ * @param quality How careful to be
+ * @param resampler A place to store the new converter's name tag
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM for rates out of range, AUDIO_ERROR_MEMORY if there's no room
+ */
+audio_status_t resampler_open(uint32_t input_rate, uint32_t output_rate, resampler_quality_t quality, resampler_t *resampler);  /* This builds a speed changer */
+
+/**
+ * Make a converter to the output's current rate, only if one is needed
+ * @param input_rate The rate the sound was recorded at
+ * @param quality How careful to be
+ * @param resampler A place to store the converter, or NULL when the rates already match
+ *                  (then the pipeline needs no audio_stage_resample at all)
+ * @return Message telling us if it worked or not
+ */
+audio_status_t resampler_open_for_output(uint32_t input_rate, resampler_quality_t quality, resampler_t *resampler);  /* This builds a speed changer if the song needs one */
+
+/**
+ * Give back the converter's memory
+ * @param resampler The converter to close
+ */
+void resampler_close(resampler_t resampler);  /* This takes the speed changer apart */
+
+/**
+ * Forget the sound held inside (after a seek, so old sound doesn't leak into the new spot)
+ * @param resampler The converter to clear
+ */
+void resampler_reset(resampler_t resampler);  /* This empties the speed changer */
+
+/* ===== Converting ===== */
+
+/**
+ * Convert 16-bit stereo frames (left, right, left, right...)
+ * @param resampler The converter to use
+ * @param input Frames at the input rate
+ * @param input_frames How many input frames there are
+ * @param consumed A place to store how many input frames were used up
+ * @param output Where to put frames at the output rate
+ * @param max_output How many output frames fit there
+ * @return How many output frames were made
+ */
+uint32_t resampler_process(resampler_t resampler, const int16_t *input, uint32_t input_frames, uint32_t *consumed,
+                           int16_t *output, uint32_t max_output);  /* This changes the sound's speed */
+
+/**
+ * Let out the last frames still inside the filter, at the end of the sound
+ * Call until it makes nothing; the converter needs resampler_reset() before new sound
+ * @param resampler The converter to empty
+ * @param output Where to put frames at the output rate
+ * @param max_output How many output frames fit there
+ * @return How many output frames were made (0 once the filter is empty)
+ */
+uint32_t resampler_flush(resampler_t resampler, int16_t *output, uint32_t max_output);  /* This squeezes out the last bit of sound */
+
+/* ===== Assembly Line Worker ===== */
+
+/**
+ * Middle worker: 16-bit stereo frames in at one rate, out at another (context is a resampler_t)
+ */
+audio_stage_result_t audio_stage_resample(void *context, spsc_ring_t *input, spsc_ring_t *output);  /* This worker changes the sound's speed */
+
+#endif /* End of RESAMPLER_H - we're done describing the sample-rate converter! */
@@ -0,0 +1,94 @@
+/* =================== PIcoOS Spectrum Analyzer =================== */
+/* This file splits sound into low, middle and high parts so the screen can make dancing bars! */
+
+#ifndef SPECTRUM_H    /* This is a special guard that makes sure we only include this file once */
+#define SPECTRUM_H
+
+#include <stdint.h>               /* This gives us special number types */
+#include "os_config.h"            /* This gets our special settings */
+#include "drivers/audio.h"        /* This gives us sound status messages */
+
+/*
+ * Turns mono samples (normally from the audio tap, audio_tap_read()) into
+ * bar heights for a visualizer. spectrum_feed() keeps the newest fft_size
+ * samples. spectrum_update() takes those, applies a Hann window and runs a
+ * fixed-point radix-4 FFT on them. It then adds up the power in each band
+ * and turns it into a 0-255 bar height on a decibel scale.
+ *
+ * The FFT works in place on Q15 complex numbers, decimation in frequency.
+ * Each radix-4 butterfly does 3 complex multiplies where radix-2 would do
+ * 4, and it needs half as many passes over the data. Every pass divides by
+ * 4, so nothing can overflow. The price is that the quietest detail is
+ * lost: log2(fft_size) bits in all, which leaves about 45 dB of range at
+ * 256 points, enough for bars. The sizes are powers of 4: 64, 256 and
+ * 1024. At 256 points this is about 15k cycles per update (an estimate
+ * from the instruction count), or 0.1 ms at 150 MHz. That is small enough
+ * for the GUI task at 30 updates a second. The twiddle factors, the window
+ * and the band edges are worked out once in spectrum_open(). That is the
+ * only floating point.
+ *
+ * Bands are spaced evenly on a log scale, from SPECTRUM_MIN_HZ to half the
+ * sample rate, like an ear hears them. Every band gets at least one FFT
+ * bin. Too many bands for a small FFT are refused. Height 255 is a
+ * full-scale sine, and height 0 is range_db below it. With a falloff, a
+ * bar jumps up at once but sinks by at most `falloff` per update.
+ *
+ * An analyzer is used by one task at a time.
+ */
+
+/* ===== Analyzer Settings ===== */
+// Spectrum settings - how to split the sound
+typedef struct {
+    uint16_t fft_size;       /* Samples looked at per update: 64, 256 or 1024 (finer bars, more work) */
+    uint8_t bands;           /* How many bars (1 to SPECTRUM_MAX_BANDS) */
+    uint32_t sample_rate;    /* Samples per second of what is fed in (audio_tap_status_t.sample_rate) */
+    uint8_t range_db;        /* How far below full scale bar height 0 is (0 = 60 dB) */
+    uint8_t falloff;         /* How far a bar may sink per update (0 = no smoothing) */
+} spectrum_config_t;
+
+// Analyzer handle - a special tag for one spectrum analyzer
+typedef struct spectrum_s *spectrum_t;  /* This is our name tag for an analyzer */
+
+/* ===== Opening and Closing ===== */
+
+/**
+ * Make a spectrum analyzer
+ * @param config How to split the sound
+ * @param spectrum A place to store the new analyzer's name tag
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM for a bad size, rate or band count, AUDIO_ERROR_MEMORY if there's no room
+ */
+audio_status_t spectrum_open(const spectrum_config_t *config, spectrum_t *spectrum);  /* This builds a sound splitter */
+
+/**
+ * Give back the analyzer's memory
+ * @param spectrum The analyzer to close
+ */
+void spectrum_close(spectrum_t spectrum);  /* This takes the sound splitter apart */
+
+/* ===== Analyzing ===== */
+
+/**
+ * Add samples (only the newest fft_size are kept)
+ * @param spectrum The analyzer to use
+ * @param samples 16-bit mono samples
+ * @param count How many there are
+ */
+void spectrum_feed(spectrum_t spectrum, const int16_t *samples, uint32_t count);  /* This pours sound into the splitter */
+
+/**
+ * Work out the bar heights from the newest samples
+ * @param spectrum The analyzer to use
+ * @param levels Where to put one height (0-255) per band, lowest band first
+ * @return Message telling us if it worked or not
+ */
+audio_status_t spectrum_update(spectrum_t spectrum, uint8_t *levels);  /* This measures how tall each bar is */
+
+/**
+ * Find where a band starts, for labels under the bars
+ * @param spectrum The analyzer to ask
+ * @param band Which band (0 = lowest)
+ * @return The band's lowest frequency in Hz, 0 if there is no such band
+ */
+uint32_t spectrum_band_hz(spectrum_t spectrum, uint8_t band);  /* This tells us which notes a bar shows */
+
+#endif /* End of SPECTRUM_H - we're done describing the spectrum analyzer! */
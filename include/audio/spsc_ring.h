@@ -0,0 +1,218 @@
+/* =================== PIcoOS One-Way Sound Pipe =================== */
+/* This file makes a pipe where one worker pours sound in and another pours it out - no waiting in line! */
+
+#ifndef SPSC_RING_H    /* This is a special guard that makes sure we only include this file once */
+#define SPSC_RING_H
+
+#include <stdint.h>      /* This gives us special number types */
+#include <stddef.h>      /* This gives us special size types */
+#include <string.h>      /* This gives us memcpy */
+#include <stdatomic.h>   /* This gives us numbers both computer cores can share safely */
+
+/*
+ * Single-producer, single-consumer byte ring. Exactly one task (or
+ * interrupt) writes and exactly one reads; under that rule no locks or
+ * critical sections are needed, even across the two cores.
+ *
+ * head and tail are free-running byte counters. Only the writer moves head
+ * and only the reader moves tail. The release store on one side pairs with
+ * the acquire load on the other, so the bytes are visible before the
+ * counter that publishes them. Size must be a power of two.
+ *
+ * The *_ptr / *_commit pairs give direct access to the contiguous part of
+ * the ring, so decoders can write (and sinks read) without an extra copy.
+ * A writer that has finished for good calls spsc_ring_close(); the reader
+ * sees spsc_ring_drained() once it has emptied the ring after that.
+ */
+
+/* ===== The Pipe ===== */
+// SPSC ring - the pipe between two stages
+typedef struct {
+    uint8_t *data;                 /* Where the bytes live */
+    uint32_t size;                 /* How many bytes fit (a power of two) */
+    atomic_uint_least32_t head;    /* How many bytes were ever poured in (writer only) */
+    atomic_uint_least32_t tail;    /* How many bytes were ever poured out (reader only) */
+    atomic_uint_least8_t closed;   /* 1 once the writer said "no more" */
+} spsc_ring_t;
+
+/**
+ * Set up a pipe on a piece of memory
+ * @param ring The pipe to set up
+ * @param storage The memory to use for the bytes
+ * @param size How many bytes the memory holds (must be a power of two)
+ * @return 1 if it worked, 0 if the size is not a power of two
+ */
+static inline uint8_t spsc_ring_init(spsc_ring_t *ring, uint8_t *storage, uint32_t size) {
+    if (ring == NULL || storage == NULL || size == 0 || (size & (size - 1)) != 0) {
+        return 0;
+    }
+    ring->data = storage;
+    ring->size = size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->closed, 0);
+    return 1;
+}  /* This is like connecting a new pipe */
+
+/**
+ * Empty the pipe and open it again (only while neither side is using it)
+ * @param ring The pipe to empty
+ */
+static inline void spsc_ring_reset(spsc_ring_t *ring) {
+    atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->closed, 0, memory_order_release);
+}  /* This is like draining and rinsing the pipe */
+
+/**
+ * Count the bytes waiting in the pipe (exact for the reader, a lower bound for anyone else)
+ * @param ring The pipe to look at
+ * @return How many bytes can be read
+ */
+static inline uint32_t spsc_ring_used(const spsc_ring_t *ring) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return head - tail;
+}  /* This is like checking how full the pipe is */
+
+/**
+ * Count the empty space in the pipe (exact for the writer)
+ * @param ring The pipe to look at
+ * @return How many bytes can be written
+ */
+static inline uint32_t spsc_ring_free(const spsc_ring_t *ring) {
+    return ring->size - spsc_ring_used(ring);
+}  /* This is like checking how much more fits */
+
+/* ===== Pouring In (writer side) ===== */
+
+/**
+ * Get the next empty stretch of the pipe to write into directly
+ * @param ring The pipe to write into
+ * @param length A place to store how many bytes fit in one go
+ * @return Where to write
+ */
+static inline uint8_t *spsc_ring_write_ptr(spsc_ring_t *ring, uint32_t *length) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t index = head & (ring->size - 1);
+    uint32_t space = ring->size - (head - tail);
+    uint32_t contiguous = ring->size - index;
+    *length = (space < contiguous) ? space : contiguous;
+    return ring->data + index;
+}  /* This is like finding the open end of the pipe */
+
+/**
+ * Say how many bytes were written at spsc_ring_write_ptr
+ * @param ring The pipe we wrote into
+ * @param length How many bytes we wrote
+ */
+static inline void spsc_ring_write_commit(spsc_ring_t *ring, uint32_t length) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + length, memory_order_release);
+}  /* This is like letting the water flow */
+
+/**
+ * Copy bytes into the pipe (as many as fit)
+ * @param ring The pipe to write into
+ * @param data The bytes to copy
+ * @param length How many bytes we have
+ * @return How many bytes were copied
+ */
+static inline uint32_t spsc_ring_write(spsc_ring_t *ring, const void *data, uint32_t length) {
+    const uint8_t *src = (const uint8_t *)data;
+    uint32_t done = 0;
+    for (uint8_t part = 0; part < 2 && done < length; part++) {
+        uint32_t space;
+        uint8_t *dst = spsc_ring_write_ptr(ring, &space);
+        uint32_t count = (length - done < space) ? length - done : space;
+        if (count == 0) {
+            break;
+        }
+        memcpy(dst, src + done, count);
+        spsc_ring_write_commit(ring, count);
+        done += count;
+    }
+    return done;
+}  /* This is like pouring a cup into the pipe */
+
+/**
+ * Tell the reader nothing more will come
+ * @param ring The pipe to close
+ */
+static inline void spsc_ring_close(spsc_ring_t *ring) {
+    atomic_store_explicit(&ring->closed, 1, memory_order_release);
+}  /* This is like putting a cap on the pipe */
+
+/* ===== Pouring Out (reader side) ===== */
+
+/**
+ * Get the next filled stretch of the pipe to read from directly
+ * @param ring The pipe to read from
+ * @param length A place to store how many bytes can be read in one go
+ * @return Where to read
+ */
+static inline const uint8_t *spsc_ring_read_ptr(spsc_ring_t *ring, uint32_t *length) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t index = tail & (ring->size - 1);
+    uint32_t used = head - tail;
+    uint32_t contiguous = ring->size - index;
+    *length = (used < contiguous) ? used : contiguous;
+    return ring->data + index;
+}  /* This is like finding the full end of the pipe */
+
+/**
+ * Say how many bytes were used from spsc_ring_read_ptr
+ * @param ring The pipe we read from
+ * @param length How many bytes we used
+ */
+static inline void spsc_ring_read_commit(spsc_ring_t *ring, uint32_t length) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + length, memory_order_release);
+}  /* This is like making room for more water */
+
+/**
+ * Copy bytes out of the pipe (as many as are there)
+ * @param ring The pipe to read from
+ * @param data Where to copy the bytes
+ * @param length How many bytes we want
+ * @return How many bytes were copied
+ */
+static inline uint32_t spsc_ring_read(spsc_ring_t *ring, void *data, uint32_t length) {
+    uint8_t *dst = (uint8_t *)data;
+    uint32_t done = 0;
+    for (uint8_t part = 0; part < 2 && done < length; part++) {
+        uint32_t available;
+        const uint8_t *src = spsc_ring_read_ptr(ring, &available);
+        uint32_t count = (length - done < available) ? length - done : available;
+        if (count == 0) {
+            break;
+        }
+        memcpy(dst + done, src, count);
+        spsc_ring_read_commit(ring, count);
+        done += count;
+    }
+    return done;
+}  /* This is like filling a cup from the pipe */
+
+/**
+ * Check if the writer said nothing more will come (there may still be bytes to read)
+ * @param ring The pipe to look at
+ * @return 1 if the pipe is closed, 0 if more may come
+ */
+static inline uint8_t spsc_ring_is_closed(const spsc_ring_t *ring) {
+    return atomic_load_explicit(&ring->closed, memory_order_acquire);
+}  /* This is like checking for the cap on the pipe */
+
+/**
+ * Check if the writer is finished and everything has been read
+ * @param ring The pipe to look at
+ * @return 1 if the pipe is closed and empty, 0 if more may come
+ */
+static inline uint8_t spsc_ring_drained(const spsc_ring_t *ring) {
+    // Check closed first: anything written before closing is visible after it
+    return spsc_ring_is_closed(ring) && spsc_ring_used(ring) == 0;
+}  /* This is like checking if the last drop has come out */
+
+#endif /* End of SPSC_RING_H - we're done describing the one-way sound pipe! */
@@ -0,0 +1,119 @@
+/* =================== PIcoOS Gapless Track Queue =================== */
+/* This file plays songs one after another with no quiet gap in between! */
+
+#ifndef TRACK_QUEUE_H    /* This is a special guard that makes sure we only include this file once */
+#define TRACK_QUEUE_H
+
+#include <stdint.h>               /* This gives us special number types */
+#include "os_config.h"            /* This gets our special settings */
+#include "drivers/audio.h"        /* This gives us sound status messages */
+#include "audio/audio_pipeline.h" /* This lets the queue work on the sound assembly line */
+
+/*
+ * The first stage of audio_play_file()'s line. It plays the files given
+ * to audio_enqueue_file() one after another into the same output ring.
+ * When one file's last sample has been written, that file is closed and
+ * the next is opened in the same call, and its first frame is decoded
+ * right away. The ring never sees a break, so the join is sample-accurate.
+ *
+ * Why open the next file only at the end and not earlier: the decoders'
+ * working memory does not fit twice in HEAP_SIZE (MP3 ~34 KB, Vorbis up
+ * to 56 KB). The switch is covered by what is already downstream: the
+ * rings plus the queued DMA buffers. Those must hold more sound than the
+ * next file takes to open (a few ms for MP3, FLAC and WAV; tens of ms
+ * for a Vorbis file whose setup isn't cached).
+ *
+ * Every file comes out at the output's sample rate. A file at another
+ * rate goes through a resampler (audio/resampler.h) owned by this stage.
+ * Consecutive files at the same rate share that resampler without a reset,
+ * so nothing is lost at the join. When the rate changes, or the queue runs
+ * out, the old resampler's filter tail (the last few frames of the file
+ * still inside the filter) is written out first and only then is the
+ * resampler closed. MP3 files are trimmed by their LAME delay and padding
+ * (see audio/mp3_decoder.h). A file that fails to open is skipped, and the
+ * next one plays. audio_get_current_track() says which file really
+ * started.
+ *
+ * audio_play_file() clears the queue with track_queue_stop(), enqueues its
+ * file, opens it with track_queue_start() and builds its line with
+ * audio_stage_track_queue first. Because the file is opened before
+ * audio_play_file() returns, audio_get_tracks_started() already counts it.
+ * Files queued later with audio_enqueue_file() then continue that line.
+ *
+ * A WAV file that is already 16-bit stereo at the output's rate
+ * (wav_reader_is_direct) isn't written into the ring at all. The stage
+ * hands its reader to the output worker (audio_stage_write_output), which
+ * must be the next stage on the line. Once its pipe in is empty, so that
+ * everything before the file has been queued, that worker calls
+ * track_queue_pump_direct() and the file is read straight into the DMA
+ * buffers. Effects, tone controls and the tap are still applied there, in
+ * place (see audio/wav_reader.h). At the end of the file the stage takes
+ * the reader back and the next file continues in the ring, in the
+ * part-filled buffer the direct file left, so the joins stay gapless.
+ *
+ * audio_seek() and audio_get_duration() go through track_queue_seek() and
+ * track_queue_get_duration(). A seek is picked up on the next call of
+ * whoever reads the file (the stage, or the output worker for a direct
+ * file), so the file is never moved under a read. A seek that fails
+ * leaves the file playing from where it was, and
+ * track_queue_get_seek_status() says why. MP3 files seek through their
+ * seek index (audio/mp3_seek_index.h). The first playback from the start
+ * builds that index, unless it is interrupted by a seek. OGG and WAV
+ * files seek with their own readers. FLAC files can't seek yet.
+ */
+
+/* ===== Assembly Line Worker ===== */
+
+/**
+ * First worker: plays the queued files back to back, 16-bit stereo frames out at the
+ * output's sample rate (context is unused)
+ */
+audio_stage_result_t audio_stage_track_queue(void *context, spsc_ring_t *input, spsc_ring_t *output);  /* This worker plays the line of songs */
+
+/**
+ * Play a direct WAV file handed over by the stage straight into the output buffers
+ * (called by audio_stage_write_output with its pipe in empty, from the output worker's task)
+ * @param filled Frames already in the output buffer being filled; updated like wav_reader_pump()
+ * @return AUDIO_OK if a direct file was played (or just finished), AUDIO_ERROR_BUSY if none is handed over
+ */
+audio_status_t track_queue_pump_direct(uint16_t *filled);  /* This lets the speaker worker read a ready-to-play file itself */
+
+/* ===== Starting and Stopping ===== */
+
+/**
+ * Open the first queued file now instead of on the worker's first call
+ * @return AUDIO_OK, AUDIO_ERROR_BUSY if nothing queued could be opened
+ */
+audio_status_t track_queue_start(void);  /* This gets the first song in line ready */
+
+/* ===== Moving Around ===== */
+
+/**
+ * Jump within the file playing now (done by the stage on its next call)
+ * @param position_ms Where to jump to (milliseconds from the start of the file)
+ * @return AUDIO_OK, AUDIO_ERROR_FORMAT if nothing is playing or the file can't seek
+ */
+audio_status_t track_queue_seek(uint32_t position_ms);  /* This skips to a part of the song playing now */
+
+/**
+ * Find out how the last track_queue_seek() went (the stage does it on its next call)
+ * @return AUDIO_OK, AUDIO_ERROR_BUSY while it waits for the stage, or why it failed
+ *         (AUDIO_ERROR_IO, AUDIO_ERROR_FORMAT...); a failed seek keeps playing from where it was
+ */
+audio_status_t track_queue_get_seek_status(void);  /* This asks "did the jump work?" */
+
+/**
+ * Read how long the file playing now is (exact for MP3 files with a Xing/VBRI
+ * frame count or a saved seek index, estimated from the bitrate otherwise)
+ * @param duration_ms A place to store the length (0 if nothing is playing)
+ * @return Message telling us if it worked or not
+ */
+audio_status_t track_queue_get_duration(uint32_t *duration_ms);  /* This tells us how long the song playing now is */
+
+/**
+ * Close the file playing now, drop its resampler and empty the queue
+ * (call while the line is stopped)
+ */
+void track_queue_stop(void);  /* This sends every song in line home */
+
+#endif /* End of TRACK_QUEUE_H - we're done describing the gapless track queue! */
@@ -0,0 +1,164 @@
+/* =================== PIcoOS Ogg Vorbis Decoder =================== */
+/* This file plays OGG music files using only whole-number math and very little memory! */
+
+#ifndef VORBIS_DECODER_H    /* This is a special guard that makes sure we only include this file once */
+#define VORBIS_DECODER_H
+
+#include <stdint.h>               /* This gives us special number types */
+#include "os_config.h"            /* This gets our special settings */
+#include "drivers/audio.h"        /* This gives us sound status messages */
+#include "audio/audio_pipeline.h" /* This lets the decoder work on the sound assembly line */
+
+/*
+ * Ogg Vorbis decoding built on Tremor (lib/tremor, libvorbisidec). Tremor
+ * is the integer-only Vorbis decoder: it uses no floating point at all,
+ * and its MDCT and window tables are const, so they stay in flash. Its
+ * 32x32->64 multiplies become SMULL on the M33. Configuring with
+ * -DPICO_OS_VORBIS_LOW_ACCURACY=ON builds it with _LOW_ACCURACY_, which
+ * trades a little precision for cheaper 32-bit multiplies.
+ *
+ * Every allocation Tremor makes goes through a counting allocator on the
+ * FreeRTOS heap (CMake maps Tremor's malloc/calloc/realloc/free to it).
+ * That allocator refuses to go past VORBIS_DECODER_HEAP_BUDGET, so an
+ * unusually heavy file fails to open with AUDIO_ERROR_MEMORY instead of
+ * starving the rest of the system.
+ *
+ * Where the memory goes for 44.1 kHz stereo with 2048-sample long blocks:
+ *   PCM work buffers (decoder + block)   2 x 2 ch x 2048 x 4 B  = 32 KB
+ *   codebooks and floor/residue setup    about 6-20 KB, set by the encoder and quality
+ *   Ogg page buffer and stream state     about 4-6 KB
+ *   this wrapper                         under 1 KB
+ * That is about 42-58 KB at peak. It fits in the 64 KB HEAP_SIZE only while
+ * no other decoder is open, which is why the default budget is 56 KB.
+ * vorbis_decoder_get_memory() reports the real peak for the files you
+ * actually play.
+ *
+ * Opening a file parses three header packets and builds every codebook's
+ * decode table, and on a long setup header that is most of the time it
+ * takes to start. With VORBIS_DECODER_CACHE_SETUP, closing a file keeps
+ * it parked: its codebooks stay built and its file stays open. Opening
+ * the same file again, checked by path, size and timestamp, just seeks
+ * back to the first sample. The parked file holds its setup memory
+ * (vorbis_memory_stats_t.cached_bytes), decoder work buffers included,
+ * which is most of the heap. Opening a different OGG file drops it. Anyone
+ * about to open something else must call vorbis_decoder_release_cache()
+ * first, or that open may fail with AUDIO_ERROR_MEMORY. The track queue
+ * does this before every file that isn't an OGG file.
+ *
+ * Only one Vorbis file can be open at a time, and only one task may use
+ * the decoder. Mono streams come out on both channels. Streams with more
+ * than two channels are refused.
+ */
+
+/* ===== What the Song Is Like ===== */
+// Stream information - from the Vorbis identification header
+typedef struct {
+    uint32_t sample_rate;      /* How many samples per second */
+    uint8_t channels;          /* 1 = mono, 2 = stereo */
+    uint64_t total_samples;    /* Samples per channel in the whole song */
+    uint32_t duration_ms;      /* How long the song is */
+} vorbis_stream_info_t;
+
+// Memory statistics - how much heap the decoder is using
+typedef struct {
+    uint32_t current_bytes;    /* Heap in use right now (open or parked file) */
+    uint32_t peak_bytes;       /* The most it ever used since the last reset */
+    uint32_t setup_bytes;      /* Heap the last opened file needed just for its headers and codebooks */
+    uint32_t cached_bytes;     /* Heap held by a parked file waiting to be replayed */
+    uint32_t budget_bytes;     /* The most it is allowed to use (VORBIS_DECODER_HEAP_BUDGET) */
+} vorbis_memory_stats_t;
+
+// Benchmark result - how expensive a whole file was to decode
+typedef struct {
+    uint32_t clock_hz;          /* How fast the CPU ran during the test */
+    uint32_t sample_rate;       /* The file's sample rate */
+    uint32_t audio_ms;          /* How much sound was decoded */
+    uint32_t busy_us;           /* How long decoding took */
+    uint32_t us_per_second;     /* CPU microseconds per second of sound (the same measure tools/vorbis_bench.c prints on a PC) */
+    uint16_t mcps_x10;          /* Cost in MCPS x 10 (215 means 21.5 MCPS) */
+    uint32_t open_cold_us;      /* How long opening took with nothing cached */
+    uint32_t open_cached_us;    /* How long opening the same file again took */
+    uint32_t peak_bytes;        /* The most heap the decoder used */
+} vorbis_benchmark_t;
+
+// Decoder handle - a special tag for one Vorbis decoder
+typedef struct vorbis_decoder_s *vorbis_decoder_t;  /* This is our name tag for a decoder */
+
+/* ===== Opening and Closing ===== */
+
+/**
+ * Open an Ogg Vorbis file (instantly, if it is the parked one)
+ * @param filename The file to play
+ * @param decoder A place to store the new decoder's name tag
+ * @return AUDIO_OK, AUDIO_ERROR_IO if the file can't be read, AUDIO_ERROR_FORMAT if it isn't
+ *         Vorbis we can play, AUDIO_ERROR_MEMORY if it needs more than the heap budget
+ */
+audio_status_t vorbis_decoder_open(const char *filename, vorbis_decoder_t *decoder);  /* This opens the song and reads its setup */
+
+/**
+ * Close the file (parking it for a fast replay when VORBIS_DECODER_CACHE_SETUP is 1)
+ * @param decoder The decoder to close
+ */
+void vorbis_decoder_close(vorbis_decoder_t decoder);  /* This puts the song away - maybe on the front shelf */
+
+/**
+ * Throw away the parked file and give back its memory
+ */
+void vorbis_decoder_release_cache(void);  /* This clears the front shelf */
+
+/**
+ * Read what the song is like
+ * @param decoder The decoder to ask
+ * @param info A place to store the description
+ * @return Message telling us if it worked or not
+ */
+audio_status_t vorbis_decoder_get_info(vorbis_decoder_t decoder, vorbis_stream_info_t *info);  /* This reads the song's label */
+
+/* ===== Decoding ===== */
+
+/**
+ * Decode sound as 16-bit stereo frames (left, right, left, right...)
+ * @param decoder The decoder to use
+ * @param pcm Where to put the frames (4-byte aligned)
+ * @param max_frames How many frames fit there
+ * @param frames A place to store how many frames were decoded
+ * @return AUDIO_OK, AUDIO_ERROR_BUSY once the song is over, AUDIO_ERROR_FORMAT if the stream is broken
+ */
+audio_status_t vorbis_decoder_read_pcm(vorbis_decoder_t decoder, int16_t *pcm, uint16_t max_frames, uint16_t *frames);  /* This pours out the sound */
+
+/**
+ * Jump to a different part of the song
+ * @param decoder The decoder to move
+ * @param position_ms Where to jump to (milliseconds from the start)
+ * @return Message telling us if it worked or not
+ */
+audio_status_t vorbis_decoder_seek(vorbis_decoder_t decoder, uint32_t position_ms);  /* This skips to a part of the song */
+
+/* ===== Memory ===== */
+
+/**
+ * Read how much heap the decoder is using
+ * @param stats A place to store the numbers
+ * @param reset_peak 1 to start measuring the peak again from the current use, 0 to keep it
+ */
+void vorbis_decoder_get_memory(vorbis_memory_stats_t *stats, uint8_t reset_peak);  /* This checks how much room the decoder takes */
+
+/* ===== Assembly Line Worker ===== */
+
+/**
+ * First worker: reads and decodes the file, 16-bit stereo frames out (context is a vorbis_decoder_t)
+ */
+audio_stage_result_t audio_stage_decode_vorbis(void *context, spsc_ring_t *input, spsc_ring_t *output);  /* This worker unsquishes OGG music */
+
+/* ===== Speed Test ===== */
+
+/**
+ * Decode a whole file as fast as possible, then open it again, measuring time and memory
+ * (the result is comparable with tools/vorbis_bench.c run on a PC)
+ * @param filename The file to test with
+ * @param result A place to store the results
+ * @return Message telling us if it worked or not
+ */
+audio_status_t vorbis_decoder_benchmark(const char *filename, vorbis_benchmark_t *result);  /* This times the decoder with a stopwatch */
+
+#endif /* End of VORBIS_DECODER_H - we're done describing the Ogg Vorbis decoder! */
@@ -0,0 +1,175 @@
+/* =================== PIcoOS WAV Reader =================== */
+/* This file plays WAV files and raw sound - plain, or squished to a quarter with ADPCM! */
+
+#ifndef WAV_READER_H    /* This is a special guard that makes sure we only include this file once */
+#define WAV_READER_H
+
+#include <stdint.h>               /* This gives us special number types */
+#include "os_config.h"            /* This gets our special settings */
+#include "drivers/audio.h"        /* This gives us sound status messages */
+#include "audio/audio_pipeline.h" /* This lets the reader work on the sound assembly line */
+#include "audio/adpcm.h"          /* This unsqueezes ADPCM sound */
+#include "fs/fs_manager.h"        /* This lets us read files */
+
+/*
+ * PCM and ADPCM playback. wav_parse_header() walks the RIFF chunks of a
+ * WAV file: it reads "fmt " (plain PCM, WAVE_FORMAT_EXTENSIBLE whose
+ * sub-format is PCM, or 4-bit IMA/MS ADPCM in mono or stereo), skips
+ * everything else (LIST, fact, cue, ...) and stops at the start of "data".
+ * wav_parse_buffer() does the same for a WAV image already in memory. A
+ * raw PCM file has no header at all and is taken to be 16-bit stereo at
+ * the output's sample rate.
+ *
+ * Two ways to play:
+ *
+ *   Direct (wav_reader_is_direct() says 1): the data is already 16-bit
+ *   stereo at the output's sample rate and starts on a 4-byte boundary.
+ *   wav_reader_pump() then reads the file straight into the output's DMA
+ *   buffers. Nothing is copied and nothing is decoded: FatFs transfers
+ *   whole sectors from the card directly into the buffer. The track queue
+ *   plays such files this way (audio/track_queue.h). Each full buffer still
+ *   goes through the sound effects, the tone controls and the tap, in
+ *   place, exactly as in the output worker. With no effects playing, a
+ *   flat equalizer at full volume and the tap off, none of them touches
+ *   the samples, so the CPU only waits for the card. Volume is the tone
+ *   controls' volume glide (audio_set_volume).
+ *
+ *   When nothing is playing ahead of the file (after a seek, or as the
+ *   first file), the first buffer starts with a little silence and ends
+ *   with the bytes up to the next sector boundary, so every read after it
+ *   is sector-aligned. That silence is shorter than one sector. The
+ *   output's buffer_size should be a multiple of 128 frames (one 512-byte
+ *   sector) so the later reads stay aligned. A file that follows another
+ *   one without a gap starts right after it instead, and FatFs copies the
+ *   partial sectors at each read's ends through its own sector buffer.
+ *
+ *   Converted (anything else): audio_stage_decode_wav() is a first stage
+ *   for the audio pipeline. It reads WAV_READER_BOUNCE_BYTES at a time and
+ *   turns 8/16/24/32-bit mono or stereo into 16-bit stereo. Files with
+ *   more channels play their first two. ADPCM files are read one block
+ *   (block_align bytes) at a time into a buffer of that size and decoded
+ *   as they go (audio/adpcm.h). Seeking lands on the block that holds the
+ *   frame and then skips the frames before it. A different sample rate is
+ *   left to a resampling stage further down the line.
+ *
+ * A reader is used by one task at a time.
+ */
+
+/* ===== What the Sound Is Like ===== */
+// Stream information - from the "fmt " and "data" chunks
+typedef struct {
+    uint32_t sample_rate;      /* How many samples per second */
+    uint16_t channels;         /* 1 = mono, 2 = stereo, more = surround */
+    uint16_t bits_per_sample;  /* How much room each sample takes (8, 16, 24 or 32; 4 for ADPCM) */
+    uint16_t block_align;      /* Bytes in one frame (all channels together), or in one ADPCM block */
+    uint16_t format_tag;       /* WAV_FORMAT_PCM, WAV_FORMAT_IMA_ADPCM or WAV_FORMAT_MS_ADPCM */
+    uint16_t samples_per_block; /* Frames in one ADPCM block (1 for PCM) */
+    uint32_t data_offset;      /* Where the sound starts in the file (or the memory image) */
+    uint32_t data_bytes;       /* How many bytes of sound there are */
+    uint32_t total_frames;     /* How many frames that makes */
+} wav_info_t;
+
+// WAV format tags - which kind of sound the "fmt " chunk says it holds
+#define WAV_FORMAT_PCM          0x0001    /* Plain samples */
+#define WAV_FORMAT_MS_ADPCM     0x0002    /* Microsoft ADPCM */
+#define WAV_FORMAT_IMA_ADPCM    0x0011    /* IMA/DVI ADPCM */
+
+// Reader handle - a special tag for one open WAV file
+typedef struct wav_reader_s *wav_reader_t;  /* This is our name tag for a reader */
+
+/* ===== Reading the Label ===== */
+
+/**
+ * Walk a WAV file's chunks and find its format and sound data
+ * @param file An open file, positioned at its start
+ * @param file_size How big the file is (a "data" chunk claiming more is cut down to fit)
+ * @param info A place to store the description
+ * @return AUDIO_OK with the file positioned at the sound, AUDIO_ERROR_FORMAT if it isn't
+ *         PCM or ADPCM we can play, AUDIO_ERROR_IO if it can't be read
+ */
+audio_status_t wav_parse_header(fs_file_t file, uint32_t file_size, wav_info_t *info);  /* This reads the WAV label */
+
+/**
+ * Walk the chunks of a whole WAV file held in memory (data_offset is counted from its start)
+ * @param data The WAV image
+ * @param size How many bytes it has
+ * @param info A place to store the description
+ * @return AUDIO_OK, AUDIO_ERROR_FORMAT if it isn't PCM or ADPCM we can play
+ */
+audio_status_t wav_parse_buffer(const void *data, uint32_t size, wav_info_t *info);  /* This reads the label of a WAV in memory */
+
+/* ===== Opening and Closing ===== */
+
+/**
+ * Open a WAV file (AUDIO_FORMAT_WAV) or a raw 16-bit stereo file (AUDIO_FORMAT_RAW_PCM)
+ * @param filename The file to play
+ * @param format AUDIO_FORMAT_WAV or AUDIO_FORMAT_RAW_PCM
+ * @param reader A place to store the new reader's name tag
+ * @return AUDIO_OK, AUDIO_ERROR_IO if the file can't be read, AUDIO_ERROR_FORMAT if it isn't
+ *         PCM or ADPCM we can play, AUDIO_ERROR_MEMORY if there's no room
+ */
+audio_status_t wav_reader_open(const char *filename, audio_format_t format, wav_reader_t *reader);  /* This opens the sound file */
+
+/**
+ * Close the file and give back the reader's memory
+ * @param reader The reader to close
+ */
+void wav_reader_close(wav_reader_t reader);  /* This puts the sound file away */
+
+/**
+ * Read what the sound is like
+ * @param reader The reader to ask
+ * @param info A place to store the description
+ * @return Message telling us if it worked or not
+ */
+audio_status_t wav_reader_get_info(wav_reader_t reader, wav_info_t *info);  /* This reads the sound's label */
+
+/**
+ * Check if the file can go straight to the speaker without converting
+ * (decided when the file is opened, against the output's sample rate)
+ * @param reader The reader to ask
+ * @return 1 if wav_reader_pump() can be used, 0 if it needs audio_stage_decode_wav()
+ */
+uint8_t wav_reader_is_direct(wav_reader_t reader);  /* This checks if the sound is already speaker-shaped */
+
+/* ===== Playing ===== */
+
+/**
+ * Fill every free output buffer straight from the file (direct files only; from the task
+ * that owns the output engine, see audio_stage_write_output)
+ * @param reader The reader to use
+ * @param filled Frames already in the next free buffer, which the file continues; updated to
+ *               the frames left in a buffer that the end of the file only part-filled
+ * @return AUDIO_OK while there is more to play, AUDIO_ERROR_BUSY once all of it is queued,
+ *         AUDIO_ERROR_FORMAT if the file isn't direct, AUDIO_ERROR_IO if reading failed
+ */
+audio_status_t wav_reader_pump(wav_reader_t reader, uint16_t *filled);  /* This pours the file right onto the conveyor belt */
+
+/**
+ * Read and convert sound as 16-bit stereo frames (left, right, left, right...), for files
+ * that aren't direct (at most WAV_READER_BOUNCE_BYTES of the file, or one ADPCM block, per call)
+ * @param reader The reader to use
+ * @param pcm Where to put the frames (4-byte aligned)
+ * @param max_frames How many frames fit there
+ * @param frames A place to store how many frames were made
+ * @return AUDIO_OK, AUDIO_ERROR_BUSY once the sound is over, AUDIO_ERROR_IO if reading failed,
+ *         AUDIO_ERROR_FORMAT if an ADPCM block is broken
+ */
+audio_status_t wav_reader_read_pcm(wav_reader_t reader, int16_t *pcm, uint16_t max_frames, uint16_t *frames);  /* This pours out the sound, reshaped */
+
+/**
+ * Jump to a different part of the sound
+ * @param reader The reader to move
+ * @param position_ms Where to jump to (milliseconds from the start)
+ * @return Message telling us if it worked or not
+ */
+audio_status_t wav_reader_seek(wav_reader_t reader, uint32_t position_ms);  /* This skips to a part of the sound */
+
+/* ===== Assembly Line Worker ===== */
+
+/**
+ * First worker: reads the file and converts or decodes it, 16-bit stereo frames out (context is a wav_reader_t)
+ */
+audio_stage_result_t audio_stage_decode_wav(void *context, spsc_ring_t *input, spsc_ring_t *output);  /* This worker reshapes plain sound */
+
+#endif /* End of WAV_READER_H - we're done describing the WAV reader! */
@@ -15,6 +15,18 @@ typedef struct {
     uint8_t enableErrorLed;          /* Should we blink a light when there's a problem? (1=yes, 0=no) */
 } SystemConfig; /* This box holds all our important system settings */
 
+/* ===== Button-to-Screen Timing ===== */
+// Latency histogram - how long button presses took to show up on the screen
+typedef struct {
+    uint32_t count;                            /* How many presses we timed */
+    uint32_t min_us;                           /* The fastest one (microseconds) */
+    uint32_t max_us;                           /* The slowest one (microseconds) */
+    uint32_t last_us;                          /* The newest one (microseconds) */
+    uint32_t last_render_us;                   /* How much of the newest one was drawing and sending (microseconds) */
+    uint64_t total_us;                         /* All of them added up (divide by count for the average) */
+    uint32_t buckets[SYSTEM_LATENCY_BUCKETS];  /* How many landed in each SYSTEM_LATENCY_BUCKET_US-wide box */
+} system_latency_stats_t; /* This is like a chart of reaction times */
+
 /* ===== Important System Jobs ===== */
 
 /**
@@ -49,6 +61,12 @@ error_code_t system_get_error(void); /* This checks if we have any problems */
  */
 uint32_t system_get_uptime(void); /* This is like checking how long a toy has been playing */
 
+/**
+ * Read the fine-grained clock (for measuring how long short jobs take)
+ * @return How many microseconds (1/1000000ths of a second) since the computer started (wraps around after ~71 minutes)
+ */
+uint32_t system_get_time_us(void); /* This is like using a stopwatch instead of a calendar */
+
 /**
  * Ask how hard the computer is working
  * @return A number from 0-100 (like a percentage) showing how hard the brain is working
@@ -61,6 +79,52 @@ uint8_t system_get_cpu_usage(void); /* This checks if our computer is working ve
  */
 uint32_t system_get_free_heap(void); /* This checks if we have room for more toys */
 
+/* ===== Timing Button Presses All the Way to the Screen ===== */
+/*
+ * One press is followed through three marks: the button going down (stamped
+ * when the button callback runs, after the driver's debounce), the GUI being
+ * told about it (the callback marks this right after
+ * gui_handle_button_press() has invalidated whatever the press changes), and
+ * the end of the first gui_update() that started after that. The GUI task
+ * hands each redraw's start time to system_latency_mark_flush(), so a redraw
+ * that was already running when the press came in does not close it, and
+ * frames with no press waiting leave the stopwatch alone. Releases and long
+ * presses are not timed. A press that arrives while an earlier one is still
+ * waiting for its redraw is counted with that redraw.
+ */
+
+/**
+ * Mark that a button changed (safe to call from a button interrupt)
+ * @param timestamp_us When the button changed, from system_get_time_us()
+ */
+void system_latency_mark_input(uint32_t timestamp_us); /* This is like starting a stopwatch */
+
+/**
+ * Mark that the GUI has been told about the press (call it once the press has invalidated what it changes)
+ */
+void system_latency_mark_invalidate(void); /* This is like noting "the answer is being drawn" */
+
+/**
+ * Mark that a redraw reached the screen (the GUI task calls this after gui_update)
+ * @param frame_start_us When that redraw started, from system_get_time_us()
+ */
+void system_latency_mark_flush(uint32_t frame_start_us); /* This is like stopping the stopwatch */
+
+/**
+ * Read the button-to-screen timing chart
+ * @param stats A place to store the chart
+ * @param reset 1 to start a fresh chart afterwards, 0 to keep counting
+ */
+void system_get_latency_stats(system_latency_stats_t *stats, uint8_t reset); /* This reads the reaction time chart */
+
+/**
+ * Find how slow the slowest presses were (like "95 out of 100 presses were faster than this")
+ * @param stats A chart from system_get_latency_stats
+ * @param percent Which share of presses to look at (1 to 100)
+ * @return The time in microseconds that that share of presses stayed under (upper edge of the box)
+ */
+uint32_t system_latency_percentile(const system_latency_stats_t *stats, uint8_t percent); /* This finds the "almost worst" time */
+
 /* ===== Secret Helper Functions ===== */
 /* These are special functions that only the system itself can use */
 
@@ -6,6 +6,7 @@
 
 #include <stdint.h>   /* This gives us special number types */
 #include <stddef.h>   /* This gives us special size types */
+#include "os_config.h"  /* This gets our special settings */
 
 /* ===== Sound Problem Messages ===== */
 // Audio status codes - messages about how the speaker is doing
@@ -49,7 +50,8 @@ typedef struct {
     audio_sample_rate_t sample_rate;  /* How many sound points per second */
     uint8_t channels;                 /* How many speakers (1=mono, 2=stereo) */
     uint8_t bits_per_sample;          /* How detailed each sound point is (8, 16, 24, 32) */
-    uint16_t buffer_size;             /* How many sound points we prepare at once */
+    uint16_t buffer_size;             /* How many sound points (left+right pairs) each output buffer holds (0 = AUDIO_DEFAULT_BUFFER_FRAMES) */
+    uint8_t buffer_count;             /* How many output buffers wait in line for the speaker (0 = AUDIO_DEFAULT_BUFFER_COUNT) */
 } audio_config_t;
 
 /* ===== Is the Sound Playing? ===== */
@@ -97,6 +99,7 @@ audio_status_t audio_get_config(audio_config_t *config);  /* This asks the speak
 
 /**
  * Play a sound or music from a file
+ * Builds a read -> decode -> resample -> mix -> output line (see audio/audio_pipeline.h)
  * @param filename The name of the sound file to play
  * @return Message telling us if it worked or not
  */
@@ -111,10 +114,48 @@ audio_status_t audio_play_file(const char *filename);  /* This plays a sound fil
  */
 audio_status_t audio_play_buffer(const void *buffer, size_t size, audio_format_t format);  /* This plays a sound from memory */
 
+/* ===== Playing Songs Back to Back ===== */
+
+/**
+ * Line up a file to play right after the current one, with no gap between them
+ * The next file is opened and its first frame decoded the moment the current one's last
+ * sample is written, while the pipes still hold sound to cover it; MP3 encoder delay
+ * and padding are trimmed so the two join sample for sample (see audio/track_queue.h)
+ * @param filename The file to play next (.mp3, .flac, .ogg, .wav, .raw or .pcm)
+ * @return AUDIO_OK, AUDIO_ERROR_BUSY if the queue is full, AUDIO_ERROR_PARAM if the name is too long
+ */
+audio_status_t audio_enqueue_file(const char *filename);  /* This puts a song in line to play next */
+
+/**
+ * Forget every file waiting in the queue (the one playing carries on)
+ */
+void audio_clear_queue(void);  /* This empties the line of songs */
+
+/**
+ * Count the files waiting in the queue
+ * @return How many files are lined up
+ */
+uint8_t audio_queue_length(void);  /* This counts the songs in line */
+
+/**
+ * Count the files that have started playing, so a player can tell when the queue moved on
+ * @return How many files have started since the sound system was turned on
+ */
+uint32_t audio_get_tracks_started(void);  /* This counts how many songs have begun */
+
+/**
+ * Find out which file started last (files that failed to open were skipped and never show up here)
+ * @param path Where to copy the file's path, as it was given to audio_enqueue_file()
+ * @param size How many characters fit in path (MAX_PATH_LENGTH always does)
+ * @param started Where to put audio_get_tracks_started() for that file, read together with the path (NULL if not needed)
+ * @return AUDIO_OK, AUDIO_ERROR_BUSY if no file has started yet, AUDIO_ERROR_PARAM if path is too small
+ */
+audio_status_t audio_get_current_track(char *path, size_t size, uint32_t *started);  /* This tells us which song is really playing */
+
 /* ===== Volume Control ===== */
 
 /**
- * Make the sound louder or quieter
+ * Make the sound louder or quieter (glides there over AUDIO_DSP_RAMP_MS, see audio_ramp_volume)
  * @param volume How loud (0 is silent, 100 is super loud)
  * @return Message telling us if it worked or not
  */
@@ -130,6 +171,7 @@ uint8_t audio_get_volume(void);  /* This checks how loud we're playing sounds */
 
 /**
  * Pause the sound (like freeze it but remember where we are)
+ * Drains the output engine, so the quiet while paused isn't counted as underruns
  * @return Message telling us if it worked or not
  */
 audio_status_t audio_pause(void);  /* This is like pressing pause on a music player */
@@ -175,17 +217,532 @@ audio_state_t audio_get_state(void);  /* This checks if the sound is playing rig
  */
 audio_status_t audio_get_duration(uint32_t *duration_ms);  /* This tells us how long the whole sound is */
 
+/* ===== Sound Effects on Top ===== */
+// Effect voice handle - names one playing effect (0 = none; a handle goes stale once its voice is reused)
+typedef uint16_t audio_voice_t;  /* This is our name tag for one playing sound effect */
+
+/*
+ * Sound effects are mixed on top of whatever is playing, in the output
+ * stage, just before each buffer is queued for DMA. A click therefore
+ * waits only for the buffers already queued, not for the song's pipes.
+ * With no song playing, audioTask keeps the output engine running on
+ * effects alone (audio_pipeline_pump_effects()) while any are pending.
+ * A click is then still heard within one buffer, and the engine stops
+ * again once they have played out.
+ *
+ * There are AUDIO_MIXER_VOICES voices. When all are busy, a new effect
+ * takes the voice with the lowest priority, oldest first, but only if that
+ * priority is not above its own. Otherwise it is refused. Samples are
+ * 16-bit mono or stereo at the output's sample rate, and they must stay
+ * in memory (flash is fine) while they play. Voices are added with
+ * saturating 16-bit SIMD adds (QADD16), so loud overlaps clip instead of
+ * wrapping around. audio_play_effect_wav() plays a whole WAV file image.
+ * 16-bit PCM plays in place. IMA or MS ADPCM also stays squeezed in
+ * memory, at a quarter of the size, and the mixer decodes it a few frames
+ * at a time as it plays.
+ */
+
+/**
+ * Play a sound effect on top of the music
+ * @param samples The sound (16-bit, left/right interleaved if stereo), at the output's sample rate
+ * @param frames How many frames it has
+ * @param channels 1 = mono, 2 = stereo
+ * @param gain How loud (0-100)
+ * @param pan Where it sits (-100 = left only, 0 = middle, 100 = right only)
+ * @param priority How important it is (a busy mixer drops the least important sound first)
+ * @param voice A place to store the effect's name tag (may be NULL)
+ * @return AUDIO_OK, AUDIO_ERROR_BUSY if every voice plays something more important
+ */
+audio_status_t audio_play_effect(const int16_t *samples, uint32_t frames, uint8_t channels,
+                                 uint8_t gain, int8_t pan, uint8_t priority, audio_voice_t *voice);  /* This plays a sound effect over the music */
+
+/**
+ * Play a sound effect stored as a WAV file image in memory (16-bit PCM, IMA ADPCM or MS ADPCM)
+ * @param wav The whole WAV file, at the output's sample rate; it must stay in memory while it plays
+ * @param size How big it is
+ * @param gain How loud (0-100)
+ * @param pan Where it sits (-100 = left only, 0 = middle, 100 = right only)
+ * @param priority How important it is (a busy mixer drops the least important sound first)
+ * @param voice A place to store the effect's name tag (may be NULL)
+ * @return AUDIO_OK, AUDIO_ERROR_FORMAT if it isn't a WAV we can mix, AUDIO_ERROR_BUSY if every
+ *         voice plays something more important
+ */
+audio_status_t audio_play_effect_wav(const void *wav, size_t size, uint8_t gain, int8_t pan,
+                                     uint8_t priority, audio_voice_t *voice);  /* This plays a WAV from memory over the music */
+
+/**
+ * Start a sound effect without waiting for anyone - safe from any task, either core or an interrupt
+ * The effect starts in the next buffer the mixer fills; there is no name tag, and it is refused
+ * then (silently) if every voice plays something more important
+ * @param samples The sound (16-bit, left/right interleaved if stereo), at the output's sample rate
+ * @param frames How many frames it has
+ * @param channels 1 = mono, 2 = stereo
+ * @param gain How loud (0-100)
+ * @param pan Where it sits (-100 = left only, 0 = middle, 100 = right only)
+ * @param priority How important it is
+ * @return AUDIO_OK, AUDIO_ERROR_BUSY if AUDIO_MIXER_TRIGGERS effects are already waiting to start
+ */
+audio_status_t audio_trigger_effect(const int16_t *samples, uint32_t frames, uint8_t channels,
+                                    uint8_t gain, int8_t pan, uint8_t priority);  /* This fires a sound effect instantly */
+
+/**
+ * Change how loud an effect is and where it sits while it plays
+ * @param voice The effect's name tag
+ * @param gain How loud (0-100)
+ * @param pan Where it sits (-100 left to 100 right)
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM if the effect has already finished
+ */
+audio_status_t audio_set_effect_gain(audio_voice_t voice, uint8_t gain, int8_t pan);  /* This turns one effect up or down */
+
+/**
+ * Stop an effect early
+ * @param voice The effect's name tag (0 stops every effect)
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM if the effect has already finished
+ */
+audio_status_t audio_stop_effect(audio_voice_t voice);  /* This silences one effect */
+
+/**
+ * Stop every effect playing (or waiting to start) from this sound, so its memory can be given back
+ * (returns once the mixer has stopped reading it; call from a task, not the output's own)
+ * @param samples The sound the effects were started with
+ */
+void audio_stop_effects_using(const int16_t *samples);  /* This silences every copy of one sound */
+
+/**
+ * Count the effects playing right now
+ * @return How many voices are busy
+ */
+uint8_t audio_effects_active(void);  /* This counts the sound effects */
+
+/**
+ * Check if there is anything for the mixer to do
+ * @return 1 if an effect is playing or waiting to start, 0 if the mixer would only add silence
+ */
+uint8_t audio_effects_pending(void);  /* This asks "any sound effects to play?" */
+
+/**
+ * Add every playing effect into 16-bit stereo frames, in place
+ * The output worker calls this on each buffer just before it is queued;
+ * with no song playing, audio_pipeline_pump_effects() runs it over silent buffers
+ * @param frames The frames to add into (left, right, left, right...)
+ * @param count How many frames there are
+ */
+void audio_mix_effects(int16_t *frames, uint16_t count);  /* This pours the sound effects into the music */
+
+/* ===== Sound Bank ===== */
+// Sound handle - names one sound in the bank (0 = none; a handle goes stale once its sound is unloaded)
+typedef uint16_t audio_sound_t;  /* This is our name tag for a ready-to-play sound */
+
+/*
+ * Short sounds (clicks, beeps, alerts) loaded once and then played with no
+ * file access at all. Loading does the slow part: it opens and parses the
+ * file, decodes it (any WAV the player handles, including ADPCM) and
+ * converts it to the output's sample rate. After that,
+ * audio_bank_play() is one lock-free slot claim (audio_trigger_effect).
+ * It can be called from a button interrupt, and the sound is mixed into
+ * the next buffer the output fills. It is heard once the buffers already
+ * queued have played.
+ *
+ * Sounds at the output's rate stay mono or stereo, as recorded. Sounds at
+ * other rates are converted once, at AUDIO_BANK_RESAMPLE_QUALITY, and
+ * stored as stereo. A 16-bit PCM WAV image in flash that is already at
+ * the output's rate is played where it lies (XIP), with no RAM used.
+ * Loaded sounds belong to one output rate. Reload them if the rate
+ * changes.
+ *
+ * Loading and unloading are for tasks only. Unloading waits for plays
+ * already under way and for the mixer to stop reading the sound, so it is
+ * safe while other tasks or interrupts may still play it.
+ */
+
+/**
+ * Load a sound file into the bank (decoded to the output's format, in RAM)
+ * @param filename The WAV file (PCM or ADPCM)
+ * @param sound A place to store the sound's name tag
+ * @return AUDIO_OK, AUDIO_ERROR_INIT if the output isn't set up, AUDIO_ERROR_IO if the file can't be read,
+ *         AUDIO_ERROR_FORMAT if it isn't a WAV we can play, AUDIO_ERROR_MEMORY if there's no room,
+ *         AUDIO_ERROR_BUSY if the bank is full
+ */
+audio_status_t audio_bank_load(const char *filename, audio_sound_t *sound);  /* This puts a sound on the shelf, ready to go */
+
+/**
+ * Add a WAV image from memory or flash to the bank (16-bit PCM at the output's rate is used in place,
+ * anything else is decoded into RAM)
+ * @param wav The whole WAV file (16-bit PCM, IMA ADPCM or MS ADPCM); it must stay there while it is in the bank
+ * @param size How big it is
+ * @param sound A place to store the sound's name tag
+ * @return Same as audio_bank_load()
+ */
+audio_status_t audio_bank_add(const void *wav, size_t size, audio_sound_t *sound);  /* This puts a sound from memory on the shelf */
+
+/**
+ * Take a sound out of the bank (stopping it if it plays) and give back its memory
+ * @param sound The sound's name tag
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM if the name tag is stale
+ */
+audio_status_t audio_bank_unload(audio_sound_t sound);  /* This takes a sound off the shelf */
+
+/**
+ * Play a sound from the bank - lock-free, safe from any task, either core or an interrupt
+ * @param sound The sound's name tag
+ * @param gain How loud (0-100)
+ * @param pan Where it sits (-100 = left only, 0 = middle, 100 = right only)
+ * @param priority How important it is (a busy mixer drops the least important sound first)
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM if the name tag is stale, AUDIO_ERROR_BUSY if too many
+ *         sounds are already waiting to start
+ */
+audio_status_t audio_bank_play(audio_sound_t sound, uint8_t gain, int8_t pan, uint8_t priority);  /* This plays a shelf sound right now */
+
+/* ===== Shaping the Sound ===== */
+// Equalizer band shapes - what one band does to the sound
+typedef enum {
+    AUDIO_EQ_OFF = 0,          /* The band does nothing (and costs nothing) */
+    AUDIO_EQ_PEAK,             /* Boost or cut around one frequency */
+    AUDIO_EQ_LOW_SHELF,        /* Boost or cut everything below a frequency */
+    AUDIO_EQ_HIGH_SHELF,       /* Boost or cut everything above a frequency */
+    AUDIO_EQ_LOW_PASS,         /* Keep only what is below a frequency */
+    AUDIO_EQ_HIGH_PASS         /* Keep only what is above a frequency */
+} audio_eq_type_t;
+
+// Equalizer presets - ready-made settings for every band
+typedef enum {
+    AUDIO_EQ_PRESET_FLAT = 0,  /* Every band off */
+    AUDIO_EQ_PRESET_BASS,      /* More low end */
+    AUDIO_EQ_PRESET_TREBLE,    /* More sparkle */
+    AUDIO_EQ_PRESET_VOCAL,     /* Voices stand out */
+    AUDIO_EQ_PRESET_SMALL_SPEAKER  /* Cuts rumble a small speaker can't play, lifts what it can */
+} audio_eq_preset_t;
+
+// Sound shaping statistics - what the chain costs
+typedef struct {
+    uint16_t eq_mcps_x10;        /* Equalizer and loudness bands, in MCPS x 10 */
+    uint16_t gain_mcps_x10;      /* Volume glide */
+    uint16_t limiter_mcps_x10;   /* Limiter and the final step back to 16 bits */
+    uint16_t total_mcps_x10;     /* All of it */
+    uint8_t load_pct;            /* Share of one core the chain takes */
+    uint8_t budget_pct;          /* The most it may take (AUDIO_DSP_BUDGET_PCT) */
+    uint8_t eq_bands_active;     /* How many bands are doing something, loudness included */
+    uint32_t limited_blocks;     /* How many blocks the limiter had to turn down */
+    uint32_t frames;             /* How many frames went through the chain */
+} audio_dsp_stats_t;
+
+/*
+ * Every buffer of music runs through the sound shaping chain in the output
+ * stage, after the sound effects are mixed in:
+ *
+ *   equalizer -> loudness -> volume glide -> limiter -> 16 bits
+ *
+ * Samples are 32-bit from the first step to the last, with 4 bits (24 dB)
+ * of room above full scale, so boosts don't clip halfway through. Bands
+ * are biquad filters with Q30 coefficients. Each sample takes five
+ * 32x32->64 multiply-accumulates (SMLAL), and the rounding error is
+ * carried into the next sample, so deep bass settings stay clean. A band
+ * set to AUDIO_EQ_OFF is skipped.
+ *
+ * Loudness lifts the bass and a little treble as the volume goes down,
+ * the way ears hear less of both at low levels. It uses two shelves of
+ * its own on top of the AUDIO_DSP_EQ_BANDS bands.
+ *
+ * Volume changes glide sample by sample over AUDIO_DSP_RAMP_MS instead
+ * of jumping a step per buffer. This removes the "zipper" noise of a
+ * volume button. The limiter turns loud blocks down so boosted music
+ * doesn't clip. It acts at once and recovers over its release time.
+ *
+ * The chain has a budget of AUDIO_DSP_BUDGET_PCT of one core. Its cost is
+ * measured as it runs (audio_get_dsp_stats). A band that would take it
+ * over budget at the output's sample rate is refused. Direct WAV playback
+ * (wav_reader_pump) runs the same chain on each buffer, in place.
+ */
+
+/**
+ * Set one equalizer band
+ * @param band Which band (0 to AUDIO_DSP_EQ_BANDS - 1)
+ * @param type What the band does (AUDIO_EQ_OFF turns it off)
+ * @param frequency_hz Where it acts
+ * @param gain_db_x10 How much to boost or cut, in tenths of a dB (-120 to 120; peak and shelves only)
+ * @param q_x100 How narrow it is, times 100 (70 is gentle, 400 is narrow)
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM if a setting is out of range,
+ *         AUDIO_ERROR_BUSY if one more band would go over the chain's budget
+ */
+audio_status_t audio_set_eq_band(uint8_t band, audio_eq_type_t type, uint16_t frequency_hz, int16_t gain_db_x10, uint16_t q_x100);  /* This turns one tone knob */
+
+/**
+ * Set every equalizer band from a preset
+ * @param preset Which preset
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM if there's no such preset, AUDIO_ERROR_BUSY if it's over budget
+ */
+audio_status_t audio_set_eq_preset(audio_eq_preset_t preset);  /* This turns all the tone knobs at once */
+
+/**
+ * Turn loudness (more bass and treble at low volume) on or off
+ * @param enabled 1 = on, 0 = off
+ * @return AUDIO_OK, AUDIO_ERROR_BUSY if its two bands would go over the chain's budget
+ */
+audio_status_t audio_set_loudness(uint8_t enabled);  /* This keeps quiet music sounding full */
+
+/**
+ * Glide to a new volume (audio_set_volume() glides over AUDIO_DSP_RAMP_MS)
+ * @param volume How loud (0 is silent, 100 is as recorded)
+ * @param ramp_ms How long the glide takes (0 = on the next sample)
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_ramp_volume(uint8_t volume, uint16_t ramp_ms);  /* This slides the volume instead of jumping */
+
+/**
+ * Set the limiter
+ * @param enabled 1 = on, 0 = off (loud peaks then just clip)
+ * @param threshold_db_x10 The loudest the music may get, in tenths of a dB below full scale (-200 to 0)
+ * @param release_ms How long it takes to turn back up after a loud part
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM if a setting is out of range
+ */
+audio_status_t audio_set_limiter(uint8_t enabled, int16_t threshold_db_x10, uint16_t release_ms);  /* This keeps loud parts from clipping */
+
+/**
+ * Run the sound shaping chain over 16-bit stereo frames, in place
+ * The output worker calls this on each buffer just after audio_mix_effects()
+ * @param frames The frames to shape (left, right, left, right...)
+ * @param count How many frames there are
+ */
+void audio_process_dsp(int16_t *frames, uint16_t count);  /* This puts the music through the tone knobs */
+
+/**
+ * Read what the sound shaping chain costs
+ * @param stats A place to store the numbers
+ * @param reset 1 to start measuring afresh afterwards, 0 to keep counting
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_get_dsp_stats(audio_dsp_stats_t *stats, uint8_t reset);  /* This shows how hard the tone knobs work */
+
+/* ===== How Smoothly It Plays ===== */
+// Timing chart - how long something took, sorted into boxes that double in width
+typedef struct {
+    uint32_t count;                              /* How many times we measured */
+    uint32_t max_us;                             /* The slowest one (microseconds) */
+    uint32_t last_us;                            /* The newest one (microseconds) */
+    uint64_t total_us;                           /* All of them added up (divide by count for the average) */
+    uint32_t buckets[AUDIO_TELEMETRY_BUCKETS];   /* Box 0 is under AUDIO_TELEMETRY_BUCKET_US, each next box ends at twice that */
+} audio_timing_histogram_t; /* This is like a chart of how long things took */
+
+// Playback telemetry - everything that tells smooth playback from a stutter
+typedef struct {
+    uint32_t elapsed_ms;                 /* How long these numbers have been collected */
+    uint32_t underruns;                  /* How many times the speaker ran dry and played silence */
+    uint32_t last_underrun_ms;           /* When the newest one happened (system uptime), 0 if none */
+    uint32_t decode_us_at_underrun;      /* The newest decode time when it happened */
+    uint32_t io_wait_us_at_underrun;     /* The newest file read time when it happened */
+    uint32_t buffers_queued;             /* How many buffers the output stage handed to the speaker */
+    uint8_t output_buffers;              /* How many buffers the speaker has in all */
+    uint8_t output_fill_min;             /* The fewest buffers found still waiting when a new one was queued */
+    uint32_t output_fill[AUDIO_OUTPUT_MAX_BUFFERS + 1];  /* How often 0, 1, 2... buffers were still waiting then */
+    audio_timing_histogram_t decode_us;  /* How long each helping of decoding took */
+    audio_timing_histogram_t io_wait_us; /* How long each file read took */
+    audio_timing_histogram_t latency_us; /* How long sound took from the output stage's pipe to the speaker */
+} audio_telemetry_t;
+
+/*
+ * A stutter is an underrun: the output engine found no buffer ready and
+ * played silence. The telemetry shows when that happened and what led to it.
+ *
+ * output_fill is the early warning. Each time a buffer is queued, it counts
+ * how many were still waiting for the speaker. A song that plays cleanly
+ * but often reaches 0 is one slow card read away from a stutter.
+ * decode_us and io_wait_us show which side was slow. The _at_underrun
+ * values record the newest of each when the speaker ran dry. A decode time
+ * includes the file reads the decoder made itself, and those reads are
+ * also counted alone in io_wait_us. latency_us is how long a sample
+ * entering the output stage's pipe waits until it is heard. It covers that
+ * pipe, the queued buffers and the buffer being filled.
+ *
+ * Timing charts sort values into boxes that double in width, so one chart
+ * covers both a 100 us decode and a 200 ms card stall. Only playback through
+ * the assembly line is measured (audio/audio_pipeline.h).
+ */
+
+/**
+ * Read the playback telemetry
+ * @param telemetry A place to store the numbers
+ * @param reset 1 to start collecting afresh afterwards, 0 to keep counting
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_get_telemetry(audio_telemetry_t *telemetry, uint8_t reset);  /* This shows how smoothly the music has been playing */
+
+/**
+ * Find how slow the slowest ones were (like "99 out of 100 reads were faster than this")
+ * @param histogram A chart from audio_get_telemetry
+ * @param percent Which share to look at (1 to 100)
+ * @return The time in microseconds that that share stayed under (upper edge of its box, max_us for the last box)
+ */
+uint32_t audio_telemetry_percentile(const audio_timing_histogram_t *histogram, uint8_t percent);  /* This finds the "almost worst" time */
+
+/* ===== Recording Voice Memos ===== */
+// Recording sources - where recorded sound comes from
+typedef enum {
+    AUDIO_INPUT_PDM = 0,       /* A digital (PDM) microphone on AUDIO_INPUT_PDM_CLOCK_PIN/DATA_PIN */
+    AUDIO_INPUT_ADC            /* An analog microphone amplifier on AUDIO_INPUT_ADC_PIN */
+} audio_input_source_t;
+
+// Recording encodings - how recorded sound is stored in the WAV file
+typedef enum {
+    AUDIO_RECORD_PCM16 = 0,    /* 16-bit samples (best quality) */
+    AUDIO_RECORD_PCM8,         /* 8-bit samples (half the card space, hiss is audible) */
+    AUDIO_RECORD_IMA_ADPCM     /* 4-bit IMA ADPCM (a quarter of the card space, fine for speech) */
+} audio_record_encoding_t;
+
+// Recording settings - how to record
+typedef struct {
+    audio_input_source_t source;        /* Which microphone */
+    uint32_t sample_rate;               /* Sound points per second, 8000 to 48000 (0 = AUDIO_RECORD_DEFAULT_RATE) */
+    audio_record_encoding_t encoding;   /* How to store the sound */
+    uint16_t max_seconds;               /* Card space to reserve; recording stops there (0 = AUDIO_RECORD_DEFAULT_SECONDS) */
+    uint8_t gain_db;                    /* How much louder to make the microphone (0 to 40) */
+} audio_record_config_t;
+
+// Recording status - how the recording is going
+typedef struct {
+    uint8_t recording;          /* 1 while sound is being captured */
+    uint8_t full;               /* 1 once max_seconds was recorded and capture stopped by itself */
+    audio_status_t result;      /* AUDIO_OK (also when full), AUDIO_ERROR_IO after a card error */
+    uint32_t recorded_ms;       /* How much sound has been captured */
+    uint32_t bytes_written;     /* How much sound has reached the card */
+    uint32_t bytes_reserved;    /* How much room the file has for sound */
+    uint32_t overruns;          /* Capture buffers lost because nobody emptied them in time */
+    uint32_t backlog_max;       /* The most sound (bytes) that waited for the card at once */
+    uint32_t backlog_size;      /* How much sound (bytes) can wait for the card */
+    uint32_t write_max_us;      /* The slowest card write */
+} audio_record_status_t;
+
+/*
+ * A recording is a mono WAV file. Two workers on their own tasks
+ * (audio/audio_pipeline.h) move the sound:
+ *
+ *   capture (AUDIO_RECORD_CAPTURE_PRIORITY): the input engine
+ *   (drivers/audio_input.h) fills a ring of buffers by DMA from the PDM
+ *   microphone or the ADC. This worker turns each buffer into samples,
+ *   encodes them and pours them into a pipe of AUDIO_RECORD_RING_BYTES.
+ *   IMA ADPCM goes in whole blocks of AUDIO_RECORD_ADPCM_BLOCK bytes.
+ *
+ *   writer (AUDIO_RECORD_WRITER_PRIORITY): writes the pipe to the card
+ *   AUDIO_RECORD_WRITE_BYTES at a time.
+ *
+ * The file is preallocated when the recording starts (fs_preallocate), so
+ * a write never has to find free clusters or update the FAT. The WAV
+ * header is padded to 512 bytes, so every write covers whole sectors and
+ * starts on a sector boundary. When the card stalls, the sound waits in
+ * the pipe. At 16 kHz, 16-bit, the default pipe covers half a second.
+ * Only a stall longer than that loses sound, and it is counted in
+ * overruns.
+ *
+ * Recording runs alongside playback. It has its own DMA interrupt, PIO
+ * block and tasks. The capture worker runs at the player's priority, so
+ * neither one starves the other. Recording shares the heap with playback:
+ * about AUDIO_RECORD_RING_BYTES plus AUDIO_INPUT_BUFFER_COUNT capture
+ * buffers.
+ *
+ * The header gets its sizes in audio_record_stop(). After the recording
+ * stops by itself (reserved space full, card error), call
+ * audio_record_stop() to finish the file. A recording cut off by a power
+ * loss keeps its sound, but its header says the sound is empty.
+ */
+
+/**
+ * Start recording to a new WAV file (an existing file with that name is replaced)
+ * @param filename Where to save the recording
+ * @param config How to record (NULL = all defaults)
+ * @return AUDIO_OK, AUDIO_ERROR_BUSY if already recording, AUDIO_ERROR_PARAM for bad settings,
+ *         AUDIO_ERROR_IO if the file can't be made or the card has no room for max_seconds,
+ *         AUDIO_ERROR_INIT if the microphone hardware is taken, AUDIO_ERROR_MEMORY if there's no room
+ */
+audio_status_t audio_record_start(const char *filename, const audio_record_config_t *config);  /* This starts the tape recorder */
+
+/**
+ * Stop recording and finish the file (waits for the card to catch up)
+ * @return AUDIO_OK, AUDIO_ERROR_INIT if nothing was recorded, AUDIO_ERROR_IO if the file couldn't be finished
+ */
+audio_status_t audio_record_stop(void);  /* This stops the tape recorder and labels the tape */
+
+/**
+ * Check how the recording is going
+ * @param status A place to store the numbers
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_record_get_status(audio_record_status_t *status);  /* This peeks at the tape recorder */
+
+/* ===== Listening In ===== */
+// Tap status - how the copy for visualizers is doing
+typedef struct {
+    uint8_t running;            /* 1 while the tap is copying */
+    uint32_t sample_rate;       /* Tapped samples per second (the output's rate / decimation) */
+    uint32_t samples_waiting;   /* Tapped samples not read yet */
+    uint32_t samples_dropped;   /* Tapped samples thrown away because the reader was behind */
+} audio_tap_status_t;
+
+/*
+ * The tap gives a visualizer (audio/spectrum.h) a copy of what is being
+ * played, without letting it slow the sound down. The output worker calls
+ * audio_tap_feed() on each buffer after the effects and tone controls.
+ * It mixes left and right to mono and averages every `decimation`
+ * samples into one. The result goes into a lock-free single-producer,
+ * single-consumer pipe (audio/spsc_ring.h) of AUDIO_TAP_RING_BYTES. If
+ * the reader falls behind, new samples are dropped and counted. The
+ * output worker never waits, and its cost is a few cycles per sample. It
+ * costs nothing while the tap is off.
+ *
+ * One task (the GUI, say) starts the tap, reads it and stops it. The
+ * averaging is a gentle low-pass filter. Bars above a quarter of the
+ * tapped rate are only roughly right, which is fine for a display.
+ * audio_register_callback() is the opposite: it hands buffers over inside
+ * the sound worker, so anything slow there causes underruns.
+ */
+
+/**
+ * Start copying what plays
+ * @param decimation How many output samples make one tapped sample (1 to AUDIO_TAP_MAX_DECIMATION;
+ *                   at 48kHz, 2 gives a 24kHz copy, enough for a full-range spectrum)
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM for a bad decimation, AUDIO_ERROR_BUSY if already running,
+ *         AUDIO_ERROR_INIT if the output isn't set up, AUDIO_ERROR_MEMORY if there's no room
+ */
+audio_status_t audio_tap_start(uint8_t decimation);  /* This plugs a listening tube into the speaker */
+
+/**
+ * Stop copying and give back the tap's memory (waits for a copy in progress to end)
+ */
+void audio_tap_stop(void);  /* This unplugs the listening tube */
+
+/**
+ * Add a buffer that is about to play (called by the output worker; returns at once while the tap is off)
+ * @param frames 16-bit stereo frames (left, right, left, right...)
+ * @param count How many frames there are
+ */
+void audio_tap_feed(const int16_t *frames, uint16_t count);  /* This drips a copy of the sound into the tube */
+
+/**
+ * Take tapped samples out (only from the task that started the tap)
+ * @param samples Where to put the 16-bit mono samples
+ * @param max_samples How many fit
+ * @return How many were taken (0 if none are waiting or the tap is off)
+ */
+uint32_t audio_tap_read(int16_t *samples, uint32_t max_samples);  /* This sips from the listening tube */
+
+/**
+ * Check how the tap is doing
+ * @param status A place to store the numbers
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_tap_get_status(audio_tap_status_t *status);  /* This peeks at the listening tube */
+
 /* ===== Special Sound Helpers ===== */
 
 /**
  * Tell the speaker who to call when it needs more sound data
+ * (called inside the sound worker; for visualizers use audio_tap_start() instead)
  * @param callback The function to call when more sound data is needed
  * @return Message telling us if it worked or not
  */
 audio_status_t audio_register_callback(audio_callback_t callback);  /* This sets up who to tell when we need more sound */
 
 /**
- * Keep the sound system happy - call this often
+ * Keep the sound system happy - fills every empty output buffer
+ * audioTask calls this each time the output engine hands a buffer back (see audio_output.h)
  */
 void audio_update(void);  /* This makes sure sounds keep playing smoothly */
 
@@ -0,0 +1,102 @@
+/* =================== PIcoOS Sound Input Engine =================== */
+/* This file moves sound from the microphone into memory all by itself, so no word gets lost! */
+
+#ifndef AUDIO_INPUT_H    /* This is a special guard that makes sure we only include this file once */
+#define AUDIO_INPUT_H
+
+#include <stdint.h>           /* This gives us special number types */
+#include "os_config.h"        /* This gets our special settings */
+#include "drivers/audio.h"    /* This gives us recording settings and status messages */
+
+/*
+ * The output engine's mirror image (drivers/audio_output.h). Two chained
+ * DMA channels fill a ring of AUDIO_INPUT_BUFFER_COUNT buffers from the
+ * microphone, and the hardware never waits for software. When a buffer is
+ * full, the DMA interrupt queues it and wakes the task sleeping in
+ * audio_input_wait(). That task turns it into samples with
+ * audio_input_read(), which gives the buffer back. If no buffer is free,
+ * the DMA fills a scratch word instead, and that buffer's time is counted
+ * as an overrun.
+ *
+ * PDM: a PIO program clocks the microphone at 64 x the sample rate and
+ * shifts its one-bit answers into 32-bit words. audio_input_read() turns
+ * 64 bits into one sample with a 4th-order CIC filter. This is about 450
+ * cycles per sample, or 5% of a core at 16 kHz. Most PDM microphones need
+ * a clock of at least 1 MHz, so use 16 kHz or more.
+ *
+ * ADC: the ADC runs free at the sample rate, and the DMA takes each
+ * 12-bit result straight from its FIFO.
+ *
+ * Both paths then remove DC, apply the gain and give 16-bit mono samples.
+ * The DMA interrupt is AUDIO_INPUT_DMA_IRQ, and the PDM program uses
+ * AUDIO_INPUT_PDM_PIO. Both are kept apart from the output engine, so
+ * recording and playback can run together.
+ */
+
+/* ===== How the Input Engine is Doing ===== */
+// Input statistics - counters kept by the DMA interrupt
+typedef struct {
+    uint32_t buffers_captured;  /* How many full buffers came in from the microphone */
+    uint32_t overruns;          /* How many buffers' worth of sound were lost because every buffer was full */
+    uint8_t queued_buffers;     /* How many full buffers are waiting to be read right now */
+} audio_input_stats_t;
+
+/* ===== Turning the Input Engine On and Off ===== */
+
+/**
+ * Set up the buffers, DMA channels and PDM or ADC hardware
+ * @param config Which microphone, how fast and how much gain
+ * @return AUDIO_OK, AUDIO_ERROR_PARAM for bad settings, AUDIO_ERROR_INIT if the hardware is taken,
+ *         AUDIO_ERROR_MEMORY if there's no room for the buffers
+ */
+audio_status_t audio_input_init(const audio_record_config_t *config);  /* This builds the conveyor belt from the microphone */
+
+/**
+ * Stop the input engine and give back its memory and hardware
+ */
+void audio_input_deinit(void);  /* This takes the conveyor belt apart */
+
+/**
+ * Start capturing
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_input_start(void);  /* This switches the microphone on */
+
+/**
+ * Stop capturing and throw away anything not read yet
+ */
+void audio_input_stop(void);  /* This switches the microphone off */
+
+/* ===== Reading Buffers ===== */
+
+/**
+ * Sleep until at least one buffer is full (called by the capture task)
+ * @param timeout_ms The longest time to wait
+ * @return AUDIO_OK if a buffer is full, AUDIO_ERROR_TIMEOUT if none came in time
+ */
+audio_status_t audio_input_wait(uint32_t timeout_ms);  /* This is like waiting for a full cup to arrive */
+
+/**
+ * Turn the oldest full buffer into samples and give it back to the DMA
+ * @param pcm Where to put the 16-bit mono samples
+ * @param max_frames How many samples fit (at least audio_input_buffer_frames(), or nothing is read)
+ * @return How many samples were made (0 if no buffer was full)
+ */
+uint16_t audio_input_read(int16_t *pcm, uint16_t max_frames);  /* This empties one full cup */
+
+/**
+ * Ask how many samples one buffer holds
+ * @return Samples per buffer, or 0 if the engine isn't set up
+ */
+uint16_t audio_input_buffer_frames(void);  /* This checks how big the cups are */
+
+/* ===== Checking the Input Engine ===== */
+
+/**
+ * Read the input engine's counters
+ * @param stats A place to store the counters
+ * @param reset 1 to start counting from zero afterwards, 0 to keep counting
+ */
+void audio_input_get_stats(audio_input_stats_t *stats, uint8_t reset);  /* This reads how smoothly the sound is coming in */
+
+#endif /* End of AUDIO_INPUT_H - we're done describing the sound input engine! */
@@ -0,0 +1,139 @@
+/* =================== PIcoOS Sound Output Engine =================== */
+/* This file moves sound from memory to the speaker all by itself, so the music never hiccups! */
+
+#ifndef AUDIO_OUTPUT_H    /* This is a special guard that makes sure we only include this file once */
+#define AUDIO_OUTPUT_H
+
+#include <stdint.h>           /* This gives us special number types */
+#include "os_config.h"        /* This gets our special settings */
+#include "drivers/audio.h"    /* This gives us sound settings and status messages */
+
+/*
+ * Samples reach the speaker through DMA, not through a polling task. Two DMA
+ * channels are chained, so one starts the moment the other finishes and the
+ * hardware never waits for software. Each channel plays one buffer from a
+ * ring of audio_config_t.buffer_count buffers of audio_config_t.buffer_size
+ * frames. When a buffer finishes, the DMA interrupt gives it back and wakes
+ * the task sleeping in audio_output_wait(). That task refills every empty
+ * buffer and goes back to sleep.
+ *
+ * The ring is the jitter budget: the refill task can be late by almost
+ * (buffer_count - 1) * buffer_size / sample_rate seconds before the speaker
+ * runs dry. If it does run dry, the engine plays a buffer of silence instead
+ * of stopping. That silence counts as an underrun only while a stream is
+ * feeding the ring: from a commit until audio_output_drain(). The end of a
+ * pipeline line drains, and so must a pause, so an idle or paused engine
+ * counts nothing.
+ *
+ * Buffers always hold 16-bit stereo frames (left, right, left, right...).
+ * The output is PWM on AUDIO_PWM_PIN/+1, or I2S through a PIO state machine
+ * when AUDIO_OUTPUT_USE_I2S is 1.
+ */
+
+/* ===== How the Output Engine is Doing ===== */
+// Output statistics - counters kept by the DMA interrupt
+typedef struct {
+    uint32_t buffers_played;   /* How many full buffers reached the speaker */
+    uint32_t underruns;        /* How many times we had nothing ready and played silence */
+    uint8_t queued_buffers;    /* How many filled buffers are waiting right now */
+    uint8_t buffer_count;      /* How many buffers the engine has in all */
+    uint32_t latency_us;       /* How long a sample waits from being queued to being heard when the line is full */
+} audio_output_stats_t;
+
+/* ===== Turning the Output Engine On and Off ===== */
+
+/**
+ * Set up the buffers, DMA channels and PWM or I2S hardware
+ * @param config Sample rate, buffer size and buffer count to use
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_output_init(const audio_config_t *config);  /* This builds the conveyor belt to the speaker */
+
+/**
+ * Stop the output engine and give back its memory and hardware
+ */
+void audio_output_deinit(void);  /* This takes the conveyor belt apart */
+
+/**
+ * Start sending buffers to the speaker (fill a few first to avoid a silent start)
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_output_start(void);  /* This switches the conveyor belt on */
+
+/**
+ * Stop sending buffers to the speaker and throw away anything waiting
+ */
+void audio_output_stop(void);  /* This switches the conveyor belt off */
+
+/* ===== Filling Buffers ===== */
+
+/**
+ * Sleep until at least one buffer is empty (called by the refill task)
+ * While the engine is stopped it sleeps until audio_output_wake() or the timeout instead
+ * @param timeout_ms The longest time to wait
+ * @return AUDIO_OK if a buffer is empty, AUDIO_ERROR_TIMEOUT if none came back in time
+ */
+audio_status_t audio_output_wait(uint32_t timeout_ms);  /* This is like waiting for an empty cup to come back */
+
+/**
+ * Wake the refill task because there is new sound to play (safe from an interrupt)
+ * If it isn't asleep yet, its next audio_output_wait() returns at once
+ */
+void audio_output_wake(void);  /* This is like ringing the kitchen bell */
+
+/**
+ * Borrow the next empty buffer to fill with sound
+ * @param buffer A place to store where the buffer is (16-bit stereo frames)
+ * @param frames A place to store how many frames fit in it
+ * @return AUDIO_OK if we got one, AUDIO_ERROR_BUSY if every buffer is full
+ */
+audio_status_t audio_output_acquire_buffer(int16_t **buffer, uint16_t *frames);  /* This is like picking up an empty cup */
+
+/**
+ * Put the borrowed buffer in line for the speaker
+ * @param frames How many frames we wrote (the rest is filled with silence)
+ * @return Message telling us if it worked or not
+ */
+audio_status_t audio_output_commit_buffer(uint16_t frames);  /* This is like putting the full cup on the conveyor belt */
+
+/**
+ * Let the queued buffers play out: the silence after them isn't counted as an underrun
+ * (until the next audio_output_commit_buffer()) - call it when a stream ends or pauses
+ * @return 1 once every queued buffer has been heard, so the engine can stop without cutting anything
+ */
+uint8_t audio_output_drain(void);  /* This is like letting the last cups ride to the end of the belt */
+
+/**
+ * Count the empty buffers
+ * @return How many buffers can be filled right now
+ */
+uint8_t audio_output_free_buffers(void);  /* This counts the empty cups */
+
+/**
+ * Count the filled buffers still waiting for the speaker (not counting the ones playing)
+ * @return How many buffers are queued right now (0 means the speaker is about to run dry)
+ */
+uint8_t audio_output_queued_buffers(void);  /* This counts the full cups in line */
+
+/* ===== Checking the Output Engine ===== */
+
+/**
+ * Check if the engine is sending buffers to the speaker
+ * @return 1 between audio_output_start() and audio_output_stop(), 0 otherwise
+ */
+uint8_t audio_output_is_running(void);  /* This checks if the conveyor belt is moving */
+
+/**
+ * Ask how fast the speaker is playing
+ * @return Samples per second per channel, or 0 if the engine isn't set up
+ */
+uint32_t audio_output_get_sample_rate(void);  /* This checks the speaker's speed */
+
+/**
+ * Read the output engine's counters
+ * @param stats A place to store the counters
+ * @param reset 1 to start counting from zero afterwards, 0 to keep counting
+ */
+void audio_output_get_stats(audio_output_stats_t *stats, uint8_t reset);  /* This reads how smoothly the sound is flowing */
+
+#endif /* End of AUDIO_OUTPUT_H - we're done describing the sound output engine! */
@@ -5,6 +5,7 @@
 #define DISPLAY_H
 
 #include <stdint.h>   /* This gives us special number types */
+#include "os_config.h"  /* This gets our special settings */
 
 /* ===== Screen Problem Messages ===== */
 // Display status codes - messages about how the screen is doing
@@ -57,6 +58,8 @@ typedef struct {
     uint8_t b;  /* Blue amount (0-255) - how much blue to add */
 } display_color_t; /* When we mix these three colors, we can make any color! */
 
+#if OS_CONFIG_ENABLE_GUI   /* Only describe the real drawing jobs when we have a screen */
+
 /* ===== Turning the Screen On and Off ===== */
 
 /**
@@ -163,6 +166,7 @@ display_status_t display_draw_char(uint16_t x, uint16_t y, char c, uint8_t font,
 
 /**
  * Draw a whole sentence on the screen
+ * Only plain ASCII letters - UTF-8 words go through gui_font_draw_text() (gui/gui_font.h)
  * @param x Where to start drawing (how far across from left)
  * @param y Where to start drawing (how far down from top)
  * @param text The words to write on the screen
@@ -173,6 +177,16 @@ display_status_t display_draw_char(uint16_t x, uint16_t y, char c, uint8_t font,
  */
 display_status_t display_draw_text(uint16_t x, uint16_t y, const char *text, uint8_t font, display_color_t color, display_color_t bg_color); /* This draws many letters to make words */
 
+/**
+ * Find out how much space some words would take without drawing them
+ * @param text The words to measure
+ * @param font Which style of letters to use
+ * @param width A place to store how many dots wide the words are
+ * @param height A place to store how many dots tall the words are
+ * @return Message telling us if it worked or not
+ */
+display_status_t display_measure_text(const char *text, uint8_t font, uint16_t *width, uint16_t *height); /* This is like measuring a sign before painting it */
+
 /* ===== Drawing Pictures ===== */
 
 /**
@@ -186,6 +200,18 @@ display_status_t display_draw_text(uint16_t x, uint16_t y, const char *text, uin
  */
 display_status_t display_draw_bitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t *data); /* This draws a whole picture at once */
 
+/**
+ * Copy the colored dots that are on the screen back into memory
+ * Reads from our hidden drawing place if we have one, otherwise asks the screen itself
+ * @param x Where to start reading (how far across from left)
+ * @param y Where to start reading (how far down from top)
+ * @param width How many dots wide to read
+ * @param height How many dots tall to read
+ * @param data Where to put the dots (16-bit RGB565, width x height of them)
+ * @return Message telling us if it worked or not
+ */
+display_status_t display_read_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t *data); /* This is like taking a photo of the screen */
+
 /**
  * Make all our drawing show up on the screen
  * Sometimes we draw in a special hidden place first, then show it all at once
@@ -232,4 +258,8 @@ display_status_t display_sleep(void);
  */
 display_status_t display_wake(void);
 
+#else
+#include "drivers/display_headless.h"  /* No screen: every drawing job becomes an empty do-nothing helper */
+#endif /* OS_CONFIG_ENABLE_GUI */
+
 #endif // DISPLAY_H
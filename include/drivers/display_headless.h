@@ -0,0 +1,83 @@
+/* =================== PIcoOS Pretend Screen =================== */
+/* This file stands in for the screen when our tiny computer doesn't have one! */
+
+#ifndef DISPLAY_HEADLESS_H    /* This is a special guard that makes sure we only include this file once */
+#define DISPLAY_HEADLESS_H
+
+/*
+ * Included by drivers/display.h when OS_CONFIG_ENABLE_GUI is 0. Every call
+ * becomes an inline no-op that reports "no screen", so callers keep
+ * compiling unchanged and the optimizer drops them together with the code
+ * guarded by display_is_connected(). No display driver is linked.
+ */
+
+#define DISPLAY_HEADLESS_UNUSED(x) ((void)(x))  /* Quietly ignore a setting we can't use */
+
+static inline display_status_t display_init(void) { return DISPLAY_ERROR_NO_DEVICE; }
+static inline void display_deinit(void) {}
+static inline display_status_t display_configure(const display_config_t *config) { DISPLAY_HEADLESS_UNUSED(config); return DISPLAY_ERROR_NO_DEVICE; }
+static inline display_status_t display_get_config(display_config_t *config) { DISPLAY_HEADLESS_UNUSED(config); return DISPLAY_ERROR_NO_DEVICE; }
+static inline display_status_t display_set_backlight(uint8_t percentage) { DISPLAY_HEADLESS_UNUSED(percentage); return DISPLAY_ERROR_NO_DEVICE; }
+static inline display_status_t display_clear(display_color_t color) { DISPLAY_HEADLESS_UNUSED(color); return DISPLAY_ERROR_NO_DEVICE; }
+
+static inline display_status_t display_draw_pixel(uint16_t x, uint16_t y, display_color_t color) {
+    DISPLAY_HEADLESS_UNUSED(x); DISPLAY_HEADLESS_UNUSED(y); DISPLAY_HEADLESS_UNUSED(color);
+    return DISPLAY_ERROR_NO_DEVICE;
+}
+
+static inline display_status_t display_draw_line(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, display_color_t color) {
+    DISPLAY_HEADLESS_UNUSED(x1); DISPLAY_HEADLESS_UNUSED(y1); DISPLAY_HEADLESS_UNUSED(x2); DISPLAY_HEADLESS_UNUSED(y2);
+    DISPLAY_HEADLESS_UNUSED(color);
+    return DISPLAY_ERROR_NO_DEVICE;
+}
+
+static inline display_status_t display_draw_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, display_color_t color, uint8_t filled) {
+    DISPLAY_HEADLESS_UNUSED(x); DISPLAY_HEADLESS_UNUSED(y); DISPLAY_HEADLESS_UNUSED(width); DISPLAY_HEADLESS_UNUSED(height);
+    DISPLAY_HEADLESS_UNUSED(color); DISPLAY_HEADLESS_UNUSED(filled);
+    return DISPLAY_ERROR_NO_DEVICE;
+}
+
+static inline display_status_t display_draw_circle(uint16_t x_center, uint16_t y_center, uint16_t radius, display_color_t color, uint8_t filled) {
+    DISPLAY_HEADLESS_UNUSED(x_center); DISPLAY_HEADLESS_UNUSED(y_center); DISPLAY_HEADLESS_UNUSED(radius);
+    DISPLAY_HEADLESS_UNUSED(color); DISPLAY_HEADLESS_UNUSED(filled);
+    return DISPLAY_ERROR_NO_DEVICE;
+}
+
+static inline display_status_t display_draw_char(uint16_t x, uint16_t y, char c, uint8_t font, display_color_t color, display_color_t bg_color) {
+    DISPLAY_HEADLESS_UNUSED(x); DISPLAY_HEADLESS_UNUSED(y); DISPLAY_HEADLESS_UNUSED(c); DISPLAY_HEADLESS_UNUSED(font);
+    DISPLAY_HEADLESS_UNUSED(color); DISPLAY_HEADLESS_UNUSED(bg_color);
+    return DISPLAY_ERROR_NO_DEVICE;
+}
+
+static inline display_status_t display_draw_text(uint16_t x, uint16_t y, const char *text, uint8_t font, display_color_t color, display_color_t bg_color) {
+    DISPLAY_HEADLESS_UNUSED(x); DISPLAY_HEADLESS_UNUSED(y); DISPLAY_HEADLESS_UNUSED(text); DISPLAY_HEADLESS_UNUSED(font);
+    DISPLAY_HEADLESS_UNUSED(color); DISPLAY_HEADLESS_UNUSED(bg_color);
+    return DISPLAY_ERROR_NO_DEVICE;
+}
+
+static inline display_status_t display_measure_text(const char *text, uint8_t font, uint16_t *width, uint16_t *height) {
+    DISPLAY_HEADLESS_UNUSED(text); DISPLAY_HEADLESS_UNUSED(font); DISPLAY_HEADLESS_UNUSED(width); DISPLAY_HEADLESS_UNUSED(height);
+    return DISPLAY_ERROR_NO_DEVICE;
+}
+
+static inline display_status_t display_draw_bitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t *data) {
+    DISPLAY_HEADLESS_UNUSED(x); DISPLAY_HEADLESS_UNUSED(y); DISPLAY_HEADLESS_UNUSED(width); DISPLAY_HEADLESS_UNUSED(height);
+    DISPLAY_HEADLESS_UNUSED(data);
+    return DISPLAY_ERROR_NO_DEVICE;
+}
+
+static inline display_status_t display_read_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t *data) {
+    DISPLAY_HEADLESS_UNUSED(x); DISPLAY_HEADLESS_UNUSED(y); DISPLAY_HEADLESS_UNUSED(width); DISPLAY_HEADLESS_UNUSED(height);
+    DISPLAY_HEADLESS_UNUSED(data);
+    return DISPLAY_ERROR_NO_DEVICE;
+}
+
+static inline display_status_t display_update(void) { return DISPLAY_ERROR_NO_DEVICE; }
+static inline uint8_t display_is_connected(void) { return 0; }
+static inline display_status_t display_set_rotation(uint8_t rotation) { DISPLAY_HEADLESS_UNUSED(rotation); return DISPLAY_ERROR_NO_DEVICE; }
+static inline uint16_t display_get_width(void) { return 0; }
+static inline uint16_t display_get_height(void) { return 0; }
+static inline display_status_t display_sleep(void) { return DISPLAY_ERROR_NO_DEVICE; }
+static inline display_status_t display_wake(void) { return DISPLAY_ERROR_NO_DEVICE; }
+
+#endif /* End of DISPLAY_HEADLESS_H - we're done pretending to have a screen! */
@@ -176,6 +176,16 @@ fs_status_t fs_tell(fs_file_t file, uint32_t *position);  /* This is like using
  */
 fs_status_t fs_truncate(fs_file_t file, uint32_t size);  /* This is like tearing pages out of a book */
 
+/**
+ * Reserve room for a file up front, in one unbroken stretch of the card when there is one, so
+ * writes up to that size never have to look for space (call on a new, empty file; fs_truncate
+ * gives back what wasn't used)
+ * @param file Our special tag for the open file
+ * @param size How big the file will get (the file has this size afterwards; the spot doesn't move)
+ * @return FS_OK, FS_ERROR_FULL if there isn't that much room, or another message if it didn't work
+ */
+fs_status_t fs_preallocate(fs_file_t file, uint32_t size);  /* This is like saving enough pages in a notebook before writing */
+
 /**
  * Make sure all our changes are saved
  * @param file Our special tag for the open file
@@ -0,0 +1,120 @@
+/* =================== PIcoOS Screen Camera =================== */
+/* This file takes photos of the screen and lets us draw one picture at a time, so computers can check our work! */
+
+#ifndef GUI_CAPTURE_H    /* This is a special guard that makes sure we only include this file once */
+#define GUI_CAPTURE_H
+
+#include <stdint.h>          /* This gives us special number types */
+#include <stddef.h>          /* This gives us special size types */
+#include "os_config.h"       /* This gets our special settings */
+#include "FreeRTOS.h"        /* This gives us the computer's brain */
+#include "semphr.h"          /* This gives us tickets for taking turns */
+#include "gui/gui_manager.h" /* This gives us GUI status messages */
+
+/*
+ * Screenshots read the panel back with display_read_rect() in bands of
+ * GUI_CAPTURE_BAND_ROWS rows and stream them as a top-down 16-bit BMP,
+ * either to a file through fs_manager or to any byte sink (for example a
+ * semihosting or USB channel to the host simulator). A CRC-32 of the raw
+ * pixels comes back with every capture so CI can compare frames without
+ * moving images around. A capture holds the display lock (the same mutex
+ * guiTask draws under, handed over with gui_capture_set_display_lock()) from
+ * the first band to the last. The picture is never half old, half new, and
+ * the panel is never read while it is being written. So don't capture
+ * while holding that lock, for example from inside gui_update().
+ *
+ * Step mode makes the GUI deterministic: guiTask only renders when a step
+ * was requested, and animations read gui_capture_get_time_ms(), which then
+ * advances by a fixed amount per frame instead of following the wall clock.
+ * Render time of every frame is recorded in both modes. The timing numbers
+ * are read and reset in a critical section, so a reader never sees a
+ * half-written 64-bit total.
+ */
+
+/* ===== Where Screenshots Go ===== */
+// Capture sink - a function that takes the screenshot bytes somewhere (file, host, ...)
+typedef gui_status_t (*gui_capture_write_t)(void *context, const void *data, size_t size);  /* This is like a mailbox for photo pieces */
+
+/* ===== How Fast Pictures Are Drawn ===== */
+// Frame timing - how long drawing took, in microseconds
+typedef struct {
+    uint32_t frames;           /* How many pictures we drew */
+    uint32_t last_us;          /* How long the newest picture took */
+    uint32_t max_us;           /* How long the slowest picture took */
+    uint64_t total_us;         /* How long all pictures took together (divide by frames for the average) */
+} gui_frame_stats_t;
+
+/* ===== Taking Screenshots ===== */
+
+/**
+ * Tell the camera which lock guards the screen (call once at startup, before any capture)
+ * @param lock The mutex guiTask holds while it draws (NULL = no lock)
+ */
+void gui_capture_set_display_lock(SemaphoreHandle_t lock);  /* This is like telling the photographer to wait their turn */
+
+/**
+ * Save what the screen shows into a picture file (BMP)
+ * @param path Where to save it (like "/shots/menu.bmp")
+ * @param crc A place to store a fingerprint of the picture (or NULL)
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_capture_to_file(const char *path, uint32_t *crc);  /* This is like taking a photo and putting it in the album */
+
+/**
+ * Send what the screen shows to someone else, piece by piece (BMP)
+ * @param write The mailbox that takes each piece
+ * @param context Anything the mailbox needs to know (passed back to it)
+ * @param crc A place to store a fingerprint of the picture (or NULL)
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_capture_to_sink(gui_capture_write_t write, void *context, uint32_t *crc);  /* This is like mailing a photo one strip at a time */
+
+/* ===== Drawing One Picture at a Time ===== */
+
+/**
+ * Turn step mode on or off
+ * @param enable 1 to only draw when asked, 0 to draw all the time
+ * @param frame_ms How much pretend time passes with each picture in step mode
+ */
+void gui_capture_set_step_mode(uint8_t enable, uint32_t frame_ms);  /* This is like switching a movie to slide show */
+
+/**
+ * Ask for some more pictures to be drawn in step mode
+ * @param frames How many pictures to draw
+ */
+void gui_capture_step(uint32_t frames);  /* This is like clicking to the next slide */
+
+/**
+ * Ask if the drawing worker should draw a picture now (called by guiTask)
+ * @return 1 to draw, 0 to wait
+ */
+uint8_t gui_capture_frame_due(void);  /* This asks "is it time for the next slide?" */
+
+/**
+ * Check if all the pictures we asked for have been drawn
+ * @return 1 if no steps are waiting, 0 if some still are
+ */
+uint8_t gui_capture_steps_done(void);  /* This asks "are we at the slide we wanted?" */
+
+/**
+ * Ask what time the screen thinks it is (pretend time in step mode)
+ * @return Milliseconds for animations to use
+ */
+uint32_t gui_capture_get_time_ms(void);  /* This is the clock that animations look at */
+
+/* ===== Measuring Drawing Speed ===== */
+
+/**
+ * Write down how long one picture took (called by guiTask)
+ * @param render_us How many microseconds drawing took
+ */
+void gui_capture_record_frame(uint32_t render_us);  /* This is like writing a lap time in a notebook */
+
+/**
+ * Read the drawing speed notebook
+ * @param stats A place to store the numbers
+ * @param reset 1 to start a fresh notebook afterwards, 0 to keep counting
+ */
+void gui_capture_get_frame_stats(gui_frame_stats_t *stats, uint8_t reset);  /* This reads the lap times */
+
+#endif /* End of GUI_CAPTURE_H - we're done describing the screen camera! */
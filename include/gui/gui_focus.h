@@ -0,0 +1,81 @@
+/* =================== PIcoOS Spotlight Map =================== */
+/* This file helps the picture maker remember who sits next to whom on the screen! */
+
+#ifndef GUI_FOCUS_H    /* This is a special guard that makes sure we only include this file once */
+#define GUI_FOCUS_H
+
+#include <stdint.h>          /* This gives us special number types */
+#include "os_config.h"       /* This gets our special settings */
+#include "gui/gui_manager.h" /* This gives us screen things and spotlight directions */
+
+/*
+ * The focus graph keeps, for every focusable element of the active screen,
+ * its up/down/left/right neighbor and its place in the next/prev order,
+ * so a button press only has to follow one precomputed link.
+ *
+ * Nothing feeds the graph yet. gui_manager.c, which creates, moves,
+ * resizes and deletes elements, is not part of this tree. It has to call
+ * gui_focus_graph_reset() from gui_set_screen(), gui_focus_graph_update()
+ * from gui_create_element(), gui_set_position() and gui_set_size() for
+ * focusable elements, and gui_focus_graph_remove() from
+ * gui_delete_element(). Until it does, gui_focus_move() has no neighbors
+ * to follow and returns GUI_ERROR_PARAM. Code that builds a screen can
+ * also register its elements by hand with the same calls.
+ *
+ * Updates are incremental: changing one element rescans the node list once
+ * and only marks the directions that pointed at it as stale. Stale directions
+ * are recomputed the first time they are followed.
+ */
+
+/* ===== Starting Over ===== */
+
+/**
+ * Forget every neighbor and start a fresh map for a screen
+ * @param screen The screen the map belongs to (the one being shown)
+ */
+void gui_focus_graph_reset(gui_element_t screen);  /* This is like wiping the seating chart clean */
+
+/**
+ * Find out which screen the map belongs to
+ * @return The screen tag, or NULL if there is no map yet
+ */
+gui_element_t gui_focus_graph_screen(void);  /* This tells us which page the seating chart is for */
+
+/* ===== Keeping the Map Up to Date ===== */
+
+/**
+ * Add a thing to the map, or tell the map it moved or changed size
+ * New things go to the end of the next/previous line
+ * @param element The special tag for the thing
+ * @param x How far across the screen the thing starts
+ * @param y How far down the screen the thing starts
+ * @param width How wide the thing is
+ * @param height How tall the thing is
+ * @return GUI_OK, or GUI_ERROR_MEMORY if the map is full
+ */
+gui_status_t gui_focus_graph_update(gui_element_t element, int16_t x, int16_t y, uint16_t width, uint16_t height);  /* This is like giving someone a new seat */
+
+/**
+ * Take a thing off the map (when it is deleted or can no longer get the spotlight)
+ * @param element The special tag for the thing
+ * @return GUI_OK, or GUI_ERROR_PARAM if the thing was not on the map
+ */
+gui_status_t gui_focus_graph_remove(gui_element_t element);  /* This is like someone leaving the classroom */
+
+/* ===== Asking the Map ===== */
+
+/**
+ * Find the neighbor of a thing in a direction
+ * @param element The thing we start from
+ * @param dir Which way to look
+ * @return The neighbor's special tag, or NULL if there is nobody that way
+ */
+gui_element_t gui_focus_graph_neighbor(gui_element_t element, gui_focus_dir_t dir);  /* This asks "who sits to my right?" */
+
+/**
+ * Find the first thing in the next/previous line
+ * @return The first thing's special tag, or NULL if the map is empty
+ */
+gui_element_t gui_focus_graph_first(void);  /* This asks "who is at the front of the line?" */
+
+#endif /* End of GUI_FOCUS_H - we're done describing the spotlight map! */
@@ -0,0 +1,138 @@
+/* =================== PIcoOS Letter Library =================== */
+/* This file helps us draw letters from every language, not just English! */
+
+#ifndef GUI_FONT_H    /* This is a special guard that makes sure we only include this file once */
+#define GUI_FONT_H
+
+#include <stdint.h>          /* This gives us special number types */
+#include "os_config.h"       /* This gets our special settings */
+#include "gui/gui_manager.h" /* This gives us GUI status messages */
+#include "drivers/display.h" /* This gives us colors */
+
+/*
+ * Fonts store only the glyphs they actually have, grouped in pages of 64
+ * consecutive codepoints. Finding a glyph takes two constant-time steps:
+ * a hash of the page number gives the page, then the rank of the glyph's bit
+ * in the page's 64-bit presence mask gives its descriptor.
+ *
+ * Fonts registered from flash are used in place (XIP). Fonts registered
+ * from a file keep only the header and page directory in RAM; pages are
+ * read on demand into GUI_FONT_PAGE_CACHE_SLOTS slots, least recently used
+ * first out.
+ *
+ * display_draw_text() and the labels gui_manager draws only know ASCII.
+ * UTF-8 text (song titles, tags) is drawn by the caller through this module,
+ * either directly or through the label cache for words that repeat:
+ *
+ *     gui_font_register_file(1, "/fonts/ui16.pfnt");
+ *     gui_font_draw_text(x, y, title, 1, fg, bg);
+ *
+ *     gui_label_cache_init(gui_font_rasterize);
+ *     gui_label_cache_draw(x, y, title, 1, fg, bg);
+ *
+ * gui_layout_text_changed() and the label cache measure with
+ * gui_font_measure() whenever the font number is registered here.
+ *
+ * File layout (little-endian, identical in flash and on SD):
+ *   header    "PFNT", u8 version (1), u8 bpp (1/2/4/8), u8 line_height,
+ *             u8 baseline, u16 page_count, u16 reserved, u32 fallback codepoint
+ *   directory page_count x { u16 page (codepoint >> 6), u16 glyph_count,
+ *             u32 offset, u32 size }, sorted by page
+ *   page      u64 presence mask, glyph_count x { u8 width, u8 height,
+ *             i8 x_offset, i8 y_offset, u8 advance, u8 reserved,
+ *             u16 bitmap_offset }, then the glyph bitmaps: rows MSB first,
+ *             each row padded to a whole byte, offsets relative to the
+ *             first bitmap byte of the page
+ */
+
+/* ===== One Letter's Measurements ===== */
+// Glyph info - how big a letter is and where its picture is
+typedef struct {
+    uint8_t width;             /* How many dots wide the letter's picture is */
+    uint8_t height;            /* How many dots tall the letter's picture is */
+    int8_t x_offset;           /* How far right of the pen the picture starts */
+    int8_t y_offset;           /* How far below the top of the line the picture starts */
+    uint8_t advance;           /* How far to move the pen for the next letter */
+    uint8_t bpp;               /* How many bits each dot uses (1, 2, 4 or 8) */
+    const uint8_t *bitmap;     /* The letter's picture (only good until the next letter lookup) */
+} gui_glyph_t;
+
+/* ===== Reading Letters From Words ===== */
+
+/**
+ * Read the next letter from UTF-8 words and move past it
+ * @param text A pointer to where we are in the words (moved forward past the letter)
+ * @return The letter's number (codepoint), 0 at the end, or 0xFFFD for broken bytes
+ */
+uint32_t gui_utf8_next(const char **text);  /* This is like reading one letter and moving your finger along */
+
+/* ===== Adding Letter Styles ===== */
+
+/**
+ * Use a letter style that lives in flash memory
+ * @param font Which style number to give it
+ * @param data Where the font starts in flash
+ * @param size How many bytes the font is
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_font_register_flash(uint8_t font, const uint8_t *data, uint32_t size);  /* This is like putting a book on the shelf */
+
+/**
+ * Use a letter style from a file, reading pages only when we need them
+ * @param font Which style number to give it
+ * @param path Where the font file is (like "/fonts/cjk16.pfnt")
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_font_register_file(uint8_t font, const char *path);  /* This is like borrowing a big book from the library one page at a time */
+
+/**
+ * Stop using a letter style
+ * @param font Which style number to forget
+ */
+void gui_font_unregister(uint8_t font);  /* This is like giving the book back */
+
+/* ===== Using Letters ===== */
+
+/**
+ * Find the picture and measurements of one letter
+ * Missing letters come back as the font's fallback letter
+ * @param font Which style of letters to use
+ * @param codepoint Which letter (its Unicode number)
+ * @param glyph A place to store what we found
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_font_get_glyph(uint8_t font, uint32_t codepoint, gui_glyph_t *glyph);  /* This is like looking up a letter in the index */
+
+/**
+ * Find out how much space UTF-8 words take
+ * @param font Which style of letters to use
+ * @param text The words to measure
+ * @param width A place to store how many dots wide they are
+ * @param height A place to store how many dots tall they are
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_font_measure(uint8_t font, const char *text, uint16_t *width, uint16_t *height);  /* This is like measuring a sign before painting it */
+
+/**
+ * Draw UTF-8 words on the screen
+ * @param x Where to start drawing (how far across from left)
+ * @param y Where to start drawing (how far down from top)
+ * @param text The words to draw
+ * @param font Which style of letters to use
+ * @param color What color to make the words
+ * @param bg_color What color to put behind the words
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_font_draw_text(uint16_t x, uint16_t y, const char *text, uint8_t font, display_color_t color, display_color_t bg_color);  /* This writes words in any language */
+
+/**
+ * Paint UTF-8 words as shades of gray (plugs into the word picture box)
+ * @param text The words to paint
+ * @param font Which style of letters to use
+ * @param coverage Where to paint (width x height bytes, 0 = empty, 255 = inked)
+ * @param width How wide the painting area is
+ * @param height How tall the painting area is
+ */
+void gui_font_rasterize(const char *text, uint8_t font, uint8_t *coverage, uint16_t width, uint16_t height);  /* This paints words on a practice sheet */
+
+#endif /* End of GUI_FONT_H - we're done describing the letter library! */
@@ -0,0 +1,146 @@
+/* =================== PIcoOS Dials and Circles =================== */
+/* This file draws round things - speedometer dials, curved bars and spinning "please wait" circles! */
+
+#ifndef GUI_GAUGE_H    /* This is a special guard that makes sure we only include this file once */
+#define GUI_GAUGE_H
+
+#include <stdint.h>          /* This gives us special number types */
+#include "os_config.h"       /* This gets our special settings */
+#include "gui/gui_manager.h" /* This gives us GUI status messages and boxes */
+#include "drivers/display.h" /* This gives us colors */
+
+/*
+ * Everything here is integer math. Angles are binary angles: a full turn is
+ * GUI_ANGLE_FULL steps, and sine/cosine come from a quarter-wave Q15 table,
+ * so no floating point is ever touched while drawing.
+ *
+ * Arcs are filled one row at a time. Each row costs two integer square roots
+ * (outer and inner edge of the ring) and the arc's start and end angles turn
+ * into simple left/right limits on that row, so every row becomes at most
+ * four horizontal spans.
+ *
+ * Gauges only redraw what changed: the part of the ring between the old and
+ * new value, and the needle inside the box it used to cover plus the box it
+ * covers now. Keep other elements out of the needle's sweep - the old needle
+ * box is cleared to bg_color.
+ *
+ * Angles given in degrees start at 3 o'clock and go clockwise.
+ */
+
+#define GUI_ANGLE_FULL               1024   /* Steps in one whole turn */
+#define GUI_ANGLE_FROM_DEGREES(deg)  ((uint16_t)((((int32_t)(deg) % 360 + 360) % 360) * GUI_ANGLE_FULL / 360))
+
+/* ===== Dial Description ===== */
+// Gauge - a dial with a ring that fills up and a needle that points at the value
+typedef struct {
+    /* Fill these in before drawing */
+    int16_t x_center;             /* Where the middle of the dial is (across) */
+    int16_t y_center;             /* Where the middle of the dial is (down) */
+    uint16_t radius;              /* How big the outside of the ring is */
+    uint16_t thickness;           /* How thick the ring is */
+    int16_t start_angle;          /* Where the ring starts, in degrees */
+    uint16_t sweep_angle;         /* How far around the ring goes, in degrees (1 to 360) */
+    int32_t min_value;            /* The value at the start of the ring */
+    int32_t max_value;            /* The value at the end of the ring */
+    uint8_t ticks;                /* How many little marks to draw (0 for none) */
+    uint16_t needle_length;       /* How long the needle is (0 for no needle) */
+    uint8_t needle_width;         /* How wide the needle is at the middle */
+    display_color_t track_color;  /* Color of the empty part of the ring */
+    display_color_t fill_color;   /* Color of the filled part of the ring */
+    display_color_t needle_color; /* Color of the needle */
+    display_color_t tick_color;   /* Color of the little marks */
+    display_color_t bg_color;     /* Color behind the needle */
+
+    /* The gauge keeps these up to date */
+    int32_t value;                /* What the dial shows now */
+    uint16_t value_angle;         /* How far around the ring the value is (binary angle) */
+    gui_rect_t needle_box;        /* The box the needle covers now */
+    uint8_t drawn;                /* 1 once the whole dial has been drawn */
+} gui_gauge_t;
+
+/* ===== Spinning Circle Description ===== */
+// Spinner - a short arc that chases itself around a ring while we wait
+typedef struct {
+    /* Fill these in before drawing */
+    int16_t x_center;             /* Where the middle of the circle is (across) */
+    int16_t y_center;             /* Where the middle of the circle is (down) */
+    uint16_t radius;              /* How big the circle is */
+    uint16_t thickness;           /* How thick the circle is */
+    uint16_t arc_length;          /* How long the moving arc is, in degrees */
+    uint16_t speed;               /* How fast it spins, in degrees per second */
+    display_color_t color;        /* Color of the moving arc */
+    display_color_t track_color;  /* Color of the rest of the circle */
+
+    /* The spinner keeps these up to date */
+    uint16_t angle;               /* Where the moving arc starts (binary angle) */
+    uint32_t remainder;           /* Leftover movement smaller than one step */
+    uint8_t drawn;                /* 1 once the whole circle has been drawn */
+} gui_spinner_t;
+
+/* ===== Circle Math ===== */
+
+/**
+ * Look up the sine of an angle
+ * @param angle The angle in binary steps (GUI_ANGLE_FULL is one turn)
+ * @return The sine as a Q15 number (32767 means 1.0)
+ */
+int16_t gui_sin(uint16_t angle);  /* This is like reading a wave off a chart */
+
+/**
+ * Look up the cosine of an angle
+ * @param angle The angle in binary steps (GUI_ANGLE_FULL is one turn)
+ * @return The cosine as a Q15 number (32767 means 1.0)
+ */
+int16_t gui_cos(uint16_t angle);  /* This is the same wave, a quarter turn later */
+
+/* ===== Drawing Curves ===== */
+
+/**
+ * Draw a thick curved bar (part of a ring)
+ * @param x_center Where the middle of the ring is (across)
+ * @param y_center Where the middle of the ring is (down)
+ * @param radius How big the outside of the ring is
+ * @param thickness How thick the ring is (radius or more fills a pie slice)
+ * @param start_angle Where the curve starts, in degrees
+ * @param sweep_angle How far around it goes, in degrees (360 for a full ring)
+ * @param color What color to paint it
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_draw_arc(int16_t x_center, int16_t y_center, uint16_t radius, uint16_t thickness,
+                          int16_t start_angle, uint16_t sweep_angle, display_color_t color);  /* This paints a rainbow shape */
+
+/* ===== Dials ===== */
+
+/**
+ * Draw the whole dial: ring, marks and needle
+ * @param gauge The dial to draw
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_gauge_draw(gui_gauge_t *gauge);  /* This paints a speedometer from scratch */
+
+/**
+ * Change what the dial shows, redrawing only the parts that moved
+ * @param gauge The dial to change
+ * @param value The new value (kept between min_value and max_value)
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_gauge_set_value(gui_gauge_t *gauge, int32_t value);  /* This moves the needle */
+
+/* ===== Spinning Circles ===== */
+
+/**
+ * Draw the whole spinning circle where it is now
+ * @param spinner The spinner to draw
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_spinner_draw(gui_spinner_t *spinner);  /* This paints the "please wait" circle */
+
+/**
+ * Move the spinning circle along, painting only the ends of the arc
+ * @param spinner The spinner to move
+ * @param elapsed_ms How much time passed since the last step (gui_capture_get_time_ms() makes this repeatable)
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_spinner_step(gui_spinner_t *spinner, uint32_t elapsed_ms);  /* This turns the circle a little bit */
+
+#endif /* End of GUI_GAUGE_H - we're done describing dials and circles! */
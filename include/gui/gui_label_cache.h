@@ -0,0 +1,71 @@
+/* =================== PIcoOS Word Picture Box =================== */
+/* This file keeps ready-made pictures of words that never change, so we don't have to write them again! */
+
+#ifndef GUI_LABEL_CACHE_H    /* This is a special guard that makes sure we only include this file once */
+#define GUI_LABEL_CACHE_H
+
+#include <stdint.h>          /* This gives us special number types */
+#include "os_config.h"       /* This gets our special settings */
+#include "gui/gui_manager.h" /* This gives us GUI status messages */
+#include "drivers/display.h" /* This gives us colors */
+
+/*
+ * Custom draw code that paints the same words over and over (button hints,
+ * headings) calls gui_label_cache_draw() in place of a plain text draw.
+ * The first draw rasterizes the whole string once into an 8-bit coverage
+ * buffer and packs it as a 1bpp or 4bpp alpha bitmap (GUI_LABEL_CACHE_BPP).
+ * Later draws expand the bitmap row by row through a small fg/bg palette
+ * and blit it; no glyph is touched again. gui_font_rasterize() fits the
+ * rasterizer callback:
+ *
+ *     gui_label_cache_init(gui_font_rasterize);
+ *     ...
+ *     if (gui_label_cache_draw(x, y, text, font, fg, bg) == GUI_ERROR_MEMORY) {
+ *         gui_font_draw_text(x, y, text, font, fg, bg);
+ *     }
+ *
+ *
+ * Entries are keyed by text, font and depth and stay under
+ * GUI_LABEL_CACHE_BUDGET_BYTES, evicting the least recently drawn first.
+ * Colors are not part of the key, so theme changes reuse the bitmaps.
+ */
+
+/* ===== The Word Painter ===== */
+// Rasterizer callback - paints words as shades of coverage (0 = empty, 255 = fully inked)
+typedef void (*gui_label_rasterizer_t)(const char *text, uint8_t font, uint8_t *coverage, uint16_t width, uint16_t height);  /* This paints words into a gray practice sheet */
+
+/* ===== Setting Up the Box ===== */
+
+/**
+ * Get the word picture box ready
+ * @param rasterizer Who paints new word pictures for us
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_label_cache_init(gui_label_rasterizer_t rasterizer);  /* This is like opening an empty sticker album */
+
+/**
+ * Throw away every word picture (for example when fonts change)
+ */
+void gui_label_cache_clear(void);  /* This is like emptying the sticker album */
+
+/* ===== Drawing Words ===== */
+
+/**
+ * Draw words using a ready-made picture, making the picture first if we don't have one
+ * @param x Where to start drawing (how far across from left)
+ * @param y Where to start drawing (how far down from top)
+ * @param text The words to draw
+ * @param font Which style of letters to use
+ * @param color What color to make the words
+ * @param bg_color What color to put behind the words
+ * @return GUI_OK, or GUI_ERROR_MEMORY if the picture can't be kept (draw the words the normal way)
+ */
+gui_status_t gui_label_cache_draw(int16_t x, int16_t y, const char *text, uint8_t font, display_color_t color, display_color_t bg_color);  /* This is like using a rubber stamp */
+
+/**
+ * Ask how much memory the word pictures are using
+ * @return How many bytes all word pictures take up
+ */
+uint32_t gui_label_cache_memory_used(void);  /* This checks how full our sticker album is */
+
+#endif /* End of GUI_LABEL_CACHE_H - we're done describing the word picture box! */
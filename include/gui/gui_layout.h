@@ -0,0 +1,159 @@
+/* =================== PIcoOS Automatic Arranger =================== */
+/* This file lines things up on the screen for us, so nobody has to count dots by hand! */
+
+#ifndef GUI_LAYOUT_H    /* This is a special guard that makes sure we only include this file once */
+#define GUI_LAYOUT_H
+
+#include <stdint.h>          /* This gives us special number types */
+#include "os_config.h"       /* This gets our special settings */
+#include "gui/gui_manager.h" /* This gives us screen things */
+
+/*
+ * A layout tree mirrors the element tree. Containers stack their children
+ * in a row or a column with padding, gaps, main-axis justification,
+ * cross-axis alignment and grow factors, then push the result into the
+ * elements with gui_set_position()/gui_set_size() (positions are relative
+ * to the parent element, like the rest of gui_manager).
+ *
+ * Every node caches its measured size. Changing content invalidates the
+ * node and its ancestors up to the first container with a fixed width and
+ * height; only that container's subtree is measured and arranged again on
+ * the next gui_layout_update(). Elements whose rectangle did not change are
+ * not touched at all.
+ *
+ * gui_manager does not report content changes itself: whoever changes a
+ * label's words also reports them and runs the update, under one lock if
+ * more than one task does it:
+ *
+ *     gui_set_text(label, text);
+ *     gui_layout_text_changed(label, text, font);
+ *     gui_layout_update();
+ *
+ * Images and other non-text content use gui_layout_set_content_size().
+ */
+
+/* ===== Which Way to Line Things Up ===== */
+// Layout directions - how a box lines up the things inside it
+typedef enum {
+    GUI_LAYOUT_NONE = 0,     /* Stack everything in the same corner - like a pile of papers */
+    GUI_LAYOUT_ROW,          /* Side by side - like kids holding hands */
+    GUI_LAYOUT_COLUMN        /* One under another - like a stack of blocks */
+} gui_layout_dir_t;
+
+/* ===== Where to Put Things ===== */
+// Alignment - where things go inside the space they have
+typedef enum {
+    GUI_ALIGN_START = 0,     /* At the beginning (left or top) */
+    GUI_ALIGN_CENTER,        /* In the middle */
+    GUI_ALIGN_END,           /* At the end (right or bottom) */
+    GUI_ALIGN_STRETCH,       /* Stretched to fill the whole space (sideways direction only) */
+    GUI_ALIGN_SPACE_BETWEEN  /* Spread out with equal gaps (line-up direction only) */
+} gui_align_t;
+
+/* ===== Special Tags for Arranged Things ===== */
+// Opaque handle for a layout node - like a name tag on each thing the arranger looks after
+typedef struct gui_layout_node_s* gui_layout_node_t;  /* This is our special tag for an arranged thing */
+
+#if OS_CONFIG_ENABLE_GUI   /* Only describe the real drawing jobs when we have a screen */
+
+/* ===== Building the Arrangement ===== */
+
+/**
+ * Ask the arranger to look after a thing on the screen
+ * @param element The screen thing to arrange (NULL for an invisible group)
+ * @param parent The box it lives in, or NULL if it is the whole screen
+ * @return A special tag for the arranged thing, or NULL if the arranger is full
+ */
+gui_layout_node_t gui_layout_create(gui_element_t element, gui_layout_node_t parent);  /* This is like adding a block to the stack */
+
+/**
+ * Stop arranging a thing (and everything inside it)
+ * @param node The special tag for the arranged thing
+ */
+void gui_layout_delete(gui_layout_node_t node);  /* This is like taking a block out of the stack */
+
+/* ===== Arrangement Rules ===== */
+
+/**
+ * Choose which way a box lines up the things inside it
+ * @param node The box
+ * @param dir Row, column, or none
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_layout_set_direction(gui_layout_node_t node, gui_layout_dir_t dir);  /* This is like choosing to line up in a row or a column */
+
+/**
+ * Leave some empty space inside the edges of a box
+ * @param node The box
+ * @param left Space on the left side
+ * @param top Space on the top side
+ * @param right Space on the right side
+ * @param bottom Space on the bottom side
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_layout_set_padding(gui_layout_node_t node, uint8_t left, uint8_t top, uint8_t right, uint8_t bottom);  /* This is like a picture frame's border */
+
+/**
+ * Leave some empty space between the things inside a box
+ * @param node The box
+ * @param gap How many dots between neighbors
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_layout_set_gap(gui_layout_node_t node, uint8_t gap);  /* This is like keeping an arm's length apart */
+
+/**
+ * Choose where the things inside a box go
+ * @param node The box
+ * @param justify Where things go along the line (start, center, end, or space between)
+ * @param align Where things go sideways (start, center, end, or stretch)
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_layout_set_align(gui_layout_node_t node, gui_align_t justify, gui_align_t align);  /* This is like deciding where to stand in line */
+
+/**
+ * Let a thing grow to take up left-over space in its box
+ * @param node The thing
+ * @param grow How greedy it is (0 means it does not grow)
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_layout_set_grow(gui_layout_node_t node, uint8_t grow);  /* This is like a balloon filling the empty space */
+
+/**
+ * Give a thing an exact size instead of sizing it by what is inside
+ * A box with both an exact width and height keeps changes inside it from moving anything outside it
+ * @param node The thing
+ * @param width How wide (0 means size by what is inside)
+ * @param height How tall (0 means size by what is inside)
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_layout_set_fixed_size(gui_layout_node_t node, uint16_t width, uint16_t height);  /* This is like choosing a box that never stretches */
+
+/**
+ * Tell the arranger how big a thing's own content is (words, pictures, ...)
+ * @param node The thing
+ * @param width How wide the content is
+ * @param height How tall the content is
+ * @return Message telling us if it worked or not
+ */
+gui_status_t gui_layout_set_content_size(gui_layout_node_t node, uint16_t width, uint16_t height);  /* This is like telling the arranger how big a toy is */
+
+/* ===== Keeping Things Arranged ===== */
+
+/**
+ * Tell the arranger that the words on a thing changed (call it right after gui_set_text)
+ * @param element The screen thing whose words changed
+ * @param text The new words
+ * @param font Which style of letters is used to measure them
+ */
+void gui_layout_text_changed(gui_element_t element, const char *text, uint8_t font);  /* This is like saying "my name tag got longer" */
+
+/**
+ * Rearrange everything that changed since last time (call it after reporting changes)
+ */
+void gui_layout_update(void);  /* This is like tidying up only the messy shelves */
+
+#else
+#include "gui/gui_layout_headless.h"  /* No screen: every drawing job becomes an empty do-nothing helper */
+#endif /* OS_CONFIG_ENABLE_GUI */
+
+#endif /* End of GUI_LAYOUT_H - we're done describing the automatic arranger! */
@@ -0,0 +1,60 @@
+/* =================== PIcoOS Pretend Arranger =================== */
+/* This file stands in for the automatic arranger when our tiny computer doesn't have a screen! */
+
+#ifndef GUI_LAYOUT_HEADLESS_H    /* This is a special guard that makes sure we only include this file once */
+#define GUI_LAYOUT_HEADLESS_H
+
+/*
+ * Included by gui/gui_layout.h when OS_CONFIG_ENABLE_GUI is 0. Nodes are
+ * never created, so every setter sees NULL and reports GUI_ERROR_NO_DISPLAY.
+ */
+
+static inline gui_layout_node_t gui_layout_create(gui_element_t element, gui_layout_node_t parent) {
+    GUI_HEADLESS_UNUSED(element); GUI_HEADLESS_UNUSED(parent);
+    return NULL;
+}
+
+static inline void gui_layout_delete(gui_layout_node_t node) { GUI_HEADLESS_UNUSED(node); }
+
+static inline gui_status_t gui_layout_set_direction(gui_layout_node_t node, gui_layout_dir_t dir) {
+    GUI_HEADLESS_UNUSED(node); GUI_HEADLESS_UNUSED(dir);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline gui_status_t gui_layout_set_padding(gui_layout_node_t node, uint8_t left, uint8_t top, uint8_t right, uint8_t bottom) {
+    GUI_HEADLESS_UNUSED(node); GUI_HEADLESS_UNUSED(left); GUI_HEADLESS_UNUSED(top); GUI_HEADLESS_UNUSED(right); GUI_HEADLESS_UNUSED(bottom);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline gui_status_t gui_layout_set_gap(gui_layout_node_t node, uint8_t gap) {
+    GUI_HEADLESS_UNUSED(node); GUI_HEADLESS_UNUSED(gap);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline gui_status_t gui_layout_set_align(gui_layout_node_t node, gui_align_t justify, gui_align_t align) {
+    GUI_HEADLESS_UNUSED(node); GUI_HEADLESS_UNUSED(justify); GUI_HEADLESS_UNUSED(align);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline gui_status_t gui_layout_set_grow(gui_layout_node_t node, uint8_t grow) {
+    GUI_HEADLESS_UNUSED(node); GUI_HEADLESS_UNUSED(grow);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline gui_status_t gui_layout_set_fixed_size(gui_layout_node_t node, uint16_t width, uint16_t height) {
+    GUI_HEADLESS_UNUSED(node); GUI_HEADLESS_UNUSED(width); GUI_HEADLESS_UNUSED(height);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline gui_status_t gui_layout_set_content_size(gui_layout_node_t node, uint16_t width, uint16_t height) {
+    GUI_HEADLESS_UNUSED(node); GUI_HEADLESS_UNUSED(width); GUI_HEADLESS_UNUSED(height);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline void gui_layout_text_changed(gui_element_t element, const char *text, uint8_t font) {
+    GUI_HEADLESS_UNUSED(element); GUI_HEADLESS_UNUSED(text); GUI_HEADLESS_UNUSED(font);
+}
+
+static inline void gui_layout_update(void) {}
+
+#endif /* End of GUI_LAYOUT_HEADLESS_H - we're done pretending to arrange! */
@@ -5,6 +5,7 @@
 #define GUI_MANAGER_H
 
 #include <stdint.h>          /* This gives us special number types */
+#include "os_config.h"       /* This gets our special settings */
 #include "drivers/display.h"  /* This lets us talk to the screen */
 
 /* ===== Picture Maker Problem Messages ===== */
@@ -49,6 +50,15 @@ typedef enum {
 // Opaque handle for UI elements - a special name tag for things on screen
 typedef void* gui_element_t;  /* This is like a special sticker we put on each thing */
 
+/* ===== A Box on the Screen ===== */
+// Screen rectangle - a box described by its top-left corner and size
+typedef struct {
+    int16_t x;          /* How far across the screen the box starts (from left) */
+    int16_t y;          /* How far down the screen the box starts (from top) */
+    uint16_t width;     /* How wide the box is */
+    uint16_t height;    /* How tall the box is */
+} gui_rect_t;
+
 /* ===== Types of Things That Can Happen ===== */
 // GUI event types - different ways people can interact with the screen
 typedef enum {
@@ -79,10 +89,24 @@ typedef struct {
     } data;
 } gui_event_t;
 
+/* ===== Which Way to Move the Spotlight ===== */
+// Focus directions - where the spotlight goes when a button is pressed
+typedef enum {
+    GUI_FOCUS_UP = 0,         /* Move to the thing above - like climbing a ladder */
+    GUI_FOCUS_DOWN,           /* Move to the thing below - like going down stairs */
+    GUI_FOCUS_LEFT,           /* Move to the thing on the left */
+    GUI_FOCUS_RIGHT,          /* Move to the thing on the right */
+    GUI_FOCUS_NEXT,           /* Move to the next thing in line - like the next kid in a queue */
+    GUI_FOCUS_PREV,           /* Move to the thing before in line */
+    GUI_FOCUS_DIR_COUNT       /* How many directions there are (not a real direction) */
+} gui_focus_dir_t;
+
 /* ===== Screen Thing Doorbell ===== */
 // GUI event callback type - a function that rings when something happens on screen
 typedef void (*gui_event_callback_t)(gui_event_t* event);  /* This is called when something happens */
 
+#if OS_CONFIG_ENABLE_GUI   /* Only describe the real drawing jobs when we have a screen */
+
 /* ===== Starting the Picture Maker ===== */
 
 /**
@@ -278,4 +302,16 @@ gui_status_t gui_focus_element(gui_element_t element);  /* This is like shining
  */
 gui_element_t gui_get_focused_element(void);  /* This tells us what has the spotlight right now */
 
+/**
+ * Move the special attention to the neighbor in a direction
+ * Neighbors come from the focus map (gui/gui_focus.h), worked out ahead of time, so this is instant
+ * @param dir Which way to move the spotlight (up, down, left, right, next, previous)
+ * @return Message telling us if it worked or not (GUI_ERROR_PARAM if there is nowhere to go)
+ */
+gui_status_t gui_focus_move(gui_focus_dir_t dir);  /* This is like passing the spotlight to a neighbor */
+
+#else
+#include "gui/gui_manager_headless.h"  /* No screen: every drawing job becomes an empty do-nothing helper */
+#endif /* OS_CONFIG_ENABLE_GUI */
+
 #endif /* End of GUI_MANAGER_H - we're done describing our picture maker! */
@@ -0,0 +1,83 @@
+/* =================== PIcoOS Pretend Picture Maker =================== */
+/* This file stands in for the picture maker when our tiny computer doesn't have a screen! */
+
+#ifndef GUI_MANAGER_HEADLESS_H    /* This is a special guard that makes sure we only include this file once */
+#define GUI_MANAGER_HEADLESS_H
+
+/*
+ * Included by gui/gui_manager.h when OS_CONFIG_ENABLE_GUI is 0. Every call
+ * becomes an inline no-op: creators return NULL, setters report
+ * GUI_ERROR_NO_DISPLAY and button handlers do nothing. gui_manager and
+ * LVGL are not compiled or linked in this configuration.
+ */
+
+#define GUI_HEADLESS_UNUSED(x) ((void)(x))  /* Quietly ignore a setting we can't use */
+
+static inline gui_status_t gui_init(void) { return GUI_ERROR_NO_DISPLAY; }
+static inline void gui_deinit(void) {}
+static inline void gui_update(void) {}
+static inline gui_status_t gui_set_theme(gui_theme_t theme) { GUI_HEADLESS_UNUSED(theme); return GUI_ERROR_NO_DISPLAY; }
+
+static inline gui_element_t gui_create_element(gui_element_type_t type, gui_element_t parent) {
+    GUI_HEADLESS_UNUSED(type); GUI_HEADLESS_UNUSED(parent);
+    return NULL;
+}
+
+static inline void gui_delete_element(gui_element_t element) { GUI_HEADLESS_UNUSED(element); }
+
+static inline gui_status_t gui_set_position(gui_element_t element, int16_t x, int16_t y) {
+    GUI_HEADLESS_UNUSED(element); GUI_HEADLESS_UNUSED(x); GUI_HEADLESS_UNUSED(y);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline gui_status_t gui_set_size(gui_element_t element, uint16_t width, uint16_t height) {
+    GUI_HEADLESS_UNUSED(element); GUI_HEADLESS_UNUSED(width); GUI_HEADLESS_UNUSED(height);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline gui_status_t gui_set_text(gui_element_t element, const char* text) {
+    GUI_HEADLESS_UNUSED(element); GUI_HEADLESS_UNUSED(text);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline gui_status_t gui_set_value(gui_element_t element, int32_t value) {
+    GUI_HEADLESS_UNUSED(element); GUI_HEADLESS_UNUSED(value);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline int32_t gui_get_value(gui_element_t element) { GUI_HEADLESS_UNUSED(element); return 0; }
+
+static inline gui_status_t gui_set_color(gui_element_t element, display_color_t color, uint8_t part) {
+    GUI_HEADLESS_UNUSED(element); GUI_HEADLESS_UNUSED(color); GUI_HEADLESS_UNUSED(part);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline gui_status_t gui_register_event(gui_element_t element, gui_event_type_t event_type, gui_event_callback_t callback) {
+    GUI_HEADLESS_UNUSED(element); GUI_HEADLESS_UNUSED(event_type); GUI_HEADLESS_UNUSED(callback);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline gui_element_t gui_create_msgbox(const char* title, const char* message, const char** buttons, gui_event_callback_t callback) {
+    GUI_HEADLESS_UNUSED(title); GUI_HEADLESS_UNUSED(message); GUI_HEADLESS_UNUSED(buttons); GUI_HEADLESS_UNUSED(callback);
+    return NULL;
+}
+
+static inline void* gui_load_image(const char* filename) { GUI_HEADLESS_UNUSED(filename); return NULL; }
+
+static inline gui_status_t gui_set_image(gui_element_t element, void* image) {
+    GUI_HEADLESS_UNUSED(element); GUI_HEADLESS_UNUSED(image);
+    return GUI_ERROR_NO_DISPLAY;
+}
+
+static inline void gui_handle_button_press(uint8_t button_id) { GUI_HEADLESS_UNUSED(button_id); }
+static inline void gui_handle_button_release(uint8_t button_id) { GUI_HEADLESS_UNUSED(button_id); }
+static inline void gui_handle_button_long_press(uint8_t button_id) { GUI_HEADLESS_UNUSED(button_id); }
+
+static inline gui_element_t gui_create_screen(void) { return NULL; }
+static inline gui_status_t gui_set_screen(gui_element_t screen) { GUI_HEADLESS_UNUSED(screen); return GUI_ERROR_NO_DISPLAY; }
+static inline gui_element_t gui_get_active_screen(void) { return NULL; }
+static inline gui_status_t gui_focus_element(gui_element_t element) { GUI_HEADLESS_UNUSED(element); return GUI_ERROR_NO_DISPLAY; }
+static inline gui_element_t gui_get_focused_element(void) { return NULL; }
+static inline gui_status_t gui_focus_move(gui_focus_dir_t dir) { GUI_HEADLESS_UNUSED(dir); return GUI_ERROR_NO_DISPLAY; }
+
+#endif /* End of GUI_MANAGER_HEADLESS_H - we're done pretending to draw! */
@@ -0,0 +1,108 @@
+/* =================== PIcoOS Screen Photo Album =================== */
+/* This file helps us remember squished photos of screens so we can flip back to them instantly! */
+
+#ifndef GUI_SNAPSHOT_H    /* This is a special guard that makes sure we only include this file once */
+#define GUI_SNAPSHOT_H
+
+#include <stdint.h>          /* This gives us special number types */
+#include "os_config.h"       /* This gets our special settings */
+#include "gui/gui_manager.h" /* This gives us screens and boxes */
+
+/*
+ * A screen's last full frame is kept here in bands of RGB565 rows. Each row
+ * is run-length compressed (UI screens are mostly flat color) and kept under
+ * GUI_SNAPSHOT_BUDGET_BYTES, evicting the least recently shown screen first.
+ *
+ * gui_manager does not call the album itself; whatever switches screens
+ * drives it. Take the photo with gui_snapshot_capture() (or begin/add_band/
+ * end when the frame is streamed out anyway) just before leaving a screen,
+ * report every change to a hidden screen with gui_snapshot_mark_dirty(), and
+ * try gui_snapshot_restore() first when coming back:
+ *
+ *     gui_snapshot_capture(current);
+ *     if (gui_snapshot_restore(next, dirty, &count) == GUI_OK) {
+ *         // Only the dirty rectangles need painting again
+ *     } else {
+ *         // No photo: paint the whole of next
+ *     }
+ *
+ * Too many changes, a theme change or a relayout should drop the snapshot
+ * (gui_snapshot_drop()) so the screen is drawn from scratch.
+ *
+ * The whole album is skipped when GUI_ENABLE_SNAPSHOT_CACHE is 0.
+ */
+
+/* ===== Taking a Photo ===== */
+
+/**
+ * Start taking a photo of a screen (replaces any older photo of it)
+ * @param screen The screen we are taking a photo of
+ * @param width How many dots wide the photo is
+ * @param height How many dots tall the photo is
+ * @return GUI_OK, or GUI_ERROR_PARAM if photos are turned off or the size is too big
+ */
+gui_status_t gui_snapshot_begin(gui_element_t screen, uint16_t width, uint16_t height);  /* This is like pointing the camera */
+
+/**
+ * Add a strip of rows to the photo we are taking
+ * @param y Which row the strip starts at
+ * @param rows How many rows are in the strip
+ * @param pixels The colored dots of the strip (16-bit RGB565)
+ * @param stride How many dots to skip from one row to the next
+ * @return GUI_OK, or GUI_ERROR_MEMORY if the photo does not fit in the budget
+ */
+gui_status_t gui_snapshot_add_band(uint16_t y, uint16_t rows, const uint16_t *pixels, uint16_t stride);  /* This is like developing one strip of film */
+
+/**
+ * Finish taking the photo and put it in the album
+ * @return GUI_OK, or an error if the photo is missing rows or ran out of memory
+ */
+gui_status_t gui_snapshot_end(void);  /* This is like sticking the photo in the album */
+
+/**
+ * Take a photo of what the display shows right now, in one go
+ * @param screen The screen that is showing
+ * @return GUI_OK, GUI_ERROR_PARAM if photos are turned off or the screen can't be read, or GUI_ERROR_MEMORY if it does not fit
+ */
+gui_status_t gui_snapshot_capture(gui_element_t screen);  /* This is like pressing the camera button once */
+
+/* ===== Keeping Photos Honest ===== */
+
+/**
+ * Tell the album that part of a hidden screen changed
+ * @param screen The screen that changed
+ * @param rect The box on that screen that needs redrawing
+ */
+void gui_snapshot_mark_dirty(gui_element_t screen, const gui_rect_t *rect);  /* This is like putting a sticky note on an old photo */
+
+/**
+ * Throw away the photo of a screen
+ * @param screen The screen whose photo is old, or NULL to empty the whole album
+ */
+void gui_snapshot_drop(gui_element_t screen);  /* This is like tearing up a photo that isn't true anymore */
+
+/* ===== Using a Photo ===== */
+
+/**
+ * Check if we have a photo of a screen
+ * @param screen The screen to look for
+ * @return 1 if we have a usable photo, 0 if not
+ */
+uint8_t gui_snapshot_has(gui_element_t screen);  /* This asks "do we have a photo of this page?" */
+
+/**
+ * Draw the photo of a screen and tell us which spots still need redrawing
+ * @param screen The screen to show
+ * @param dirty A list with room for GUI_SNAPSHOT_MAX_DIRTY boxes that changed since the photo
+ * @param dirty_count A place to store how many boxes were put in the list
+ * @return GUI_OK, or GUI_ERROR_PARAM if we have no photo (draw the screen the normal way)
+ */
+gui_status_t gui_snapshot_restore(gui_element_t screen, gui_rect_t *dirty, uint8_t *dirty_count);  /* This is like holding up the photo and fixing the sticky-note spots */
+
+/**
+ * Ask how much memory the album is using
+ * @return How many bytes all the squished photos take up
+ */
+uint32_t gui_snapshot_memory_used(void);  /* This checks how full our photo album is */
+
+#endif /* End of GUI_SNAPSHOT_H - we're done describing the photo album! */
@@ -8,7 +8,9 @@
 
 /* ===== Turn Special Features On or Off ===== */
 // Feature configuration - like light switches for different parts of our system
+#ifndef OS_CONFIG_ENABLE_GUI          /* The build can switch this off for boxes without a screen (PICO_OS_HEADLESS) */
 #define OS_CONFIG_ENABLE_GUI        1   /* 1 means ON, 0 means OFF - this is for pretty pictures */
+#endif
 #define OS_CONFIG_ENABLE_AUDIO      1   /* 1 means ON, 0 means OFF - this is for making sounds */
 #define OS_CONFIG_ENABLE_SDCARD     1   /* 1 means ON, 0 means OFF - this is for saving files */
 
@@ -50,6 +52,99 @@ typedef enum {
 #define ENABLE_DMA_TRANSFERS        1   /* Turn ON special data moving tricks */
 #define ENABLE_INSTRUCTION_PREFETCH 1   /* Turn ON looking ahead at instructions */
 
+/* ===== Screen Drawing Settings ===== */
+// GUI tuning - limits for the picture maker
+#define GUI_FOCUS_MAX_NODES         64     /* How many things on one screen can get the spotlight (64 maximum) */
+#define GUI_ENABLE_SNAPSHOT_CACHE   1      /* 1 means ON - remember squished pictures of recent screens so flipping back is instant */
+#define GUI_SNAPSHOT_SLOTS          3      /* How many screens we remember pictures of */
+#define GUI_SNAPSHOT_BUDGET_BYTES   (24 * 1024)  /* 24KB - the most memory all remembered pictures may use together */
+#define GUI_SNAPSHOT_MAX_DIRTY      8      /* How many changed spots we remember per picture before giving up on it */
+#define GUI_SNAPSHOT_MAX_WIDTH      320    /* The widest screen (in dots) we can take pictures of */
+#define GUI_LAYOUT_MAX_NODES        48     /* How many things the automatic arranger can look after */
+#define GUI_LAYOUT_MAX_DIRTY_ROOTS  8      /* How many boxes can wait to be rearranged before we redo the whole screen */
+#define GUI_LABEL_CACHE_ENTRIES     16     /* How many ready-made word pictures we keep */
+#define GUI_LABEL_CACHE_BUDGET_BYTES (8 * 1024)  /* 8KB - the most memory all word pictures may use together */
+#define GUI_LABEL_CACHE_BPP         4      /* Dots per word picture: 1 = crisp black/white, 4 = smooth edges (16 shades) */
+#define GUI_LABEL_MAX_WIDTH         480    /* The widest word picture (in dots) we will make */
+#define GUI_FONT_MAX_FONTS          4      /* How many letter styles we can load at once */
+#define GUI_FONT_MAX_PAGES          512    /* The most pages of letters one letter style may have */
+#define GUI_FONT_PAGE_CACHE_SLOTS   3      /* How many pages of letters from the memory card we keep in memory */
+#define GUI_FONT_PAGE_MAX_BYTES     2560   /* The biggest page of letters (in bytes) we can keep */
+#define GUI_CAPTURE_BAND_ROWS       8      /* How many rows of the screen we copy at a time when taking a screenshot */
+#define GUI_CAPTURE_MAX_WIDTH       320    /* The widest screen (in dots) we can take screenshots of */
+
+/* ===== Sound Output Settings ===== */
+// Audio output engine - how samples travel from memory to the speaker
+#define AUDIO_OUTPUT_USE_I2S        0      /* 0 = speaker on two PWM pins, 1 = I2S sound chip (DAC) */
+#define AUDIO_PWM_PIN               2      /* Left speaker pin for PWM (right is the next pin; must be even so both share one PWM slice) */
+#define AUDIO_I2S_DATA_PIN          9      /* The pin that carries I2S sound data (kept off 26-29 so the analog microphone has them) */
+#define AUDIO_I2S_CLOCK_PIN_BASE    10     /* Bit clock on this pin, left/right clock on the next one */
+#define AUDIO_I2S_PIO               0      /* Which PIO block runs the I2S program (0 or 1) */
+#define AUDIO_OUTPUT_DMA_IRQ        1      /* Which DMA interrupt line (0 or 1) tells us a buffer finished playing */
+#define AUDIO_OUTPUT_MAX_BUFFERS    8      /* The most sound buffers that can wait in line for the speaker */
+#define AUDIO_DEFAULT_BUFFER_COUNT  4      /* Sound buffers used when the settings don't say (more = survives longer hiccups, but reacts later) */
+#define AUDIO_DEFAULT_BUFFER_FRAMES 512    /* Sound points per buffer when the settings don't say (512 at 44.1kHz is about 12ms) */
+#define AUDIO_OUTPUT_WAIT_MS        100    /* Longest the sound worker sleeps waiting for an empty buffer */
+#define AUDIO_PIPELINE_MAX_STAGES   6      /* The most workers on one sound assembly line (read, decode, resample, mix, output...) */
+#define AUDIO_PIPELINE_STACK_SIZE   768    /* Desk size (in words) for each sound worker that gets its own task */
+#define AUDIO_PIPELINE_IDLE_MS      10     /* Longest a sound worker naps when it has nothing to do */
+#define AUDIO_MIXER_VOICES          8      /* How many sound effects can play on top of the music at once (at most 16) */
+#define AUDIO_MIXER_TRIGGERS        8      /* Sound effects that can be waiting to start at once (lock-free triggers) */
+#define AUDIO_BANK_SOUNDS           16     /* How many sounds the sound bank can hold (at most 16) */
+#define AUDIO_QUEUE_MAX_TRACKS      4      /* How many songs can wait in line to play next */
+#define AUDIO_DSP_EQ_BANDS          5      /* How many tone-control bands the equalizer has */
+#define AUDIO_DSP_RAMP_MS           20     /* How long a volume change takes to glide to the new level */
+#define AUDIO_DSP_BUDGET_PCT        4      /* The most of one core the tone controls may use */
+
+// Audio tap and spectrum analyzer - a copy of what plays, for visualizers
+#define AUDIO_TAP_RING_BYTES        4096   /* Tapped sound that can wait for the visualizer (a power of two; 2048 samples) */
+#define AUDIO_TAP_MAX_DECIMATION    16     /* The most output samples averaged into one tapped sample */
+#define SPECTRUM_MIN_HZ             40     /* Where the spectrum's lowest band starts */
+#define SPECTRUM_MAX_BANDS          32     /* The most bars one spectrum can have */
+
+// Audio input engine and recorder - voice memos from a microphone to the memory card
+#define AUDIO_INPUT_PDM_CLOCK_PIN   20     /* The pin that clocks a digital (PDM) microphone */
+#define AUDIO_INPUT_PDM_DATA_PIN    21     /* The pin the digital microphone answers on */
+#define AUDIO_INPUT_PDM_PIO         1      /* Which PIO block runs the microphone program (the other one from I2S) */
+#define AUDIO_INPUT_ADC_PIN         26     /* The pin an analog microphone amplifier is on (26 to 29; must not be an I2S pin) */
+#define AUDIO_INPUT_DMA_IRQ         0      /* Which DMA interrupt line tells us a capture buffer is full (not the output's) */
+#define AUDIO_INPUT_BUFFER_COUNT    4      /* How many capture buffers the microphone fills in turn */
+#define AUDIO_INPUT_BUFFER_FRAMES   128    /* Sound points per capture buffer (128 at 16kHz is 8ms) */
+#define AUDIO_RECORD_DEFAULT_RATE   16000  /* Recording speed when the settings don't say (16kHz is plenty for voices) */
+#define AUDIO_RECORD_DEFAULT_SECONDS 600   /* Longest recording when the settings don't say (card space is reserved for it) */
+#define AUDIO_RECORD_RING_BYTES     16384  /* Recorded sound that can wait for a slow card (a power of two; 16KB is 0.5s at 16kHz) */
+#define AUDIO_RECORD_WRITE_BYTES    4096   /* Recorded sound written to the card at once (whole sectors; a power of two up to the ring) */
+#define AUDIO_RECORD_ADPCM_BLOCK    256    /* Bytes in one IMA ADPCM block when recording (505 samples; must hold a capture buffer) */
+#define AUDIO_RECORD_CAPTURE_PRIORITY AUDIO_TASK_PRIORITY  /* The microphone worker is as important as the sound player */
+#define AUDIO_RECORD_WRITER_PRIORITY  GUI_TASK_PRIORITY    /* The card writer can wait - the pipe covers it */
+#define AUDIO_RECORD_STOP_MS        1000   /* Longest audio_record_stop() waits for the card to catch up */
+
+/* ===== Sound Decoder Settings ===== */
+// Compressed audio decoders - how much of the file each decoder keeps at hand
+#define MP3_DECODER_INPUT_BYTES     2048   /* MP3 bytes kept ready for the decoder (must hold the biggest frame: 1441 bytes at 320 kbps) */
+#define MP3_BENCHMARK_MAX_ROWS      16     /* How many different bitrates the MP3 speed test keeps apart */
+#define MP3_INDEX_TOC_ENTRIES       128    /* Most Xing/VBRI table points an MP3 seek index keeps (at least 100) */
+#define MP3_INDEX_WRITE_ENTRIES     128    /* MP3 frame positions saved to the card at once while building a seek index */
+#define FLAC_DECODER_MAX_BLOCK_SIZE 4608   /* Biggest FLAC block we accept (the FLAC "subset" limit up to 48 kHz) */
+#define FLAC_DECODER_CACHE_BYTES    1024   /* FLAC bytes read from the card at once */
+#define VORBIS_DECODER_HEAP_BUDGET  (56 * 1024)  /* Most heap the OGG decoder may use (files that need more are refused) */
+#define VORBIS_DECODER_CACHE_SETUP  1      /* 1 means ON - keep the last OGG file's setup so playing it again starts fast */
+#define WAV_READER_BOUNCE_BYTES     512    /* WAV bytes converted at once when a file can't go straight to the speaker (one card sector) */
+#define WAV_ADPCM_MAX_BLOCK         4096   /* Biggest ADPCM block we accept (the reader keeps one block in memory) */
+#define RESAMPLER_BLOCK_FRAMES      64     /* Sound frames the speed changer takes in at once (on top of its filter length) */
+#define RESAMPLER_DEFAULT_QUALITY   RESAMPLER_QUALITY_BALANCED  /* How carefully songs at other speeds are converted */
+#define AUDIO_BANK_RESAMPLE_QUALITY RESAMPLER_QUALITY_BEST      /* How carefully bank sounds at other speeds are converted (only once, when loaded) */
+
+/* ===== Speed Measuring Settings ===== */
+// Input-to-photon latency - how long from a button press until the screen shows the answer
+#define SYSTEM_ENABLE_LATENCY_TRACE 1      /* 1 means ON - time every button press until its picture reaches the screen */
+#define SYSTEM_LATENCY_BUCKETS      16     /* How many boxes the waiting times get sorted into (the last box catches all slow ones) */
+#define SYSTEM_LATENCY_BUCKET_US    4000   /* How wide each box is (4000 microseconds = 4ms, so 16 boxes cover 64ms) */
+
+// Audio telemetry - how smoothly the music plays (see audio_get_telemetry)
+#define AUDIO_TELEMETRY_BUCKETS     14     /* How many boxes audio timings get sorted into (the last box catches all slow ones) */
+#define AUDIO_TELEMETRY_BUCKET_US   64     /* How wide the first box is (each next box is twice as wide, so 14 boxes reach past 260ms) */
+
 /* ===== Memory Space Settings ===== */
 // Memory management - how much space we have for toys
 #define HEAP_SIZE                   (64 * 1024)  /* 64KB (that's 65,536 bytes!) of memory for all our needs */
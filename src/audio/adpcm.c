@@ -0,0 +1,387 @@
+#include "audio/adpcm.h"
+#include "audio/dsp_kernels.h"
+#include <stdatomic.h>
+#include <string.h>
+
+#define IMA_STEPS           89
+#define IMA_ROW_SHIFT       3       // A table row is 8 entries, one per nibble magnitude
+#define IMA_DIFF_MASK       0xFFFFu
+#define IMA_NEXT_SHIFT      16
+#define MS_PREDICTORS       7
+#define MS_MIN_DELTA        16
+
+// The standard IMA step sizes
+static const int16_t imaStepTable[IMA_STEPS] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+    34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+    157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+    724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+    3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// How the step index moves after each nibble magnitude
+static const int8_t imaIndexTable[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+// MS step size adaptation (Q8) and the standard predictor pairs (Q8)
+static const int16_t msAdaptTable[16] = {
+    230, 230, 230, 230, 307, 409, 512, 614, 768, 614, 512, 409, 307, 230, 230, 230
+};
+static const int16_t msCoef1[MS_PREDICTORS] = { 256, 512, 0, 192, 240, 460, 392 };
+static const int16_t msCoef2[MS_PREDICTORS] = { 0, -256, 0, 64, 0, -208, -232 };
+
+// Row (index x 8) + nibble magnitude -> difference in the low half, next row in the high half
+static uint32_t imaTable[IMA_STEPS << IMA_ROW_SHIFT];
+static atomic_uint_least8_t imaTableReady = 0;    // Set with release once imaTable is filled in
+
+// Function declarations for internal functions
+static void build_ima_table(void);
+static inline int32_t ima_expand(int32_t *predictor, int32_t *row, uint32_t nibble);
+static inline int32_t ms_expand(adpcm_decoder_t *decoder, uint8_t channel, uint32_t nibble);
+static uint16_t read_ima(adpcm_decoder_t *decoder, uint32_t *frames, uint16_t count);
+static uint16_t read_ms(adpcm_decoder_t *decoder, uint32_t *frames, uint16_t count);
+static int16_t read_le16(const uint8_t *data);
+
+uint16_t adpcm_samples_per_block(adpcm_type_t type, uint8_t channels, uint16_t block_align) {
+    if (channels == 0 || channels > 2) {
+        return 0;
+    }
+    if (type == ADPCM_IMA) {
+        uint32_t header = 4u * channels;
+        if (block_align < header + 4u * channels) {
+            return 0;
+        }
+        // One sample in the header, then 8 per 4-byte group per channel
+        return (uint16_t)(((block_align - header) / (4u * channels)) * 8u + 1u);
+    }
+    uint32_t header = 7u * channels;
+    if (block_align <= header) {
+        return 0;
+    }
+    // Two samples in the header, then two nibbles per byte shared by the channels
+    uint32_t frames = (block_align - header) * 2u / channels + 2u;
+    return (frames > UINT16_MAX) ? 0 : (uint16_t)frames;
+}
+
+uint16_t adpcm_block_frames(const adpcm_format_t *format, uint32_t bytes) {
+    if (format == NULL || format->channels == 0 || format->channels > 2) {
+        return 0;
+    }
+    uint8_t channels = format->channels;
+    if (bytes > format->block_align) {
+        bytes = format->block_align;
+    }
+
+    uint32_t frames;
+    if (format->type == ADPCM_IMA) {
+        uint32_t header = 4u * channels;
+        if (bytes < header) {
+            return 0;
+        }
+        uint32_t data = bytes - header;
+        frames = 1u + (data / (4u * channels)) * 8u;
+        if (channels == 1) {
+            frames += (data % 4u) * 2u;    // Mono groups are just consecutive bytes
+        }
+    } else {
+        uint32_t header = 7u * channels;
+        if (bytes < header) {
+            return 0;
+        }
+        frames = 2u + (bytes - header) * 2u / channels;
+    }
+    if (frames > format->samples_per_block) {
+        frames = format->samples_per_block;
+    }
+    return (uint16_t)frames;
+}
+
+void adpcm_decoder_init(adpcm_decoder_t *decoder, const adpcm_format_t *format) {
+    if (decoder == NULL || format == NULL) {
+        return;
+    }
+    build_ima_table();
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->format = *format;
+}
+
+audio_status_t adpcm_decoder_start_block(adpcm_decoder_t *decoder, const uint8_t *block, uint32_t bytes) {
+    if (decoder == NULL || block == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    uint8_t channels = decoder->format.channels;
+    uint16_t frames = adpcm_block_frames(&decoder->format, bytes);
+    decoder->block_frames = 0;
+    decoder->position = 0;
+    if (frames == 0) {
+        return AUDIO_ERROR_FORMAT;
+    }
+
+    if (decoder->format.type == ADPCM_IMA) {
+        for (uint8_t c = 0; c < channels; c++) {
+            const uint8_t *header = block + 4u * c;
+            if (header[2] >= IMA_STEPS) {
+                return AUDIO_ERROR_FORMAT;
+            }
+            decoder->sample1[c] = read_le16(header);
+            decoder->step[c] = (int32_t)header[2] << IMA_ROW_SHIFT;
+        }
+    } else {
+        for (uint8_t c = 0; c < channels; c++) {
+            uint8_t predictor = block[c];
+            if (predictor >= MS_PREDICTORS) {
+                return AUDIO_ERROR_FORMAT;
+            }
+            decoder->coef1[c] = msCoef1[predictor];
+            decoder->coef2[c] = msCoef2[predictor];
+            decoder->step[c] = read_le16(block + channels + 2u * c);
+            decoder->sample1[c] = read_le16(block + 3u * channels + 2u * c);
+            decoder->sample2[c] = read_le16(block + 5u * channels + 2u * c);
+        }
+    }
+
+    decoder->block = block;
+    decoder->block_frames = frames;
+    return AUDIO_OK;
+}
+
+uint16_t adpcm_decoder_read(adpcm_decoder_t *decoder, uint32_t *frames, uint16_t max_frames) {
+    if (decoder == NULL || frames == NULL || decoder->position >= decoder->block_frames) {
+        return 0;
+    }
+    uint16_t count = (uint16_t)(decoder->block_frames - decoder->position);
+    if (count > max_frames) {
+        count = max_frames;
+    }
+    return (decoder->format.type == ADPCM_IMA) ? read_ima(decoder, frames, count) : read_ms(decoder, frames, count);
+}
+
+uint8_t adpcm_decoder_block_done(const adpcm_decoder_t *decoder) {
+    return (decoder == NULL || decoder->position >= decoder->block_frames) ? 1 : 0;
+}
+
+audio_status_t adpcm_encoder_init(adpcm_encoder_t *encoder, uint8_t *block, uint16_t block_align) {
+    if (encoder == NULL || block == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    uint16_t perBlock = adpcm_samples_per_block(ADPCM_IMA, 1, block_align);
+    if (perBlock == 0) {
+        return AUDIO_ERROR_PARAM;
+    }
+    build_ima_table();
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->block = block;
+    encoder->block_align = block_align;
+    encoder->samples_per_block = perBlock;
+    return AUDIO_OK;
+}
+
+uint16_t adpcm_encoder_write(adpcm_encoder_t *encoder, const int16_t *pcm, uint16_t count) {
+    if (encoder == NULL || pcm == NULL) {
+        return 0;
+    }
+
+    uint8_t *block = encoder->block;
+    int32_t predictor = encoder->predictor;
+    int32_t row = encoder->row;
+    uint16_t position = encoder->position;
+    uint16_t taken = 0;
+    while (taken < count && position < encoder->samples_per_block) {
+        int32_t sample = pcm[taken++];
+        if (position == 0) {
+            // The header carries the first sample exactly and the step index we continue from
+            block[0] = (uint8_t)sample;
+            block[1] = (uint8_t)((uint16_t)sample >> 8);
+            block[2] = (uint8_t)(row >> IMA_ROW_SHIFT);
+            block[3] = 0;
+            predictor = sample;
+            position = 1;
+            continue;
+        }
+
+        // Pick each bit of the magnitude in turn, as the reference encoder does
+        int32_t step = imaStepTable[row >> IMA_ROW_SHIFT];
+        int32_t diff = sample - predictor;
+        uint32_t nibble = 0;
+        if (diff < 0) {
+            nibble = 8;
+            diff = -diff;
+        }
+        if (diff >= step) {
+            nibble |= 4;
+            diff -= step;
+        }
+        step >>= 1;
+        if (diff >= step) {
+            nibble |= 2;
+            diff -= step;
+        }
+        step >>= 1;
+        if (diff >= step) {
+            nibble |= 1;
+        }
+        // Follow the decoder's own table so both sides stay in step
+        ima_expand(&predictor, &row, nibble);
+
+        uint32_t index = position - 1u;
+        uint8_t *byte = block + 4u + (index >> 1);
+        if (index & 1u) {
+            *byte |= (uint8_t)(nibble << 4);
+        } else {
+            *byte = (uint8_t)nibble;
+        }
+        position++;
+    }
+
+    encoder->predictor = predictor;
+    encoder->row = row;
+    encoder->position = position;
+    return taken;
+}
+
+uint8_t adpcm_encoder_block_full(const adpcm_encoder_t *encoder) {
+    return (encoder != NULL && encoder->position >= encoder->samples_per_block) ? 1 : 0;
+}
+
+uint16_t adpcm_encoder_take_block(adpcm_encoder_t *encoder) {
+    if (encoder == NULL || encoder->position == 0) {
+        return 0;
+    }
+    uint16_t bytes = encoder->block_align;
+    if (encoder->position < encoder->samples_per_block) {
+        // A short block ends after its last nibble (an odd count leaves a zero nibble)
+        bytes = (uint16_t)(4u + (encoder->position / 2u));
+    }
+    encoder->position = 0;
+    return bytes;
+}
+
+// Same answer whoever gets here first, so a race between two tasks is harmless; the acquire
+// pairs with the release below so a task that sees the flag also sees the whole table
+static void build_ima_table(void) {
+    if (atomic_load_explicit(&imaTableReady, memory_order_acquire)) {
+        return;
+    }
+    for (int32_t index = 0; index < IMA_STEPS; index++) {
+        int32_t step = imaStepTable[index];
+        for (uint32_t nibble = 0; nibble < 8; nibble++) {
+            uint32_t diff = (uint32_t)(step >> 3);
+            if (nibble & 4u) {
+                diff += (uint32_t)step;
+            }
+            if (nibble & 2u) {
+                diff += (uint32_t)(step >> 1);
+            }
+            if (nibble & 1u) {
+                diff += (uint32_t)(step >> 2);
+            }
+            int32_t next = index + imaIndexTable[nibble];
+            if (next < 0) {
+                next = 0;
+            } else if (next >= IMA_STEPS) {
+                next = IMA_STEPS - 1;
+            }
+            imaTable[((uint32_t)index << IMA_ROW_SHIFT) + nibble] =
+                diff | ((uint32_t)next << (IMA_NEXT_SHIFT + IMA_ROW_SHIFT));
+        }
+    }
+    atomic_store_explicit(&imaTableReady, 1, memory_order_release);
+}
+
+// One IMA nibble: a table load, an add or subtract, a saturate and the next row
+static inline int32_t ima_expand(int32_t *predictor, int32_t *row, uint32_t nibble) {
+    uint32_t entry = imaTable[*row + (int32_t)(nibble & 7u)];
+    int32_t diff = (int32_t)(entry & IMA_DIFF_MASK);
+    int32_t value = dsp_ssat16((nibble & 8u) ? *predictor - diff : *predictor + diff);
+    *predictor = value;
+    *row = (int32_t)(entry >> IMA_NEXT_SHIFT);
+    return value;
+}
+
+// One MS nibble: predict from the last two samples, correct, and adapt the step
+static inline int32_t ms_expand(adpcm_decoder_t *decoder, uint8_t channel, uint32_t nibble) {
+    int32_t signedNibble = (int32_t)(nibble ^ 8u) - 8;
+    int32_t delta = decoder->step[channel];
+    int32_t predicted = (decoder->sample1[channel] * decoder->coef1[channel] +
+                         decoder->sample2[channel] * decoder->coef2[channel]) >> 8;
+    int32_t value = dsp_ssat16(predicted + signedNibble * delta);
+    decoder->sample2[channel] = decoder->sample1[channel];
+    decoder->sample1[channel] = value;
+    delta = (msAdaptTable[nibble] * delta) >> 8;
+    decoder->step[channel] = (delta < MS_MIN_DELTA) ? MS_MIN_DELTA : delta;
+    return value;
+}
+
+static uint16_t read_ima(adpcm_decoder_t *decoder, uint32_t *frames, uint16_t count) {
+    const uint8_t *block = decoder->block;
+    uint32_t position = decoder->position;
+    uint16_t made = 0;
+
+    if (position == 0 && made < count) {
+        int32_t right = (decoder->format.channels > 1) ? decoder->sample1[1] : decoder->sample1[0];
+        frames[made++] = dsp_pack16x2(decoder->sample1[0], right);
+        position = 1;
+    }
+
+    if (decoder->format.channels == 1) {
+        int32_t predictor = decoder->sample1[0];
+        int32_t row = decoder->step[0];
+        while (made < count) {
+            uint32_t index = position - 1u;
+            uint32_t nibble = block[4u + (index >> 1)] >> ((index & 1u) << 2);
+            int32_t value = ima_expand(&predictor, &row, nibble & 0xFu);
+            frames[made++] = dsp_pack16x2(value, value);
+            position++;
+        }
+        decoder->sample1[0] = predictor;
+        decoder->step[0] = row;
+    } else {
+        while (made < count) {
+            // Each channel has its own 4-byte group for every 8 frames
+            uint32_t index = position - 1u;
+            const uint8_t *group = block + 8u + (index >> 3) * 8u + ((index & 7u) >> 1);
+            uint32_t shift = (index & 1u) << 2;
+            int32_t left = ima_expand(&decoder->sample1[0], &decoder->step[0], (group[0] >> shift) & 0xFu);
+            int32_t right = ima_expand(&decoder->sample1[1], &decoder->step[1], (group[4] >> shift) & 0xFu);
+            frames[made++] = dsp_pack16x2(left, right);
+            position++;
+        }
+    }
+
+    decoder->position = (uint16_t)position;
+    return made;
+}
+
+static uint16_t read_ms(adpcm_decoder_t *decoder, uint32_t *frames, uint16_t count) {
+    uint8_t channels = decoder->format.channels;
+    const uint8_t *data = decoder->block + 7u * channels;
+    uint32_t position = decoder->position;
+    uint16_t made = 0;
+
+    // The header's two samples come out oldest first
+    while (position < 2u && made < count) {
+        const int32_t *sample = (position == 0) ? decoder->sample2 : decoder->sample1;
+        frames[made++] = dsp_pack16x2(sample[0], sample[channels - 1u]);
+        position++;
+    }
+
+    while (made < count) {
+        // Nibbles run high half first, channels interleaved
+        uint32_t nibbleIndex = (position - 2u) * channels;
+        int32_t left = ms_expand(decoder, 0, (data[nibbleIndex >> 1] >> ((~nibbleIndex & 1u) << 2)) & 0xFu);
+        int32_t right = left;
+        if (channels > 1) {
+            nibbleIndex++;
+            right = ms_expand(decoder, 1, (data[nibbleIndex >> 1] >> ((~nibbleIndex & 1u) << 2)) & 0xFu);
+        }
+        frames[made++] = dsp_pack16x2(left, right);
+        position++;
+    }
+
+    decoder->position = (uint16_t)position;
+    return made;
+}
+
+static int16_t read_le16(const uint8_t *data) {
+    return (int16_t)(uint16_t)(data[0] | (data[1] << 8));
+}
@@ -0,0 +1,450 @@
+#include "drivers/audio.h"
+#include "drivers/audio_output.h"
+#include "audio/dsp_kernels.h"
+#include "audio/adpcm.h"
+#include "audio/wav_reader.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdatomic.h>
+#include <string.h>
+
+#define MIXER_INDEX_BITS        4
+#define MIXER_INDEX_MASK        ((1u << MIXER_INDEX_BITS) - 1u)
+#define MIXER_GENERATION_MAX    (UINT16_MAX >> MIXER_INDEX_BITS)
+#define MIXER_ADPCM_CHUNK       32      // ADPCM frames decoded onto the stack at once
+#define MIXER_TRIGGER_FREE      0
+#define MIXER_TRIGGER_CLAIMED   1       // A trigger (or the mixer) owns the slot's fields
+#define MIXER_TRIGGER_READY     2       // Filled in and waiting for the mixer
+#define MIXER_STOP_WAIT_MS      100     // Longest audio_stop_effects_using() waits for a trigger or mixing pass
+
+#if AUDIO_MIXER_VOICES > (1 << MIXER_INDEX_BITS)
+#error "AUDIO_MIXER_VOICES must be 16 or less"
+#endif
+
+// One effect being played
+typedef struct {
+    const int16_t *samples; // PCM, or NULL for ADPCM
+    const uint8_t *blocks;  // ADPCM blocks
+    uint32_t blockBytes;    // How many bytes of blocks there are
+    uint32_t nextBlock;     // Offset of the next ADPCM block to decode
+    adpcm_decoder_t adpcm;  // Where the ADPCM decoder is within its block
+    uint32_t frames;
+    uint32_t position;      // Next frame to mix
+    uint32_t started;       // Start order, for stealing the oldest
+    int32_t gainLeft;       // Q15
+    int32_t gainRight;      // Q15
+    uint16_t generation;    // Bumped each time the voice is reused, so old handles go stale
+    uint8_t channels;
+    uint8_t priority;
+    uint8_t active;
+} mixer_voice_t;
+
+// One effect waiting for the mixer to start it (the state is the only shared field)
+typedef struct {
+    atomic_uint_least8_t state;
+    const int16_t *samples;
+    uint32_t frames;
+    uint8_t channels;
+    uint8_t gain;
+    int8_t pan;
+    uint8_t priority;
+} mixer_trigger_t;
+
+static mixer_voice_t voices[AUDIO_MIXER_VOICES];
+static uint32_t startCounter = 0;
+static mixer_trigger_t triggers[AUDIO_MIXER_TRIGGERS];
+static atomic_uint_least32_t mixPasses;     // Odd while audio_mix_effects() runs
+
+// Function declarations for internal functions
+static audio_status_t start_voice(const mixer_voice_t *setup, audio_voice_t *voice);
+static void start_triggered(void);
+static void wait_for_mix_pass(void);
+static void pan_gains(uint8_t gain, int8_t pan, int32_t *left, int32_t *right);
+static mixer_voice_t *find_voice(audio_voice_t voice);
+static void mix_voice(uint32_t *out, const mixer_voice_t *voice, uint32_t count);
+static uint32_t mix_adpcm_voice(uint32_t *out, mixer_voice_t *voice, uint32_t count);
+
+audio_status_t audio_play_effect(const int16_t *samples, uint32_t frames, uint8_t channels,
+                                 uint8_t gain, int8_t pan, uint8_t priority, audio_voice_t *voice) {
+    if (samples == NULL || frames == 0 || (channels != 1 && channels != 2)) {
+        return AUDIO_ERROR_PARAM;
+    }
+    mixer_voice_t setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.samples = samples;
+    setup.frames = frames;
+    setup.channels = channels;
+    setup.priority = priority;
+    pan_gains(gain, pan, &setup.gainLeft, &setup.gainRight);
+    audio_status_t status = start_voice(&setup, voice);
+    if (status == AUDIO_OK) {
+        audio_output_wake();    // With no song playing, the refill task may be asleep with the engine stopped
+    }
+    return status;
+}
+
+audio_status_t audio_play_effect_wav(const void *wav, size_t size, uint8_t gain, int8_t pan,
+                                     uint8_t priority, audio_voice_t *voice) {
+    if (wav == NULL || size > UINT32_MAX) {
+        return AUDIO_ERROR_PARAM;
+    }
+    wav_info_t info;
+    audio_status_t status = wav_parse_buffer(wav, (uint32_t)size, &info);
+    if (status != AUDIO_OK) {
+        return status;
+    }
+    if (info.channels > 2 || info.total_frames == 0) {
+        return AUDIO_ERROR_FORMAT;
+    }
+    const uint8_t *data = (const uint8_t *)wav + info.data_offset;
+
+    if (info.format_tag == WAV_FORMAT_PCM) {
+        // Plain 16-bit sound plays in place
+        if (info.bits_per_sample != 16 || ((uintptr_t)data & 1u) != 0) {
+            return AUDIO_ERROR_FORMAT;
+        }
+        return audio_play_effect((const int16_t *)(const void *)data, info.total_frames, (uint8_t)info.channels,
+                                 gain, pan, priority, voice);
+    }
+
+    // ADPCM stays squeezed in memory and is decoded a few frames at a time as it is mixed
+    mixer_voice_t setup;
+    memset(&setup, 0, sizeof(setup));
+    adpcm_format_t format = {
+        .type = (info.format_tag == WAV_FORMAT_IMA_ADPCM) ? ADPCM_IMA : ADPCM_MS,
+        .channels = (uint8_t)info.channels,
+        .block_align = info.block_align,
+        .samples_per_block = info.samples_per_block,
+    };
+    adpcm_decoder_init(&setup.adpcm, &format);
+    setup.blocks = data;
+    setup.blockBytes = info.data_bytes;
+    setup.frames = info.total_frames;
+    setup.channels = (uint8_t)info.channels;
+    setup.priority = priority;
+    pan_gains(gain, pan, &setup.gainLeft, &setup.gainRight);
+    status = start_voice(&setup, voice);
+    if (status == AUDIO_OK) {
+        audio_output_wake();
+    }
+    return status;
+}
+
+audio_status_t audio_trigger_effect(const int16_t *samples, uint32_t frames, uint8_t channels,
+                                    uint8_t gain, int8_t pan, uint8_t priority) {
+    if (samples == NULL || frames == 0 || (channels != 1 && channels != 2)) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    // Claim a free slot with one compare-and-swap; no lock, so any task, core or interrupt may call
+    for (uint8_t i = 0; i < AUDIO_MIXER_TRIGGERS; i++) {
+        mixer_trigger_t *t = &triggers[i];
+        uint_least8_t expected = MIXER_TRIGGER_FREE;
+        if (atomic_compare_exchange_strong_explicit(&t->state, &expected, MIXER_TRIGGER_CLAIMED,
+                                                    memory_order_acquire, memory_order_relaxed)) {
+            t->samples = samples;
+            t->frames = frames;
+            t->channels = channels;
+            t->gain = gain;
+            t->pan = pan;
+            t->priority = priority;
+            // Publishes the fields above to the mixer
+            atomic_store_explicit(&t->state, MIXER_TRIGGER_READY, memory_order_release);
+            audio_output_wake();
+            return AUDIO_OK;
+        }
+    }
+    return AUDIO_ERROR_BUSY;
+}
+
+audio_status_t audio_set_effect_gain(audio_voice_t voice, uint8_t gain, int8_t pan) {
+    int32_t gainLeft;
+    int32_t gainRight;
+    pan_gains(gain, pan, &gainLeft, &gainRight);
+
+    taskENTER_CRITICAL();
+    mixer_voice_t *v = find_voice(voice);
+    if (v != NULL) {
+        v->gainLeft = gainLeft;
+        v->gainRight = gainRight;
+    }
+    taskEXIT_CRITICAL();
+    return (v != NULL) ? AUDIO_OK : AUDIO_ERROR_PARAM;
+}
+
+audio_status_t audio_stop_effect(audio_voice_t voice) {
+    audio_status_t status = AUDIO_OK;
+    taskENTER_CRITICAL();
+    if (voice == 0) {
+        for (uint8_t i = 0; i < AUDIO_MIXER_VOICES; i++) {
+            voices[i].active = 0;
+        }
+    } else {
+        mixer_voice_t *v = find_voice(voice);
+        if (v != NULL) {
+            v->active = 0;
+        } else {
+            status = AUDIO_ERROR_PARAM;
+        }
+    }
+    taskEXIT_CRITICAL();
+    return status;
+}
+
+void audio_stop_effects_using(const int16_t *samples) {
+    if (samples == NULL) {
+        return;
+    }
+
+    // A trigger being filled in right now may be for this sound: let every one be published first
+    for (uint32_t waited = 0; waited < MIXER_STOP_WAIT_MS; waited++) {
+        uint8_t claimed = 0;
+        for (uint8_t i = 0; i < AUDIO_MIXER_TRIGGERS; i++) {
+            if (atomic_load_explicit(&triggers[i].state, memory_order_acquire) == MIXER_TRIGGER_CLAIMED) {
+                claimed = 1;
+            }
+        }
+        if (!claimed) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    // Triggers not started yet are dropped; the mixer takes a slot with the same swap, so only one side wins
+    for (uint8_t i = 0; i < AUDIO_MIXER_TRIGGERS; i++) {
+        mixer_trigger_t *t = &triggers[i];
+        uint_least8_t expected = MIXER_TRIGGER_READY;
+        if (atomic_load_explicit(&t->state, memory_order_acquire) == MIXER_TRIGGER_READY && t->samples == samples) {
+            atomic_compare_exchange_strong_explicit(&t->state, &expected, MIXER_TRIGGER_FREE,
+                                                    memory_order_relaxed, memory_order_relaxed);
+        }
+    }
+
+    // A pass that took one of them before we could may be starting it on a voice: let it finish first
+    wait_for_mix_pass();
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < AUDIO_MIXER_VOICES; i++) {
+        if (voices[i].samples == samples) {
+            voices[i].active = 0;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    // The mixer works on copies, so a pass already running may still read the sound
+    wait_for_mix_pass();
+}
+
+uint8_t audio_effects_active(void) {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < AUDIO_MIXER_VOICES; i++) {
+        count = (uint8_t)(count + (voices[i].active ? 1 : 0));
+    }
+    return count;
+}
+
+uint8_t audio_effects_pending(void) {
+    if (audio_effects_active() > 0) {
+        return 1;
+    }
+    for (uint8_t i = 0; i < AUDIO_MIXER_TRIGGERS; i++) {
+        if (atomic_load_explicit(&triggers[i].state, memory_order_relaxed) != MIXER_TRIGGER_FREE) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void audio_mix_effects(int16_t *frames, uint16_t count) {
+    if (frames == NULL || count == 0) {
+        return;
+    }
+    atomic_fetch_add_explicit(&mixPasses, 1, memory_order_acq_rel);
+    start_triggered();
+
+    for (uint8_t i = 0; i < AUDIO_MIXER_VOICES; i++) {
+        // Work on a copy so the effect can be started, changed or stopped meanwhile
+        mixer_voice_t snapshot;
+        taskENTER_CRITICAL();
+        snapshot = voices[i];
+        taskEXIT_CRITICAL();
+        if (!snapshot.active) {
+            continue;
+        }
+
+        uint32_t remaining = snapshot.frames - snapshot.position;
+        uint32_t n = (remaining < count) ? remaining : count;
+        uint32_t mixed = n;
+        if (snapshot.samples != NULL) {
+            mix_voice((uint32_t *)frames, &snapshot, n);
+        } else {
+            mixed = mix_adpcm_voice((uint32_t *)frames, &snapshot, n);
+        }
+
+        // Move it along, unless it was restarted or stopped while we mixed
+        taskENTER_CRITICAL();
+        mixer_voice_t *v = &voices[i];
+        if (v->active && v->generation == snapshot.generation) {
+            v->position = snapshot.position + mixed;
+            v->nextBlock = snapshot.nextBlock;
+            v->adpcm = snapshot.adpcm;
+            // A broken ADPCM block ends the effect early
+            if (v->position >= v->frames || mixed < n) {
+                v->active = 0;
+            }
+        }
+        taskEXIT_CRITICAL();
+    }
+    atomic_fetch_add_explicit(&mixPasses, 1, memory_order_acq_rel);
+}
+
+// Puts a prepared voice on the free or least important voice, keeping that voice's generation
+static audio_status_t start_voice(const mixer_voice_t *setup, audio_voice_t *voice) {
+    taskENTER_CRITICAL();
+    // A free voice if there is one, otherwise the least important, oldest first
+    int8_t chosen = -1;
+    for (uint8_t i = 0; i < AUDIO_MIXER_VOICES; i++) {
+        if (!voices[i].active) {
+            chosen = (int8_t)i;
+            break;
+        }
+        if (voices[i].priority <= setup->priority &&
+            (chosen < 0 || voices[i].priority < voices[chosen].priority ||
+             (voices[i].priority == voices[chosen].priority &&
+              (int32_t)(voices[i].started - voices[chosen].started) < 0))) {
+            chosen = (int8_t)i;
+        }
+    }
+    if (chosen < 0) {
+        taskEXIT_CRITICAL();
+        return AUDIO_ERROR_BUSY;
+    }
+
+    mixer_voice_t *v = &voices[chosen];
+    uint16_t generation = (v->generation >= MIXER_GENERATION_MAX) ? 1 : (uint16_t)(v->generation + 1);
+    *v = *setup;
+    v->generation = generation;
+    v->position = 0;
+    v->started = startCounter++;
+    v->active = 1;
+    audio_voice_t handle = (audio_voice_t)((generation << MIXER_INDEX_BITS) | (uint16_t)chosen);
+    taskEXIT_CRITICAL();
+
+    if (voice != NULL) {
+        *voice = handle;
+    }
+    return AUDIO_OK;
+}
+
+// Starts every waiting trigger, so it is heard in the buffer being mixed right now
+static void start_triggered(void) {
+    for (uint8_t i = 0; i < AUDIO_MIXER_TRIGGERS; i++) {
+        mixer_trigger_t *t = &triggers[i];
+        uint_least8_t expected = MIXER_TRIGGER_READY;
+        if (!atomic_compare_exchange_strong_explicit(&t->state, &expected, MIXER_TRIGGER_CLAIMED,
+                                                     memory_order_acquire, memory_order_relaxed)) {
+            continue;
+        }
+        mixer_voice_t setup;
+        memset(&setup, 0, sizeof(setup));
+        setup.samples = t->samples;
+        setup.frames = t->frames;
+        setup.channels = t->channels;
+        setup.priority = t->priority;
+        pan_gains(t->gain, t->pan, &setup.gainLeft, &setup.gainRight);
+
+        // Refused only if every voice plays something more important, as with audio_play_effect()
+        start_voice(&setup, NULL);
+        // Freed only once the voice is live, so audio_stop_effects_using() never misses it in between
+        atomic_store_explicit(&t->state, MIXER_TRIGGER_FREE, memory_order_release);
+    }
+}
+
+// Returns once a mixing pass running now has ended (passes starting later aren't waited for)
+static void wait_for_mix_pass(void) {
+    uint32_t pass = atomic_load_explicit(&mixPasses, memory_order_acquire);
+    if (pass & 1u) {
+        for (uint32_t waited = 0; atomic_load_explicit(&mixPasses, memory_order_acquire) == pass &&
+                                  waited < MIXER_STOP_WAIT_MS; waited++) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+    }
+}
+
+// Gain 0-100 and balance pan -100..100 to Q15 per-side gains (the centre keeps both at full gain)
+static void pan_gains(uint8_t gain, int8_t pan, int32_t *left, int32_t *right) {
+    if (gain > 100) {
+        gain = 100;
+    }
+    if (pan > 100) {
+        pan = 100;
+    }
+    if (pan < -100) {
+        pan = -100;
+    }
+    int32_t base = (int32_t)gain * 32768 / 100;
+    *left = (pan > 0) ? base * (100 - pan) / 100 : base;
+    *right = (pan < 0) ? base * (100 + pan) / 100 : base;
+}
+
+// The live voice a handle names, or NULL if it has finished (call with the critical section held)
+static mixer_voice_t *find_voice(audio_voice_t voice) {
+    uint16_t index = voice & MIXER_INDEX_MASK;
+    if (voice == 0 || index >= AUDIO_MIXER_VOICES) {
+        return NULL;
+    }
+    mixer_voice_t *v = &voices[index];
+    return (v->active && v->generation == (voice >> MIXER_INDEX_BITS)) ? v : NULL;
+}
+
+// Adds count frames of one voice into packed stereo frames, saturating both lanes at once
+static void mix_voice(uint32_t *out, const mixer_voice_t *voice, uint32_t count) {
+    int32_t gainLeft = voice->gainLeft;
+    int32_t gainRight = voice->gainRight;
+    if (voice->channels == 2) {
+        const int16_t *src = voice->samples + voice->position * 2u;
+        for (uint32_t i = 0; i < count; i++) {
+            int32_t left = ((int32_t)src[2u * i] * gainLeft) >> 15;
+            int32_t right = ((int32_t)src[2u * i + 1u] * gainRight) >> 15;
+            out[i] = dsp_qadd16(out[i], dsp_pack16x2(left, right));
+        }
+    } else {
+        const int16_t *src = voice->samples + voice->position;
+        for (uint32_t i = 0; i < count; i++) {
+            int32_t left = ((int32_t)src[i] * gainLeft) >> 15;
+            int32_t right = ((int32_t)src[i] * gainRight) >> 15;
+            out[i] = dsp_qadd16(out[i], dsp_pack16x2(left, right));
+        }
+    }
+}
+
+// Decodes and adds up to count frames of an ADPCM voice, moving its decoder along; returns frames mixed
+static uint32_t mix_adpcm_voice(uint32_t *out, mixer_voice_t *voice, uint32_t count) {
+    uint32_t decoded[MIXER_ADPCM_CHUNK];
+    int32_t gainLeft = voice->gainLeft;
+    int32_t gainRight = voice->gainRight;
+    uint32_t done = 0;
+    while (done < count) {
+        if (adpcm_decoder_block_done(&voice->adpcm)) {
+            uint32_t bytes = voice->blockBytes - voice->nextBlock;
+            if (bytes > voice->adpcm.format.block_align) {
+                bytes = voice->adpcm.format.block_align;
+            }
+            if (bytes == 0 ||
+                adpcm_decoder_start_block(&voice->adpcm, voice->blocks + voice->nextBlock, bytes) != AUDIO_OK) {
+                break;
+            }
+            voice->nextBlock += bytes;
+        }
+
+        uint32_t want = count - done;
+        uint16_t got = adpcm_decoder_read(&voice->adpcm, decoded, (want < MIXER_ADPCM_CHUNK) ? (uint16_t)want : MIXER_ADPCM_CHUNK);
+        for (uint32_t i = 0; i < got; i++) {
+            int32_t left = ((int32_t)(int16_t)decoded[i] * gainLeft) >> 15;
+            int32_t right = ((int32_t)(int16_t)(decoded[i] >> 16) * gainRight) >> 15;
+            out[done + i] = dsp_qadd16(out[done + i], dsp_pack16x2(left, right));
+        }
+        done += got;
+    }
+    return done;
+}
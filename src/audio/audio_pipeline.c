@@ -0,0 +1,478 @@
+#include "audio/audio_pipeline.h"
+#include "audio/audio_telemetry.h"
+#include "audio/track_queue.h"
+#include "drivers/audio_output.h"
+#include "core/system.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdatomic.h>
+#include <string.h>
+
+typedef struct {
+    audio_stage_config_t config;
+    struct audio_pipeline_s *pipeline;
+    uint8_t index;
+    TaskHandle_t task;
+    volatile uint8_t finished;    // Returned DONE or ERROR
+    volatile uint8_t failed;      // Returned ERROR
+    atomic_uint_least8_t ownsOutput;    // An output stage that has started and not finished
+    audio_stage_stats_t stats;
+} stage_t;
+
+struct audio_pipeline_s {
+    stage_t stages[AUDIO_PIPELINE_MAX_STAGES];
+    spsc_ring_t rings[AUDIO_PIPELINE_MAX_STAGES - 1];   // rings[i] sits between stage i and i + 1
+    uint8_t *ringStorage[AUDIO_PIPELINE_MAX_STAGES - 1];
+    uint8_t count;
+    volatile uint8_t running;
+    volatile uint8_t stopping;
+    volatile uint8_t activeTasks;
+};
+
+// Who feeds the output engine: running output stages, or the effects-only pump when there are none
+static atomic_uint_least8_t outputOwners;
+static atomic_uint_least8_t effectsFilling;     // The effects pump is filling buffers right now
+static uint8_t effectsStartedOutput = 0;        // The effects pump started the engine, so it stops it (audioTask only)
+
+// Function declarations for internal functions
+static audio_stage_result_t run_stage(struct audio_pipeline_s *pipeline, uint8_t index);
+static void wake_neighbours(struct audio_pipeline_s *pipeline, uint8_t index);
+static void stage_task(void *pvParameters);
+static void record_output(spsc_ring_t *input, uint16_t frames);
+static void release_output(stage_t *stage);
+static uint32_t round_up_pow2(uint32_t value);
+
+audio_status_t audio_pipeline_create(const audio_stage_config_t *stages, uint8_t count, audio_pipeline_t *pipeline) {
+    if (stages == NULL || pipeline == NULL || count == 0 || count > AUDIO_PIPELINE_MAX_STAGES) {
+        return AUDIO_ERROR_PARAM;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (stages[i].process == NULL || (i + 1 < count && stages[i].output_ring_bytes == 0)) {
+            return AUDIO_ERROR_PARAM;
+        }
+    }
+
+    struct audio_pipeline_s *p = pvPortMalloc(sizeof(struct audio_pipeline_s));
+    if (p == NULL) {
+        return AUDIO_ERROR_MEMORY;
+    }
+    memset(p, 0, sizeof(*p));
+    p->count = count;
+
+    for (uint8_t i = 0; i < count; i++) {
+        p->stages[i].config = stages[i];
+        p->stages[i].pipeline = p;
+        p->stages[i].index = i;
+
+        if (i + 1 < count) {
+            uint32_t size = round_up_pow2(stages[i].output_ring_bytes);
+            p->ringStorage[i] = pvPortMalloc(size);
+            if (p->ringStorage[i] == NULL) {
+                audio_pipeline_destroy(p);
+                return AUDIO_ERROR_MEMORY;
+            }
+            spsc_ring_init(&p->rings[i], p->ringStorage[i], size);
+        }
+    }
+
+    *pipeline = p;
+    return AUDIO_OK;
+}
+
+void audio_pipeline_destroy(audio_pipeline_t pipeline) {
+    if (pipeline == NULL) {
+        return;
+    }
+
+    audio_pipeline_stop(pipeline);
+    for (uint8_t i = 0; i < pipeline->count; i++) {
+        release_output(&pipeline->stages[i]);    // A pumped line that was never started or stopped
+    }
+    for (uint8_t i = 0; i + 1 < pipeline->count; i++) {
+        if (pipeline->ringStorage[i] != NULL) {
+            vPortFree(pipeline->ringStorage[i]);
+        }
+    }
+    vPortFree(pipeline);
+}
+
+audio_status_t audio_pipeline_start(audio_pipeline_t pipeline) {
+    if (pipeline == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (pipeline->running) {
+        return AUDIO_OK;
+    }
+
+    pipeline->stopping = 0;
+    pipeline->running = 1;
+
+    for (uint8_t i = 0; i < pipeline->count; i++) {
+        stage_t *stage = &pipeline->stages[i];
+        if (!stage->config.own_task) {
+            continue;
+        }
+
+        taskENTER_CRITICAL();
+        pipeline->activeTasks++;
+        taskEXIT_CRITICAL();
+
+        if (xTaskCreate(stage_task, stage->config.name ? stage->config.name : "ASTAGE",
+                        AUDIO_PIPELINE_STACK_SIZE, stage, stage->config.priority, &stage->task) != pdPASS) {
+            taskENTER_CRITICAL();
+            pipeline->activeTasks--;
+            taskEXIT_CRITICAL();
+            stage->task = NULL;
+            audio_pipeline_stop(pipeline);
+            return AUDIO_ERROR_MEMORY;
+        }
+
+#if (configNUMBER_OF_CORES > 1) && (configUSE_CORE_AFFINITY == 1)
+        if (stage->config.core >= 0) {
+            vTaskCoreAffinitySet(stage->task, (UBaseType_t)(1u << stage->config.core));
+        }
+#endif
+    }
+
+    return AUDIO_OK;
+}
+
+void audio_pipeline_stop(audio_pipeline_t pipeline) {
+    if (pipeline == NULL || !pipeline->running) {
+        return;
+    }
+
+    pipeline->stopping = 1;
+    for (uint8_t i = 0; i < pipeline->count; i++) {
+        if (pipeline->stages[i].task != NULL) {
+            xTaskNotifyGive(pipeline->stages[i].task);
+        }
+    }
+
+    // Stage tasks park themselves once they see the flag; nobody touches a handle after that
+    while (pipeline->activeTasks > 0) {
+        vTaskDelay(1);
+    }
+    for (uint8_t i = 0; i < pipeline->count; i++) {
+        if (pipeline->stages[i].task != NULL) {
+            vTaskDelete(pipeline->stages[i].task);
+            pipeline->stages[i].task = NULL;
+        }
+        release_output(&pipeline->stages[i]);
+    }
+
+    pipeline->running = 0;
+    pipeline->stopping = 0;
+}
+
+void audio_pipeline_reset(audio_pipeline_t pipeline) {
+    if (pipeline == NULL || pipeline->running) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < pipeline->count; i++) {
+        if (i + 1 < pipeline->count) {
+            spsc_ring_reset(&pipeline->rings[i]);
+        }
+        pipeline->stages[i].finished = 0;
+        pipeline->stages[i].failed = 0;
+        release_output(&pipeline->stages[i]);
+    }
+}
+
+uint8_t audio_pipeline_pump(audio_pipeline_t pipeline) {
+    if (pipeline == NULL) {
+        return 0;
+    }
+
+    uint8_t progressed = 0;
+    for (uint8_t i = 0; i < pipeline->count; i++) {
+        if (!pipeline->stages[i].config.own_task && run_stage(pipeline, i) == AUDIO_STAGE_PROGRESS) {
+            progressed = 1;
+        }
+    }
+    return progressed;
+}
+
+uint8_t audio_pipeline_is_done(audio_pipeline_t pipeline) {
+    if (pipeline == NULL) {
+        return 1;
+    }
+
+    for (uint8_t i = 0; i < pipeline->count; i++) {
+        if (pipeline->stages[i].failed) {
+            return 1;
+        }
+    }
+    return pipeline->stages[pipeline->count - 1].finished;
+}
+
+audio_status_t audio_pipeline_get_stats(audio_pipeline_t pipeline, uint8_t stage, audio_stage_stats_t *stats, uint8_t reset) {
+    if (pipeline == NULL || stage >= pipeline->count) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    stage_t *s = &pipeline->stages[stage];
+    taskENTER_CRITICAL();
+    if (stats != NULL) {
+        *stats = s->stats;
+    }
+    if (reset) {
+        uint32_t capacity = s->stats.capacity;
+        memset(&s->stats, 0, sizeof(s->stats));
+        s->stats.capacity = capacity;
+    }
+    taskEXIT_CRITICAL();
+    return AUDIO_OK;
+}
+
+audio_stage_result_t audio_stage_read_file(void *context, spsc_ring_t *input, spsc_ring_t *output) {
+    (void)input;
+    audio_file_source_t *source = (audio_file_source_t *)context;
+    if (source == NULL || output == NULL) {
+        return AUDIO_STAGE_ERROR;
+    }
+
+    // Wait for a worthwhile amount of room so the card sees few, large reads
+    uint32_t chunk = source->chunk_bytes ? source->chunk_bytes : 512;
+    if (chunk > output->size) {
+        chunk = output->size;
+    }
+    if (spsc_ring_free(output) < chunk) {
+        return AUDIO_STAGE_BLOCKED;
+    }
+
+    uint32_t space;
+    uint8_t *dst = spsc_ring_write_ptr(output, &space);
+    size_t got = 0;
+    if (audio_telemetry_read(source->file, dst, space, &got) != FS_OK) {
+        return AUDIO_STAGE_ERROR;
+    }
+    if (got == 0) {
+        return AUDIO_STAGE_DONE;
+    }
+    spsc_ring_write_commit(output, (uint32_t)got);
+    return AUDIO_STAGE_PROGRESS;
+}
+
+audio_stage_result_t audio_stage_write_output(void *context, spsc_ring_t *input, spsc_ring_t *output) {
+    (void)output;
+    audio_output_sink_t *sink = (audio_output_sink_t *)context;
+    if (sink == NULL || input == NULL) {
+        return AUDIO_STAGE_ERROR;
+    }
+    // The output ring has one producer: let an effects-only pass that began before we took over finish
+    if (atomic_load(&effectsFilling)) {
+        return AUDIO_STAGE_BLOCKED;
+    }
+
+    int16_t *buffer;
+    uint16_t frames;
+    audio_status_t status = audio_output_acquire_buffer(&buffer, &frames);
+    if (status == AUDIO_ERROR_BUSY) {
+        // The sink may sleep here: the DMA interrupt is what frees the next buffer
+        if (audio_output_wait(AUDIO_PIPELINE_IDLE_MS) != AUDIO_OK) {
+            return AUDIO_STAGE_BLOCKED;
+        }
+        status = audio_output_acquire_buffer(&buffer, &frames);
+    }
+    if (status != AUDIO_OK) {
+        return (status == AUDIO_ERROR_BUSY) ? AUDIO_STAGE_BLOCKED : AUDIO_STAGE_ERROR;
+    }
+
+    // Whole frames only: 2 channels x 16 bits
+    uint32_t want = (uint32_t)(frames - sink->filled) * 4u;
+    uint32_t available = spsc_ring_used(input) & ~3u;
+    uint32_t count = (available < want) ? available : want;
+
+    if (count == 0) {
+        if (spsc_ring_is_closed(input)) {
+            // Drop a trailing partial frame; nothing will complete it
+            spsc_ring_read_commit(input, spsc_ring_used(input));
+            if (sink->filled > 0) {
+                audio_mix_effects(buffer, sink->filled);
+                audio_process_dsp(buffer, sink->filled);
+                audio_tap_feed(buffer, sink->filled);
+                audio_output_commit_buffer(sink->filled);
+                sink->filled = 0;
+            }
+            audio_output_drain();    // The line is over: the silence after it isn't an underrun
+            return AUDIO_STAGE_DONE;
+        }
+        // Everything before a direct WAV file has been queued: it goes from the card straight into the buffers
+        if (track_queue_pump_direct(&sink->filled) == AUDIO_OK) {
+            return AUDIO_STAGE_PROGRESS;
+        }
+        return AUDIO_STAGE_STARVED;
+    }
+
+    spsc_ring_read(input, (uint8_t *)buffer + (uint32_t)sink->filled * 4u, count);
+    sink->filled = (uint16_t)(sink->filled + count / 4u);
+    if (sink->filled == frames) {
+        // Effects go in last, so they only wait for the buffers already queued; then the whole
+        // mix is shaped, so the volume glide and the limiter cover the effects too; the tap
+        // copies exactly what will be heard
+        audio_mix_effects(buffer, frames);
+        audio_process_dsp(buffer, frames);
+        audio_tap_feed(buffer, frames);
+        record_output(input, frames);
+        audio_output_commit_buffer(frames);
+        sink->filled = 0;
+    }
+    return AUDIO_STAGE_PROGRESS;
+}
+
+uint8_t audio_pipeline_pump_effects(void) {
+    // Announce the pass before looking for owners; an output stage does the opposite, so one of us backs off
+    atomic_store(&effectsFilling, 1);
+    if (atomic_load(&outputOwners) > 0) {
+        atomic_store(&effectsFilling, 0);
+        effectsStartedOutput = 0;    // The song's line feeds the engine now, and whoever started it stops it
+        return 0;
+    }
+
+    uint8_t progressed = 0;
+    if (audio_effects_pending()) {
+        int16_t *buffer;
+        uint16_t frames;
+        while (audio_effects_pending() && audio_output_acquire_buffer(&buffer, &frames) == AUDIO_OK) {
+            // Effects over silence, through the same shaping and tap as the music
+            memset(buffer, 0, (size_t)frames * 4u);
+            audio_mix_effects(buffer, frames);
+            audio_process_dsp(buffer, frames);
+            audio_tap_feed(buffer, frames);
+            audio_output_commit_buffer(frames);
+            progressed = 1;
+        }
+        if (progressed && !audio_output_is_running() && audio_output_start() == AUDIO_OK) {
+            effectsStartedOutput = 1;
+        }
+    } else if (effectsStartedOutput && audio_output_drain()) {
+        // Everything has been heard: let the engine (and audioTask) sleep until the next effect
+        audio_output_stop();
+        effectsStartedOutput = 0;
+    }
+    atomic_store(&effectsFilling, 0);
+    return progressed;
+}
+
+static audio_stage_result_t run_stage(struct audio_pipeline_s *pipeline, uint8_t index) {
+    stage_t *stage = &pipeline->stages[index];
+    if (stage->finished) {
+        return AUDIO_STAGE_DONE;
+    }
+    // An output stage owns the output engine from its first turn until it finishes
+    if (stage->config.process == audio_stage_write_output && !atomic_exchange(&stage->ownsOutput, 1)) {
+        atomic_fetch_add(&outputOwners, 1);
+    }
+
+    spsc_ring_t *input = (index > 0) ? &pipeline->rings[index - 1] : NULL;
+    spsc_ring_t *output = (index + 1 < pipeline->count) ? &pipeline->rings[index] : NULL;
+
+    uint32_t start = system_get_time_us();
+    audio_stage_result_t result = stage->config.process(stage->config.context, input, output);
+    uint32_t elapsed = system_get_time_us() - start;
+
+    audio_stage_stats_t *stats = &stage->stats;
+    stats->runs++;
+    stats->busy_us += elapsed;
+    if (result == AUDIO_STAGE_PROGRESS) {
+        stats->progress++;
+        if (stage->config.decodes) {
+            audio_telemetry_record(AUDIO_TELEMETRY_DECODE, elapsed);
+        }
+    } else if (result == AUDIO_STAGE_STARVED) {
+        stats->starved++;
+    } else if (result == AUDIO_STAGE_BLOCKED) {
+        stats->blocked++;
+    }
+
+    // Fill level of the ring this stage feeds (the last stage watches what feeds it)
+    spsc_ring_t *watched = (output != NULL) ? output : input;
+    if (watched != NULL) {
+        uint32_t fill = spsc_ring_used(watched);
+        stats->fill = fill;
+        stats->capacity = watched->size;
+        if (stats->runs == 1 || fill < stats->fill_min) {
+            stats->fill_min = fill;
+        }
+        if (fill > stats->fill_max) {
+            stats->fill_max = fill;
+        }
+    }
+
+    if (result == AUDIO_STAGE_DONE || result == AUDIO_STAGE_ERROR) {
+        stage->failed = (result == AUDIO_STAGE_ERROR);
+        stage->finished = 1;
+        if (output != NULL) {
+            spsc_ring_close(output);
+        }
+        release_output(stage);
+    }
+    if (result != AUDIO_STAGE_STARVED && result != AUDIO_STAGE_BLOCKED) {
+        wake_neighbours(pipeline, index);
+    }
+    return result;
+}
+
+// New data for the next stage, new room for the previous one
+static void wake_neighbours(struct audio_pipeline_s *pipeline, uint8_t index) {
+    if (pipeline->stopping) {
+        return;
+    }
+    if (index > 0 && pipeline->stages[index - 1].task != NULL) {
+        xTaskNotifyGive(pipeline->stages[index - 1].task);
+    }
+    if (index + 1 < pipeline->count && pipeline->stages[index + 1].task != NULL) {
+        xTaskNotifyGive(pipeline->stages[index + 1].task);
+    }
+}
+
+static void stage_task(void *pvParameters) {
+    stage_t *stage = (stage_t *)pvParameters;
+    struct audio_pipeline_s *pipeline = stage->pipeline;
+
+    while (!pipeline->stopping) {
+        if (run_stage(pipeline, stage->index) != AUDIO_STAGE_PROGRESS) {
+            // Starved, blocked or finished: sleep until a neighbour moves (or a short timeout)
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(AUDIO_PIPELINE_IDLE_MS));
+        }
+    }
+
+    taskENTER_CRITICAL();
+    pipeline->activeTasks--;
+    taskEXIT_CRITICAL();
+
+    // audio_pipeline_stop deletes us
+    vTaskSuspend(NULL);
+}
+
+// Telemetry for a full buffer about to be queued: how many were still waiting for the
+// speaker, and how long a sample entering the input pipe now takes to be heard
+static void record_output(spsc_ring_t *input, uint16_t frames) {
+    uint8_t waiting = audio_output_queued_buffers();
+    audio_telemetry_record_fill(waiting);
+
+    uint32_t rate = audio_output_get_sample_rate();
+    if (rate > 0) {
+        uint64_t pending = (uint64_t)(spsc_ring_used(input) / 4u) + ((uint64_t)waiting + 1u) * frames;
+        audio_telemetry_record(AUDIO_TELEMETRY_LATENCY, (uint32_t)(pending * 1000000u / rate));
+    }
+}
+
+// Hands the output engine back to the effects-only pump (once per claim, whoever gets here first)
+static void release_output(stage_t *stage) {
+    if (atomic_exchange(&stage->ownsOutput, 0)) {
+        atomic_fetch_sub(&outputOwners, 1);
+        audio_output_wake();    // Effects may be waiting for the song to end
+    }
+}
+
+static uint32_t round_up_pow2(uint32_t value) {
+    uint32_t size = 64;
+    while (size < value) {
+        size <<= 1;
+    }
+    return size;
+}
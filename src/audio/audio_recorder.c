@@ -0,0 +1,391 @@
+#include "drivers/audio.h"
+#include "drivers/audio_input.h"
+#include "audio/audio_pipeline.h"
+#include "audio/adpcm.h"
+#include "fs/fs_manager.h"
+#include "core/system.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+#define RECORD_HEADER_BYTES   512    // WAV header padded with a JUNK chunk, so the sound starts on a sector
+#define RECORD_FORMAT_PCM     0x0001
+#define RECORD_FORMAT_IMA     0x0011
+
+#if AUDIO_RECORD_ADPCM_BLOCK < 4 + AUDIO_INPUT_BUFFER_FRAMES / 2
+#error "AUDIO_RECORD_ADPCM_BLOCK must hold at least one capture buffer"
+#endif
+
+// One recording (the capture and writer tasks update their own fields; everyone may read)
+typedef struct {
+    fs_file_t file;
+    audio_pipeline_t pipeline;
+    audio_record_encoding_t encoding;
+    uint32_t sampleRate;
+    uint32_t maxFrames;
+    uint32_t bytesReserved;
+    volatile uint32_t framesCaptured;
+    volatile uint32_t bytesWritten;
+    volatile uint32_t backlogMax;
+    volatile uint32_t writeMaxUs;
+    uint32_t overruns;                 // Copied from the input engine when the recording is stopped
+    adpcm_encoder_t adpcm;             // IMA ADPCM block being filled (capture task only)
+    volatile uint8_t stopping;
+    volatile uint8_t full;             // The capture worker stopped at maxFrames (not an error)
+    volatile audio_status_t result;
+} recorder_t;
+
+static recorder_t recorder;
+static uint8_t recorderActive = 0;
+static int16_t captureScratch[AUDIO_INPUT_BUFFER_FRAMES];
+static uint8_t adpcmBlock[AUDIO_RECORD_ADPCM_BLOCK];
+
+// Function declarations for internal functions
+static audio_stage_result_t capture_stage(void *context, spsc_ring_t *input, spsc_ring_t *output);
+static audio_stage_result_t writer_stage(void *context, spsc_ring_t *input, spsc_ring_t *output);
+static uint8_t flush_adpcm(spsc_ring_t *output);
+static fs_status_t write_header(fs_file_t file, uint32_t data_bytes);
+static audio_status_t finish_file(void);
+static void put_u16(uint8_t *p, uint16_t value);
+static void put_u32(uint8_t *p, uint32_t value);
+
+audio_status_t audio_record_start(const char *filename, const audio_record_config_t *config) {
+    if (filename == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (recorderActive) {
+        return AUDIO_ERROR_BUSY;
+    }
+
+    audio_record_config_t settings;
+    if (config != NULL) {
+        settings = *config;
+    } else {
+        memset(&settings, 0, sizeof(settings));
+    }
+    if (settings.sample_rate == 0) {
+        settings.sample_rate = AUDIO_RECORD_DEFAULT_RATE;
+    }
+    if (settings.max_seconds == 0) {
+        settings.max_seconds = AUDIO_RECORD_DEFAULT_SECONDS;
+    }
+    if (settings.encoding > AUDIO_RECORD_IMA_ADPCM) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    memset(&recorder, 0, sizeof(recorder));
+    uint64_t frames = (uint64_t)settings.sample_rate * settings.max_seconds;
+    uint64_t dataBytes;
+    if (settings.encoding == AUDIO_RECORD_IMA_ADPCM) {
+        adpcm_encoder_init(&recorder.adpcm, adpcmBlock, AUDIO_RECORD_ADPCM_BLOCK);
+        uint32_t perBlock = recorder.adpcm.samples_per_block;
+        dataBytes = (frames + perBlock - 1u) / perBlock * AUDIO_RECORD_ADPCM_BLOCK;
+    } else {
+        dataBytes = frames * ((settings.encoding == AUDIO_RECORD_PCM8) ? 1u : 2u);
+    }
+    if (dataBytes > UINT32_MAX - RECORD_HEADER_BYTES) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    recorder.encoding = settings.encoding;
+    recorder.sampleRate = settings.sample_rate;
+    recorder.maxFrames = (uint32_t)frames;
+    recorder.bytesReserved = (uint32_t)dataBytes;
+    recorder.full = 0;
+    recorder.result = AUDIO_OK;
+
+    // Reserve the whole file first, so no write during the recording has to find space
+    if (fs_open(filename, FS_CREATE_ALWAYS, &recorder.file) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+    if (fs_preallocate(recorder.file, RECORD_HEADER_BYTES + recorder.bytesReserved) != FS_OK ||
+        write_header(recorder.file, 0) != FS_OK) {
+        fs_close(recorder.file);
+        fs_remove(filename);
+        return AUDIO_ERROR_IO;
+    }
+
+    audio_status_t status = audio_input_init(&settings);
+    if (status == AUDIO_OK) {
+        const audio_stage_config_t stages[2] = {
+            { .name = "RECCAP", .process = capture_stage, .output_ring_bytes = AUDIO_RECORD_RING_BYTES,
+              .own_task = 1, .core = -1, .priority = AUDIO_RECORD_CAPTURE_PRIORITY },
+            { .name = "RECWRITE", .process = writer_stage,
+              .own_task = 1, .core = -1, .priority = AUDIO_RECORD_WRITER_PRIORITY }
+        };
+        status = audio_pipeline_create(stages, 2, &recorder.pipeline);
+        if (status == AUDIO_OK) {
+            status = audio_pipeline_start(recorder.pipeline);
+            if (status == AUDIO_OK) {
+                status = audio_input_start();
+            }
+            if (status != AUDIO_OK) {
+                audio_pipeline_destroy(recorder.pipeline);
+            }
+        }
+        if (status != AUDIO_OK) {
+            audio_input_deinit();
+        }
+    }
+    if (status != AUDIO_OK) {
+        fs_close(recorder.file);
+        fs_remove(filename);
+        return status;
+    }
+
+    recorderActive = 1;
+    return AUDIO_OK;
+}
+
+audio_status_t audio_record_stop(void) {
+    if (!recorderActive) {
+        return AUDIO_ERROR_INIT;
+    }
+
+    // The capture worker finishes and closes its pipe; the writer then empties it onto the card
+    recorder.stopping = 1;
+    for (uint32_t waited = 0; !audio_pipeline_is_done(recorder.pipeline) && waited < AUDIO_RECORD_STOP_MS; waited++) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    audio_pipeline_destroy(recorder.pipeline);
+    recorder.pipeline = NULL;
+
+    audio_input_stats_t input;
+    audio_input_get_stats(&input, 0);
+    recorder.overruns = input.overruns;
+    audio_input_deinit();
+
+    recorderActive = 0;
+    return finish_file();
+}
+
+audio_status_t audio_record_get_status(audio_record_status_t *status) {
+    if (status == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    memset(status, 0, sizeof(*status));
+    if (recorderActive) {
+        audio_input_stats_t input;
+        audio_input_get_stats(&input, 0);
+        status->overruns = input.overruns;
+        status->recording = !recorder.stopping && !audio_pipeline_is_done(recorder.pipeline);
+    } else {
+        status->overruns = recorder.overruns;
+    }
+    status->result = recorder.result;
+    status->full = recorder.full;
+    status->recorded_ms = (recorder.sampleRate == 0) ? 0 :
+        (uint32_t)((uint64_t)recorder.framesCaptured * 1000u / recorder.sampleRate);
+    status->bytes_written = recorder.bytesWritten;
+    status->bytes_reserved = recorder.bytesReserved;
+    status->backlog_max = recorder.backlogMax;
+    status->backlog_size = AUDIO_RECORD_RING_BYTES;
+    status->write_max_us = recorder.writeMaxUs;
+    return AUDIO_OK;
+}
+
+// First worker: one capture buffer at a time, encoded into the pipe to the writer
+static audio_stage_result_t capture_stage(void *context, spsc_ring_t *input, spsc_ring_t *output) {
+    (void)context;
+    (void)input;
+    if (output == NULL) {
+        return AUDIO_STAGE_ERROR;
+    }
+    if (recorder.stopping || recorder.framesCaptured >= recorder.maxFrames) {
+        // A half-filled ADPCM block still goes to the card
+        if (!flush_adpcm(output)) {
+            return AUDIO_STAGE_BLOCKED;
+        }
+        if (!recorder.stopping) {
+            recorder.full = 1;    // The reserved space is full: finished, not failed
+        }
+        return AUDIO_STAGE_DONE;
+    }
+
+    uint32_t frameBytes = (recorder.encoding == AUDIO_RECORD_PCM8) ? 1u : 2u;
+    uint32_t needed = AUDIO_INPUT_BUFFER_FRAMES * frameBytes;
+    if (recorder.encoding == AUDIO_RECORD_IMA_ADPCM) {
+        needed = AUDIO_RECORD_ADPCM_BLOCK;    // A capture buffer finishes at most one block
+    }
+    if (spsc_ring_free(output) < needed) {
+        // The card is behind by a whole pipe; the input engine's buffers cover us a little longer
+        return AUDIO_STAGE_BLOCKED;
+    }
+
+    uint16_t frames = audio_input_read(captureScratch, AUDIO_INPUT_BUFFER_FRAMES);
+    if (frames == 0) {
+        // The worker may sleep here: the DMA interrupt is what fills the next buffer
+        if (audio_input_wait(AUDIO_PIPELINE_IDLE_MS) != AUDIO_OK) {
+            return AUDIO_STAGE_STARVED;
+        }
+        frames = audio_input_read(captureScratch, AUDIO_INPUT_BUFFER_FRAMES);
+        if (frames == 0) {
+            return AUDIO_STAGE_STARVED;
+        }
+    }
+    if (frames > recorder.maxFrames - recorder.framesCaptured) {
+        frames = (uint16_t)(recorder.maxFrames - recorder.framesCaptured);
+    }
+
+    if (recorder.encoding == AUDIO_RECORD_IMA_ADPCM) {
+        // Whole blocks go into the pipe as they fill; the rest waits in the encoder
+        uint16_t taken = 0;
+        while (taken < frames) {
+            taken = (uint16_t)(taken + adpcm_encoder_write(&recorder.adpcm, captureScratch + taken, (uint16_t)(frames - taken)));
+            if (adpcm_encoder_block_full(&recorder.adpcm)) {
+                spsc_ring_write(output, adpcmBlock, adpcm_encoder_take_block(&recorder.adpcm));
+            }
+        }
+        recorder.framesCaptured += frames;
+        return AUDIO_STAGE_PROGRESS;
+    }
+
+    if (recorder.encoding == AUDIO_RECORD_PCM8) {
+        // WAV 8-bit is unsigned; byte i never lands on a sample not yet read
+        uint8_t *bytes = (uint8_t *)captureScratch;
+        for (uint16_t i = 0; i < frames; i++) {
+            int32_t value = ((int32_t)captureScratch[i] + 32768 + 128) >> 8;
+            bytes[i] = (uint8_t)((value > 255) ? 255 : value);
+        }
+    }
+    spsc_ring_write(output, captureScratch, frames * frameBytes);
+    recorder.framesCaptured += frames;
+    return AUDIO_STAGE_PROGRESS;
+}
+
+// Last worker: whole AUDIO_RECORD_WRITE_BYTES blocks to the card, and whatever is left at the end
+static audio_stage_result_t writer_stage(void *context, spsc_ring_t *input, spsc_ring_t *output) {
+    (void)context;
+    (void)output;
+    if (input == NULL) {
+        return AUDIO_STAGE_ERROR;
+    }
+
+    // Closed is checked first: once it is set, everything the capture worker made is in the pipe
+    uint8_t closed = spsc_ring_is_closed(input);
+    uint32_t used = spsc_ring_used(input);
+    if (used > recorder.backlogMax) {
+        recorder.backlogMax = used;
+    }
+
+    // The read side only ever moves by whole blocks until the end, so a block never wraps
+    uint32_t length;
+    const uint8_t *data = spsc_ring_read_ptr(input, &length);
+    if (length >= AUDIO_RECORD_WRITE_BYTES) {
+        length = AUDIO_RECORD_WRITE_BYTES;
+    } else if (!closed) {
+        return AUDIO_STAGE_STARVED;
+    } else if (length == 0) {
+        return AUDIO_STAGE_DONE;
+    }
+
+    uint32_t start = system_get_time_us();
+    size_t written = 0;
+    fs_status_t fsStatus = fs_write(recorder.file, data, length, &written);
+    uint32_t elapsed = system_get_time_us() - start;
+    if (elapsed > recorder.writeMaxUs) {
+        recorder.writeMaxUs = elapsed;
+    }
+    if (fsStatus != FS_OK || written != length) {
+        recorder.result = AUDIO_ERROR_IO;
+        recorder.stopping = 1;
+        return AUDIO_STAGE_ERROR;
+    }
+
+    spsc_ring_read_commit(input, length);
+    recorder.bytesWritten += length;
+    return AUDIO_STAGE_PROGRESS;
+}
+
+// The last, partly filled ADPCM block into the pipe; 0 if the pipe has no room for it yet
+static uint8_t flush_adpcm(spsc_ring_t *output) {
+    if (recorder.encoding != AUDIO_RECORD_IMA_ADPCM || recorder.adpcm.position == 0) {
+        return 1;
+    }
+    if (spsc_ring_free(output) < AUDIO_RECORD_ADPCM_BLOCK) {
+        return 0;
+    }
+    spsc_ring_write(output, adpcmBlock, adpcm_encoder_take_block(&recorder.adpcm));
+    return 1;
+}
+
+// RIFF header, fmt chunk (and fact for ADPCM), a JUNK chunk up to byte 504, then the data chunk header
+static fs_status_t write_header(fs_file_t file, uint32_t data_bytes) {
+    uint8_t header[RECORD_HEADER_BYTES];
+    uint8_t adpcm = (recorder.encoding == AUDIO_RECORD_IMA_ADPCM);
+    uint16_t bits = (recorder.encoding == AUDIO_RECORD_PCM8) ? 8 : 16;
+    uint16_t blockAlign = (uint16_t)(bits / 8);
+    uint32_t byteRate = recorder.sampleRate * blockAlign;
+    if (adpcm) {
+        bits = 4;
+        blockAlign = AUDIO_RECORD_ADPCM_BLOCK;
+        byteRate = (uint32_t)((uint64_t)recorder.sampleRate * AUDIO_RECORD_ADPCM_BLOCK / recorder.adpcm.samples_per_block);
+    }
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, "RIFF", 4);
+    put_u32(header + 4, RECORD_HEADER_BYTES - 8 + data_bytes);
+    memcpy(header + 8, "WAVE", 4);
+    uint8_t *chunk = header + 12;
+    memcpy(chunk, "fmt ", 4);
+    put_u32(chunk + 4, adpcm ? 20 : 16);
+    put_u16(chunk + 8, adpcm ? RECORD_FORMAT_IMA : RECORD_FORMAT_PCM);
+    put_u16(chunk + 10, 1);    // Mono
+    put_u32(chunk + 12, recorder.sampleRate);
+    put_u32(chunk + 16, byteRate);
+    put_u16(chunk + 20, blockAlign);
+    put_u16(chunk + 22, bits);
+    if (adpcm) {
+        // Extra bytes, samples per block, then the frame count compressed files must carry
+        put_u16(chunk + 24, 2);
+        put_u16(chunk + 26, recorder.adpcm.samples_per_block);
+        chunk += 28;
+        memcpy(chunk, "fact", 4);
+        put_u32(chunk + 4, 4);
+        put_u32(chunk + 8, recorder.framesCaptured);
+        chunk += 12;
+    } else {
+        chunk += 24;
+    }
+    memcpy(chunk, "JUNK", 4);
+    put_u32(chunk + 4, (uint32_t)((header + RECORD_HEADER_BYTES - 8) - (chunk + 8)));
+    memcpy(header + RECORD_HEADER_BYTES - 8, "data", 4);
+    put_u32(header + RECORD_HEADER_BYTES - 4, data_bytes);
+
+    size_t written = 0;
+    fs_status_t status = fs_seek(file, 0, FS_SEEK_SET);
+    if (status == FS_OK) {
+        status = fs_write(file, header, sizeof(header), &written);
+    }
+    return (status == FS_OK && written != sizeof(header)) ? FS_ERROR_WRITE : status;
+}
+
+// Give back the unused reservation and put the real sizes in the header
+static audio_status_t finish_file(void) {
+    fs_status_t status = fs_truncate(recorder.file, RECORD_HEADER_BYTES + recorder.bytesWritten);
+    if (status == FS_OK) {
+        status = write_header(recorder.file, recorder.bytesWritten);
+    }
+    if (status == FS_OK) {
+        status = fs_sync(recorder.file);
+    }
+    if (fs_close(recorder.file) != FS_OK) {
+        status = FS_ERROR_CLOSE;
+    }
+    recorder.file = NULL;
+    return (status == FS_OK) ? AUDIO_OK : AUDIO_ERROR_IO;
+}
+
+static void put_u16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
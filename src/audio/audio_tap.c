@@ -0,0 +1,141 @@
+#include "drivers/audio.h"
+#include "drivers/audio_output.h"
+#include "audio/spsc_ring.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdatomic.h>
+#include <string.h>
+
+#define TAP_CHUNK_SAMPLES   32      // Tapped samples gathered on the stack before going into the pipe
+#define TAP_STOP_WAIT_MS    100     // Longest audio_tap_stop() waits for a feed in progress to end
+
+// The pipe and its memory belong to the starting task; the output worker only writes into it
+static spsc_ring_t tapRing;
+static uint8_t *tapStorage = NULL;
+static atomic_uint_least8_t tapRunning;
+static atomic_uint_least32_t feedPasses;    // Odd while audio_tap_feed() runs
+static atomic_uint_least32_t samplesDropped;
+static uint32_t tapRate = 0;
+static uint8_t tapDecimation = 1;
+
+// Averaging carried from one buffer to the next (output worker only)
+static int32_t pendingSum = 0;
+static uint8_t pendingCount = 0;
+
+// Function declarations for internal functions
+static void push_samples(const int16_t *samples, uint32_t count);
+
+audio_status_t audio_tap_start(uint8_t decimation) {
+    if (decimation == 0 || decimation > AUDIO_TAP_MAX_DECIMATION) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (atomic_load(&tapRunning)) {
+        return AUDIO_ERROR_BUSY;
+    }
+    uint32_t outputRate = audio_output_get_sample_rate();
+    if (outputRate == 0) {
+        return AUDIO_ERROR_INIT;
+    }
+
+    tapStorage = (uint8_t *)pvPortMalloc(AUDIO_TAP_RING_BYTES);
+    if (tapStorage == NULL) {
+        return AUDIO_ERROR_MEMORY;
+    }
+    if (!spsc_ring_init(&tapRing, tapStorage, AUDIO_TAP_RING_BYTES)) {
+        vPortFree(tapStorage);
+        tapStorage = NULL;
+        return AUDIO_ERROR_PARAM;    // AUDIO_TAP_RING_BYTES isn't a power of two
+    }
+    tapDecimation = decimation;
+    tapRate = outputRate / decimation;
+    pendingSum = 0;
+    pendingCount = 0;
+    atomic_store(&samplesDropped, 0);
+
+    // Publishes everything above to the output worker
+    atomic_store(&tapRunning, 1);
+    return AUDIO_OK;
+}
+
+void audio_tap_stop(void) {
+    if (!atomic_load(&tapRunning)) {
+        return;
+    }
+    atomic_store(&tapRunning, 0);
+
+    // A feed that saw the tap running may still be writing: let it finish before the memory goes
+    uint32_t pass = atomic_load(&feedPasses);
+    if (pass & 1u) {
+        for (uint32_t waited = 0; atomic_load(&feedPasses) == pass && waited < TAP_STOP_WAIT_MS; waited++) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+    }
+    vPortFree(tapStorage);
+    tapStorage = NULL;
+}
+
+void audio_tap_feed(const int16_t *frames, uint16_t count) {
+    if (frames == NULL || count == 0) {
+        return;
+    }
+    // Marked busy before looking at tapRunning, so audio_tap_stop() either sees us or we see it stopped
+    atomic_fetch_add(&feedPasses, 1);
+    if (atomic_load(&tapRunning)) {
+        int16_t chunk[TAP_CHUNK_SAMPLES];
+        uint32_t made = 0;
+        int32_t sum = pendingSum;
+        uint8_t taken = pendingCount;
+        uint8_t decimation = tapDecimation;
+        int32_t divisor = 2 * (int32_t)decimation;
+        for (uint16_t i = 0; i < count; i++) {
+            // Left + right, averaged over decimation frames
+            sum += (int32_t)frames[2u * i] + frames[2u * i + 1u];
+            if (++taken == decimation) {
+                chunk[made++] = (int16_t)(sum / divisor);
+                sum = 0;
+                taken = 0;
+                if (made == TAP_CHUNK_SAMPLES) {
+                    push_samples(chunk, made);
+                    made = 0;
+                }
+            }
+        }
+        push_samples(chunk, made);
+        pendingSum = sum;
+        pendingCount = taken;
+    }
+    atomic_fetch_add(&feedPasses, 1);
+}
+
+uint32_t audio_tap_read(int16_t *samples, uint32_t max_samples) {
+    if (samples == NULL || !atomic_load_explicit(&tapRunning, memory_order_acquire)) {
+        return 0;
+    }
+    return spsc_ring_read(&tapRing, samples, max_samples * 2u) / 2u;
+}
+
+audio_status_t audio_tap_get_status(audio_tap_status_t *status) {
+    if (status == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    memset(status, 0, sizeof(*status));
+    status->running = atomic_load(&tapRunning) ? 1 : 0;
+    if (status->running) {
+        status->sample_rate = tapRate;
+        status->samples_waiting = spsc_ring_used(&tapRing) / 2u;
+    }
+    status->samples_dropped = atomic_load_explicit(&samplesDropped, memory_order_relaxed);
+    return AUDIO_OK;
+}
+
+// Into the pipe if there is room; a reader that fell behind loses the rest, never the speaker
+static void push_samples(const int16_t *samples, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+    uint32_t written = spsc_ring_write(&tapRing, samples, count * 2u) / 2u;
+    if (written < count) {
+        atomic_fetch_add_explicit(&samplesDropped, count - written, memory_order_relaxed);
+    }
+}
@@ -0,0 +1,126 @@
+#include "audio/audio_telemetry.h"
+#include "audio/dsp_kernels.h"
+#include "drivers/audio_output.h"
+#include "core/system.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+// Everything since the last reset; the DMA interrupt writes the underrun fields
+static audio_telemetry_t telemetry;
+static uint32_t startMs = 0;
+
+// Function declarations for internal functions
+static void add_timing(audio_timing_histogram_t *histogram, uint32_t value_us);
+static uint32_t timing_bucket(uint32_t value_us);
+static void clear_telemetry(void);
+
+audio_status_t audio_get_telemetry(audio_telemetry_t *result, uint8_t reset) {
+    if (result == NULL && !reset) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    audio_output_stats_t output;
+    audio_output_get_stats(&output, 0);
+
+    taskENTER_CRITICAL();
+    if (result != NULL) {
+        *result = telemetry;
+        result->elapsed_ms = system_get_uptime() - startMs;
+        result->output_buffers = output.buffer_count;
+    }
+    if (reset) {
+        clear_telemetry();
+    }
+    taskEXIT_CRITICAL();
+    return AUDIO_OK;
+}
+
+uint32_t audio_telemetry_percentile(const audio_timing_histogram_t *histogram, uint8_t percent) {
+    if (histogram == NULL || histogram->count == 0) {
+        return 0;
+    }
+    if (percent > 100) {
+        percent = 100;
+    }
+
+    // Smallest bucket whose running total reaches the requested share
+    uint32_t target = (uint32_t)(((uint64_t)histogram->count * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < AUDIO_TELEMETRY_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= target && seen > 0) {
+            // The overflow bucket has no upper edge, so report the real worst case
+            if (i == AUDIO_TELEMETRY_BUCKETS - 1) {
+                return histogram->max_us;
+            }
+            uint32_t edge = (uint32_t)AUDIO_TELEMETRY_BUCKET_US << i;
+            return (edge < histogram->max_us) ? edge : histogram->max_us;
+        }
+    }
+    return histogram->max_us;
+}
+
+void audio_telemetry_record(audio_telemetry_metric_t metric, uint32_t value_us) {
+    taskENTER_CRITICAL();
+    if (metric == AUDIO_TELEMETRY_DECODE) {
+        add_timing(&telemetry.decode_us, value_us);
+    } else if (metric == AUDIO_TELEMETRY_IO_WAIT) {
+        add_timing(&telemetry.io_wait_us, value_us);
+    } else {
+        add_timing(&telemetry.latency_us, value_us);
+    }
+    taskEXIT_CRITICAL();
+}
+
+void audio_telemetry_record_fill(uint8_t waiting) {
+    if (waiting > AUDIO_OUTPUT_MAX_BUFFERS) {
+        waiting = AUDIO_OUTPUT_MAX_BUFFERS;
+    }
+
+    taskENTER_CRITICAL();
+    if (telemetry.buffers_queued == 0 || waiting < telemetry.output_fill_min) {
+        telemetry.output_fill_min = waiting;
+    }
+    telemetry.buffers_queued++;
+    telemetry.output_fill[waiting]++;
+    taskEXIT_CRITICAL();
+}
+
+void audio_telemetry_note_underrun(void) {
+    // Already inside the output engine's critical section, which is also the one readers take
+    telemetry.underruns++;
+    telemetry.last_underrun_ms = system_get_uptime();
+    telemetry.decode_us_at_underrun = telemetry.decode_us.last_us;
+    telemetry.io_wait_us_at_underrun = telemetry.io_wait_us.last_us;
+}
+
+fs_status_t audio_telemetry_read(fs_file_t file, void *buffer, size_t size, size_t *bytes_read) {
+    uint32_t start = system_get_time_us();
+    fs_status_t status = fs_read(file, buffer, size, bytes_read);
+    audio_telemetry_record(AUDIO_TELEMETRY_IO_WAIT, system_get_time_us() - start);
+    return status;
+}
+
+static void add_timing(audio_timing_histogram_t *histogram, uint32_t value_us) {
+    if (value_us > histogram->max_us) {
+        histogram->max_us = value_us;
+    }
+    histogram->count++;
+    histogram->last_us = value_us;
+    histogram->total_us += value_us;
+    histogram->buckets[timing_bucket(value_us)]++;
+}
+
+// Box 0 holds values under AUDIO_TELEMETRY_BUCKET_US; box i (i > 0) holds values up to BUCKET_US << i
+static uint32_t timing_bucket(uint32_t value_us) {
+    uint32_t bucket = 32u - dsp_clz(value_us / AUDIO_TELEMETRY_BUCKET_US);
+    return (bucket < AUDIO_TELEMETRY_BUCKETS) ? bucket : AUDIO_TELEMETRY_BUCKETS - 1;
+}
+
+// Called inside a critical section
+static void clear_telemetry(void) {
+    memset(&telemetry, 0, sizeof(telemetry));
+    startMs = system_get_uptime();
+}
@@ -0,0 +1,578 @@
+#include "drivers/audio.h"
+#include "drivers/audio_output.h"
+#include "audio/dsp_kernels.h"
+#include "core/system.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "hardware/clocks.h"
+#include <math.h>
+#include <string.h>
+
+#define DSP_BLOCK_FRAMES        32
+#define DSP_SAMPLE_SHIFT        12                       // 16-bit samples sit 12 bits up: 4 bits (24 dB) over full scale
+#define DSP_FULL_SCALE          (32767L << DSP_SAMPLE_SHIFT)
+#define DSP_COEFF_BITS          28                       // Q4.28: a +12 dB band's b0 reaches 4
+#define DSP_COEFF_MASK          ((1u << DSP_COEFF_BITS) - 1u)
+#define DSP_GAIN_BITS           30
+#define DSP_UNITY               (1L << DSP_GAIN_BITS)    // Q30 gain of 1
+#define DSP_LOUDNESS_BANDS      2
+#define DSP_TOTAL_BANDS         (AUDIO_DSP_EQ_BANDS + DSP_LOUDNESS_BANDS)
+#define DSP_BAND_CYCLES_GUESS   40                       // Cycles per frame for one stereo band before any is measured
+#define DSP_OTHER_CYCLES_GUESS  30                       // The same for glide, limiter and narrowing together
+#define DSP_PI                  3.14159265f
+
+// What one band was asked to do
+typedef struct {
+    audio_eq_type_t type;
+    uint16_t frequency;
+    int16_t gainDbX10;
+    uint16_t qX100;
+} band_setting_t;
+
+// Q28 biquad coefficients, with a1 and a2 negated so every term is added
+typedef struct {
+    int32_t b0;
+    int32_t b1;
+    int32_t b2;
+    int32_t a1;
+    int32_t a2;
+} biquad_t;
+
+// One channel's filter memory
+typedef struct {
+    int32_t x1;
+    int32_t x2;
+    int32_t y1;
+    int32_t y2;
+    uint32_t error;        // Fraction rounded off the last output, added back into the next
+} biquad_state_t;
+
+// Settings (any task changes them, inside a critical section)
+static band_setting_t settings[AUDIO_DSP_EQ_BANDS];
+static uint8_t loudnessOn = 0;
+static uint8_t volume = 100;
+static uint16_t volumeRampMs = 0;
+static uint8_t limiterOn = 1;
+static int16_t limiterThresholdDbX10 = 0;
+static uint16_t limiterReleaseMs = 200;
+static uint32_t settingsVersion = 1;
+static uint32_t volumeVersion = 0;
+
+// Working state (only the output task touches it)
+static uint32_t appliedSettings = 0;
+static uint32_t appliedVolume = 0;
+static uint32_t designRate = 0;
+static biquad_t coefficients[DSP_TOTAL_BANDS];
+static biquad_state_t filterState[DSP_TOTAL_BANDS][2];
+static audio_eq_type_t activeType[DSP_TOTAL_BANDS];
+static uint8_t activeBands[DSP_TOTAL_BANDS];
+static uint8_t activeCount = 0;
+static int32_t gainNow = DSP_UNITY;
+static int32_t gainTarget = DSP_UNITY;
+static int32_t gainStep = 0;
+static uint32_t gainSteps = 0;
+static uint8_t limiting = 1;
+static int32_t limiterThreshold = DSP_FULL_SCALE;
+static int32_t limiterRelease = DSP_UNITY;
+static int32_t limiterGain = DSP_UNITY;
+static int32_t work[DSP_BLOCK_FRAMES * 2];
+
+// Measurements
+static uint64_t eqBusyUs = 0;
+static uint64_t gainBusyUs = 0;
+static uint64_t limiterBusyUs = 0;
+static uint64_t bandFrames = 0;
+static uint64_t chainFrames = 0;
+static uint32_t limitedBlocks = 0;
+
+// Function declarations for internal functions
+static void apply_settings(uint32_t rate);
+static void design_band(const band_setting_t *band, uint32_t rate, biquad_t *biquad);
+static void run_band(const biquad_t *biquad, biquad_state_t *state, int32_t *samples, uint16_t count);
+static void run_gain(int32_t *samples, uint16_t count);
+static uint8_t run_limiter(int32_t *samples, uint16_t count, uint32_t *out);
+static uint8_t within_budget(uint8_t bands);
+static uint8_t count_bands(const band_setting_t *bands, uint8_t loudness);
+static int32_t to_q(float value, uint8_t bits);
+static int32_t saturate32(int64_t value);
+static uint16_t mcps_x10(uint64_t busy_us, uint64_t samples, uint32_t sample_rate, uint32_t clock_hz);
+
+audio_status_t audio_set_eq_band(uint8_t band, audio_eq_type_t type, uint16_t frequency_hz, int16_t gain_db_x10, uint16_t q_x100) {
+    if (band >= AUDIO_DSP_EQ_BANDS || type > AUDIO_EQ_HIGH_PASS || gain_db_x10 < -120 || gain_db_x10 > 120 ||
+        (type != AUDIO_EQ_OFF && (frequency_hz < 20 || q_x100 < 10 || q_x100 > 2000))) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    band_setting_t proposed[AUDIO_DSP_EQ_BANDS];
+    taskENTER_CRITICAL();
+    memcpy(proposed, settings, sizeof(proposed));
+    uint8_t loudness = loudnessOn;
+    taskEXIT_CRITICAL();
+    proposed[band].type = type;
+    proposed[band].frequency = frequency_hz;
+    proposed[band].gainDbX10 = gain_db_x10;
+    proposed[band].qX100 = q_x100;
+    if (type != AUDIO_EQ_OFF && !within_budget(count_bands(proposed, loudness))) {
+        return AUDIO_ERROR_BUSY;
+    }
+
+    taskENTER_CRITICAL();
+    settings[band] = proposed[band];
+    settingsVersion++;
+    taskEXIT_CRITICAL();
+    return AUDIO_OK;
+}
+
+audio_status_t audio_set_eq_preset(audio_eq_preset_t preset) {
+    // Type, frequency, gain (tenths of a dB), Q x 100 for each of the first four bands
+    static const band_setting_t presets[][4] = {
+        [AUDIO_EQ_PRESET_FLAT] = {{AUDIO_EQ_OFF, 0, 0, 0}},
+        [AUDIO_EQ_PRESET_BASS] = {
+            {AUDIO_EQ_LOW_SHELF, 120, 60, 70},
+            {AUDIO_EQ_PEAK, 60, 20, 100}
+        },
+        [AUDIO_EQ_PRESET_TREBLE] = {
+            {AUDIO_EQ_HIGH_SHELF, 6000, 50, 70},
+            {AUDIO_EQ_PEAK, 3000, -10, 100}
+        },
+        [AUDIO_EQ_PRESET_VOCAL] = {
+            {AUDIO_EQ_LOW_SHELF, 150, -30, 70},
+            {AUDIO_EQ_PEAK, 1000, 20, 80},
+            {AUDIO_EQ_PEAK, 3000, 30, 100}
+        },
+        [AUDIO_EQ_PRESET_SMALL_SPEAKER] = {
+            {AUDIO_EQ_HIGH_PASS, 150, 0, 71},
+            {AUDIO_EQ_PEAK, 250, 40, 100},
+            {AUDIO_EQ_PEAK, 800, -20, 140},
+            {AUDIO_EQ_HIGH_SHELF, 8000, 30, 70}
+        }
+    };
+    if ((uint32_t)preset >= sizeof(presets) / sizeof(presets[0])) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    band_setting_t proposed[AUDIO_DSP_EQ_BANDS];
+    memset(proposed, 0, sizeof(proposed));
+    for (uint8_t i = 0; i < 4 && i < AUDIO_DSP_EQ_BANDS; i++) {
+        proposed[i] = presets[preset][i];
+    }
+    taskENTER_CRITICAL();
+    uint8_t loudness = loudnessOn;
+    taskEXIT_CRITICAL();
+    if (!within_budget(count_bands(proposed, loudness))) {
+        return AUDIO_ERROR_BUSY;
+    }
+
+    taskENTER_CRITICAL();
+    memcpy(settings, proposed, sizeof(settings));
+    settingsVersion++;
+    taskEXIT_CRITICAL();
+    return AUDIO_OK;
+}
+
+audio_status_t audio_set_loudness(uint8_t enabled) {
+    band_setting_t current[AUDIO_DSP_EQ_BANDS];
+    taskENTER_CRITICAL();
+    memcpy(current, settings, sizeof(current));
+    taskEXIT_CRITICAL();
+    if (enabled && !within_budget(count_bands(current, 1))) {
+        return AUDIO_ERROR_BUSY;
+    }
+
+    taskENTER_CRITICAL();
+    loudnessOn = enabled ? 1 : 0;
+    settingsVersion++;
+    taskEXIT_CRITICAL();
+    return AUDIO_OK;
+}
+
+audio_status_t audio_ramp_volume(uint8_t level, uint16_t ramp_ms) {
+    if (level > 100) {
+        level = 100;
+    }
+    taskENTER_CRITICAL();
+    volume = level;
+    volumeRampMs = ramp_ms;
+    volumeVersion++;
+    if (loudnessOn) {
+        settingsVersion++;    // The loudness shelves follow the volume
+    }
+    taskEXIT_CRITICAL();
+    return AUDIO_OK;
+}
+
+audio_status_t audio_set_limiter(uint8_t enabled, int16_t threshold_db_x10, uint16_t release_ms) {
+    if (threshold_db_x10 < -200 || threshold_db_x10 > 0 || release_ms == 0) {
+        return AUDIO_ERROR_PARAM;
+    }
+    taskENTER_CRITICAL();
+    limiterOn = enabled ? 1 : 0;
+    limiterThresholdDbX10 = threshold_db_x10;
+    limiterReleaseMs = release_ms;
+    settingsVersion++;
+    taskEXIT_CRITICAL();
+    return AUDIO_OK;
+}
+
+void audio_process_dsp(int16_t *frames, uint16_t count) {
+    if (frames == NULL || count == 0) {
+        return;
+    }
+    uint32_t rate = audio_output_get_sample_rate();
+    if (rate == 0) {
+        return;
+    }
+    if (appliedSettings != settingsVersion || appliedVolume != volumeVersion || designRate != rate) {
+        apply_settings(rate);
+    }
+    // Nothing to do: leave the samples exactly as they are
+    if (activeCount == 0 && gainSteps == 0 && gainNow == DSP_UNITY && (!limiting || limiterThreshold >= DSP_FULL_SCALE)) {
+        return;
+    }
+
+    // The output's buffers hold whole frames, so they are 4-byte aligned
+    uint32_t *pairs = (uint32_t *)frames;
+    for (uint16_t offset = 0; offset < count;) {
+        uint16_t n = (uint16_t)(count - offset);
+        if (n > DSP_BLOCK_FRAMES) {
+            n = DSP_BLOCK_FRAMES;
+        }
+        for (uint16_t i = 0; i < n; i++) {
+            uint32_t pair = pairs[offset + i];
+            work[i * 2u] = (int32_t)(int16_t)(pair & 0xFFFFu) * (1 << DSP_SAMPLE_SHIFT);
+            work[i * 2u + 1u] = (int32_t)(int16_t)(pair >> 16) * (1 << DSP_SAMPLE_SHIFT);
+        }
+
+        uint32_t start = system_get_time_us();
+        for (uint8_t b = 0; b < activeCount; b++) {
+            uint8_t band = activeBands[b];
+            run_band(&coefficients[band], &filterState[band][0], work, n);
+            run_band(&coefficients[band], &filterState[band][1], work + 1, n);
+        }
+        uint32_t eqDone = system_get_time_us();
+        run_gain(work, n);
+        uint32_t gainDone = system_get_time_us();
+        if (run_limiter(work, n, pairs + offset)) {
+            limitedBlocks++;
+        }
+        uint32_t limiterDone = system_get_time_us();
+
+        eqBusyUs += eqDone - start;
+        gainBusyUs += gainDone - eqDone;
+        limiterBusyUs += limiterDone - gainDone;
+        bandFrames += (uint32_t)n * activeCount;
+        chainFrames += n;
+        offset = (uint16_t)(offset + n);
+    }
+}
+
+audio_status_t audio_get_dsp_stats(audio_dsp_stats_t *stats, uint8_t reset) {
+    if (stats == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    uint32_t rate = audio_output_get_sample_rate();
+    uint32_t clock = clock_get_hz(clk_sys);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->eq_mcps_x10 = mcps_x10(eqBusyUs, chainFrames, rate, clock);
+    stats->gain_mcps_x10 = mcps_x10(gainBusyUs, chainFrames, rate, clock);
+    stats->limiter_mcps_x10 = mcps_x10(limiterBusyUs, chainFrames, rate, clock);
+    stats->total_mcps_x10 = mcps_x10(eqBusyUs + gainBusyUs + limiterBusyUs, chainFrames, rate, clock);
+    if (clock >= 100000) {
+        uint32_t load = (uint32_t)stats->total_mcps_x10 * 100u / (clock / 100000u);
+        stats->load_pct = (load > 100) ? 100 : (uint8_t)load;
+    }
+    stats->budget_pct = AUDIO_DSP_BUDGET_PCT;
+    stats->eq_bands_active = activeCount;
+    stats->limited_blocks = limitedBlocks;
+    stats->frames = (uint32_t)chainFrames;
+
+    if (reset) {
+        eqBusyUs = 0;
+        gainBusyUs = 0;
+        limiterBusyUs = 0;
+        bandFrames = 0;
+        chainFrames = 0;
+        limitedBlocks = 0;
+    }
+    return AUDIO_OK;
+}
+
+// Turns the settings into coefficients (float is fine here: it runs once per change, not per sample)
+static void apply_settings(uint32_t rate) {
+    band_setting_t bands[DSP_TOTAL_BANDS];
+    taskENTER_CRITICAL();
+    memcpy(bands, settings, sizeof(settings));
+    uint8_t loudness = loudnessOn;
+    uint8_t level = volume;
+    uint16_t rampMs = volumeRampMs;
+    uint8_t limiterEnabled = limiterOn;
+    int16_t thresholdDbX10 = limiterThresholdDbX10;
+    uint16_t releaseMs = limiterReleaseMs;
+    uint32_t version = settingsVersion;
+    uint32_t volumeChange = volumeVersion;
+    taskEXIT_CRITICAL();
+
+    // Loudness: up to +10 dB of bass and +4 dB of treble as the volume goes to nothing
+    memset(&bands[AUDIO_DSP_EQ_BANDS], 0, sizeof(band_setting_t) * DSP_LOUDNESS_BANDS);
+    if (loudness && level < 100) {
+        bands[AUDIO_DSP_EQ_BANDS] = (band_setting_t){AUDIO_EQ_LOW_SHELF, 100, (int16_t)(100 - level), 70};
+        bands[AUDIO_DSP_EQ_BANDS + 1] = (band_setting_t){AUDIO_EQ_HIGH_SHELF, 10000, (int16_t)((100 - level) * 4 / 10), 70};
+    }
+
+    activeCount = 0;
+    for (uint8_t i = 0; i < DSP_TOTAL_BANDS; i++) {
+        if (bands[i].type == AUDIO_EQ_OFF) {
+            activeType[i] = AUDIO_EQ_OFF;
+            continue;
+        }
+        if (activeType[i] != bands[i].type || designRate != rate) {
+            // A different filter can't reuse the old one's memory; the same kind just changes smoothly
+            memset(filterState[i], 0, sizeof(filterState[i]));
+        }
+        design_band(&bands[i], rate, &coefficients[i]);
+        activeType[i] = bands[i].type;
+        activeBands[activeCount++] = (uint8_t)i;
+    }
+
+    limiting = limiterEnabled;
+    limiterThreshold = (int32_t)(powf(10.0f, (float)thresholdDbX10 / 200.0f) * (float)DSP_FULL_SCALE);
+    // Recovery per block: 1 - e^(-block / release time)
+    float releaseFrames = (float)releaseMs * (float)rate / 1000.0f;
+    limiterRelease = to_q(1.0f - expf(-(float)DSP_BLOCK_FRAMES / releaseFrames), DSP_GAIN_BITS);
+
+    if (appliedVolume != volumeChange || designRate == 0) {
+        // Squared, like a volume knob's taper: 50 sounds about half as loud as 100
+        gainTarget = (int32_t)(((int64_t)level * level * DSP_UNITY) / 10000);
+        gainSteps = (uint32_t)rampMs * rate / 1000u;
+        if (gainSteps == 0) {
+            gainNow = gainTarget;
+        } else {
+            gainStep = (int32_t)(((int64_t)gainTarget - gainNow) / (int64_t)gainSteps);
+        }
+    }
+
+    appliedSettings = version;
+    appliedVolume = volumeChange;
+    designRate = rate;
+}
+
+// Robert Bristow-Johnson's "Audio EQ Cookbook" biquads, normalized and turned into Q28
+static void design_band(const band_setting_t *band, uint32_t rate, biquad_t *biquad) {
+    float frequency = (float)band->frequency;
+    if (frequency > 0.45f * (float)rate) {
+        frequency = 0.45f * (float)rate;
+    }
+    float w0 = 2.0f * DSP_PI * frequency / (float)rate;
+    float cosW = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * (float)band->qX100 / 100.0f);
+    float a = powf(10.0f, (float)band->gainDbX10 / 400.0f);
+    float shelf = 2.0f * sqrtf(a) * alpha;
+    float b0;
+    float b1;
+    float b2;
+    float a0;
+    float a1;
+    float a2;
+
+    switch (band->type) {
+        case AUDIO_EQ_PEAK:
+            b0 = 1.0f + alpha * a;
+            b1 = -2.0f * cosW;
+            b2 = 1.0f - alpha * a;
+            a0 = 1.0f + alpha / a;
+            a1 = -2.0f * cosW;
+            a2 = 1.0f - alpha / a;
+            break;
+        case AUDIO_EQ_LOW_SHELF:
+            b0 = a * ((a + 1.0f) - (a - 1.0f) * cosW + shelf);
+            b1 = 2.0f * a * ((a - 1.0f) - (a + 1.0f) * cosW);
+            b2 = a * ((a + 1.0f) - (a - 1.0f) * cosW - shelf);
+            a0 = (a + 1.0f) + (a - 1.0f) * cosW + shelf;
+            a1 = -2.0f * ((a - 1.0f) + (a + 1.0f) * cosW);
+            a2 = (a + 1.0f) + (a - 1.0f) * cosW - shelf;
+            break;
+        case AUDIO_EQ_HIGH_SHELF:
+            b0 = a * ((a + 1.0f) + (a - 1.0f) * cosW + shelf);
+            b1 = -2.0f * a * ((a - 1.0f) + (a + 1.0f) * cosW);
+            b2 = a * ((a + 1.0f) + (a - 1.0f) * cosW - shelf);
+            a0 = (a + 1.0f) - (a - 1.0f) * cosW + shelf;
+            a1 = 2.0f * ((a - 1.0f) - (a + 1.0f) * cosW);
+            a2 = (a + 1.0f) - (a - 1.0f) * cosW - shelf;
+            break;
+        case AUDIO_EQ_LOW_PASS:
+            b0 = (1.0f - cosW) / 2.0f;
+            b1 = 1.0f - cosW;
+            b2 = b0;
+            a0 = 1.0f + alpha;
+            a1 = -2.0f * cosW;
+            a2 = 1.0f - alpha;
+            break;
+        default:    // AUDIO_EQ_HIGH_PASS
+            b0 = (1.0f + cosW) / 2.0f;
+            b1 = -(1.0f + cosW);
+            b2 = b0;
+            a0 = 1.0f + alpha;
+            a1 = -2.0f * cosW;
+            a2 = 1.0f - alpha;
+            break;
+    }
+
+    biquad->b0 = to_q(b0 / a0, DSP_COEFF_BITS);
+    biquad->b1 = to_q(b1 / a0, DSP_COEFF_BITS);
+    biquad->b2 = to_q(b2 / a0, DSP_COEFF_BITS);
+    biquad->a1 = to_q(-a1 / a0, DSP_COEFF_BITS);
+    biquad->a2 = to_q(-a2 / a0, DSP_COEFF_BITS);
+}
+
+// The EQ hot loop: one channel of a block (samples has a stride of 2), five SMLALs per sample
+static void run_band(const biquad_t *biquad, biquad_state_t *state, int32_t *samples, uint16_t count) {
+    const int32_t b0 = biquad->b0;
+    const int32_t b1 = biquad->b1;
+    const int32_t b2 = biquad->b2;
+    const int32_t a1 = biquad->a1;
+    const int32_t a2 = biquad->a2;
+    int32_t x1 = state->x1;
+    int32_t x2 = state->x2;
+    int32_t y1 = state->y1;
+    int32_t y2 = state->y2;
+    uint32_t error = state->error;
+
+    for (uint16_t i = 0; i < count; i++) {
+        int32_t x = samples[i * 2u];
+        // Adding back the fraction dropped last time (first-order error feedback) keeps low bands quiet
+        int64_t acc = (int64_t)error;
+        acc += (int64_t)b0 * x;
+        acc += (int64_t)b1 * x1;
+        acc += (int64_t)b2 * x2;
+        acc += (int64_t)a1 * y1;
+        acc += (int64_t)a2 * y2;
+        int32_t y = saturate32(acc >> DSP_COEFF_BITS);
+        error = (uint32_t)acc & DSP_COEFF_MASK;
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+        samples[i * 2u] = y;
+    }
+
+    state->x1 = x1;
+    state->x2 = x2;
+    state->y1 = y1;
+    state->y2 = y2;
+    state->error = error;
+}
+
+// Volume, gliding a step per frame while a ramp is running
+static void run_gain(int32_t *samples, uint16_t count) {
+    if (gainSteps == 0 && gainNow == DSP_UNITY) {
+        return;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        if (gainSteps > 0) {
+            gainNow += gainStep;
+            if (--gainSteps == 0) {
+                gainNow = gainTarget;    // Land exactly, whatever the division dropped
+            }
+        }
+        samples[i * 2u] = (int32_t)(((int64_t)samples[i * 2u] * gainNow) >> DSP_GAIN_BITS);
+        samples[i * 2u + 1u] = (int32_t)(((int64_t)samples[i * 2u + 1u] * gainNow) >> DSP_GAIN_BITS);
+    }
+}
+
+// Turns the block down if it's too loud, then rounds and clips back to 16 bits; 1 if it limited
+static uint8_t run_limiter(int32_t *samples, uint16_t count, uint32_t *out) {
+    uint8_t limited = 0;
+    if (limiting) {
+        uint32_t peak = 0;
+        for (uint16_t i = 0; i < count * 2u; i++) {
+            uint32_t level = (samples[i] < 0) ? (uint32_t)0 - (uint32_t)samples[i] : (uint32_t)samples[i];
+            if (level > peak) {
+                peak = level;
+            }
+        }
+        int32_t needed = DSP_UNITY;
+        if (peak > (uint32_t)limiterThreshold) {
+            needed = (int32_t)(((int64_t)limiterThreshold << DSP_GAIN_BITS) / peak);
+        }
+        if (needed < limiterGain) {
+            limiterGain = needed;    // Attack at once, so this block doesn't clip
+            limited = 1;
+        } else if (limiterGain < DSP_UNITY) {
+            limiterGain += (int32_t)(((int64_t)(DSP_UNITY - limiterGain) * limiterRelease) >> DSP_GAIN_BITS);
+            if (limiterGain > needed) {
+                limiterGain = needed;
+            }
+            limited = (limiterGain < DSP_UNITY);
+        }
+        if (limiterGain < DSP_UNITY) {
+            for (uint16_t i = 0; i < count * 2u; i++) {
+                samples[i] = (int32_t)(((int64_t)samples[i] * limiterGain) >> DSP_GAIN_BITS);
+            }
+        }
+    }
+
+    const int32_t round = 1 << (DSP_SAMPLE_SHIFT - 1);
+    for (uint16_t i = 0; i < count; i++) {
+        int32_t left = dsp_ssat16(dsp_qadd(samples[i * 2u], round) >> DSP_SAMPLE_SHIFT);
+        int32_t right = dsp_ssat16(dsp_qadd(samples[i * 2u + 1u], round) >> DSP_SAMPLE_SHIFT);
+        out[i] = dsp_pack16x2(left, right);
+    }
+    return limited;
+}
+
+// 1 if a chain with this many bands fits AUDIO_DSP_BUDGET_PCT at the output's rate
+static uint8_t within_budget(uint8_t bands) {
+    uint32_t rate = audio_output_get_sample_rate();
+    uint32_t clock = clock_get_hz(clk_sys);
+    if (rate == 0 || clock < 1000000u) {
+        return 1;    // Not playing yet: checked again when a band is set while playing
+    }
+    uint32_t cyclesPerUs = clock / 1000000u;
+    uint64_t bandCycles = (bandFrames > 0) ? eqBusyUs * cyclesPerUs / bandFrames : DSP_BAND_CYCLES_GUESS;
+    uint64_t otherCycles = (chainFrames > 0) ? (gainBusyUs + limiterBusyUs) * cyclesPerUs / chainFrames : DSP_OTHER_CYCLES_GUESS;
+    uint64_t load = (bandCycles * bands + otherCycles) * rate * 100u / clock;
+    return load <= AUDIO_DSP_BUDGET_PCT;
+}
+
+static uint8_t count_bands(const band_setting_t *bands, uint8_t loudness) {
+    uint8_t count = loudness ? DSP_LOUDNESS_BANDS : 0;
+    for (uint8_t i = 0; i < AUDIO_DSP_EQ_BANDS; i++) {
+        if (bands[i].type != AUDIO_EQ_OFF) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int32_t to_q(float value, uint8_t bits) {
+    float scaled = value * (float)(1L << bits);
+    if (scaled >= 2147483647.0f) {
+        return INT32_MAX;
+    }
+    if (scaled <= -2147483648.0f) {
+        return INT32_MIN;
+    }
+    return (int32_t)lrintf(scaled);
+}
+
+static int32_t saturate32(int64_t value) {
+    if (value > INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (value < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return (int32_t)value;
+}
+
+// Millions of cycles per second of audio, times 10
+static uint16_t mcps_x10(uint64_t busy_us, uint64_t samples, uint32_t sample_rate, uint32_t clock_hz) {
+    if (samples == 0 || sample_rate == 0) {
+        return 0;
+    }
+    uint64_t cycles = busy_us * (clock_hz / 1000u) / 1000u;
+    uint64_t value = cycles * sample_rate * 10u / samples / 1000000u;
+    return (value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+}
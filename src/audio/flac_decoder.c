@@ -0,0 +1,729 @@
+#include "audio/flac_decoder.h"
+#include "audio/audio_telemetry.h"
+#include "audio/dsp_kernels.h"
+#include "fs/fs_manager.h"
+#include "FreeRTOS.h"
+#include <string.h>
+
+#define FLAC_MAX_CHANNELS       2
+#define FLAC_MAX_BITS           24
+#define FLAC_MAX_LPC_ORDER      32
+#define FLAC_MAX_HEADER_BYTES   16
+
+// Channel assignments beyond "independent"
+#define FLAC_LEFT_SIDE          8
+#define FLAC_SIDE_RIGHT         9
+#define FLAC_MID_SIDE           10
+
+struct flac_decoder_s {
+    fs_file_t file;
+    flac_stream_info_t info;
+    int32_t *samples[FLAC_MAX_CHANNELS];   // One block per channel
+    uint32_t bitWindow;       // Next bits of the file, MSB first; bits past bitCount are zero
+    uint8_t bitCount;         // Valid bits in bitWindow
+    uint16_t crc16;           // Frame CRC-16 of every byte that entered bitWindow so far
+    uint16_t crcBefore[4];    // crc16 before each of the last four bytes that entered, by crcSlot
+    uint8_t crcSlot;
+    uint8_t eof;              // Tried to read past the end of the file
+    uint8_t finished;         // No more frames
+    uint8_t frameChannels;    // Channels in the decoded frame
+    uint8_t frameBits;        // Bits per sample in the decoded frame
+    uint16_t pcmFrames;       // Samples per channel in the decoded frame
+    uint16_t pcmPosition;     // Next one to hand out
+    uint32_t cachePosition;
+    uint32_t cacheLength;
+    uint8_t cache[FLAC_DECODER_CACHE_BYTES];
+};
+
+// Function declarations for internal functions
+static void refill(struct flac_decoder_s *flac);
+static uint32_t read_bits(struct flac_decoder_s *flac, uint8_t count);
+static uint32_t read_bits32(struct flac_decoder_s *flac, uint8_t count);
+static int32_t read_signed(struct flac_decoder_s *flac, uint8_t count);
+static uint32_t read_unary(struct flac_decoder_s *flac);
+static void align_to_byte(struct flac_decoder_s *flac);
+static uint8_t skip_bytes(struct flac_decoder_s *flac, uint32_t count);
+static audio_status_t read_metadata(struct flac_decoder_s *flac);
+static int8_t read_frame_header(struct flac_decoder_s *flac, uint32_t *block_size, uint8_t *assignment, uint8_t *bits);
+static uint8_t decode_subframe(struct flac_decoder_s *flac, int32_t *samples, uint32_t block_size, uint8_t bits);
+static uint8_t decode_residual(struct flac_decoder_s *flac, int32_t *samples, uint32_t block_size, uint8_t order);
+static void restore_fixed(int32_t *samples, uint32_t block_size, uint8_t order);
+static void restore_lpc(int32_t *samples, uint32_t block_size, const int32_t *coefs, uint8_t order, uint8_t shift, uint8_t wide);
+static uint8_t crc8(const uint8_t *data, uint8_t length);
+static inline void crc16_add(struct flac_decoder_s *flac, uint8_t byte);
+static uint16_t crc16_consumed(const struct flac_decoder_s *flac);
+
+audio_status_t flac_decoder_open(const char *filename, flac_decoder_t *decoder) {
+    if (filename == NULL || decoder == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    struct flac_decoder_s *flac = (struct flac_decoder_s *)pvPortMalloc(sizeof(struct flac_decoder_s));
+    if (flac == NULL) {
+        return AUDIO_ERROR_MEMORY;
+    }
+    memset(flac, 0, sizeof(*flac));
+
+    if (fs_open(filename, FS_READ, &flac->file) != FS_OK) {
+        vPortFree(flac);
+        return AUDIO_ERROR_IO;
+    }
+
+    audio_status_t status = read_metadata(flac);
+    if (status == AUDIO_OK && flac->info.max_block_size > FLAC_DECODER_MAX_BLOCK_SIZE) {
+        status = AUDIO_ERROR_MEMORY;
+    }
+    for (uint8_t ch = 0; status == AUDIO_OK && ch < flac->info.channels; ch++) {
+        flac->samples[ch] = (int32_t *)pvPortMalloc((size_t)flac->info.max_block_size * sizeof(int32_t));
+        if (flac->samples[ch] == NULL) {
+            status = AUDIO_ERROR_MEMORY;
+        }
+    }
+    if (status != AUDIO_OK) {
+        flac_decoder_close(flac);
+        return status;
+    }
+
+    *decoder = flac;
+    return AUDIO_OK;
+}
+
+void flac_decoder_close(flac_decoder_t decoder) {
+    if (decoder == NULL) {
+        return;
+    }
+    for (uint8_t ch = 0; ch < FLAC_MAX_CHANNELS; ch++) {
+        if (decoder->samples[ch] != NULL) {
+            vPortFree(decoder->samples[ch]);
+        }
+    }
+    fs_close(decoder->file);
+    vPortFree(decoder);
+}
+
+audio_status_t flac_decoder_get_info(flac_decoder_t decoder, flac_stream_info_t *info) {
+    if (decoder == NULL || info == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    *info = decoder->info;
+    return AUDIO_OK;
+}
+
+audio_status_t flac_decoder_decode_frame(flac_decoder_t decoder) {
+    if (decoder == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    struct flac_decoder_s *flac = decoder;
+    if (flac->pcmPosition < flac->pcmFrames) {
+        return AUDIO_OK;
+    }
+    if (flac->finished) {
+        return AUDIO_ERROR_BUSY;
+    }
+
+    uint32_t blockSize;
+    uint8_t assignment;
+    uint8_t bits;
+    int8_t header;
+    // A header that fails its CRC is not a frame: look for the next sync code
+    while ((header = read_frame_header(flac, &blockSize, &assignment, &bits)) == 0) {
+    }
+    if (header < 0) {
+        flac->finished = 1;
+        return AUDIO_ERROR_BUSY;
+    }
+
+    uint8_t channels = (assignment < FLAC_LEFT_SIDE) ? (uint8_t)(assignment + 1) : 2;
+    uint8_t ok = 1;
+    for (uint8_t ch = 0; ch < channels && ok; ch++) {
+        // The side channel needs one more bit than the others
+        uint8_t sideBit = ((assignment == FLAC_LEFT_SIDE || assignment == FLAC_MID_SIDE) && ch == 1) ||
+                          (assignment == FLAC_SIDE_RIGHT && ch == 0);
+        ok = decode_subframe(flac, flac->samples[ch], blockSize, (uint8_t)(bits + sideBit));
+    }
+    align_to_byte(flac);
+    uint16_t crc = crc16_consumed(flac);
+    if (read_bits(flac, 16) != crc) {
+        ok = 0;    // Damaged somewhere the subframes can't tell
+    }
+    if (flac->eof) {
+        // A frame cut short by the end of the file is dropped
+        flac->finished = 1;
+        return AUDIO_ERROR_BUSY;
+    }
+
+    if (!ok) {
+        // Keep the timing: a broken frame plays as silence
+        for (uint8_t ch = 0; ch < channels; ch++) {
+            memset(flac->samples[ch], 0, blockSize * sizeof(int32_t));
+        }
+    } else if (assignment >= FLAC_LEFT_SIDE) {
+        int32_t *a = flac->samples[0];
+        int32_t *b = flac->samples[1];
+        for (uint32_t i = 0; i < blockSize; i++) {
+            if (assignment == FLAC_LEFT_SIDE) {
+                b[i] = a[i] - b[i];
+            } else if (assignment == FLAC_SIDE_RIGHT) {
+                a[i] += b[i];
+            } else {
+                int32_t mid = (int32_t)((uint32_t)a[i] << 1) | (b[i] & 1);
+                int32_t side = b[i];
+                a[i] = (mid + side) >> 1;
+                b[i] = (mid - side) >> 1;
+            }
+        }
+    }
+
+    flac->frameChannels = channels;
+    flac->frameBits = bits;
+    flac->pcmFrames = (uint16_t)blockSize;
+    flac->pcmPosition = 0;
+    return AUDIO_OK;
+}
+
+uint16_t flac_decoder_read_pcm(flac_decoder_t decoder, int16_t *pcm, uint16_t max_frames) {
+    if (decoder == NULL || pcm == NULL) {
+        return 0;
+    }
+
+    uint16_t count = flac_decoder_pending_frames(decoder);
+    if (count > max_frames) {
+        count = max_frames;
+    }
+    const int32_t *left = decoder->samples[0] + decoder->pcmPosition;
+    const int32_t *right = (decoder->frameChannels == 2) ? decoder->samples[1] + decoder->pcmPosition : left;
+    // pcm is 4-byte aligned: the rings and output buffers only ever hold whole frames
+    uint32_t *out = (uint32_t *)pcm;
+
+    if (decoder->frameBits > 16) {
+        uint8_t shift = (uint8_t)(decoder->frameBits - 16);
+        int32_t round = 1 << (shift - 1);
+        for (uint16_t i = 0; i < count; i++) {
+            out[i] = dsp_pack16x2(dsp_ssat16((left[i] + round) >> shift), dsp_ssat16((right[i] + round) >> shift));
+        }
+    } else {
+        uint8_t shift = (uint8_t)(16 - decoder->frameBits);
+        for (uint16_t i = 0; i < count; i++) {
+            out[i] = dsp_pack16x2((int32_t)((uint32_t)left[i] << shift), (int32_t)((uint32_t)right[i] << shift));
+        }
+    }
+
+    decoder->pcmPosition += count;
+    return count;
+}
+
+uint16_t flac_decoder_pending_frames(flac_decoder_t decoder) {
+    if (decoder == NULL || decoder->pcmPosition >= decoder->pcmFrames) {
+        return 0;
+    }
+    return (uint16_t)(decoder->pcmFrames - decoder->pcmPosition);
+}
+
+audio_stage_result_t audio_stage_decode_flac(void *context, spsc_ring_t *input, spsc_ring_t *output) {
+    (void)input;
+    flac_decoder_t decoder = (flac_decoder_t)context;
+    if (decoder == NULL || output == NULL) {
+        return AUDIO_STAGE_ERROR;
+    }
+
+    uint8_t moved = 0;
+    for (;;) {
+        // Hand out the last frame first; it may take two goes if the ring wraps
+        if (flac_decoder_pending_frames(decoder) > 0) {
+            uint32_t space;
+            int16_t *dst = (int16_t *)spsc_ring_write_ptr(output, &space);
+            uint32_t room = space / 4u;
+            uint16_t frames = flac_decoder_read_pcm(decoder, dst, (room > UINT16_MAX) ? UINT16_MAX : (uint16_t)room);
+            if (frames == 0) {
+                return moved ? AUDIO_STAGE_PROGRESS : AUDIO_STAGE_BLOCKED;
+            }
+            spsc_ring_write_commit(output, (uint32_t)frames * 4u);
+            moved = 1;
+            continue;
+        }
+        if (moved) {
+            // One frame per call keeps the other stages moving
+            return AUDIO_STAGE_PROGRESS;
+        }
+
+        audio_status_t status = flac_decoder_decode_frame(decoder);
+        if (status == AUDIO_ERROR_BUSY) {
+            return AUDIO_STAGE_DONE;
+        }
+        if (status != AUDIO_OK) {
+            return AUDIO_STAGE_ERROR;
+        }
+    }
+}
+
+// Tops the bit window up to at least 25 bits, reading the card when the cache runs dry
+static void refill(struct flac_decoder_s *flac) {
+    while (flac->bitCount <= 24) {
+        if (flac->cachePosition == flac->cacheLength) {
+            size_t got = 0;
+            if (audio_telemetry_read(flac->file, flac->cache, sizeof(flac->cache), &got) != FS_OK || got == 0) {
+                return;
+            }
+            flac->cachePosition = 0;
+            flac->cacheLength = (uint32_t)got;
+        }
+        uint8_t byte = flac->cache[flac->cachePosition++];
+        crc16_add(flac, byte);
+        flac->bitWindow |= (uint32_t)byte << (24 - flac->bitCount);
+        flac->bitCount += 8;
+    }
+}
+
+// Reads up to 24 bits; past the end of the file it reads zeros and sets eof
+static inline uint32_t read_bits(struct flac_decoder_s *flac, uint8_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    if (flac->bitCount < count) {
+        refill(flac);
+        if (flac->bitCount < count) {
+            flac->eof = 1;
+            flac->bitCount = count;
+        }
+    }
+    uint32_t value = flac->bitWindow >> (32 - count);
+    flac->bitWindow <<= count;
+    flac->bitCount -= count;
+    return value;
+}
+
+static uint32_t read_bits32(struct flac_decoder_s *flac, uint8_t count) {
+    if (count <= 24) {
+        return read_bits(flac, count);
+    }
+    uint32_t high = read_bits(flac, (uint8_t)(count - 16));
+    return (high << 16) | read_bits(flac, 16);
+}
+
+static inline int32_t read_signed(struct flac_decoder_s *flac, uint8_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t value = read_bits32(flac, count);
+    return (int32_t)(value << (32 - count)) >> (32 - count);
+}
+
+// Counts zero bits up to and including the next one bit, a whole window at a time
+static inline uint32_t read_unary(struct flac_decoder_s *flac) {
+    uint32_t zeros = 0;
+    for (;;) {
+        if (flac->bitCount == 0) {
+            refill(flac);
+            if (flac->bitCount == 0) {
+                flac->eof = 1;
+                return zeros;
+            }
+        }
+        uint32_t run = dsp_clz(flac->bitWindow);
+        if (run < flac->bitCount) {
+            zeros += run;
+            // run + 1 can be 32 when the window was full and the one bit was last
+            flac->bitWindow = (run + 1 < 32) ? flac->bitWindow << (run + 1) : 0;
+            flac->bitCount -= (uint8_t)(run + 1);
+            return zeros;
+        }
+        zeros += flac->bitCount;
+        flac->bitWindow = 0;
+        flac->bitCount = 0;
+    }
+}
+
+static void align_to_byte(struct flac_decoder_s *flac) {
+    read_bits(flac, flac->bitCount & 7);
+}
+
+// Skips whole bytes: first from the window and cache, then by seeking the file
+static uint8_t skip_bytes(struct flac_decoder_s *flac, uint32_t count) {
+    align_to_byte(flac);
+    while (count > 0 && flac->bitCount >= 8) {
+        read_bits(flac, 8);
+        count--;
+    }
+    uint32_t cached = flac->cacheLength - flac->cachePosition;
+    uint32_t take = (count < cached) ? count : cached;
+    flac->cachePosition += take;
+    count -= take;
+    if (count > 0 && fs_seek(flac->file, (int32_t)count, FS_SEEK_CUR) != FS_OK) {
+        return 0;
+    }
+    return 1;
+}
+
+static audio_status_t read_metadata(struct flac_decoder_s *flac) {
+    uint32_t magic = read_bits32(flac, 32);
+
+    // Some taggers put ID3v2 in front of FLAC too
+    if ((magic >> 8) == 0x494433u) {
+        read_bits(flac, 8);     // Revision
+        uint8_t flags = (uint8_t)read_bits(flac, 8);
+        uint32_t size = 0;
+        for (uint8_t i = 0; i < 4; i++) {
+            size = (size << 7) | (read_bits(flac, 8) & 0x7Fu);
+        }
+        if (flags & 0x10) {
+            size += 10;         // Footer
+        }
+        if (!skip_bytes(flac, size)) {
+            return AUDIO_ERROR_IO;
+        }
+        magic = read_bits32(flac, 32);
+    }
+    if (magic != 0x664C6143u) {    // "fLaC"
+        return AUDIO_ERROR_FORMAT;
+    }
+
+    uint8_t haveInfo = 0;
+    uint8_t last = 0;
+    while (!last) {
+        last = (uint8_t)read_bits(flac, 1);
+        uint8_t type = (uint8_t)read_bits(flac, 7);
+        uint32_t length = read_bits(flac, 24);
+        if (flac->eof) {
+            return AUDIO_ERROR_FORMAT;
+        }
+
+        if (type == 0 && length >= 34) {
+            // STREAMINFO
+            read_bits(flac, 16);    // Min block size
+            flac->info.max_block_size = (uint16_t)read_bits(flac, 16);
+            read_bits(flac, 24);    // Min frame size
+            read_bits(flac, 24);    // Max frame size
+            flac->info.sample_rate = read_bits(flac, 20);
+            flac->info.channels = (uint8_t)(read_bits(flac, 3) + 1);
+            flac->info.bits_per_sample = (uint8_t)(read_bits(flac, 5) + 1);
+            flac->info.total_samples = ((uint64_t)read_bits(flac, 4) << 32) | read_bits32(flac, 32);
+            length -= 18;           // The MD5 and anything newer is skipped below
+            haveInfo = 1;
+        }
+        if (!skip_bytes(flac, length)) {
+            return AUDIO_ERROR_IO;
+        }
+    }
+
+    if (!haveInfo || flac->eof) {
+        return AUDIO_ERROR_FORMAT;
+    }
+    if (flac->info.channels > FLAC_MAX_CHANNELS || flac->info.bits_per_sample > FLAC_MAX_BITS ||
+        flac->info.bits_per_sample < 4 || flac->info.max_block_size < 16 || flac->info.sample_rate == 0) {
+        return AUDIO_ERROR_FORMAT;
+    }
+    return AUDIO_OK;
+}
+
+// 1 = header read, 0 = bad header (call again to resync), -1 = end of file
+static int8_t read_frame_header(struct flac_decoder_s *flac, uint32_t *block_size, uint8_t *assignment, uint8_t *bits) {
+    static const uint16_t blockSizes[16] = {0, 192, 576, 1152, 2304, 4608, 0, 0, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768};
+    static const uint8_t sampleBits[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+    uint8_t header[FLAC_MAX_HEADER_BYTES];
+    uint8_t length = 0;
+
+    // Sync code: 0xFF then 0xF8 (fixed blocks) or 0xF9 (variable blocks), byte aligned
+    align_to_byte(flac);
+    uint32_t byte = read_bits(flac, 8);
+    for (;;) {
+        if (flac->eof) {
+            return -1;
+        }
+        if (byte == 0xFF) {
+            byte = read_bits(flac, 8);
+            if ((byte & 0xFE) == 0xF8) {
+                break;
+            }
+            continue;
+        }
+        byte = read_bits(flac, 8);
+    }
+    header[length++] = 0xFF;
+    header[length++] = (uint8_t)byte;
+    header[length++] = (uint8_t)read_bits(flac, 8);
+    header[length++] = (uint8_t)read_bits(flac, 8);
+
+    uint8_t blockCode = header[2] >> 4;
+    uint8_t rateCode = header[2] & 0x0F;
+    *assignment = header[3] >> 4;
+    uint8_t bitsCode = (header[3] >> 1) & 0x07;
+    if (blockCode == 0 || rateCode == 15 || *assignment > FLAC_MID_SIDE || bitsCode == 3 || (header[3] & 1)) {
+        return 0;
+    }
+
+    // Frame or sample number, UTF-8 style: the count of leading ones is the length
+    uint8_t first = (uint8_t)read_bits(flac, 8);
+    header[length++] = first;
+    uint8_t extra = 0;
+    if (first & 0x80) {
+        extra = (uint8_t)(dsp_clz(~((uint32_t)first << 24)) - 1);
+        if (extra == 0 || extra > 6) {
+            return 0;
+        }
+    }
+    for (uint8_t i = 0; i < extra; i++) {
+        header[length++] = (uint8_t)read_bits(flac, 8);
+    }
+
+    if (blockCode == 6) {
+        header[length] = (uint8_t)read_bits(flac, 8);
+        *block_size = header[length++] + 1u;
+    } else if (blockCode == 7) {
+        header[length] = (uint8_t)read_bits(flac, 8);
+        header[length + 1] = (uint8_t)read_bits(flac, 8);
+        *block_size = (((uint32_t)header[length] << 8) | header[length + 1]) + 1u;
+        length += 2;
+    } else {
+        *block_size = blockSizes[blockCode];
+    }
+    if (rateCode == 12) {
+        header[length++] = (uint8_t)read_bits(flac, 8);
+    } else if (rateCode == 13 || rateCode == 14) {
+        header[length++] = (uint8_t)read_bits(flac, 8);
+        header[length++] = (uint8_t)read_bits(flac, 8);
+    }
+
+    uint8_t crc = (uint8_t)read_bits(flac, 8);
+    if (flac->eof) {
+        return -1;
+    }
+    if (crc != crc8(header, length)) {
+        return 0;
+    }
+
+    // Start the frame CRC-16: the header, its CRC-8, then the bytes already waiting in the window
+    header[length++] = crc;
+    flac->crc16 = 0;
+    for (uint8_t i = 0; i < length; i++) {
+        crc16_add(flac, header[i]);
+    }
+    for (uint8_t i = 0; i < flac->bitCount / 8u; i++) {
+        crc16_add(flac, (uint8_t)(flac->bitWindow >> (24 - 8 * i)));
+    }
+
+    *bits = bitsCode ? sampleBits[bitsCode] : flac->info.bits_per_sample;
+    uint8_t channels = (*assignment < FLAC_LEFT_SIDE) ? (uint8_t)(*assignment + 1) : 2;
+    // Sample rate changes mid-stream are not followed; the output runs at the STREAMINFO rate
+    if (*block_size > flac->info.max_block_size || channels > flac->info.channels || *bits > FLAC_MAX_BITS) {
+        return 0;
+    }
+    return 1;
+}
+
+static uint8_t decode_subframe(struct flac_decoder_s *flac, int32_t *samples, uint32_t block_size, uint8_t bits) {
+    if (read_bits(flac, 1) != 0) {
+        return 0;
+    }
+    uint8_t type = (uint8_t)read_bits(flac, 6);
+    uint8_t wasted = 0;
+    if (read_bits(flac, 1)) {
+        // Wasted bits: every sample had this many zero bits at the bottom
+        wasted = (uint8_t)(read_unary(flac) + 1);
+        if (wasted >= bits) {
+            return 0;
+        }
+        bits -= wasted;
+    }
+
+    if (type == 0) {
+        int32_t value = read_signed(flac, bits);
+        for (uint32_t i = 0; i < block_size; i++) {
+            samples[i] = value;
+        }
+    } else if (type == 1) {
+        for (uint32_t i = 0; i < block_size; i++) {
+            samples[i] = read_signed(flac, bits);
+        }
+    } else if (type >= 8 && type <= 12) {
+        uint8_t order = type - 8;
+        if (order > block_size) {
+            return 0;
+        }
+        for (uint8_t i = 0; i < order; i++) {
+            samples[i] = read_signed(flac, bits);
+        }
+        if (!decode_residual(flac, samples, block_size, order)) {
+            return 0;
+        }
+        restore_fixed(samples, block_size, order);
+    } else if (type >= 32) {
+        uint8_t order = (uint8_t)(type - 31);
+        int32_t coefs[FLAC_MAX_LPC_ORDER];
+        if (order > block_size) {
+            return 0;
+        }
+        for (uint8_t i = 0; i < order; i++) {
+            samples[i] = read_signed(flac, bits);
+        }
+        uint8_t precision = (uint8_t)(read_bits(flac, 4) + 1);
+        int32_t shift = read_signed(flac, 5);
+        if (precision == 16 || shift < 0) {
+            return 0;
+        }
+        for (uint8_t i = 0; i < order; i++) {
+            coefs[i] = read_signed(flac, precision);
+        }
+        if (!decode_residual(flac, samples, block_size, order)) {
+            return 0;
+        }
+        // |sum| < order * 2^(precision - 1) * 2^(bits - 1), so 32 bits are enough while this holds
+        uint8_t orderBits = (uint8_t)(32 - dsp_clz((uint32_t)order - 1u));
+        restore_lpc(samples, block_size, coefs, order, (uint8_t)shift, (uint8_t)(bits + precision + orderBits > 32));
+    } else {
+        return 0;
+    }
+
+    if (wasted) {
+        for (uint32_t i = 0; i < block_size; i++) {
+            samples[i] = (int32_t)((uint32_t)samples[i] << wasted);
+        }
+    }
+    return !flac->eof;
+}
+
+// Writes residuals after the warm-up samples; the predictor is added on top afterwards
+static uint8_t decode_residual(struct flac_decoder_s *flac, int32_t *samples, uint32_t block_size, uint8_t order) {
+    uint8_t method = (uint8_t)read_bits(flac, 2);
+    if (method > 1) {
+        return 0;
+    }
+    uint8_t paramBits = method ? 5 : 4;
+    uint8_t escape = method ? 31 : 15;
+    uint8_t partitionOrder = (uint8_t)read_bits(flac, 4);
+    uint32_t partitionSize = block_size >> partitionOrder;
+    if ((partitionSize << partitionOrder) != block_size || partitionSize < order) {
+        return 0;
+    }
+
+    int32_t *out = samples + order;
+    for (uint32_t partition = 0; partition < (1u << partitionOrder); partition++) {
+        uint32_t count = (partition == 0) ? partitionSize - order : partitionSize;
+        uint8_t param = (uint8_t)read_bits(flac, paramBits);
+        if (param == escape) {
+            uint8_t rawBits = (uint8_t)read_bits(flac, 5);
+            for (uint32_t i = 0; i < count; i++) {
+                out[i] = read_signed(flac, rawBits);
+            }
+        } else {
+            // The hot loop: unary quotient by CLZ, then param raw bits, then zigzag back to signed
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t value = (read_unary(flac) << param) | read_bits32(flac, param);
+                out[i] = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+            }
+        }
+        out += count;
+        if (flac->eof) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void restore_fixed(int32_t *samples, uint32_t block_size, uint8_t order) {
+    int32_t *s = samples;
+    switch (order) {
+        case 1:
+            for (uint32_t i = 1; i < block_size; i++) {
+                s[i] += s[i - 1];
+            }
+            break;
+        case 2:
+            for (uint32_t i = 2; i < block_size; i++) {
+                s[i] += 2 * s[i - 1] - s[i - 2];
+            }
+            break;
+        case 3:
+            for (uint32_t i = 3; i < block_size; i++) {
+                s[i] += 3 * (s[i - 1] - s[i - 2]) + s[i - 3];
+            }
+            break;
+        case 4:
+            for (uint32_t i = 4; i < block_size; i++) {
+                s[i] += 4 * (s[i - 1] + s[i - 3]) - 6 * s[i - 2] - s[i - 4];
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// With a constant order the inner loop unrolls completely and the coefficients stay in registers
+static inline __attribute__((always_inline)) void restore_lpc32(int32_t *samples, uint32_t block_size, const int32_t *coefs, const uint8_t order, uint8_t shift) {
+    for (uint32_t i = order; i < block_size; i++) {
+        int32_t sum = 0;
+        for (uint8_t j = 0; j < order; j++) {
+            sum += coefs[j] * samples[i - 1 - j];
+        }
+        samples[i] += sum >> shift;
+    }
+}
+
+static void restore_lpc(int32_t *samples, uint32_t block_size, const int32_t *coefs, uint8_t order, uint8_t shift, uint8_t wide) {
+    if (wide) {
+        // 24-bit audio with high-precision coefficients: SMLAL into a 64-bit sum
+        for (uint32_t i = order; i < block_size; i++) {
+            int64_t sum = 0;
+            for (uint8_t j = 0; j < order; j++) {
+                sum += (int64_t)coefs[j] * samples[i - 1 - j];
+            }
+            samples[i] += (int32_t)(sum >> shift);
+        }
+        return;
+    }
+
+    switch (order) {
+        case 1:  restore_lpc32(samples, block_size, coefs, 1, shift);  break;
+        case 2:  restore_lpc32(samples, block_size, coefs, 2, shift);  break;
+        case 3:  restore_lpc32(samples, block_size, coefs, 3, shift);  break;
+        case 4:  restore_lpc32(samples, block_size, coefs, 4, shift);  break;
+        case 5:  restore_lpc32(samples, block_size, coefs, 5, shift);  break;
+        case 6:  restore_lpc32(samples, block_size, coefs, 6, shift);  break;
+        case 7:  restore_lpc32(samples, block_size, coefs, 7, shift);  break;
+        case 8:  restore_lpc32(samples, block_size, coefs, 8, shift);  break;
+        case 9:  restore_lpc32(samples, block_size, coefs, 9, shift);  break;
+        case 10: restore_lpc32(samples, block_size, coefs, 10, shift); break;
+        case 11: restore_lpc32(samples, block_size, coefs, 11, shift); break;
+        case 12: restore_lpc32(samples, block_size, coefs, 12, shift); break;
+        default:
+            // Orders above 12 fall outside the FLAC subset and are rare
+            for (uint32_t i = order; i < block_size; i++) {
+                int32_t sum = 0;
+                for (uint8_t j = 0; j < order; j++) {
+                    sum += coefs[j] * samples[i - 1 - j];
+                }
+                samples[i] += sum >> shift;
+            }
+            break;
+    }
+}
+
+// CRC-8, polynomial x^8 + x^2 + x + 1, over the frame header
+static uint8_t crc8(const uint8_t *data, uint8_t length) {
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// CRC-16, polynomial 0x8005, MSB first, one table step per byte
+static inline void crc16_add(struct flac_decoder_s *flac, uint8_t byte) {
+    static const uint16_t table[16] = {
+        0x0000, 0x8005, 0x800F, 0x000A, 0x801B, 0x001E, 0x0014, 0x8011,
+        0x8033, 0x0036, 0x003C, 0x8039, 0x0028, 0x802D, 0x8027, 0x0022
+    };
+    uint16_t crc = flac->crc16;
+    flac->crcBefore[flac->crcSlot++ & 3u] = crc;
+    crc = (uint16_t)((crc << 4) ^ table[((crc >> 12) ^ (byte >> 4)) & 0x0F]);
+    crc = (uint16_t)((crc << 4) ^ table[((crc >> 12) ^ byte) & 0x0F]);
+    flac->crc16 = crc;
+}
+
+// CRC-16 up to the read position: the whole bytes still in the window haven't been read yet
+static uint16_t crc16_consumed(const struct flac_decoder_s *flac) {
+    uint8_t ahead = flac->bitCount / 8u;
+    return (ahead == 0) ? flac->crc16 : flac->crcBefore[(uint8_t)(flac->crcSlot - ahead) & 3u];
+}
@@ -0,0 +1,538 @@
+#include "audio/mp3_decoder.h"
+#include "audio/mp3_synth.h"
+#include "core/system.h"
+#include "fs/fs_manager.h"
+#include "FreeRTOS.h"
+#include "hardware/clocks.h"
+#include "mad.h"
+#include <string.h>
+
+#define BENCHMARK_CHUNK_BYTES   512
+#define BENCHMARK_PCM_FRAMES    64
+
+#define MP3_NO_LIMIT            UINT64_MAX
+
+// MAD numbers errors found after a good frame header 0x02xx: that frame was used up
+#define MAD_FRAME_ERROR(error)  (((error) & 0xff00) == 0x0200)
+
+struct mp3_decoder_s {
+    struct mad_stream stream;
+    struct mad_frame frame;
+    mp3_synth_t synth;        // Our synthesis filter, in place of MAD's (audio/mp3_synth.h)
+    uint8_t input[MP3_DECODER_INPUT_BYTES + MAD_BUFFER_GUARD];
+    uint32_t inputLength;     // Bytes in input, including ones MAD has already used
+    uint32_t streamOffset;    // Stream bytes fed before input[0] (skipped tag bytes included)
+    uint32_t skipBytes;       // ID3v2 tag bytes still to throw away
+    uint8_t tagChecked;       // Looked for an ID3v2 tag at the start of the stream
+    uint8_t finished;         // No more input; guard bytes appended
+    uint16_t pcmPosition;     // Next frame of synth.pcm to hand out
+    uint32_t frameCount;      // Frames decoded since the stream started
+    uint32_t soundFrames;     // Frames of sound met since the stream started (header frame not counted)
+    uint32_t frameOffset;     // Stream offset of the last frame of sound decoded
+    uint32_t dropFrames;      // Whole frames still to decode and throw away after a seek
+    uint32_t trimStart;       // Samples still to drop from the front (encoder + decoder delay)
+    uint64_t playLimit;       // Samples still to hand out before the encoder's padding (MP3_NO_LIMIT = unknown)
+    mp3_gapless_t gapless;
+    mp3_frame_info_t info;
+};
+
+// Function declarations for internal functions
+static void compact_input(struct mp3_decoder_s *decoder);
+static uint8_t read_info_frame(struct mp3_decoder_s *decoder);
+static uint16_t mcps_x10(uint64_t busy_us, uint64_t samples, uint32_t sample_rate, uint32_t clock_hz);
+
+audio_status_t mp3_decoder_create(mp3_decoder_t *decoder) {
+    if (decoder == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    struct mp3_decoder_s *d = (struct mp3_decoder_s *)pvPortMalloc(sizeof(struct mp3_decoder_s));
+    if (d == NULL) {
+        return AUDIO_ERROR_MEMORY;
+    }
+    memset(d, 0, sizeof(*d));
+    d->playLimit = MP3_NO_LIMIT;
+    mad_stream_init(&d->stream);
+    mad_frame_init(&d->frame);
+    audio_status_t status = mp3_synth_init(&d->synth);
+    if (status != AUDIO_OK) {
+        mad_frame_finish(&d->frame);
+        mad_stream_finish(&d->stream);
+        vPortFree(d);
+        return status;
+    }
+
+    *decoder = d;
+    return AUDIO_OK;
+}
+
+void mp3_decoder_destroy(mp3_decoder_t decoder) {
+    if (decoder == NULL) {
+        return;
+    }
+    mad_frame_finish(&decoder->frame);
+    mad_stream_finish(&decoder->stream);
+    vPortFree(decoder);
+}
+
+void mp3_decoder_reset(mp3_decoder_t decoder) {
+    if (decoder == NULL) {
+        return;
+    }
+    // A fresh stream drops the bit reservoir; MAD skips frames that point back into it
+    mad_stream_finish(&decoder->stream);
+    mad_stream_init(&decoder->stream);
+    mad_frame_mute(&decoder->frame);
+    mp3_synth_mute(&decoder->synth);
+    decoder->inputLength = 0;
+    decoder->streamOffset = 0;
+    decoder->skipBytes = 0;
+    decoder->tagChecked = 0;
+    decoder->finished = 0;
+    decoder->pcmPosition = 0;
+    decoder->frameCount = 0;
+    decoder->soundFrames = 0;
+    decoder->frameOffset = 0;
+    decoder->dropFrames = 0;
+    decoder->trimStart = 0;
+    decoder->playLimit = MP3_NO_LIMIT;
+    memset(&decoder->gapless, 0, sizeof(decoder->gapless));
+}
+
+uint32_t mp3_decoder_feed(mp3_decoder_t decoder, const uint8_t *data, uint32_t length) {
+    if (decoder == NULL || data == NULL || decoder->finished) {
+        return 0;
+    }
+
+    uint32_t taken = 0;
+    if (!decoder->tagChecked) {
+        decoder->skipBytes = mp3_id3v2_size(data, length);
+        decoder->tagChecked = 1;
+    }
+    if (decoder->skipBytes > 0) {
+        taken = (length < decoder->skipBytes) ? length : decoder->skipBytes;
+        decoder->skipBytes -= taken;
+        decoder->streamOffset += taken;
+        if (taken == length) {
+            return taken;
+        }
+    }
+
+    compact_input(decoder);
+    uint32_t space = MP3_DECODER_INPUT_BYTES - decoder->inputLength;
+    uint32_t count = (length - taken < space) ? length - taken : space;
+    memcpy(decoder->input + decoder->inputLength, data + taken, count);
+    decoder->inputLength += count;
+    mad_stream_buffer(&decoder->stream, decoder->input, decoder->inputLength);
+    return taken + count;
+}
+
+void mp3_decoder_finish(mp3_decoder_t decoder) {
+    if (decoder == NULL || decoder->finished) {
+        return;
+    }
+    // MAD needs MAD_BUFFER_GUARD bytes past the last frame before it will decode it
+    compact_input(decoder);
+    memset(decoder->input + decoder->inputLength, 0, MAD_BUFFER_GUARD);
+    decoder->inputLength += MAD_BUFFER_GUARD;
+    mad_stream_buffer(&decoder->stream, decoder->input, decoder->inputLength);
+    decoder->finished = 1;
+}
+
+uint8_t mp3_decoder_is_finished(mp3_decoder_t decoder) {
+    return (decoder != NULL) ? decoder->finished : 1;
+}
+
+audio_status_t mp3_decoder_decode_frame(mp3_decoder_t decoder, mp3_frame_info_t *info) {
+    if (decoder == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    while (decoder->pcmPosition >= decoder->synth.length) {
+        if (decoder->stream.buffer == NULL) {
+            return AUDIO_ERROR_BUSY;
+        }
+        if (decoder->playLimit == 0) {
+            // Only the encoder's padding is left: the song is over
+            decoder->finished = 1;
+            return AUDIO_ERROR_BUSY;
+        }
+        while (mad_frame_decode(&decoder->frame, &decoder->stream) != 0) {
+            if (decoder->stream.error == MAD_ERROR_BUFLEN) {
+                return AUDIO_ERROR_BUSY;
+            }
+            if (!MAD_RECOVERABLE(decoder->stream.error)) {
+                return AUDIO_ERROR_FORMAT;
+            }
+            // Lost sync, bad CRC or missing reservoir: MAD has moved past the frame, try the next
+            if (MAD_FRAME_ERROR(decoder->stream.error)) {
+                // Still a frame of sound, so seek numbering and dropping stay in step
+                decoder->soundFrames++;
+                if (decoder->dropFrames > 0) {
+                    decoder->dropFrames--;
+                }
+            }
+        }
+        if (decoder->frameCount++ == 0 && read_info_frame(decoder)) {
+            continue;    // The Xing/Info/VBRI frame only describes the stream; it holds no sound
+        }
+        decoder->soundFrames++;
+        decoder->frameOffset = decoder->streamOffset + (uint32_t)(decoder->stream.this_frame - decoder->input);
+
+        // Synthesize even frames we throw away: the filter's memory must be right for the next one
+        mp3_synth_frame(&decoder->synth, &decoder->frame);
+        if (decoder->dropFrames > 0) {
+            decoder->dropFrames--;
+            decoder->pcmPosition = decoder->synth.length;
+            continue;
+        }
+        decoder->pcmPosition = 0;
+        decoder->info.sample_rate = decoder->synth.sample_rate;
+        decoder->info.channels = decoder->synth.channels;
+        decoder->info.bitrate_kbps = (uint16_t)(decoder->frame.header.bitrate / 1000);
+        decoder->info.frame_samples = decoder->synth.length;
+        if (decoder->trimStart > 0) {
+            uint16_t drop = (decoder->trimStart < decoder->synth.length) ? (uint16_t)decoder->trimStart : decoder->synth.length;
+            decoder->pcmPosition = drop;
+            decoder->trimStart -= drop;
+        }
+    }
+
+    if (info != NULL) {
+        *info = decoder->info;
+    }
+    return AUDIO_OK;
+}
+
+uint16_t mp3_decoder_read_pcm(mp3_decoder_t decoder, int16_t *pcm, uint16_t max_frames) {
+    if (decoder == NULL || pcm == NULL) {
+        return 0;
+    }
+
+    uint16_t count = mp3_decoder_pending_frames(decoder);
+    if (count > max_frames) {
+        count = max_frames;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    // Already 16-bit stereo pairs: the synthesis filter rounds and clips as it goes
+    memcpy(pcm, &decoder->synth.pcm[decoder->pcmPosition], (size_t)count * sizeof(uint32_t));
+    decoder->pcmPosition += count;
+    if (decoder->playLimit != MP3_NO_LIMIT) {
+        decoder->playLimit -= count;
+        if (decoder->playLimit == 0) {
+            decoder->pcmPosition = decoder->synth.length;    // The rest of the frame is padding
+        }
+    }
+    return count;
+}
+
+uint16_t mp3_decoder_pending_frames(mp3_decoder_t decoder) {
+    if (decoder == NULL || decoder->pcmPosition >= decoder->synth.length) {
+        return 0;
+    }
+    uint16_t pending = (uint16_t)(decoder->synth.length - decoder->pcmPosition);
+    if (decoder->playLimit < pending) {
+        pending = (uint16_t)decoder->playLimit;
+    }
+    return pending;
+}
+
+audio_status_t mp3_decoder_get_gapless(mp3_decoder_t decoder, mp3_gapless_t *gapless) {
+    if (decoder == NULL || gapless == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    *gapless = decoder->gapless;
+    return AUDIO_OK;
+}
+
+void mp3_decoder_get_frame_position(mp3_decoder_t decoder, uint32_t *frame, uint32_t *offset) {
+    if (decoder == NULL) {
+        return;
+    }
+    if (frame != NULL) {
+        *frame = (decoder->soundFrames > 0) ? decoder->soundFrames - 1u : 0;
+    }
+    if (offset != NULL) {
+        *offset = decoder->frameOffset;
+    }
+}
+
+void mp3_decoder_set_seek_trims(mp3_decoder_t decoder, uint32_t drop_frames, uint32_t drop_samples, uint64_t play_samples) {
+    if (decoder == NULL) {
+        return;
+    }
+    decoder->dropFrames = drop_frames;
+    decoder->trimStart = drop_samples;
+    decoder->playLimit = (play_samples > 0) ? play_samples : MP3_NO_LIMIT;
+}
+
+audio_stage_result_t audio_stage_decode_mp3(void *context, spsc_ring_t *input, spsc_ring_t *output) {
+    mp3_decoder_t decoder = (mp3_decoder_t)context;
+    if (decoder == NULL || input == NULL || output == NULL) {
+        return AUDIO_STAGE_ERROR;
+    }
+
+    uint8_t moved = 0;
+    for (;;) {
+        // Hand out the last frame first; it may take two goes if the ring wraps
+        if (mp3_decoder_pending_frames(decoder) > 0) {
+            uint32_t space;
+            int16_t *dst = (int16_t *)spsc_ring_write_ptr(output, &space);
+            uint32_t room = space / 4u;
+            uint16_t frames = mp3_decoder_read_pcm(decoder, dst, (room > UINT16_MAX) ? UINT16_MAX : (uint16_t)room);
+            if (frames == 0) {
+                return moved ? AUDIO_STAGE_PROGRESS : AUDIO_STAGE_BLOCKED;
+            }
+            spsc_ring_write_commit(output, (uint32_t)frames * 4u);
+            moved = 1;
+            continue;
+        }
+        if (moved) {
+            // One frame per call keeps the other stages moving
+            return AUDIO_STAGE_PROGRESS;
+        }
+
+        audio_status_t status = mp3_decoder_decode_frame(decoder, NULL);
+        if (status == AUDIO_OK) {
+            continue;
+        }
+        if (status != AUDIO_ERROR_BUSY) {
+            return AUDIO_STAGE_ERROR;
+        }
+        if (mp3_decoder_is_finished(decoder)) {
+            return AUDIO_STAGE_DONE;
+        }
+
+        uint32_t available;
+        const uint8_t *src = spsc_ring_read_ptr(input, &available);
+        if (available == 0) {
+            if (spsc_ring_drained(input)) {
+                mp3_decoder_finish(decoder);
+                continue;
+            }
+            return AUDIO_STAGE_STARVED;
+        }
+        uint32_t taken = mp3_decoder_feed(decoder, src, available);
+        if (taken == 0) {
+            // A frame bigger than the whole input buffer (free format) - we can't decode it
+            return AUDIO_STAGE_ERROR;
+        }
+        spsc_ring_read_commit(input, taken);
+    }
+}
+
+audio_status_t mp3_decoder_benchmark(const char *filename, mp3_benchmark_t *result) {
+    if (filename == NULL || result == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    fs_file_t file;
+    if (fs_open(filename, FS_READ, &file) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+    mp3_decoder_t decoder;
+    audio_status_t status = mp3_decoder_create(&decoder);
+    if (status != AUDIO_OK) {
+        fs_close(file);
+        return status;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->clock_hz = clock_get_hz(clk_sys);
+
+    uint64_t rowBusy[MP3_BENCHMARK_MAX_ROWS] = {0};
+    uint64_t rowSamples[MP3_BENCHMARK_MAX_ROWS] = {0};
+    uint64_t totalBusy = 0;
+    uint64_t totalSamples = 0;
+    uint8_t chunk[BENCHMARK_CHUNK_BYTES];
+    int16_t pcm[BENCHMARK_PCM_FRAMES * 2];
+    uint32_t chunkLength = 0;
+    uint32_t chunkPosition = 0;
+
+    for (;;) {
+        // File reads are outside the timed region; only decoding is measured
+        if (chunkPosition == chunkLength && !mp3_decoder_is_finished(decoder)) {
+            size_t got = 0;
+            if (fs_read(file, chunk, sizeof(chunk), &got) != FS_OK) {
+                status = AUDIO_ERROR_IO;
+                break;
+            }
+            chunkLength = (uint32_t)got;
+            chunkPosition = 0;
+            if (got == 0) {
+                mp3_decoder_finish(decoder);
+            }
+        }
+        uint32_t fed = 0;
+        if (chunkPosition < chunkLength) {
+            fed = mp3_decoder_feed(decoder, chunk + chunkPosition, chunkLength - chunkPosition);
+            chunkPosition += fed;
+        }
+
+        mp3_frame_info_t info;
+        uint32_t start = system_get_time_us();
+        status = mp3_decoder_decode_frame(decoder, &info);
+        if (status == AUDIO_OK) {
+            while (mp3_decoder_read_pcm(decoder, pcm, BENCHMARK_PCM_FRAMES) > 0) {
+            }
+        }
+        uint32_t elapsed = system_get_time_us() - start;
+
+        if (status == AUDIO_ERROR_BUSY) {
+            if (mp3_decoder_is_finished(decoder)) {
+                status = AUDIO_OK;
+                break;
+            }
+            if (fed == 0 && chunkPosition < chunkLength) {
+                // Input buffer full and still no frame: not something MAD can decode
+                status = AUDIO_ERROR_FORMAT;
+                break;
+            }
+            continue;
+        }
+        if (status != AUDIO_OK) {
+            break;
+        }
+
+        if (result->sample_rate == 0) {
+            result->sample_rate = info.sample_rate;
+        }
+        uint16_t frameMcps = mcps_x10(elapsed, info.frame_samples, info.sample_rate, result->clock_hz);
+
+        uint8_t row = 0;
+        while (row < result->row_count && result->rows[row].bitrate_kbps != info.bitrate_kbps) {
+            row++;
+        }
+        if (row == result->row_count && row < MP3_BENCHMARK_MAX_ROWS) {
+            result->rows[row].bitrate_kbps = info.bitrate_kbps;
+            result->row_count++;
+        }
+        if (row < result->row_count) {
+            result->rows[row].frames++;
+            rowBusy[row] += elapsed;
+            rowSamples[row] += info.frame_samples;
+            if (frameMcps > result->rows[row].mcps_peak_x10) {
+                result->rows[row].mcps_peak_x10 = frameMcps;
+            }
+        }
+
+        result->frames++;
+        totalBusy += elapsed;
+        totalSamples += info.frame_samples;
+        if (frameMcps > result->mcps_peak_x10) {
+            result->mcps_peak_x10 = frameMcps;
+        }
+    }
+
+    for (uint8_t row = 0; row < result->row_count; row++) {
+        result->rows[row].mcps_avg_x10 = mcps_x10(rowBusy[row], rowSamples[row], result->sample_rate, result->clock_hz);
+    }
+    result->mcps_avg_x10 = mcps_x10(totalBusy, totalSamples, result->sample_rate, result->clock_hz);
+    if (result->clock_hz >= 100000) {
+        uint32_t load = (uint32_t)result->mcps_avg_x10 * 100u / (result->clock_hz / 100000u);
+        result->load_pct = (load > 100) ? 100 : (uint8_t)load;
+    }
+
+    mp3_decoder_destroy(decoder);
+    fs_close(file);
+    return status;
+}
+
+// Drops the bytes MAD has finished with so new input lands after the rest
+static void compact_input(struct mp3_decoder_s *decoder) {
+    if (decoder->stream.buffer == NULL || decoder->stream.next_frame == NULL) {
+        return;
+    }
+    uint32_t used = (uint32_t)(decoder->stream.next_frame - decoder->input);
+    if (used == 0) {
+        return;
+    }
+    memmove(decoder->input, decoder->input + used, decoder->inputLength - used);
+    decoder->inputLength -= used;
+    decoder->streamOffset += used;
+    mad_stream_buffer(&decoder->stream, decoder->input, decoder->inputLength);
+}
+
+// Size of an ID3v2 tag at the start of data, or 0 if there is none
+uint32_t mp3_id3v2_size(const uint8_t *data, uint32_t length) {
+    if (length < 10 || data[0] != 'I' || data[1] != 'D' || data[2] != '3') {
+        return 0;
+    }
+    // Sizes are "syncsafe": 4 bytes of 7 bits each
+    if ((data[6] | data[7] | data[8] | data[9]) & 0x80) {
+        return 0;
+    }
+    uint32_t size = ((uint32_t)data[6] << 21) | ((uint32_t)data[7] << 14) | ((uint32_t)data[8] << 7) | data[9];
+    size += 10;
+    if (data[5] & 0x10) {
+        size += 10;    // Footer present
+    }
+    return size;
+}
+
+// Reads a Xing/Info (LAME) or VBRI header from the first frame, setting up the trims; 1 if it was one
+static uint8_t read_info_frame(struct mp3_decoder_s *decoder) {
+    const uint8_t *frame = decoder->stream.this_frame;
+    uint32_t length = (uint32_t)(decoder->stream.bufend - frame);
+    const struct mad_header *header = &decoder->frame.header;
+    uint8_t mpeg1 = (header->flags & MAD_FLAG_LSF_EXT) == 0;
+    uint8_t mono = header->mode == MAD_MODE_SINGLE_CHANNEL;
+    uint32_t frameSamples = (header->layer == MAD_LAYER_III && !mpeg1) ? 576u : 1152u;
+    mp3_gapless_t *gapless = &decoder->gapless;
+
+    // Xing/Info sits right after the side information
+    uint32_t offset = 4u + ((header->flags & MAD_FLAG_PROTECTION) ? 2u : 0u) +
+                      (mpeg1 ? (mono ? 17u : 32u) : (mono ? 9u : 17u));
+    if (header->layer == MAD_LAYER_III && length >= offset + 8u &&
+        (memcmp(frame + offset, "Xing", 4) == 0 || memcmp(frame + offset, "Info", 4) == 0)) {
+        const uint8_t *p = frame + offset + 4;
+        uint32_t flags = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        p += 4;
+        uint32_t frames = 0;
+        if ((flags & 0x1u) && p + 4 <= decoder->stream.bufend) {
+            frames = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+            p += 4;
+        }
+        p += ((flags & 0x2u) ? 4 : 0) + ((flags & 0x4u) ? 100 : 0) + ((flags & 0x8u) ? 4 : 0);
+        // The LAME extension stores the encoder delay and padding as two 12-bit numbers
+        if (p + 24 <= decoder->stream.bufend && memcmp(p, "LAME", 4) == 0) {
+            gapless->encoder_delay = (uint16_t)((p[21] << 4) | (p[22] >> 4));
+            gapless->padding = (uint16_t)(((p[22] & 0x0F) << 8) | p[23]);
+            gapless->has_delay = 1;
+        }
+        gapless->total_frames = frames;
+    } else if (length >= 36u + 18u && memcmp(frame + 36, "VBRI", 4) == 0) {
+        // Fraunhofer's VBRI: always 32 bytes after the header; it knows the delay but not the padding
+        const uint8_t *p = frame + 36;
+        gapless->encoder_delay = (uint16_t)((p[6] << 8) | p[7]);
+        gapless->has_delay = 1;
+        gapless->total_frames = ((uint32_t)p[14] << 24) | ((uint32_t)p[15] << 16) | ((uint32_t)p[16] << 8) | p[17];
+    } else {
+        return 0;
+    }
+
+    gapless->is_info_frame = 1;
+    if (gapless->has_delay) {
+        decoder->trimStart = (uint32_t)gapless->encoder_delay + MP3_DECODER_DELAY;
+        if (gapless->total_frames > 0 && gapless->padding > 0) {
+            uint64_t total = (uint64_t)gapless->total_frames * frameSamples;
+            uint64_t trims = (uint64_t)gapless->encoder_delay + gapless->padding;
+            decoder->playLimit = (total > trims) ? total - trims : 0;
+        }
+    }
+    gapless->total_samples = (decoder->playLimit != MP3_NO_LIMIT) ? decoder->playLimit : 0;
+    return 1;
+}
+
+// Millions of cycles per second of audio, times 10
+static uint16_t mcps_x10(uint64_t busy_us, uint64_t samples, uint32_t sample_rate, uint32_t clock_hz) {
+    if (samples == 0 || sample_rate == 0) {
+        return 0;
+    }
+    uint64_t cycles = busy_us * (clock_hz / 1000u) / 1000u;
+    uint64_t value = cycles * sample_rate * 10u / samples / 1000000u;
+    return (value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+}
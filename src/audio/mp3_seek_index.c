@@ -0,0 +1,572 @@
+#include "audio/mp3_seek_index.h"
+#include "audio/mp3_decoder.h"
+#include "fs/fs_manager.h"
+#include "FreeRTOS.h"
+#include <string.h>
+
+#define INDEX_MAGIC             0x31585049u   // "IPX1" as stored on the little-endian card
+#define INDEX_SUFFIX            ".idx"
+#define INDEX_SCAN_BYTES        512           // Bytes searched for the first frame after the ID3v2 tag
+#define INDEX_RESERVOIR_BYTES   512           // Layer III data can start up to 511 bytes before its frame
+#define INDEX_PREROLL_FRAMES    16            // Most frames a seek reads back (enough for 8 kbps MPEG-2)
+#define INDEX_XING_POINTS       100
+
+// The saved index file: this header, then one 32-bit offset per frame of sound
+typedef struct {
+    uint32_t magic;
+    uint32_t fileSize;        // The song's size, date and time when the index was built
+    uint32_t fileDate;
+    uint32_t fileTime;
+    uint32_t frames;          // Entries after the header
+} index_header_t;
+
+// One MPEG audio frame header, unpacked
+typedef struct {
+    uint8_t layer;            // 1, 2 or 3
+    uint8_t lsf;              // MPEG-2 or 2.5 (half-size side info and frames)
+    uint8_t mono;
+    uint8_t crc;              // A 16-bit CRC follows the header
+    uint16_t bitrateKbps;
+    uint32_t sampleRate;
+    uint16_t frameSamples;
+    uint16_t frameBytes;
+} frame_header_t;
+
+struct mp3_index_s {
+    char indexPath[MAX_PATH_LENGTH];   // Empty if the name is too long to add the suffix
+    uint32_t fileSize;
+    uint32_t fileDate;
+    uint32_t fileTime;
+    mp3_index_info_t info;
+    uint32_t headerOffset;    // The first MPEG frame (maybe a Xing/VBRI frame)
+    uint32_t soundOffset;     // The first frame of sound
+    uint16_t bitrateKbps;     // The first frame's bitrate, for estimates
+    uint16_t encoderDelay;
+    uint16_t padding;
+    uint8_t hasDelay;
+    uint32_t headerFrames;    // Frame count from the Xing/VBRI frame (0 = unknown)
+    uint32_t indexFrames;     // Entries in the saved index
+    // Xing or VBRI table, as file offsets spread evenly over tocSpan frames
+    uint32_t toc[MP3_INDEX_TOC_ENTRIES + 1];
+    uint16_t tocPoints;
+    uint32_t tocSpan;
+    // Building
+    fs_file_t buildFile;
+    uint32_t builtFrames;
+    uint32_t pending[MP3_INDEX_WRITE_ENTRIES];
+    uint16_t pendingCount;
+};
+
+// Kilobits per second by [MPEG-1 layer I, II, III, MPEG-2/2.5 layer I, II and III][bitrate index]
+static const uint16_t bitrateTable[5][15] = {
+    {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}
+};
+static const uint32_t sampleRateTable[3] = {44100, 48000, 32000};
+
+// Function declarations for internal functions
+static audio_status_t read_header_frame(struct mp3_index_s *index, fs_file_t file);
+static audio_status_t read_vbri_table(struct mp3_index_s *index, fs_file_t file, uint32_t offset, const uint8_t *vbri);
+static uint8_t parse_frame_header(const uint8_t *data, frame_header_t *header);
+static uint8_t load_saved_index(struct mp3_index_s *index);
+static audio_status_t read_entries(struct mp3_index_s *index, uint32_t first, uint32_t count, uint32_t *offsets);
+static audio_status_t flush_pending(struct mp3_index_s *index);
+static void update_duration(struct mp3_index_s *index);
+static uint32_t read_be32(const uint8_t *data);
+static uint16_t read_be16(const uint8_t *data);
+
+audio_status_t mp3_index_open(const char *filename, mp3_index_t *index) {
+    if (filename == NULL || index == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    fs_file_info_t stat;
+    if (fs_stat(filename, &stat) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+    struct mp3_index_s *x = (struct mp3_index_s *)pvPortMalloc(sizeof(struct mp3_index_s));
+    if (x == NULL) {
+        return AUDIO_ERROR_MEMORY;
+    }
+    memset(x, 0, sizeof(*x));
+    x->fileSize = stat.size;
+    x->fileDate = stat.date;
+    x->fileTime = stat.time;
+    if (strlen(filename) + sizeof(INDEX_SUFFIX) <= MAX_PATH_LENGTH) {
+        strcpy(x->indexPath, filename);
+        strcat(x->indexPath, INDEX_SUFFIX);
+    }
+
+    fs_file_t file;
+    if (fs_open(filename, FS_READ, &file) != FS_OK) {
+        vPortFree(x);
+        return AUDIO_ERROR_IO;
+    }
+    audio_status_t status = read_header_frame(x, file);
+    fs_close(file);
+    if (status != AUDIO_OK) {
+        vPortFree(x);
+        return status;
+    }
+
+    if (load_saved_index(x)) {
+        x->info.source = MP3_INDEX_FULL;
+    } else {
+        // No usable index yet: the first playback from the start builds one
+        x->info.building = (x->indexPath[0] != '\0');
+    }
+    update_duration(x);
+    *index = x;
+    return AUDIO_OK;
+}
+
+void mp3_index_close(mp3_index_t index) {
+    if (index == NULL) {
+        return;
+    }
+    mp3_index_abandon(index);
+    vPortFree(index);
+}
+
+audio_status_t mp3_index_get_info(mp3_index_t index, mp3_index_info_t *info) {
+    if (index == NULL || info == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    *info = index->info;
+    return AUDIO_OK;
+}
+
+audio_status_t mp3_index_lookup(mp3_index_t index, uint32_t position_ms, mp3_seek_point_t *point) {
+    if (index == NULL || point == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    memset(point, 0, sizeof(*point));
+    if (position_ms == 0) {
+        // The very start is always exact: the decoder trims it as it does for a new song
+        point->exact = 1;
+        return AUDIO_OK;
+    }
+
+    const mp3_index_info_t *info = &index->info;
+    uint64_t position = (uint64_t)position_ms * info->sample_rate / 1000u;
+    if (info->total_samples > 0 && position >= info->total_samples) {
+        position = info->total_samples - 1u;
+    }
+    // The decoder's sample 0 is this far into what MAD puts out
+    uint32_t trim = index->hasDelay ? (uint32_t)index->encoderDelay + MP3_DECODER_DELAY : 0u;
+    uint64_t raw = position + trim;
+    uint32_t frame = (uint32_t)(raw / info->frame_samples);
+
+    if (info->source == MP3_INDEX_FULL) {
+        if (frame >= index->indexFrames) {
+            frame = index->indexFrames - 1u;
+        }
+        uint32_t offsets[INDEX_PREROLL_FRAMES];
+        uint32_t first = (frame >= INDEX_PREROLL_FRAMES - 1u) ? frame - (INDEX_PREROLL_FRAMES - 1u) : 0u;
+        audio_status_t status = read_entries(index, first, frame - first + 1u, offsets);
+        if (status != AUDIO_OK) {
+            return status;
+        }
+        // Start where the frame before the target has all of its reservoir: then both decode,
+        // and the target's overlap with the frame before it is right too
+        uint32_t start = frame;
+        if (frame > 0) {
+            uint32_t limit = offsets[frame - 1u - first];
+            start = frame - 1u;
+            while (start > first && limit - offsets[start - first] < INDEX_RESERVOIR_BYTES) {
+                start--;
+            }
+        }
+        point->byte_offset = offsets[start - first];
+        point->frame = start;
+        point->drop_frames = frame - start;
+        point->drop_samples = (uint32_t)(raw - (uint64_t)frame * info->frame_samples);
+        point->play_samples = (info->total_samples > 0) ? info->total_samples - position : 0;
+        point->exact = 1;
+        return AUDIO_OK;
+    }
+
+    uint64_t offset;
+    if (index->tocPoints >= 2) {
+        // Xing/VBRI: interpolate between the two table entries around the frame
+        uint32_t last = index->tocPoints - 1u;
+        uint64_t scaled = (uint64_t)frame * last * 256u / index->tocSpan;
+        uint32_t entry = (uint32_t)(scaled >> 8);
+        if (entry >= last) {
+            offset = index->toc[last];
+        } else {
+            uint32_t a = index->toc[entry];
+            uint32_t b = index->toc[entry + 1u];
+            offset = a + (((uint64_t)(b - a) * (scaled & 0xFFu)) >> 8);
+        }
+    } else {
+        offset = index->soundOffset + (uint64_t)position_ms * index->bitrateKbps / 8u;
+    }
+    if (offset >= index->fileSize) {
+        offset = index->fileSize;
+    }
+    point->byte_offset = (uint32_t)offset;
+    // Playing resumes about at the start of that frame; count from there, so the
+    // decoder still stops before the encoder's padding at the end
+    uint64_t landed = (uint64_t)frame * info->frame_samples;
+    uint64_t from = (landed > trim) ? landed - trim : 0;
+    point->frame = frame;
+    point->play_samples = (info->total_samples > from) ? info->total_samples - from : 0;
+    return AUDIO_OK;
+}
+
+void mp3_index_add_frame(mp3_index_t index, uint32_t frame, uint32_t offset) {
+    if (index == NULL || !index->info.building || frame < index->builtFrames) {
+        return;
+    }
+    if (frame != index->builtFrames) {
+        mp3_index_abandon(index);    // A frame went missing: this index would point at the wrong ones
+        return;
+    }
+    if (index->buildFile == NULL) {
+        // The header stays blank (and the file invalid) until mp3_index_finish()
+        index_header_t blank;
+        memset(&blank, 0, sizeof(blank));
+        size_t written = 0;
+        if (fs_open(index->indexPath, FS_CREATE_ALWAYS, &index->buildFile) != FS_OK) {
+            index->buildFile = NULL;
+            index->info.building = 0;
+            return;
+        }
+        if (fs_write(index->buildFile, &blank, sizeof(blank), &written) != FS_OK || written != sizeof(blank)) {
+            mp3_index_abandon(index);
+            return;
+        }
+    }
+
+    index->pending[index->pendingCount++] = offset;
+    index->builtFrames++;
+    if (index->pendingCount == MP3_INDEX_WRITE_ENTRIES && flush_pending(index) != AUDIO_OK) {
+        mp3_index_abandon(index);
+    }
+}
+
+audio_status_t mp3_index_finish(mp3_index_t index) {
+    if (index == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (!index->info.building) {
+        return AUDIO_OK;
+    }
+    if (index->buildFile == NULL) {
+        index->info.building = 0;
+        return AUDIO_OK;
+    }
+
+    index_header_t header;
+    header.magic = INDEX_MAGIC;
+    header.fileSize = index->fileSize;
+    header.fileDate = index->fileDate;
+    header.fileTime = index->fileTime;
+    header.frames = index->builtFrames;
+    size_t written = 0;
+    if (flush_pending(index) != AUDIO_OK || fs_seek(index->buildFile, 0, FS_SEEK_SET) != FS_OK ||
+        fs_write(index->buildFile, &header, sizeof(header), &written) != FS_OK || written != sizeof(header)) {
+        mp3_index_abandon(index);
+        return AUDIO_ERROR_IO;
+    }
+    if (fs_close(index->buildFile) != FS_OK) {
+        index->buildFile = NULL;
+        mp3_index_abandon(index);
+        return AUDIO_ERROR_IO;
+    }
+    index->buildFile = NULL;
+    index->info.building = 0;
+    index->indexFrames = index->builtFrames;
+    index->info.source = MP3_INDEX_FULL;
+    update_duration(index);
+    return AUDIO_OK;
+}
+
+void mp3_index_abandon(mp3_index_t index) {
+    if (index == NULL || !index->info.building) {
+        return;
+    }
+    if (index->buildFile != NULL) {
+        fs_close(index->buildFile);
+        index->buildFile = NULL;
+    }
+    if (index->builtFrames > 0) {
+        fs_remove(index->indexPath);
+    }
+    index->info.building = 0;
+    index->builtFrames = 0;
+    index->pendingCount = 0;
+}
+
+// Finds the first MPEG frame and reads a Xing/Info (LAME) or VBRI frame if that's what it is
+static audio_status_t read_header_frame(struct mp3_index_s *index, fs_file_t file) {
+    uint8_t buffer[INDEX_SCAN_BYTES];
+    size_t got = 0;
+    if (fs_read(file, buffer, 10, &got) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+    uint32_t start = mp3_id3v2_size(buffer, (uint32_t)got);
+    if (start >= index->fileSize) {
+        return AUDIO_ERROR_FORMAT;
+    }
+    if (fs_seek(file, (int32_t)start, FS_SEEK_SET) != FS_OK || fs_read(file, buffer, sizeof(buffer), &got) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+
+    // A frame counts once the next one follows it (or the buffer ends first)
+    frame_header_t header;
+    frame_header_t next;
+    uint32_t at = 0;
+    for (;;) {
+        if (at + 4u > got) {
+            return AUDIO_ERROR_FORMAT;
+        }
+        if (parse_frame_header(buffer + at, &header)) {
+            uint32_t follow = at + header.frameBytes;
+            if (follow + 4u > got ||
+                (parse_frame_header(buffer + follow, &next) && next.layer == header.layer && next.sampleRate == header.sampleRate)) {
+                break;
+            }
+        }
+        at++;
+    }
+
+    index->headerOffset = start + at;
+    index->soundOffset = index->headerOffset;
+    index->bitrateKbps = header.bitrateKbps;
+    index->info.sample_rate = header.sampleRate;
+    index->info.frame_samples = header.frameSamples;
+    index->info.source = MP3_INDEX_ESTIMATE;
+
+    const uint8_t *frame = buffer + at;
+    const uint8_t *end = buffer + got;
+    uint32_t side = 4u + (header.crc ? 2u : 0u) + (header.lsf ? (header.mono ? 9u : 17u) : (header.mono ? 17u : 32u));
+    if (header.layer == 3 && frame + side + 8u <= end &&
+        (memcmp(frame + side, "Xing", 4) == 0 || memcmp(frame + side, "Info", 4) == 0)) {
+        uint32_t flags = read_be32(frame + side + 4);
+        const uint8_t *p = frame + side + 8;
+        uint32_t bytes = 0;
+        const uint8_t *toc = NULL;
+        if ((flags & 0x1u) && p + 4 <= end) {
+            index->headerFrames = read_be32(p);
+            p += 4;
+        }
+        if ((flags & 0x2u) && p + 4 <= end) {
+            bytes = read_be32(p);
+            p += 4;
+        }
+        if ((flags & 0x4u) && p + INDEX_XING_POINTS <= end) {
+            toc = p;
+        }
+        p += ((flags & 0x4u) ? INDEX_XING_POINTS : 0) + ((flags & 0x8u) ? 4 : 0);
+        if (p + 24 <= end && memcmp(p, "LAME", 4) == 0) {
+            index->encoderDelay = (uint16_t)((p[21] << 4) | (p[22] >> 4));
+            index->padding = (uint16_t)(((p[22] & 0x0F) << 8) | p[23]);
+            index->hasDelay = 1;
+        }
+        index->soundOffset = index->headerOffset + header.frameBytes;
+
+        // The table's entries are 1/256ths of the stream's bytes at each percent of its length
+        if (toc != NULL && index->headerFrames > 0) {
+            if (bytes == 0 || bytes > index->fileSize - index->headerOffset) {
+                bytes = index->fileSize - index->headerOffset;
+            }
+            for (uint32_t i = 0; i < INDEX_XING_POINTS; i++) {
+                index->toc[i] = index->headerOffset + (uint32_t)(((uint64_t)toc[i] * bytes) >> 8);
+            }
+            index->toc[INDEX_XING_POINTS] = index->headerOffset + bytes;
+            index->tocPoints = INDEX_XING_POINTS + 1;
+            index->tocSpan = index->headerFrames;
+            index->info.source = MP3_INDEX_XING;
+        }
+    } else if (frame + 36u + 26u <= end && memcmp(frame + 36, "VBRI", 4) == 0) {
+        const uint8_t *p = frame + 36;
+        index->encoderDelay = read_be16(p + 6);
+        index->hasDelay = 1;
+        index->headerFrames = read_be32(p + 14);
+        index->soundOffset = index->headerOffset + header.frameBytes;
+        audio_status_t status = read_vbri_table(index, file, index->headerOffset + 36u + 26u, p);
+        if (status != AUDIO_OK) {
+            return status;
+        }
+    }
+    return AUDIO_OK;
+}
+
+// Sums VBRI's chunk sizes into offsets, keeping at most MP3_INDEX_TOC_ENTRIES of them
+static audio_status_t read_vbri_table(struct mp3_index_s *index, fs_file_t file, uint32_t offset, const uint8_t *vbri) {
+    uint16_t entries = read_be16(vbri + 18);
+    uint16_t scale = read_be16(vbri + 20);
+    uint16_t entrySize = read_be16(vbri + 22);
+    uint16_t framesPerEntry = read_be16(vbri + 24);
+    if (entries == 0 || entrySize == 0 || entrySize > 4 || framesPerEntry == 0) {
+        return AUDIO_OK;    // No usable table: estimate instead
+    }
+    if (fs_seek(file, (int32_t)offset, FS_SEEK_SET) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+
+    uint32_t stride = ((uint32_t)entries + MP3_INDEX_TOC_ENTRIES - 1u) / MP3_INDEX_TOC_ENTRIES;
+    uint32_t position = index->soundOffset;
+    uint16_t points = 0;
+    index->toc[points++] = position;
+
+    uint8_t chunk[64];
+    size_t got = 0;
+    size_t used = 0;
+    for (uint32_t entry = 0; entry < entries; entry++) {
+        if (used + entrySize > got) {
+            // Entries never straddle a read: every read is a whole number of them
+            if (fs_read(file, chunk, sizeof(chunk) - sizeof(chunk) % entrySize, &got) != FS_OK) {
+                return AUDIO_ERROR_IO;
+            }
+            used = 0;
+            if (got < entrySize) {
+                break;    // The table runs past the end of the file
+            }
+        }
+        uint32_t size = 0;
+        for (uint16_t i = 0; i < entrySize; i++) {
+            size = (size << 8) | chunk[used++];
+        }
+        position += size * scale;
+        if ((entry + 1u) % stride == 0) {
+            index->toc[points++] = position;
+        }
+    }
+
+    if (points >= 2) {
+        index->tocPoints = points;
+        index->tocSpan = (uint32_t)(points - 1u) * stride * framesPerEntry;
+        index->info.source = MP3_INDEX_VBRI;
+    }
+    return AUDIO_OK;
+}
+
+// Unpacks a frame header; 0 if it isn't one we can decode (free format included)
+static uint8_t parse_frame_header(const uint8_t *data, frame_header_t *header) {
+    uint32_t word = read_be32(data);
+    if ((word & 0xFFE00000u) != 0xFFE00000u) {
+        return 0;
+    }
+    uint32_t version = (word >> 19) & 0x3u;         // 0 = MPEG-2.5, 1 = reserved, 2 = MPEG-2, 3 = MPEG-1
+    uint32_t layerBits = (word >> 17) & 0x3u;       // 1 = layer III, 2 = layer II, 3 = layer I
+    uint32_t bitrateIndex = (word >> 12) & 0xFu;
+    uint32_t rateIndex = (word >> 10) & 0x3u;
+    if (version == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) {
+        return 0;
+    }
+
+    header->layer = (uint8_t)(4u - layerBits);
+    header->lsf = (version != 3);
+    header->mono = ((word >> 6) & 0x3u) == 0x3u;
+    header->crc = ((word >> 16) & 0x1u) == 0;
+    uint32_t row = header->lsf ? ((header->layer == 1) ? 3u : 4u) : header->layer - 1u;
+    header->bitrateKbps = bitrateTable[row][bitrateIndex];
+    header->sampleRate = sampleRateTable[rateIndex] >> ((version == 3) ? 0 : (version == 2) ? 1 : 2);
+
+    uint32_t padding = (word >> 9) & 0x1u;
+    uint32_t bits = (uint32_t)header->bitrateKbps * 1000u;
+    if (header->layer == 1) {
+        header->frameSamples = 384;
+        header->frameBytes = (uint16_t)((12u * bits / header->sampleRate + padding) * 4u);
+    } else if (header->layer == 3 && header->lsf) {
+        header->frameSamples = 576;
+        header->frameBytes = (uint16_t)(72u * bits / header->sampleRate + padding);
+    } else {
+        header->frameSamples = 1152;
+        header->frameBytes = (uint16_t)(144u * bits / header->sampleRate + padding);
+    }
+    return 1;
+}
+
+// 1 if the index file next to the song was built from this very song
+static uint8_t load_saved_index(struct mp3_index_s *index) {
+    if (index->indexPath[0] == '\0') {
+        return 0;
+    }
+    fs_file_info_t stat;
+    if (fs_stat(index->indexPath, &stat) != FS_OK) {
+        return 0;
+    }
+    fs_file_t file;
+    if (fs_open(index->indexPath, FS_READ, &file) != FS_OK) {
+        return 0;
+    }
+    index_header_t header;
+    size_t got = 0;
+    fs_status_t status = fs_read(file, &header, sizeof(header), &got);
+    fs_close(file);
+
+    if (status != FS_OK || got != sizeof(header) || header.magic != INDEX_MAGIC || header.frames == 0 ||
+        header.fileSize != index->fileSize || header.fileDate != index->fileDate || header.fileTime != index->fileTime ||
+        stat.size != sizeof(header) + (uint64_t)header.frames * 4u) {
+        return 0;    // Unfinished, or the song changed since: build it again
+    }
+    index->indexFrames = header.frames;
+    return 1;
+}
+
+// Reads count saved offsets starting at frame first
+static audio_status_t read_entries(struct mp3_index_s *index, uint32_t first, uint32_t count, uint32_t *offsets) {
+    fs_file_t file;
+    if (fs_open(index->indexPath, FS_READ, &file) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+    size_t got = 0;
+    uint32_t position = (uint32_t)sizeof(index_header_t) + first * 4u;
+    fs_status_t status = fs_seek(file, (int32_t)position, FS_SEEK_SET);
+    if (status == FS_OK) {
+        status = fs_read(file, offsets, count * 4u, &got);
+    }
+    fs_close(file);
+    return (status == FS_OK && got == count * 4u) ? AUDIO_OK : AUDIO_ERROR_IO;
+}
+
+static audio_status_t flush_pending(struct mp3_index_s *index) {
+    if (index->pendingCount == 0) {
+        return AUDIO_OK;
+    }
+    size_t bytes = (size_t)index->pendingCount * 4u;
+    size_t written = 0;
+    if (fs_write(index->buildFile, index->pending, bytes, &written) != FS_OK || written != bytes) {
+        return AUDIO_ERROR_IO;
+    }
+    index->pendingCount = 0;
+    return AUDIO_OK;
+}
+
+// Works out the length the decoder will play, trimmed the way it trims (see mp3_decoder.c)
+static void update_duration(struct mp3_index_s *index) {
+    mp3_index_info_t *info = &index->info;
+    uint32_t frames = (index->headerFrames > 0) ? index->headerFrames : index->indexFrames;
+    info->frames = frames;
+    if (frames > 0 && info->sample_rate > 0) {
+        uint64_t raw = (uint64_t)frames * info->frame_samples;
+        uint64_t trims = 0;
+        if (index->hasDelay) {
+            // Without a frame count the decoder can't stop at the padding; it only trims the front
+            trims = (uint64_t)index->encoderDelay + ((index->padding > 0 && index->headerFrames > 0) ? index->padding : MP3_DECODER_DELAY);
+        }
+        info->total_samples = (raw > trims) ? raw - trims : 0;
+        info->duration_ms = (uint32_t)(info->total_samples * 1000u / info->sample_rate);
+        info->exact = 1;
+    } else {
+        uint32_t bytes = (index->fileSize > index->soundOffset) ? index->fileSize - index->soundOffset : 0;
+        info->total_samples = 0;
+        info->duration_ms = (index->bitrateKbps > 0) ? (uint32_t)((uint64_t)bytes * 8u / index->bitrateKbps) : 0;
+        info->exact = 0;
+    }
+}
+
+static uint32_t read_be32(const uint8_t *data) {
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static uint16_t read_be16(const uint8_t *data) {
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
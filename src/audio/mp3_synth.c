@@ -0,0 +1,223 @@
+#include "audio/mp3_synth.h"
+#include "audio/dsp_kernels.h"
+#include "FreeRTOS.h"
+#include <math.h>
+#include <string.h>
+
+// Q28 subband samples -> Q25 going into the DCT; the odd parts come out halved, so X is Q24
+#define SYNTH_IN_SHIFT      3
+// Q24 history times the window (Q31, halved) is Q22; 16-bit output is Q15
+#define SYNTH_OUT_SHIFT     7
+#define SYNTH_ROUND         (1 << (SYNTH_OUT_SHIFT - 1))
+#define SYNTH_TAPS          16
+
+// Q28 -> 16 bits, the way MAD's output used to be converted (for the self-check)
+#define MAD_PCM_SHIFT       (MAD_F_FRACBITS + 1 - 16)
+#define MAD_PCM_ROUND       (1L << (MAD_PCM_SHIFT - 1))
+
+// MAD's filter and a frame to feed it, only while init runs
+typedef struct {
+    struct mad_synth synth;
+    struct mad_frame frame;
+} synth_reference_t;
+
+// Function declarations for internal functions
+static void build_dct_table(mp3_synth_t *synth);
+static audio_status_t calibrate_window(mp3_synth_t *synth, synth_reference_t *reference);
+static uint32_t history_index(uint32_t output, uint32_t tap);
+static void dct32(const int32_t *table, const mad_fixed_t *in, int32_t *out);
+static void window_slot(const mp3_synth_t *synth, uint8_t channel, int32_t *samples);
+
+audio_status_t mp3_synth_init(mp3_synth_t *synth) {
+    if (synth == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    memset(synth, 0, sizeof(*synth));
+    build_dct_table(synth);
+
+    synth_reference_t *reference = (synth_reference_t *)pvPortMalloc(sizeof(synth_reference_t));
+    if (reference == NULL) {
+        return AUDIO_ERROR_MEMORY;
+    }
+    mad_synth_init(&reference->synth);
+    mad_frame_init(&reference->frame);
+    audio_status_t status = calibrate_window(synth, reference);
+    mad_frame_finish(&reference->frame);
+    mad_synth_finish(&reference->synth);
+    vPortFree(reference);
+
+    mp3_synth_mute(synth);
+    return status;
+}
+
+void mp3_synth_mute(mp3_synth_t *synth) {
+    if (synth == NULL) {
+        return;
+    }
+    memset(synth->history, 0, sizeof(synth->history));
+    synth->newest = 0;
+    synth->length = 0;
+}
+
+void mp3_synth_frame(mp3_synth_t *synth, const struct mad_frame *frame) {
+    if (synth == NULL || frame == NULL) {
+        return;
+    }
+    uint8_t channels = (uint8_t)MAD_NCHANNELS(&frame->header);
+    uint32_t slots = MAD_NSBSAMPLES(&frame->header);
+    synth->channels = channels;
+    synth->sample_rate = frame->header.samplerate;
+    synth->length = (uint16_t)(slots * 32u);
+
+    int32_t left[32];
+    int32_t right[32];
+    uint32_t *out = synth->pcm;
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        synth->newest = (uint8_t)((synth->newest - 1u) & (SYNTH_TAPS - 1u));
+        for (uint8_t ch = 0; ch < channels; ch++) {
+            dct32(synth->dct, frame->sbsample[ch][slot], synth->history[ch][synth->newest]);
+        }
+        window_slot(synth, 0, left);
+        const int32_t *second = left;    // Mono plays on both sides
+        if (channels == 2) {
+            window_slot(synth, 1, right);
+            second = right;
+        }
+        // out is 4-byte aligned: one packed store per frame
+        for (uint32_t j = 0; j < 32u; j++) {
+            out[j] = dsp_pack16x2(left[j], second[j]);
+        }
+        out += 32;
+    }
+}
+
+// Odd-part cosines for each level of the partial-butterfly DCT, in the order dct32() reads them
+static void build_dct_table(mp3_synth_t *synth) {
+    const float pi = 3.14159265358979f;
+    int32_t *coefficient = synth->dct;
+    for (uint32_t size = 32; size > 1u; size >>= 1) {
+        uint32_t half = size / 2u;
+        for (uint32_t m = 0; m < half; m++) {
+            for (uint32_t n = 0; n < half; n++) {
+                float angle = pi * (float)((2u * m + 1u) * (2u * n + 1u)) / (float)(2u * size);
+                *coefficient++ = (int32_t)lrintf(cosf(angle) * 2147483648.0f);
+            }
+        }
+    }
+}
+
+// Read the window out of MAD with one impulse, then check both filters agree on another
+static audio_status_t calibrate_window(mp3_synth_t *synth, synth_reference_t *reference) {
+    const float pi = 3.14159265358979f;
+    struct mad_frame *frame = &reference->frame;
+    frame->header.layer = MAD_LAYER_II;    // 36 slots: two more than the 16 taps need
+    frame->header.mode = MAD_MODE_SINGLE_CHANNEL;
+    frame->header.flags = 0;
+    frame->header.samplerate = 44100;
+    frame->options = 0;
+
+    // Subband 0 alone makes X[m] = cos(m * pi / 64), so slot t, output j is that times tap t's coefficient
+    frame->sbsample[0][0][0] = MAD_F_ONE;
+    mad_synth_frame(&reference->synth, frame);
+    const mad_fixed_t *impulse = reference->synth.pcm.samples[0];
+    for (uint32_t t = 0; t < SYNTH_TAPS; t++) {
+        for (uint32_t j = 0; j < 32u; j++) {
+            float x = cosf(pi * (float)history_index(j, t) / 64.0f);
+            // out / x is the coefficient in Q28; stored halved in Q31, that is times 4
+            synth->window[j][t] = (int32_t)lrintf((float)impulse[32u * t + j] * 4.0f / x);
+        }
+    }
+
+    // Two subbands, two slots, two signs: MAD and this filter must give the same 16-bit output
+    mad_frame_mute(frame);
+    mad_synth_mute(&reference->synth);
+    frame->sbsample[0][0][7] = MAD_F_ONE / 2;
+    frame->sbsample[0][5][20] = -MAD_F_ONE / 4;
+    mad_synth_frame(&reference->synth, frame);
+    mp3_synth_mute(synth);
+    mp3_synth_frame(synth, frame);
+
+    const mad_fixed_t *expected = reference->synth.pcm.samples[0];
+    for (uint32_t i = 0; i < synth->length; i++) {
+        int32_t want = dsp_ssat16((int32_t)(((int64_t)expected[i] + MAD_PCM_ROUND) >> MAD_PCM_SHIFT));
+        int32_t got = (int16_t)(synth->pcm[i] & 0xFFFFu);
+        if (got - want > 1 || want - got > 1) {
+            return AUDIO_ERROR_INIT;
+        }
+    }
+    return AUDIO_OK;
+}
+
+// Which DCT output tap `tap` of output `output` reads; the standard's V vector is these, some negated
+static uint32_t history_index(uint32_t output, uint32_t tap) {
+    if (tap & 1u) {
+        return (output <= 16u) ? 16u - output : output - 16u;
+    }
+    // Output 16's even taps read V[16], which is always zero; X[0] stands in with a zero coefficient
+    return (output <= 16u) ? (output + 16u) & 31u : 48u - output;
+}
+
+// 32-point DCT-II, X[m] = sum of in[k] * cos(m * (2k + 1) * pi / 64), out in Q24
+static void dct32(const int32_t *table, const mad_fixed_t *in, int32_t *out) {
+    int32_t x[32];
+    int32_t odd[16];
+    for (uint32_t n = 0; n < 32u; n++) {
+        x[n] = in[n] >> SYNTH_IN_SHIFT;
+    }
+
+    // Each level: sums are the next level's input (its outputs are the even ones), differences times
+    // a small cosine matrix are the odd ones. stride spaces this level's outputs in out.
+    uint32_t stride = 1;
+    for (uint32_t size = 32; size > 1u; size >>= 1) {
+        uint32_t half = size / 2u;
+        for (uint32_t n = 0; n < half; n++) {
+            odd[n] = x[n] - x[size - 1u - n];
+            x[n] = x[n] + x[size - 1u - n];
+        }
+        for (uint32_t m = 0; m < half; m++) {
+            int32_t acc = 0;
+            for (uint32_t n = 0; n < half; n++) {
+                acc = dsp_smmlar(odd[n], *table++, acc);
+            }
+            out[stride * (2u * m + 1u)] = acc;
+        }
+        stride <<= 1;
+    }
+    out[0] = x[0] >> 1;    // The sum of all 32, halved like the rest
+}
+
+// 32 outputs from the 16 newest DCT outputs of one channel, rounded and clipped to 16 bits
+static void window_slot(const mp3_synth_t *synth, uint8_t channel, int32_t *samples) {
+    const int32_t *rows[SYNTH_TAPS];
+    for (uint32_t t = 0; t < SYNTH_TAPS; t++) {
+        rows[t] = synth->history[channel][(synth->newest + t) & (SYNTH_TAPS - 1u)];
+    }
+
+    // Outputs j and 32 - j read the same values, so each load feeds two multiplies
+    for (uint32_t j = 1; j < 16u; j++) {
+        const int32_t *w = synth->window[j];
+        const int32_t *mirror = synth->window[32u - j];
+        int32_t acc = SYNTH_ROUND;
+        int32_t accMirror = SYNTH_ROUND;
+        for (uint32_t t = 0; t < SYNTH_TAPS; t += 2u) {
+            int32_t even = rows[t][j + 16u];
+            int32_t odd = rows[t + 1u][16u - j];
+            acc = dsp_smmlar(even, w[t], acc);
+            accMirror = dsp_smmlar(even, mirror[t], accMirror);
+            acc = dsp_smmlar(odd, w[t + 1u], acc);
+            accMirror = dsp_smmlar(odd, mirror[t + 1u], accMirror);
+        }
+        samples[j] = dsp_ssat16(acc >> SYNTH_OUT_SHIFT);
+        samples[32u - j] = dsp_ssat16(accMirror >> SYNTH_OUT_SHIFT);
+    }
+
+    // Outputs 0 and 16 have no partner
+    for (uint32_t j = 0; j <= 16u; j += 16u) {
+        const int32_t *w = synth->window[j];
+        int32_t acc = SYNTH_ROUND;
+        for (uint32_t t = 0; t < SYNTH_TAPS; t++) {
+            acc = dsp_smmlar(rows[t][history_index(j, t)], w[t], acc);
+        }
+        samples[j] = dsp_ssat16(acc >> SYNTH_OUT_SHIFT);
+    }
+}
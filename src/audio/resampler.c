@@ -0,0 +1,318 @@
+#include "audio/resampler.h"
+#include "audio/dsp_kernels.h"
+#include "drivers/audio_output.h"
+#include "FreeRTOS.h"
+#include <math.h>
+#include <string.h>
+
+#define RESAMPLER_MIN_RATE      8000
+#define RESAMPLER_MAX_RATE      48000
+
+// Filter shape for each preset
+typedef struct {
+    uint8_t taps;           // Even, so SMLAD always has a pair
+    uint16_t phases;
+    uint8_t blend;          // Blend the two nearest phases instead of picking one
+    uint16_t cutoff_x1000;  // Passband edge as a share of the lower Nyquist frequency
+} resampler_preset_t;
+
+static const resampler_preset_t presets[] = {
+    { 8, 32, 0, 800 },      // RESAMPLER_QUALITY_FAST
+    { 16, 64, 0, 900 },     // RESAMPLER_QUALITY_BALANCED
+    { 32, 128, 1, 940 },    // RESAMPLER_QUALITY_BEST
+};
+
+struct resampler_s {
+    uint32_t inputRate;
+    uint32_t outputRate;
+    uint32_t stepWhole;     // Input frames per output frame, whole part
+    uint32_t stepRemainder; // ... and the rest, in outputRate units
+    uint32_t remainder;     // Position between two input frames, in outputRate units
+    uint64_t phaseScale;    // remainder * phaseScale >> 32 = phase in 1/65536ths
+    uint32_t position;      // First history frame of the next output's window
+    uint32_t filled;        // Frames in the history
+    uint32_t flush;         // Silent frames still to push through at the end of the stream
+    uint8_t taps;
+    uint8_t blend;
+    uint16_t phases;
+    int16_t *coefs;         // (phases + 1) rows of taps; the extra row is phase 0 one frame later
+    int16_t *history[2];    // Left and right kept apart, so neighbouring samples pair up for SMLAD
+    uint32_t historySize;
+};
+
+// Function declarations for internal functions
+static void build_filter(struct resampler_s *rs, uint16_t cutoff_x1000);
+static inline void filter_pair(const int16_t *left, const int16_t *right, const int16_t *coefs, uint8_t taps,
+                               int32_t *outLeft, int32_t *outRight);
+static inline int32_t round_q15(int32_t value);
+
+audio_status_t resampler_open(uint32_t input_rate, uint32_t output_rate, resampler_quality_t quality, resampler_t *resampler) {
+    if (resampler == NULL || input_rate < RESAMPLER_MIN_RATE || input_rate > RESAMPLER_MAX_RATE ||
+        output_rate < RESAMPLER_MIN_RATE || output_rate > RESAMPLER_MAX_RATE ||
+        (uint32_t)quality >= sizeof(presets) / sizeof(presets[0])) {
+        return AUDIO_ERROR_PARAM;
+    }
+    const resampler_preset_t *preset = &presets[quality];
+
+    struct resampler_s *rs = (struct resampler_s *)pvPortMalloc(sizeof(struct resampler_s));
+    if (rs == NULL) {
+        return AUDIO_ERROR_MEMORY;
+    }
+    memset(rs, 0, sizeof(*rs));
+    rs->inputRate = input_rate;
+    rs->outputRate = output_rate;
+    rs->stepWhole = input_rate / output_rate;
+    rs->stepRemainder = input_rate % output_rate;
+    rs->phaseScale = ((uint64_t)preset->phases << 48) / output_rate;
+    rs->taps = preset->taps;
+    rs->blend = preset->blend;
+    rs->phases = preset->phases;
+    rs->historySize = (uint32_t)preset->taps + RESAMPLER_BLOCK_FRAMES;
+
+    rs->coefs = (int16_t *)pvPortMalloc((size_t)(rs->phases + 1u) * rs->taps * sizeof(int16_t));
+    rs->history[0] = (int16_t *)pvPortMalloc((size_t)rs->historySize * 2u * sizeof(int16_t));
+    if (rs->coefs == NULL || rs->history[0] == NULL) {
+        resampler_close(rs);
+        return AUDIO_ERROR_MEMORY;
+    }
+    rs->history[1] = rs->history[0] + rs->historySize;
+
+    build_filter(rs, preset->cutoff_x1000);
+    resampler_reset(rs);
+    *resampler = rs;
+    return AUDIO_OK;
+}
+
+audio_status_t resampler_open_for_output(uint32_t input_rate, resampler_quality_t quality, resampler_t *resampler) {
+    if (resampler == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    uint32_t outputRate = audio_output_get_sample_rate();
+    if (outputRate == 0) {
+        return AUDIO_ERROR_INIT;
+    }
+    *resampler = NULL;
+    if (input_rate == outputRate) {
+        return AUDIO_OK;
+    }
+    return resampler_open(input_rate, outputRate, quality, resampler);
+}
+
+void resampler_close(resampler_t resampler) {
+    if (resampler == NULL) {
+        return;
+    }
+    if (resampler->coefs != NULL) {
+        vPortFree(resampler->coefs);
+    }
+    if (resampler->history[0] != NULL) {
+        vPortFree(resampler->history[0]);
+    }
+    vPortFree(resampler);
+}
+
+void resampler_reset(resampler_t resampler) {
+    if (resampler == NULL) {
+        return;
+    }
+    // Start with taps/2 - 1 frames of silence so the first output lands on the first input frame
+    resampler->filled = (uint32_t)resampler->taps / 2u - 1u;
+    memset(resampler->history[0], 0, resampler->filled * sizeof(int16_t));
+    memset(resampler->history[1], 0, resampler->filled * sizeof(int16_t));
+    resampler->position = 0;
+    resampler->remainder = 0;
+    resampler->flush = (uint32_t)resampler->taps / 2u;
+}
+
+uint32_t resampler_process(resampler_t resampler, const int16_t *input, uint32_t input_frames, uint32_t *consumed,
+                           int16_t *output, uint32_t max_output) {
+    uint32_t used = 0;
+    uint32_t made = 0;
+    if (resampler == NULL || (input == NULL && input_frames > 0) || (output == NULL && max_output > 0)) {
+        if (consumed != NULL) {
+            *consumed = 0;
+        }
+        return 0;
+    }
+
+    struct resampler_s *rs = resampler;
+    uint32_t *out = (uint32_t *)output;
+    while (made < max_output) {
+        if (rs->position + rs->taps > rs->filled) {
+            if (used == input_frames) {
+                break;
+            }
+            // Drop what is behind the window, then top the history up from the input
+            uint32_t drop = (rs->position < rs->filled) ? rs->position : rs->filled;
+            uint32_t keep = rs->filled - drop;
+            if (drop > 0) {
+                memmove(rs->history[0], rs->history[0] + drop, keep * sizeof(int16_t));
+                memmove(rs->history[1], rs->history[1] + drop, keep * sizeof(int16_t));
+                rs->position -= drop;
+                rs->filled = keep;
+            }
+            uint32_t take = rs->historySize - rs->filled;
+            if (take > input_frames - used) {
+                take = input_frames - used;
+            }
+            const int16_t *src = input + used * 2u;
+            for (uint32_t i = 0; i < take; i++) {
+                rs->history[0][rs->filled + i] = src[2u * i];
+                rs->history[1][rs->filled + i] = src[2u * i + 1u];
+            }
+            rs->filled += take;
+            used += take;
+            continue;
+        }
+
+        // Which phase: the top 16 bits are the row, the bottom 16 how far towards the next one
+        uint32_t phase = (uint32_t)(((uint64_t)rs->remainder * rs->phaseScale) >> 32);
+        uint32_t row = phase >> 16;
+        const int16_t *left = rs->history[0] + rs->position;
+        const int16_t *right = rs->history[1] + rs->position;
+        int32_t sumLeft;
+        int32_t sumRight;
+        if (rs->blend) {
+            int32_t nextLeft;
+            int32_t nextRight;
+            int32_t weight = (int32_t)((phase >> 1) & 0x7FFFu);
+            filter_pair(left, right, rs->coefs + row * rs->taps, rs->taps, &sumLeft, &sumRight);
+            filter_pair(left, right, rs->coefs + (row + 1u) * rs->taps, rs->taps, &nextLeft, &nextRight);
+            sumLeft += (int32_t)((((int64_t)nextLeft - sumLeft) * weight) >> 15);
+            sumRight += (int32_t)((((int64_t)nextRight - sumRight) * weight) >> 15);
+        } else {
+            row += (phase >> 15) & 1u;    // Round to the nearest phase (row == phases is the extra row)
+            filter_pair(left, right, rs->coefs + row * rs->taps, rs->taps, &sumLeft, &sumRight);
+        }
+        out[made++] = dsp_pack16x2(round_q15(sumLeft), round_q15(sumRight));
+
+        rs->position += rs->stepWhole;
+        rs->remainder += rs->stepRemainder;
+        if (rs->remainder >= rs->outputRate) {
+            rs->remainder -= rs->outputRate;
+            rs->position++;
+        }
+    }
+
+    if (consumed != NULL) {
+        *consumed = used;
+    }
+    return made;
+}
+
+uint32_t resampler_flush(resampler_t resampler, int16_t *output, uint32_t max_output) {
+    if (resampler == NULL || output == NULL) {
+        return 0;
+    }
+    // Push silence through until the window has passed the last real frame
+    static const int16_t silence[32] = { 0 };
+    uint32_t made = 0;
+    while (made < max_output) {
+        uint32_t push = (resampler->flush < 16u) ? resampler->flush : 16u;
+        uint32_t consumed = 0;
+        uint32_t got = resampler_process(resampler, silence, push, &consumed, output + made * 2u, max_output - made);
+        resampler->flush -= consumed;
+        made += got;
+        if (got == 0 && consumed == 0) {
+            break;
+        }
+    }
+    return made;
+}
+
+audio_stage_result_t audio_stage_resample(void *context, spsc_ring_t *input, spsc_ring_t *output) {
+    resampler_t resampler = (resampler_t)context;
+    if (resampler == NULL || input == NULL || output == NULL) {
+        return AUDIO_STAGE_ERROR;
+    }
+
+    uint32_t available;
+    const int16_t *src = (const int16_t *)spsc_ring_read_ptr(input, &available);
+    uint32_t space;
+    int16_t *dst = (int16_t *)spsc_ring_write_ptr(output, &space);
+    uint32_t inFrames = available / 4u;
+    uint32_t outFrames = space / 4u;
+
+    if (outFrames == 0) {
+        return AUDIO_STAGE_BLOCKED;
+    }
+
+    uint32_t consumed = 0;
+    if (inFrames == 0 && spsc_ring_is_closed(input)) {
+        // Drop a trailing partial frame, then let the last frames out of the filter
+        spsc_ring_read_commit(input, spsc_ring_used(input));
+        uint32_t made = resampler_flush(resampler, dst, outFrames);
+        if (made > 0) {
+            spsc_ring_write_commit(output, made * 4u);
+            return AUDIO_STAGE_PROGRESS;
+        }
+        return AUDIO_STAGE_DONE;
+    }
+
+    uint32_t made = resampler_process(resampler, src, inFrames, &consumed, dst, outFrames);
+    if (consumed > 0) {
+        spsc_ring_read_commit(input, consumed * 4u);
+    }
+    if (made > 0) {
+        spsc_ring_write_commit(output, made * 4u);
+    }
+    if (made == 0 && consumed == 0) {
+        return AUDIO_STAGE_STARVED;
+    }
+    return AUDIO_STAGE_PROGRESS;
+}
+
+// Fills the filter bank: Blackman-windowed sinc, one row per phase, each row summing to unity gain
+static void build_filter(struct resampler_s *rs, uint16_t cutoff_x1000) {
+    const float pi = 3.14159265f;
+    uint32_t lowerRate = (rs->inputRate < rs->outputRate) ? rs->inputRate : rs->outputRate;
+    // Cutoff as a share of the input's Nyquist frequency
+    float cutoff = (float)cutoff_x1000 / 1000.0f * (float)lowerRate / (float)rs->inputRate;
+    float half = (float)rs->taps / 2.0f;
+
+    for (uint32_t row = 0; row <= rs->phases; row++) {
+        float fraction = (float)row / (float)rs->phases;
+        float values[32];
+        float sum = 0.0f;
+        for (uint8_t tap = 0; tap < rs->taps; tap++) {
+            // Distance from this tap to the point being made, in input frames
+            float t = (float)tap - (half - 1.0f) - fraction;
+            float x = pi * cutoff * t;
+            float sinc = (fabsf(x) < 1e-6f) ? 1.0f : sinf(x) / x;
+            float w = t / half;
+            float window = (fabsf(w) >= 1.0f) ? 0.0f : 0.42f + 0.5f * cosf(pi * w) + 0.08f * cosf(2.0f * pi * w);
+            values[tap] = sinc * window;
+            sum += values[tap];
+        }
+        int16_t *coefs = rs->coefs + row * rs->taps;
+        for (uint8_t tap = 0; tap < rs->taps; tap++) {
+            float scaled = values[tap] / sum * 32767.0f;
+            coefs[tap] = (int16_t)lrintf(scaled);
+        }
+    }
+}
+
+// Both channels' dot products over one filter row, two taps per SMLAD
+static inline void filter_pair(const int16_t *left, const int16_t *right, const int16_t *coefs, uint8_t taps,
+                               int32_t *outLeft, int32_t *outRight) {
+    int32_t sumLeft = 0;
+    int32_t sumRight = 0;
+    for (uint8_t tap = 0; tap < taps; tap += 2) {
+        // The window can start on any sample, so the history loads may be unaligned (fine for LDR on the M33)
+        uint32_t c;
+        uint32_t l;
+        uint32_t r;
+        memcpy(&c, coefs + tap, sizeof(c));
+        memcpy(&l, left + tap, sizeof(l));
+        memcpy(&r, right + tap, sizeof(r));
+        sumLeft = dsp_smlad(l, c, sumLeft);
+        sumRight = dsp_smlad(r, c, sumRight);
+    }
+    *outLeft = sumLeft;
+    *outRight = sumRight;
+}
+
+// Q15 sum back to a 16-bit sample
+static inline int32_t round_q15(int32_t value) {
+    return dsp_ssat16((value + (1 << 14)) >> 15);
+}
@@ -0,0 +1,366 @@
+#include "drivers/audio.h"
+#include "drivers/audio_output.h"
+#include "audio/adpcm.h"
+#include "audio/resampler.h"
+#include "audio/wav_reader.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdatomic.h>
+#include <string.h>
+
+#define BANK_INDEX_BITS         4
+#define BANK_INDEX_MASK         ((1u << BANK_INDEX_BITS) - 1u)
+#define BANK_GENERATION_MAX     (UINT16_MAX >> BANK_INDEX_BITS)
+#define BANK_CHUNK_FRAMES       64      // Frames decoded onto the stack at once while loading
+#define BANK_RESAMPLE_TAIL      64      // Extra output frames so the converter's filter delay doesn't cut the ending
+#define BANK_FLUSH_CHUNKS       4       // Silent chunks fed to the converter to push the ending out
+
+#if AUDIO_BANK_SOUNDS > (1 << BANK_INDEX_BITS)
+#error "AUDIO_BANK_SOUNDS must be 16 or less"
+#endif
+
+// One sound on the shelf (handle is published last, so a reader that sees it sees the rest)
+typedef struct {
+    atomic_uint_least16_t handle;   // 0 while empty or loading
+    atomic_uint_least16_t playing;  // audio_bank_play() calls between their handle check and their trigger
+    const int16_t *samples;
+    int16_t *owned;                 // Memory to give back (NULL when played in place)
+    uint32_t frames;
+    uint16_t generation;            // Bumped each time the slot is reused, so old handles go stale
+    uint8_t channels;
+    uint8_t used;                   // Taken, loaded or still loading
+} bank_sound_t;
+
+// Where sound comes from while it is loaded: a file, or a WAV image in memory
+typedef struct {
+    wav_info_t info;
+    wav_reader_t reader;
+    const uint8_t *data;
+    uint32_t offset;                // Next byte of data
+    adpcm_decoder_t adpcm;
+} bank_source_t;
+
+static bank_sound_t sounds[AUDIO_BANK_SOUNDS];
+
+// Function declarations for internal functions
+static audio_status_t claim_slot(uint8_t *index);
+static void release_slot(uint8_t index);
+static audio_sound_t publish(uint8_t index, const int16_t *samples, int16_t *owned, uint32_t frames, uint8_t channels);
+static audio_status_t load_sound(bank_source_t *source, audio_sound_t *sound);
+static audio_status_t read_source(bank_source_t *source, uint32_t *frames, uint16_t max_frames, uint16_t *count);
+static audio_status_t convert_rate(const uint32_t *input, uint32_t input_frames, uint32_t input_rate,
+                                   uint32_t output_rate, int16_t **output, uint32_t *frames);
+static int16_t read_le16(const uint8_t *data);
+
+audio_status_t audio_bank_load(const char *filename, audio_sound_t *sound) {
+    if (filename == NULL || sound == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (audio_output_get_sample_rate() == 0) {
+        return AUDIO_ERROR_INIT;
+    }
+
+    bank_source_t source;
+    memset(&source, 0, sizeof(source));
+    audio_status_t status = wav_reader_open(filename, AUDIO_FORMAT_WAV, &source.reader);
+    if (status != AUDIO_OK) {
+        return status;
+    }
+    wav_reader_get_info(source.reader, &source.info);
+    status = load_sound(&source, sound);
+    wav_reader_close(source.reader);
+    return status;
+}
+
+audio_status_t audio_bank_add(const void *wav, size_t size, audio_sound_t *sound) {
+    if (wav == NULL || sound == NULL || size > UINT32_MAX) {
+        return AUDIO_ERROR_PARAM;
+    }
+    uint32_t outputRate = audio_output_get_sample_rate();
+    if (outputRate == 0) {
+        return AUDIO_ERROR_INIT;
+    }
+
+    bank_source_t source;
+    memset(&source, 0, sizeof(source));
+    audio_status_t status = wav_parse_buffer(wav, (uint32_t)size, &source.info);
+    if (status != AUDIO_OK) {
+        return status;
+    }
+    source.data = (const uint8_t *)wav + source.info.data_offset;
+
+    if (source.info.format_tag == WAV_FORMAT_PCM) {
+        if (source.info.bits_per_sample != 16) {
+            return AUDIO_ERROR_FORMAT;
+        }
+        // Already speaker-shaped: play it where it lies, flash included
+        if (source.info.sample_rate == outputRate && source.info.channels <= 2 &&
+            ((uintptr_t)source.data & 1u) == 0) {
+            if (source.info.total_frames == 0) {
+                return AUDIO_ERROR_FORMAT;
+            }
+            uint8_t index;
+            status = claim_slot(&index);
+            if (status != AUDIO_OK) {
+                return status;
+            }
+            *sound = publish(index, (const int16_t *)(const void *)source.data, NULL,
+                             source.info.total_frames, (uint8_t)source.info.channels);
+            return AUDIO_OK;
+        }
+    } else {
+        adpcm_format_t format = {
+            .type = (source.info.format_tag == WAV_FORMAT_IMA_ADPCM) ? ADPCM_IMA : ADPCM_MS,
+            .channels = (uint8_t)source.info.channels,
+            .block_align = source.info.block_align,
+            .samples_per_block = source.info.samples_per_block,
+        };
+        adpcm_decoder_init(&source.adpcm, &format);
+    }
+    return load_sound(&source, sound);
+}
+
+audio_status_t audio_bank_unload(audio_sound_t sound) {
+    uint16_t index = sound & BANK_INDEX_MASK;
+    if (sound == 0 || index >= AUDIO_BANK_SOUNDS) {
+        return AUDIO_ERROR_PARAM;
+    }
+    bank_sound_t *s = &sounds[index];
+
+    taskENTER_CRITICAL();
+    uint8_t current = (atomic_load_explicit(&s->handle, memory_order_relaxed) == sound);
+    if (current) {
+        atomic_store(&s->handle, 0);
+    }
+    taskEXIT_CRITICAL();
+    if (!current) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    // A play that saw the old handle may still be triggering it; with the handle gone, no new one can
+    while (atomic_load(&s->playing) != 0) {
+        vTaskDelay(1);
+    }
+    // Nothing may still be playing it when its memory goes back
+    audio_stop_effects_using(s->samples);
+    if (s->owned != NULL) {
+        vPortFree(s->owned);
+    }
+    s->samples = NULL;
+    s->owned = NULL;
+    release_slot((uint8_t)index);
+    return AUDIO_OK;
+}
+
+audio_status_t audio_bank_play(audio_sound_t sound, uint8_t gain, int8_t pan, uint8_t priority) {
+    uint16_t index = sound & BANK_INDEX_MASK;
+    if (sound == 0 || index >= AUDIO_BANK_SOUNDS) {
+        return AUDIO_ERROR_PARAM;
+    }
+    bank_sound_t *s = &sounds[index];
+
+    // Counted in before the handle check, so audio_bank_unload() either sees us or we see it gone
+    atomic_fetch_add(&s->playing, 1);
+    audio_status_t status = AUDIO_ERROR_PARAM;
+    if (atomic_load(&s->handle) == sound) {
+        status = audio_trigger_effect(s->samples, s->frames, s->channels, gain, pan, priority);
+    }
+    atomic_fetch_sub_explicit(&s->playing, 1, memory_order_release);
+    return status;
+}
+
+// Takes a free slot and gives it a new generation
+static audio_status_t claim_slot(uint8_t *index) {
+    audio_status_t status = AUDIO_ERROR_BUSY;
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < AUDIO_BANK_SOUNDS; i++) {
+        bank_sound_t *s = &sounds[i];
+        if (!s->used) {
+            s->used = 1;
+            s->generation = (s->generation >= BANK_GENERATION_MAX) ? 1 : (uint16_t)(s->generation + 1);
+            *index = i;
+            status = AUDIO_OK;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+    return status;
+}
+
+static void release_slot(uint8_t index) {
+    taskENTER_CRITICAL();
+    sounds[index].used = 0;
+    taskEXIT_CRITICAL();
+}
+
+// Fills in a claimed slot, then makes its handle live
+static audio_sound_t publish(uint8_t index, const int16_t *samples, int16_t *owned, uint32_t frames, uint8_t channels) {
+    bank_sound_t *s = &sounds[index];
+    s->samples = samples;
+    s->owned = owned;
+    s->frames = frames;
+    s->channels = channels;
+    audio_sound_t handle = (audio_sound_t)((s->generation << BANK_INDEX_BITS) | index);
+    atomic_store_explicit(&s->handle, handle, memory_order_release);
+    return handle;
+}
+
+// Decodes the whole source into RAM at the output's rate and puts it on the shelf
+static audio_status_t load_sound(bank_source_t *source, audio_sound_t *sound) {
+    uint32_t total = source->info.total_frames;
+    uint32_t inputRate = source->info.sample_rate;
+    uint32_t outputRate = audio_output_get_sample_rate();
+    if (total == 0 || inputRate == 0) {
+        return AUDIO_ERROR_FORMAT;
+    }
+
+    uint8_t index;
+    audio_status_t status = claim_slot(&index);
+    if (status != AUDIO_OK) {
+        return status;
+    }
+
+    // At the output's rate mono stays mono; otherwise decode to stereo for the converter
+    uint8_t channels = (source->info.channels > 1 || inputRate != outputRate) ? 2 : 1;
+    int16_t *decoded = (int16_t *)pvPortMalloc((size_t)total * channels * sizeof(int16_t));
+    if (decoded == NULL) {
+        release_slot(index);
+        return AUDIO_ERROR_MEMORY;
+    }
+
+    uint32_t chunk[BANK_CHUNK_FRAMES];
+    uint32_t frames = 0;
+    while (frames < total) {
+        uint32_t want = total - frames;
+        uint16_t count = 0;
+        status = read_source(source, chunk, (want < BANK_CHUNK_FRAMES) ? (uint16_t)want : BANK_CHUNK_FRAMES, &count);
+        if (status != AUDIO_OK || count == 0) {
+            break;
+        }
+        if (channels == 2) {
+            memcpy((uint32_t *)(void *)decoded + frames, chunk, (size_t)count * sizeof(uint32_t));
+        } else {
+            for (uint16_t i = 0; i < count; i++) {
+                decoded[frames + i] = (int16_t)chunk[i];
+            }
+        }
+        frames += count;
+    }
+    if (status == AUDIO_OK && frames == 0) {
+        status = AUDIO_ERROR_FORMAT;
+    }
+
+    if (status == AUDIO_OK && inputRate != outputRate) {
+        int16_t *converted = NULL;
+        status = convert_rate((const uint32_t *)(void *)decoded, frames, inputRate, outputRate, &converted, &frames);
+        vPortFree(decoded);
+        decoded = converted;
+    }
+    if (status != AUDIO_OK) {
+        if (decoded != NULL) {
+            vPortFree(decoded);
+        }
+        release_slot(index);
+        return status;
+    }
+
+    *sound = publish(index, decoded, decoded, frames, channels);
+    return AUDIO_OK;
+}
+
+// Next frames as packed 16-bit stereo; count 0 at the end
+static audio_status_t read_source(bank_source_t *source, uint32_t *frames, uint16_t max_frames, uint16_t *count) {
+    *count = 0;
+    if (source->reader != NULL) {
+        audio_status_t status = wav_reader_read_pcm(source->reader, (int16_t *)(void *)frames, max_frames, count);
+        return (status == AUDIO_ERROR_BUSY) ? AUDIO_OK : status;
+    }
+
+    const wav_info_t *info = &source->info;
+    if (info->format_tag != WAV_FORMAT_PCM) {
+        if (adpcm_decoder_block_done(&source->adpcm)) {
+            uint32_t bytes = info->data_bytes - source->offset;
+            if (bytes > info->block_align) {
+                bytes = info->block_align;
+            }
+            if (bytes == 0) {
+                return AUDIO_OK;
+            }
+            audio_status_t status = adpcm_decoder_start_block(&source->adpcm, source->data + source->offset, bytes);
+            source->offset += bytes;
+            if (status != AUDIO_OK) {
+                // Only a last block too short for its header may be skipped
+                return (source->offset >= info->data_bytes) ? AUDIO_OK : status;
+            }
+        }
+        *count = adpcm_decoder_read(&source->adpcm, frames, max_frames);
+        return AUDIO_OK;
+    }
+
+    // 16-bit PCM from memory, any number of channels (the first two play)
+    uint32_t available = (info->data_bytes - source->offset) / info->block_align;
+    uint16_t n = (available < max_frames) ? (uint16_t)available : max_frames;
+    uint32_t rightOffset = (info->channels > 1) ? 2u : 0u;
+    const uint8_t *src = source->data + source->offset;
+    for (uint16_t i = 0; i < n; i++) {
+        frames[i] = ((uint32_t)(uint16_t)read_le16(src) | ((uint32_t)(uint16_t)read_le16(src + rightOffset) << 16));
+        src += info->block_align;
+    }
+    source->offset += (uint32_t)n * info->block_align;
+    *count = n;
+    return AUDIO_OK;
+}
+
+// Converts a whole stereo sound to the output's rate in one go
+static audio_status_t convert_rate(const uint32_t *input, uint32_t input_frames, uint32_t input_rate,
+                                   uint32_t output_rate, int16_t **output, uint32_t *frames) {
+    resampler_t resampler;
+    audio_status_t status = resampler_open(input_rate, output_rate, AUDIO_BANK_RESAMPLE_QUALITY, &resampler);
+    if (status != AUDIO_OK) {
+        return status;
+    }
+
+    uint32_t room = (uint32_t)((uint64_t)input_frames * output_rate / input_rate) + BANK_RESAMPLE_TAIL;
+    int16_t *converted = (int16_t *)pvPortMalloc((size_t)room * 2u * sizeof(int16_t));
+    if (converted == NULL) {
+        resampler_close(resampler);
+        return AUDIO_ERROR_MEMORY;
+    }
+
+    static const int16_t silence[BANK_CHUNK_FRAMES * 2] = { 0 };
+    uint32_t used = 0;
+    uint32_t made = 0;
+    uint32_t flushes = 0;
+    while (made < room) {
+        uint32_t consumed = 0;
+        uint32_t n;
+        if (used < input_frames) {
+            n = resampler_process(resampler, (const int16_t *)(const void *)(input + used), input_frames - used,
+                                  &consumed, converted + made * 2u, room - made);
+            used += consumed;
+        } else if (flushes++ < BANK_FLUSH_CHUNKS) {
+            // The filter still holds the ending: push it out with silence
+            n = resampler_process(resampler, silence, BANK_CHUNK_FRAMES, &consumed, converted + made * 2u, room - made);
+        } else {
+            break;
+        }
+        made += n;
+        if (n == 0 && consumed == 0) {
+            break;
+        }
+    }
+    resampler_close(resampler);
+
+    if (made == 0) {
+        vPortFree(converted);
+        return AUDIO_ERROR_FORMAT;
+    }
+    *output = converted;
+    *frames = made;
+    return AUDIO_OK;
+}
+
+static int16_t read_le16(const uint8_t *data) {
+    return (int16_t)(uint16_t)(data[0] | (data[1] << 8));
+}
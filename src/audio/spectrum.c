@@ -0,0 +1,272 @@
+#include "audio/spectrum.h"
+#include "audio/dsp_kernels.h"
+#include "FreeRTOS.h"
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define SPECTRUM_DEFAULT_RANGE_DB   60
+#define SPECTRUM_FULL_SCALE_LOG2    26      // Power of a full-scale sine's peak bin: (32767 / 4)^2 after the Hann window
+#define SPECTRUM_DB_PER_LOG2_Q8     771     // 10 * log10(2) = 3.0103 dB per doubling, in Q8
+
+struct spectrum_s {
+    uint16_t size;              // FFT points, a power of 4
+    uint8_t bands;
+    uint8_t falloff;
+    int32_t rangeQ8;            // range_db in Q8
+    uint32_t sampleRate;
+    uint16_t historyPos;        // Where the next sample goes (history is circular)
+    int16_t *history;           // Newest `size` samples
+    int16_t *window;            // Hann window, Q15
+    int16_t *twiddle;           // cos, sin pairs of 2*pi*k/size in Q15, k < 3*size/4
+    int16_t *work;              // re, im pairs the FFT runs on
+    uint16_t bandEdge[SPECTRUM_MAX_BANDS + 1];  // Band b covers bins bandEdge[b] .. bandEdge[b+1]-1
+    uint8_t levels[SPECTRUM_MAX_BANDS];         // Last heights, for the falloff
+};
+
+// Function declarations for internal functions
+static bool build_bands(spectrum_t spectrum);
+static void fft_radix4(int16_t *data, uint16_t size, const int16_t *twiddle);
+static void digit_reverse(int16_t *data, uint16_t size);
+static int32_t log2_q8(uint64_t value);
+
+audio_status_t spectrum_open(const spectrum_config_t *config, spectrum_t *spectrum) {
+    if (config == NULL || spectrum == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    uint16_t size = config->fft_size;
+    if (size != 64 && size != 256 && size != 1024) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (config->bands == 0 || config->bands > SPECTRUM_MAX_BANDS ||
+        config->sample_rate < 4u * SPECTRUM_MIN_HZ) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    // One block: the struct, then history, window, twiddles and the work area
+    uint32_t twiddleCount = 3u * size / 4u;
+    size_t bytes = sizeof(struct spectrum_s) +
+                   (size_t)size * sizeof(int16_t) * 2u +
+                   (size_t)twiddleCount * sizeof(int16_t) * 2u +
+                   (size_t)size * sizeof(int16_t) * 2u;
+    spectrum_t s = (spectrum_t)pvPortMalloc(bytes);
+    if (s == NULL) {
+        return AUDIO_ERROR_MEMORY;
+    }
+    memset(s, 0, bytes);
+    s->size = size;
+    s->bands = config->bands;
+    s->falloff = config->falloff;
+    s->rangeQ8 = (int32_t)(config->range_db ? config->range_db : SPECTRUM_DEFAULT_RANGE_DB) * 256;
+    s->sampleRate = config->sample_rate;
+    s->history = (int16_t *)(s + 1);
+    s->window = s->history + size;
+    s->twiddle = s->window + size;
+    s->work = s->twiddle + 2u * twiddleCount;
+
+    if (!build_bands(s)) {
+        vPortFree(s);
+        return AUDIO_ERROR_PARAM;    // More bands than this FFT size has bins for
+    }
+
+    // Floating point only here: the tables never change afterwards
+    const float pi = 3.14159265358979f;
+    for (uint32_t i = 0; i < size; i++) {
+        float hann = 0.5f - 0.5f * cosf(2.0f * pi * (float)i / (float)size);
+        s->window[i] = (int16_t)lrintf(hann * 32767.0f);
+    }
+    for (uint32_t k = 0; k < twiddleCount; k++) {
+        float angle = 2.0f * pi * (float)k / (float)size;
+        s->twiddle[2u * k] = (int16_t)lrintf(cosf(angle) * 32767.0f);
+        s->twiddle[2u * k + 1u] = (int16_t)lrintf(sinf(angle) * 32767.0f);
+    }
+
+    *spectrum = s;
+    return AUDIO_OK;
+}
+
+void spectrum_close(spectrum_t spectrum) {
+    if (spectrum != NULL) {
+        vPortFree(spectrum);
+    }
+}
+
+void spectrum_feed(spectrum_t spectrum, const int16_t *samples, uint32_t count) {
+    if (spectrum == NULL || samples == NULL) {
+        return;
+    }
+    // Older samples would be overwritten anyway
+    if (count > spectrum->size) {
+        samples += count - spectrum->size;
+        count = spectrum->size;
+    }
+    uint16_t pos = spectrum->historyPos;
+    while (count > 0) {
+        uint32_t run = spectrum->size - pos;
+        if (run > count) {
+            run = count;
+        }
+        memcpy(&spectrum->history[pos], samples, run * sizeof(int16_t));
+        samples += run;
+        count -= run;
+        pos = (uint16_t)((pos + run) & (spectrum->size - 1u));
+    }
+    spectrum->historyPos = pos;
+}
+
+audio_status_t spectrum_update(spectrum_t spectrum, uint8_t *levels) {
+    if (spectrum == NULL || levels == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    uint16_t size = spectrum->size;
+    int16_t *work = spectrum->work;
+
+    // Oldest sample first, windowed; the imaginary parts start at zero
+    uint16_t pos = spectrum->historyPos;
+    for (uint32_t i = 0; i < size; i++) {
+        int32_t sample = spectrum->history[pos];
+        work[2u * i] = (int16_t)((sample * spectrum->window[i]) >> 15);
+        work[2u * i + 1u] = 0;
+        pos = (uint16_t)((pos + 1u) & (size - 1u));
+    }
+
+    fft_radix4(work, size, spectrum->twiddle);
+    digit_reverse(work, size);
+
+    for (uint8_t b = 0; b < spectrum->bands; b++) {
+        uint64_t power = 0;
+        for (uint32_t k = spectrum->bandEdge[b]; k < spectrum->bandEdge[b + 1u]; k++) {
+            int32_t re = work[2u * k];
+            int32_t im = work[2u * k + 1u];
+            power += (uint64_t)((uint32_t)(re * re) + (uint32_t)(im * im));
+        }
+
+        int32_t level = 0;
+        if (power != 0) {
+            // Decibels below a full-scale sine, in Q8, then onto 0..255 across the range
+            int32_t dbQ8 = (log2_q8(power) - SPECTRUM_FULL_SCALE_LOG2 * 256) * SPECTRUM_DB_PER_LOG2_Q8 / 256;
+            level = (dbQ8 + spectrum->rangeQ8) * 255 / spectrum->rangeQ8;
+            if (level < 0) {
+                level = 0;
+            } else if (level > 255) {
+                level = 255;
+            }
+        }
+
+        // Up at once, down slowly
+        int32_t floor = (int32_t)spectrum->levels[b] - spectrum->falloff;
+        if (spectrum->falloff != 0 && level < floor) {
+            level = floor;
+        }
+        spectrum->levels[b] = (uint8_t)level;
+        levels[b] = (uint8_t)level;
+    }
+    return AUDIO_OK;
+}
+
+uint32_t spectrum_band_hz(spectrum_t spectrum, uint8_t band) {
+    if (spectrum == NULL || band >= spectrum->bands) {
+        return 0;
+    }
+    return (uint32_t)spectrum->bandEdge[band] * spectrum->sampleRate / spectrum->size;
+}
+
+// Log-spaced edges from SPECTRUM_MIN_HZ to Nyquist, each band at least one bin wide
+static bool build_bands(spectrum_t spectrum) {
+    uint32_t lastBin = spectrum->size / 2u;    // Nyquist, one past the last bin used
+    float binHz = (float)spectrum->sampleRate / (float)spectrum->size;
+    float lowHz = (float)SPECTRUM_MIN_HZ;
+    float ratio = ((float)spectrum->sampleRate / 2.0f) / lowHz;
+
+    uint32_t edge = (uint32_t)lrintf(lowHz / binHz);
+    if (edge < 1u) {
+        edge = 1u;    // Bin 0 is the DC offset, not a sound
+    }
+    spectrum->bandEdge[0] = (uint16_t)edge;
+    for (uint32_t b = 1; b <= spectrum->bands; b++) {
+        float hz = lowHz * powf(ratio, (float)b / (float)spectrum->bands);
+        uint32_t next = (uint32_t)lrintf(hz / binHz);
+        if (next <= edge) {
+            next = edge + 1u;
+        }
+        if (next > lastBin) {
+            return false;
+        }
+        spectrum->bandEdge[b] = (uint16_t)next;
+        edge = next;
+    }
+    return true;
+}
+
+// Radix-4 decimation in frequency, in place on re, im pairs; each stage divides by 4
+static void fft_radix4(int16_t *data, uint16_t size, const int16_t *twiddle) {
+    for (uint32_t span = size; span > 1u; span >>= 2) {
+        uint32_t quarter = span >> 2;
+        uint32_t step = size / span;    // Twiddle stride for this stage
+        for (uint32_t j = 0; j < quarter; j++) {
+            int32_t c1 = twiddle[2u * (j * step)];
+            int32_t s1 = twiddle[2u * (j * step) + 1u];
+            int32_t c2 = twiddle[2u * (2u * j * step)];
+            int32_t s2 = twiddle[2u * (2u * j * step) + 1u];
+            int32_t c3 = twiddle[2u * (3u * j * step)];
+            int32_t s3 = twiddle[2u * (3u * j * step) + 1u];
+            for (uint32_t i = j; i < size; i += span) {
+                int16_t *x0 = &data[2u * i];
+                int16_t *x1 = x0 + 2u * quarter;
+                int16_t *x2 = x1 + 2u * quarter;
+                int16_t *x3 = x2 + 2u * quarter;
+
+                int32_t a0r = x0[0] >> 2, a0i = x0[1] >> 2;
+                int32_t a1r = x1[0] >> 2, a1i = x1[1] >> 2;
+                int32_t a2r = x2[0] >> 2, a2i = x2[1] >> 2;
+                int32_t a3r = x3[0] >> 2, a3i = x3[1] >> 2;
+
+                int32_t t0r = a0r + a2r, t0i = a0i + a2i;
+                int32_t t1r = a0r - a2r, t1i = a0i - a2i;
+                int32_t t2r = a1r + a3r, t2i = a1i + a3i;
+                int32_t t3r = a1r - a3r, t3i = a1i - a3i;
+
+                // Outputs 0..3 of the butterfly; W = cos - j*sin
+                int32_t yr = t1r + t3i, yi = t1i - t3r;
+                x0[0] = (int16_t)(t0r + t2r);
+                x0[1] = (int16_t)(t0i + t2i);
+                x1[0] = dsp_ssat16((yr * c1 + yi * s1) >> 15);
+                x1[1] = dsp_ssat16((yi * c1 - yr * s1) >> 15);
+                yr = t0r - t2r;
+                yi = t0i - t2i;
+                x2[0] = dsp_ssat16((yr * c2 + yi * s2) >> 15);
+                x2[1] = dsp_ssat16((yi * c2 - yr * s2) >> 15);
+                yr = t1r - t3i;
+                yi = t1i + t3r;
+                x3[0] = dsp_ssat16((yr * c3 + yi * s3) >> 15);
+                x3[1] = dsp_ssat16((yi * c3 - yr * s3) >> 15);
+            }
+        }
+    }
+}
+
+// Bins come out of the FFT in base-4 digit-reversed order
+static void digit_reverse(int16_t *data, uint16_t size) {
+    for (uint32_t i = 1; i < size; i++) {
+        uint32_t reversed = 0;
+        for (uint32_t rest = i, digits = size; digits > 1u; digits >>= 2, rest >>= 2) {
+            reversed = (reversed << 2) | (rest & 3u);
+        }
+        if (reversed > i) {
+            int16_t re = data[2u * i];
+            int16_t im = data[2u * i + 1u];
+            data[2u * i] = data[2u * reversed];
+            data[2u * i + 1u] = data[2u * reversed + 1u];
+            data[2u * reversed] = re;
+            data[2u * reversed + 1u] = im;
+        }
+    }
+}
+
+// log2 in Q8: the top bit's position, then the next 8 bits as a straight-line fraction
+static int32_t log2_q8(uint64_t value) {
+    uint32_t high = (uint32_t)(value >> 32);
+    uint32_t top = high ? 63u - dsp_clz(high) : 31u - dsp_clz((uint32_t)value);
+    uint32_t fraction = (uint32_t)((top >= 8u) ? (value >> (top - 8u)) : (value << (8u - top))) & 0xFFu;
+    return (int32_t)(top * 256u + fraction);
+}
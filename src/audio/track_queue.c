@@ -0,0 +1,652 @@
+#include "audio/track_queue.h"
+#include "audio/audio_telemetry.h"
+#include "audio/mp3_decoder.h"
+#include "audio/mp3_seek_index.h"
+#include "audio/flac_decoder.h"
+#include "audio/vorbis_decoder.h"
+#include "audio/wav_reader.h"
+#include "audio/resampler.h"
+#include "fs/fs_manager.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdatomic.h>
+#include <string.h>
+
+#define TRACK_MP3_CHUNK_BYTES   512
+#define TRACK_SCRATCH_FRAMES    128
+
+// What kind of file is playing
+typedef enum {
+    TRACK_NONE = 0,
+    TRACK_MP3,
+    TRACK_FLAC,
+    TRACK_OGG,
+    TRACK_WAV
+} track_kind_t;
+
+// Who holds a direct WAV file's reader
+typedef enum {
+    DIRECT_NONE = 0,    // Not handed over yet (or not a direct file)
+    DIRECT_HANDED,      // The output worker reads it straight into its buffers
+    DIRECT_OVER         // The output worker got to its end, or a read failed
+} direct_state_t;
+
+// The file playing now
+typedef struct {
+    track_kind_t kind;
+    union {
+        struct {
+            mp3_decoder_t decoder;
+            fs_file_t file;
+            mp3_index_t index;    // NULL if the file's first frame couldn't be read
+        } mp3;
+        flac_decoder_t flac;
+        vorbis_decoder_t vorbis;
+        wav_reader_t wav;
+    } source;
+    uint32_t sampleRate;
+    uint8_t seekable;
+    uint8_t direct;       // A WAV file the output worker reads itself (wav_reader_is_direct)
+} track_t;
+
+// Files waiting their turn
+static char queue[AUDIO_QUEUE_MAX_TRACKS][MAX_PATH_LENGTH];
+static uint8_t queueHead = 0;
+static uint8_t queueCount = 0;
+static uint32_t tracksStarted = 0;
+static char startedPath[MAX_PATH_LENGTH];    // The file tracksStarted last counted (changed together)
+
+// Set by other tasks, read by the stage
+static volatile uint8_t seekPending = 0;
+static volatile uint32_t seekTarget = 0;
+static volatile audio_status_t seekStatus = AUDIO_OK;    // How the last seek went (BUSY until it is done)
+
+// Set by the stage, read by other tasks
+static volatile uint8_t currentSeekable = 0;
+static volatile uint32_t currentDurationMs = 0;
+
+// Set by the stage, then by the output worker while it holds the reader
+static atomic_uint_least8_t directState;
+static volatile uint8_t directFailed = 0;
+
+// The stage's own state (only the stage's task touches it, but see directState)
+static track_t current;
+static resampler_t converter = NULL;
+static uint32_t converterRate = 0;
+static resampler_t retiring = NULL;      // The last file's converter, still letting its filter tail out
+static uint8_t mp3Chunk[TRACK_MP3_CHUNK_BYTES];
+static uint32_t mp3ChunkLength = 0;
+static uint32_t mp3ChunkPosition = 0;
+static int16_t scratch[TRACK_SCRATCH_FRAMES * 2];
+static uint16_t scratchLength = 0;
+static uint16_t scratchPosition = 0;
+
+// Function declarations for internal functions
+static uint8_t start_next_track(void);
+static audio_stage_result_t flush_retiring(spsc_ring_t *output);
+static audio_stage_result_t play_direct(void);
+static void retire_converter(void);
+static audio_status_t open_track(const char *path, track_t *track);
+static void close_track(track_t *track);
+static audio_status_t read_track(track_t *track, int16_t *pcm, uint16_t max_frames, uint16_t *frames);
+static audio_status_t mp3_next_frame(track_t *track);
+static void apply_seek(void);
+static audio_status_t seek_track(track_t *track, uint32_t position_ms);
+static audio_status_t seek_mp3(track_t *track, uint32_t position_ms);
+static uint32_t track_duration(track_t *track);
+static uint8_t has_extension(const char *path, const char *extension);
+
+audio_status_t audio_enqueue_file(const char *filename) {
+    if (filename == NULL || strlen(filename) >= MAX_PATH_LENGTH) {
+        return AUDIO_ERROR_PARAM;
+    }
+    audio_status_t status = AUDIO_OK;
+    taskENTER_CRITICAL();
+    if (queueCount == AUDIO_QUEUE_MAX_TRACKS) {
+        status = AUDIO_ERROR_BUSY;
+    } else {
+        strcpy(queue[(queueHead + queueCount) % AUDIO_QUEUE_MAX_TRACKS], filename);
+        queueCount++;
+    }
+    taskEXIT_CRITICAL();
+    return status;
+}
+
+void audio_clear_queue(void) {
+    taskENTER_CRITICAL();
+    queueCount = 0;
+    taskEXIT_CRITICAL();
+}
+
+uint8_t audio_queue_length(void) {
+    return queueCount;
+}
+
+uint32_t audio_get_tracks_started(void) {
+    return tracksStarted;
+}
+
+audio_status_t audio_get_current_track(char *path, size_t size, uint32_t *started) {
+    if (path == NULL || size == 0) {
+        return AUDIO_ERROR_PARAM;
+    }
+    audio_status_t status = AUDIO_OK;
+    taskENTER_CRITICAL();
+    if (tracksStarted == 0) {
+        status = AUDIO_ERROR_BUSY;
+    } else if (strlen(startedPath) >= size) {
+        status = AUDIO_ERROR_PARAM;
+    } else {
+        strcpy(path, startedPath);
+        if (started != NULL) {
+            *started = tracksStarted;
+        }
+    }
+    taskEXIT_CRITICAL();
+    return status;
+}
+
+audio_stage_result_t audio_stage_track_queue(void *context, spsc_ring_t *input, spsc_ring_t *output) {
+    (void)context;
+    (void)input;
+    if (output == NULL) {
+        return AUDIO_STAGE_ERROR;
+    }
+    if (retiring != NULL) {
+        audio_stage_result_t result = flush_retiring(output);
+        if (result != AUDIO_STAGE_DONE) {
+            return result;
+        }
+    }
+    if (current.kind == TRACK_NONE && !start_next_track()) {
+        return AUDIO_STAGE_DONE;
+    }
+    if (current.direct) {
+        return play_direct();
+    }
+    if (seekPending) {
+        apply_seek();
+    }
+
+    uint32_t space;
+    int16_t *dst = (int16_t *)spsc_ring_write_ptr(output, &space);
+    uint32_t room = space / 4u;
+    if (room == 0) {
+        return AUDIO_STAGE_BLOCKED;
+    }
+
+    audio_status_t status = AUDIO_OK;
+    uint32_t made = 0;
+    if (converter == NULL) {
+        uint16_t frames = 0;
+        status = read_track(&current, dst, (room > UINT16_MAX) ? UINT16_MAX : (uint16_t)room, &frames);
+        made = frames;
+    } else {
+        if (scratchPosition == scratchLength) {
+            scratchPosition = 0;
+            status = read_track(&current, scratch, TRACK_SCRATCH_FRAMES, &scratchLength);
+        }
+        if (scratchPosition < scratchLength) {
+            uint32_t consumed = 0;
+            made = resampler_process(converter, scratch + scratchPosition * 2u, (uint32_t)(scratchLength - scratchPosition),
+                                     &consumed, dst, room);
+            scratchPosition = (uint16_t)(scratchPosition + consumed);
+        }
+    }
+    if (made > 0) {
+        spsc_ring_write_commit(output, made * 4u);
+    }
+
+    if (status == AUDIO_ERROR_BUSY) {
+        // This file is over: the next one starts right here, in the same ring
+        if (current.kind == TRACK_MP3) {
+            mp3_index_finish(current.source.mp3.index);    // Played from the start: its index is complete
+        }
+        close_track(&current);
+        if (!start_next_track()) {
+            if (converter == NULL) {
+                return AUDIO_STAGE_DONE;
+            }
+            retire_converter();    // The last file's final frames are still in the filter
+        }
+        return AUDIO_STAGE_PROGRESS;
+    }
+    if (status != AUDIO_OK) {
+        return AUDIO_STAGE_ERROR;
+    }
+    return AUDIO_STAGE_PROGRESS;
+}
+
+audio_status_t track_queue_pump_direct(uint16_t *filled) {
+    if (filled == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (atomic_load_explicit(&directState, memory_order_acquire) != DIRECT_HANDED) {
+        return AUDIO_ERROR_BUSY;
+    }
+    // The reader is ours until DIRECT_OVER, so its seeks happen here too
+    if (seekPending) {
+        apply_seek();
+    }
+
+    audio_status_t status = wav_reader_pump(current.source.wav, filled);
+    if (status != AUDIO_OK) {
+        directFailed = (status != AUDIO_ERROR_BUSY);
+        atomic_store_explicit(&directState, DIRECT_OVER, memory_order_release);
+    }
+    return AUDIO_OK;
+}
+
+audio_status_t track_queue_start(void) {
+    if (current.kind != TRACK_NONE) {
+        return AUDIO_OK;
+    }
+    return start_next_track() ? AUDIO_OK : AUDIO_ERROR_BUSY;
+}
+
+audio_status_t track_queue_seek(uint32_t position_ms) {
+    if (!currentSeekable) {
+        return AUDIO_ERROR_FORMAT;
+    }
+    taskENTER_CRITICAL();
+    seekTarget = position_ms;
+    seekPending = 1;
+    seekStatus = AUDIO_ERROR_BUSY;
+    taskEXIT_CRITICAL();
+    return AUDIO_OK;
+}
+
+audio_status_t track_queue_get_seek_status(void) {
+    return seekStatus;
+}
+
+audio_status_t track_queue_get_duration(uint32_t *duration_ms) {
+    if (duration_ms == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    *duration_ms = currentDurationMs;
+    return AUDIO_OK;
+}
+
+void track_queue_stop(void) {
+    close_track(&current);
+    if (retiring != NULL) {
+        resampler_close(retiring);
+        retiring = NULL;
+    }
+    if (converter != NULL) {
+        resampler_close(converter);
+        converter = NULL;
+        converterRate = 0;
+    }
+    scratchLength = 0;
+    scratchPosition = 0;
+    seekPending = 0;
+    atomic_store(&directState, DIRECT_NONE);
+    directFailed = 0;
+    audio_clear_queue();
+}
+
+// Opens queued files until one works; 1 if something is playing
+static uint8_t start_next_track(void) {
+    char path[MAX_PATH_LENGTH];
+    for (;;) {
+        taskENTER_CRITICAL();
+        if (queueCount == 0) {
+            taskEXIT_CRITICAL();
+            return 0;
+        }
+        strcpy(path, queue[queueHead]);
+        queueHead = (uint8_t)((queueHead + 1u) % AUDIO_QUEUE_MAX_TRACKS);
+        queueCount--;
+        taskEXIT_CRITICAL();
+
+        if (open_track(path, &current) != AUDIO_OK) {
+            continue;    // A broken file shouldn't stop the album
+        }
+
+        // Same rate as the last file: keep the resampler, history and all, so the join is seamless.
+        // Another rate: the old one is kept until its filter tail is out, ahead of this file's frames.
+        if (converter != NULL && converterRate != current.sampleRate) {
+            retire_converter();
+        }
+        if (converter == NULL && resampler_open_for_output(current.sampleRate, RESAMPLER_DEFAULT_QUALITY, &converter) == AUDIO_OK &&
+            converter != NULL) {
+            converterRate = current.sampleRate;
+        }
+        // A seek asked for while the last file played doesn't apply to this one
+        seekPending = 0;
+        currentSeekable = current.seekable;
+        currentDurationMs = track_duration(&current);
+        taskENTER_CRITICAL();
+        strcpy(startedPath, path);
+        tracksStarted++;
+        taskEXIT_CRITICAL();
+        return 1;
+    }
+}
+
+// Writes what is left in the retiring converter; AUDIO_STAGE_DONE once it is empty and closed
+static audio_stage_result_t flush_retiring(spsc_ring_t *output) {
+    uint32_t space;
+    int16_t *dst = (int16_t *)spsc_ring_write_ptr(output, &space);
+    uint32_t room = space / 4u;
+    if (room == 0) {
+        return AUDIO_STAGE_BLOCKED;
+    }
+    uint32_t made = resampler_flush(retiring, dst, room);
+    if (made > 0) {
+        spsc_ring_write_commit(output, made * 4u);
+        return AUDIO_STAGE_PROGRESS;
+    }
+    resampler_close(retiring);
+    retiring = NULL;
+    return AUDIO_STAGE_DONE;
+}
+
+// A direct file goes to the output worker, which reads it once it has played everything before it;
+// meanwhile this stage has nothing to do, and when the file is over it starts the next one
+static audio_stage_result_t play_direct(void) {
+    uint8_t state = atomic_load_explicit(&directState, memory_order_acquire);
+    if (state == DIRECT_NONE) {
+        atomic_store_explicit(&directState, DIRECT_HANDED, memory_order_release);
+        return AUDIO_STAGE_STARVED;
+    }
+    if (state == DIRECT_HANDED) {
+        return AUDIO_STAGE_STARVED;
+    }
+
+    atomic_store_explicit(&directState, DIRECT_NONE, memory_order_relaxed);
+    if (directFailed) {
+        directFailed = 0;
+        return AUDIO_STAGE_ERROR;
+    }
+    close_track(&current);
+    return start_next_track() ? AUDIO_STAGE_PROGRESS : AUDIO_STAGE_DONE;
+}
+
+// Hands the converter over to be flushed by the stage's next call
+static void retire_converter(void) {
+    if (retiring != NULL) {
+        resampler_close(retiring);    // Only if a tail is still waiting, which the stage never allows
+    }
+    retiring = converter;
+    converter = NULL;
+    converterRate = 0;
+}
+
+// Opens a file by its extension and decodes as far as its first sound (to learn its rate)
+static audio_status_t open_track(const char *path, track_t *track) {
+    memset(track, 0, sizeof(*track));
+    audio_status_t status = AUDIO_ERROR_FORMAT;
+    if (!has_extension(path, ".ogg")) {
+        // A parked Vorbis file holds most of the heap, and only another OGG file can reuse it
+        vorbis_decoder_release_cache();
+    }
+
+    if (has_extension(path, ".mp3")) {
+        if (fs_open(path, FS_READ, &track->source.mp3.file) != FS_OK) {
+            return AUDIO_ERROR_IO;
+        }
+        if (mp3_index_open(path, &track->source.mp3.index) != AUDIO_OK) {
+            track->source.mp3.index = NULL;    // Still playable, just not seekable
+        }
+        status = mp3_decoder_create(&track->source.mp3.decoder);
+        if (status != AUDIO_OK) {
+            mp3_index_close(track->source.mp3.index);
+            fs_close(track->source.mp3.file);
+            return status;
+        }
+        track->kind = TRACK_MP3;
+        track->seekable = (track->source.mp3.index != NULL);
+        mp3ChunkLength = 0;
+        mp3ChunkPosition = 0;
+        mp3_frame_info_t info;
+        status = mp3_next_frame(track);
+        if (status == AUDIO_OK) {
+            mp3_decoder_decode_frame(track->source.mp3.decoder, &info);
+            track->sampleRate = info.sample_rate;
+        }
+    } else if (has_extension(path, ".flac")) {
+        flac_stream_info_t info;
+        status = flac_decoder_open(path, &track->source.flac);
+        if (status == AUDIO_OK) {
+            track->kind = TRACK_FLAC;
+            flac_decoder_get_info(track->source.flac, &info);
+            track->sampleRate = info.sample_rate;
+        }
+    } else if (has_extension(path, ".ogg")) {
+        vorbis_stream_info_t info;
+        status = vorbis_decoder_open(path, &track->source.vorbis);
+        if (status == AUDIO_OK) {
+            track->kind = TRACK_OGG;
+            track->seekable = 1;
+            vorbis_decoder_get_info(track->source.vorbis, &info);
+            track->sampleRate = info.sample_rate;
+        }
+    } else if (has_extension(path, ".wav") || has_extension(path, ".raw") || has_extension(path, ".pcm")) {
+        wav_info_t info;
+        audio_format_t format = has_extension(path, ".wav") ? AUDIO_FORMAT_WAV : AUDIO_FORMAT_RAW_PCM;
+        status = wav_reader_open(path, format, &track->source.wav);
+        if (status == AUDIO_OK) {
+            track->kind = TRACK_WAV;
+            track->seekable = 1;
+            track->direct = wav_reader_is_direct(track->source.wav);
+            wav_reader_get_info(track->source.wav, &info);
+            track->sampleRate = info.sample_rate;
+        }
+    }
+
+    if (status != AUDIO_OK) {
+        close_track(track);
+    }
+    return status;
+}
+
+static void close_track(track_t *track) {
+    switch (track->kind) {
+        case TRACK_MP3:
+            mp3_decoder_destroy(track->source.mp3.decoder);
+            mp3_index_close(track->source.mp3.index);    // An index not finished by now is thrown away
+            fs_close(track->source.mp3.file);
+            break;
+        case TRACK_FLAC:
+            flac_decoder_close(track->source.flac);
+            break;
+        case TRACK_OGG:
+            vorbis_decoder_close(track->source.vorbis);
+            break;
+        case TRACK_WAV:
+            wav_reader_close(track->source.wav);
+            break;
+        default:
+            break;
+    }
+    track->kind = TRACK_NONE;
+    track->seekable = 0;
+    track->direct = 0;
+    if (track == &current) {
+        currentSeekable = 0;
+        currentDurationMs = 0;
+    }
+}
+
+// The next helping of 16-bit stereo frames from any kind of file; AUDIO_ERROR_BUSY once it is over
+static audio_status_t read_track(track_t *track, int16_t *pcm, uint16_t max_frames, uint16_t *frames) {
+    *frames = 0;
+    switch (track->kind) {
+        case TRACK_MP3: {
+            audio_status_t status = mp3_next_frame(track);
+            if (status == AUDIO_OK) {
+                *frames = mp3_decoder_read_pcm(track->source.mp3.decoder, pcm, max_frames);
+            }
+            return status;
+        }
+        case TRACK_FLAC: {
+            audio_status_t status = flac_decoder_decode_frame(track->source.flac);
+            if (status == AUDIO_OK) {
+                *frames = flac_decoder_read_pcm(track->source.flac, pcm, max_frames);
+            }
+            return status;
+        }
+        case TRACK_OGG:
+            return vorbis_decoder_read_pcm(track->source.vorbis, pcm, max_frames, frames);
+        case TRACK_WAV:
+            return wav_reader_read_pcm(track->source.wav, pcm, max_frames, frames);
+        default:
+            return AUDIO_ERROR_BUSY;
+    }
+}
+
+// Feeds the MP3 decoder from its file until a frame is ready; AUDIO_ERROR_BUSY at the end
+static audio_status_t mp3_next_frame(track_t *track) {
+    mp3_decoder_t decoder = track->source.mp3.decoder;
+    for (;;) {
+        audio_status_t status = mp3_decoder_decode_frame(decoder, NULL);
+        if (status == AUDIO_OK) {
+            // Every frame played from the start goes into the seek index (repeats are ignored)
+            uint32_t frame;
+            uint32_t offset;
+            mp3_decoder_get_frame_position(decoder, &frame, &offset);
+            mp3_index_add_frame(track->source.mp3.index, frame, offset);
+        }
+        if (status != AUDIO_ERROR_BUSY) {
+            return status;
+        }
+        if (mp3_decoder_is_finished(decoder)) {
+            return AUDIO_ERROR_BUSY;
+        }
+        if (mp3ChunkPosition == mp3ChunkLength) {
+            size_t got = 0;
+            if (audio_telemetry_read(track->source.mp3.file, mp3Chunk, sizeof(mp3Chunk), &got) != FS_OK) {
+                return AUDIO_ERROR_IO;
+            }
+            mp3ChunkLength = (uint32_t)got;
+            mp3ChunkPosition = 0;
+            if (got == 0) {
+                mp3_decoder_finish(decoder);
+                continue;
+            }
+        }
+        uint32_t fed = mp3_decoder_feed(decoder, mp3Chunk + mp3ChunkPosition, mp3ChunkLength - mp3ChunkPosition);
+        if (fed == 0) {
+            return AUDIO_ERROR_FORMAT;    // Input buffer full and still no frame
+        }
+        mp3ChunkPosition += fed;
+    }
+}
+
+// Picks up a seek asked for by another task; one that fails leaves the file playing where it was
+static void apply_seek(void) {
+    taskENTER_CRITICAL();
+    uint32_t target = seekTarget;
+    seekPending = 0;
+    taskEXIT_CRITICAL();
+    audio_status_t status = seek_track(&current, target);
+    taskENTER_CRITICAL();
+    if (!seekPending) {
+        seekStatus = status;    // A newer request is still BUSY
+    }
+    taskEXIT_CRITICAL();
+}
+
+// Moves the file playing now; whatever is in the scratch and the resampler belongs to the old spot
+static audio_status_t seek_track(track_t *track, uint32_t position_ms) {
+    audio_status_t status;
+    switch (track->kind) {
+        case TRACK_MP3:
+            status = seek_mp3(track, position_ms);
+            break;
+        case TRACK_OGG:
+            status = vorbis_decoder_seek(track->source.vorbis, position_ms);
+            break;
+        case TRACK_WAV:
+            status = wav_reader_seek(track->source.wav, position_ms);
+            break;
+        default:
+            return AUDIO_OK;    // FLAC can't seek yet (track_queue_seek refuses it)
+    }
+    if (status == AUDIO_OK) {
+        scratchLength = 0;
+        scratchPosition = 0;
+        if (converter != NULL) {
+            resampler_reset(converter);
+        }
+    }
+    return status;
+}
+
+// One fs_seek to where the index says, then a reset decoder told what to drop
+static audio_status_t seek_mp3(track_t *track, uint32_t position_ms) {
+    mp3_seek_point_t point;
+    audio_status_t status = mp3_index_lookup(track->source.mp3.index, position_ms, &point);
+    if (status != AUDIO_OK) {
+        return status;
+    }
+    if (point.byte_offset != 0) {
+        // Frames played from here on don't follow on from the start
+        mp3_index_abandon(track->source.mp3.index);
+    }
+    if (point.byte_offset > (uint32_t)INT32_MAX ||
+        fs_seek(track->source.mp3.file, (int32_t)point.byte_offset, FS_SEEK_SET) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+    mp3_decoder_reset(track->source.mp3.decoder);
+    mp3_decoder_set_seek_trims(track->source.mp3.decoder, point.drop_frames, point.drop_samples, point.play_samples);
+    mp3ChunkLength = 0;
+    mp3ChunkPosition = 0;
+    return AUDIO_OK;
+}
+
+// How long a file plays, from what its decoder or index knows
+static uint32_t track_duration(track_t *track) {
+    switch (track->kind) {
+        case TRACK_MP3: {
+            mp3_index_info_t info;
+            if (mp3_index_get_info(track->source.mp3.index, &info) != AUDIO_OK) {
+                return 0;
+            }
+            return info.duration_ms;
+        }
+        case TRACK_FLAC: {
+            flac_stream_info_t info;
+            flac_decoder_get_info(track->source.flac, &info);
+            return (info.sample_rate > 0) ? (uint32_t)(info.total_samples * 1000u / info.sample_rate) : 0;
+        }
+        case TRACK_OGG: {
+            vorbis_stream_info_t info;
+            vorbis_decoder_get_info(track->source.vorbis, &info);
+            return info.duration_ms;
+        }
+        case TRACK_WAV: {
+            wav_info_t info;
+            wav_reader_get_info(track->source.wav, &info);
+            if (info.sample_rate == 0) {
+                return 0;
+            }
+            return (uint32_t)((uint64_t)info.total_frames * 1000u / info.sample_rate);
+        }
+        default:
+            return 0;
+    }
+}
+
+// Case-blind check of a file name's ending
+static uint8_t has_extension(const char *path, const char *extension) {
+    size_t pathLength = strlen(path);
+    size_t extensionLength = strlen(extension);
+    if (pathLength < extensionLength) {
+        return 0;
+    }
+    const char *tail = path + pathLength - extensionLength;
+    for (size_t i = 0; i < extensionLength; i++) {
+        char c = tail[i];
+        if (c >= 'A' && c <= 'Z') {
+            c = (char)(c - 'A' + 'a');
+        }
+        if (c != extension[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,389 @@
+#include "audio/vorbis_decoder.h"
+#include "audio/audio_telemetry.h"
+#include "audio/dsp_kernels.h"
+#include "core/system.h"
+#include "fs/fs_manager.h"
+#include "FreeRTOS.h"
+#include "hardware/clocks.h"
+#include "ivorbiscodec.h"
+#include "ivorbisfile.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BENCHMARK_PCM_FRAMES    256
+
+// Every heap block carries its size so realloc and free can keep count
+typedef struct {
+    uint32_t size;
+    uint32_t reserved;    // Keeps the payload 8-byte aligned
+} mem_header_t;
+
+struct vorbis_decoder_s {
+    OggVorbis_File vf;
+    fs_file_t file;
+    vorbis_stream_info_t info;
+    uint8_t finished;
+    char path[MAX_PATH_LENGTH];
+    uint32_t fileSize;    // With fileDate/fileTime, tells a parked file from a changed one
+    uint32_t fileDate;
+    uint32_t fileTime;
+};
+
+static struct vorbis_decoder_s *parkedDecoder = NULL;
+static uint32_t memCurrent = 0;
+static uint32_t memPeak = 0;
+static uint32_t memSetup = 0;
+static uint8_t memRefused = 0;    // An allocation was turned down by the budget
+
+// Tremor is built with malloc/calloc/realloc/free mapped to these (see CMakeLists.txt)
+void *vorbis_mem_malloc(size_t size);
+void *vorbis_mem_calloc(size_t count, size_t size);
+void *vorbis_mem_realloc(void *pointer, size_t size);
+void vorbis_mem_free(void *pointer);
+
+// Function declarations for internal functions
+static size_t file_read(void *ptr, size_t size, size_t nmemb, void *datasource);
+static int file_seek(void *datasource, ogg_int64_t offset, int whence);
+static int file_close(void *datasource);
+static long file_tell(void *datasource);
+static void destroy_decoder(struct vorbis_decoder_s *decoder);
+
+audio_status_t vorbis_decoder_open(const char *filename, vorbis_decoder_t *decoder) {
+    if (filename == NULL || decoder == NULL || strlen(filename) >= MAX_PATH_LENGTH) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    fs_file_info_t stat;
+    if (fs_stat(filename, &stat) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+
+    if (parkedDecoder != NULL) {
+        struct vorbis_decoder_s *parked = parkedDecoder;
+        parkedDecoder = NULL;
+        if (strcmp(parked->path, filename) == 0 && parked->fileSize == stat.size &&
+            parked->fileDate == stat.date && parked->fileTime == stat.time &&
+            ov_pcm_seek(&parked->vf, 0) == 0) {
+            // Same file, unchanged: headers and codebooks are already built
+            parked->finished = 0;
+            *decoder = parked;
+            return AUDIO_OK;
+        }
+        // Make room before building the new file's setup
+        destroy_decoder(parked);
+    }
+
+    struct vorbis_decoder_s *d = (struct vorbis_decoder_s *)vorbis_mem_calloc(1, sizeof(struct vorbis_decoder_s));
+    if (d == NULL) {
+        return AUDIO_ERROR_MEMORY;
+    }
+    if (fs_open(filename, FS_READ, &d->file) != FS_OK) {
+        vorbis_mem_free(d);
+        return AUDIO_ERROR_IO;
+    }
+    strcpy(d->path, filename);
+    d->fileSize = stat.size;
+    d->fileDate = stat.date;
+    d->fileTime = stat.time;
+
+    ov_callbacks callbacks = {file_read, file_seek, file_close, file_tell};
+    uint32_t before = memCurrent;
+    memRefused = 0;
+    int result = ov_open_callbacks(d, &d->vf, NULL, 0, callbacks);
+    if (result != 0) {
+        // ov_open_callbacks does not close the file when it fails
+        fs_close(d->file);
+        vorbis_mem_free(d);
+        if (result == OV_EREAD) {
+            return AUDIO_ERROR_IO;
+        }
+        // Tremor reports a failed allocation as a broken header
+        return memRefused ? AUDIO_ERROR_MEMORY : AUDIO_ERROR_FORMAT;
+    }
+    memSetup = memCurrent - before;
+
+    vorbis_info *vi = ov_info(&d->vf, -1);
+    if (vi == NULL || vi->channels < 1 || vi->channels > 2) {
+        destroy_decoder(d);
+        return AUDIO_ERROR_FORMAT;
+    }
+    d->info.sample_rate = (uint32_t)vi->rate;
+    d->info.channels = (uint8_t)vi->channels;
+    ogg_int64_t total = ov_pcm_total(&d->vf, -1);
+    d->info.total_samples = (total > 0) ? (uint64_t)total : 0;
+    ogg_int64_t duration = ov_time_total(&d->vf, -1);    // Tremor counts time in milliseconds
+    d->info.duration_ms = (duration > 0) ? (uint32_t)duration : 0;
+
+    *decoder = d;
+    return AUDIO_OK;
+}
+
+void vorbis_decoder_close(vorbis_decoder_t decoder) {
+    if (decoder == NULL) {
+        return;
+    }
+#if VORBIS_DECODER_CACHE_SETUP
+    // Keep it for a fast replay; whatever was parked before goes
+    vorbis_decoder_release_cache();
+    parkedDecoder = decoder;
+#else
+    destroy_decoder(decoder);
+#endif
+}
+
+void vorbis_decoder_release_cache(void) {
+    if (parkedDecoder != NULL) {
+        destroy_decoder(parkedDecoder);
+        parkedDecoder = NULL;
+    }
+}
+
+audio_status_t vorbis_decoder_get_info(vorbis_decoder_t decoder, vorbis_stream_info_t *info) {
+    if (decoder == NULL || info == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    *info = decoder->info;
+    return AUDIO_OK;
+}
+
+audio_status_t vorbis_decoder_read_pcm(vorbis_decoder_t decoder, int16_t *pcm, uint16_t max_frames, uint16_t *frames) {
+    if (decoder == NULL || pcm == NULL || frames == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    *frames = 0;
+    if (decoder->finished) {
+        return AUDIO_ERROR_BUSY;
+    }
+    if (max_frames == 0) {
+        return AUDIO_OK;
+    }
+
+    // Tremor writes interleaved 16-bit samples straight into pcm; mono fills the first half
+    int bitstream;
+    long got;
+    do {
+        got = ov_read(&decoder->vf, (char *)pcm, (int)max_frames * 2 * decoder->info.channels, &bitstream);
+    } while (got == OV_HOLE);    // A gap in the data: Tremor has resynced, just carry on
+
+    if (got == 0) {
+        decoder->finished = 1;
+        return AUDIO_ERROR_BUSY;
+    }
+    if (got < 0) {
+        return AUDIO_ERROR_FORMAT;
+    }
+
+    uint16_t count = (uint16_t)(got / (2 * decoder->info.channels));
+    if (decoder->info.channels == 1) {
+        // Spread mono to both channels, from the back so nothing is overwritten before it's read
+        uint32_t *out = (uint32_t *)pcm;
+        for (uint16_t i = count; i > 0; i--) {
+            int32_t sample = pcm[i - 1];
+            out[i - 1] = dsp_pack16x2(sample, sample);
+        }
+    }
+    *frames = count;
+    return AUDIO_OK;
+}
+
+audio_status_t vorbis_decoder_seek(vorbis_decoder_t decoder, uint32_t position_ms) {
+    if (decoder == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (ov_time_seek(&decoder->vf, (ogg_int64_t)position_ms) != 0) {
+        return AUDIO_ERROR_IO;
+    }
+    decoder->finished = 0;
+    return AUDIO_OK;
+}
+
+void vorbis_decoder_get_memory(vorbis_memory_stats_t *stats, uint8_t reset_peak) {
+    if (stats == NULL) {
+        return;
+    }
+    stats->current_bytes = memCurrent;
+    stats->peak_bytes = memPeak;
+    stats->setup_bytes = memSetup;
+    stats->cached_bytes = 0;
+    if (parkedDecoder != NULL) {
+        // Everything in use belongs to the parked file when nothing else is open
+        stats->cached_bytes = memCurrent;
+    }
+    stats->budget_bytes = VORBIS_DECODER_HEAP_BUDGET;
+    if (reset_peak) {
+        memPeak = memCurrent;
+    }
+}
+
+audio_stage_result_t audio_stage_decode_vorbis(void *context, spsc_ring_t *input, spsc_ring_t *output) {
+    (void)input;
+    vorbis_decoder_t decoder = (vorbis_decoder_t)context;
+    if (decoder == NULL || output == NULL) {
+        return AUDIO_STAGE_ERROR;
+    }
+
+    uint32_t space;
+    int16_t *dst = (int16_t *)spsc_ring_write_ptr(output, &space);
+    uint32_t room = space / 4u;
+    if (room == 0) {
+        return AUDIO_STAGE_BLOCKED;
+    }
+
+    uint16_t frames;
+    audio_status_t status = vorbis_decoder_read_pcm(decoder, dst, (room > UINT16_MAX) ? UINT16_MAX : (uint16_t)room, &frames);
+    if (status == AUDIO_ERROR_BUSY) {
+        return AUDIO_STAGE_DONE;
+    }
+    if (status != AUDIO_OK) {
+        return AUDIO_STAGE_ERROR;
+    }
+    spsc_ring_write_commit(output, (uint32_t)frames * 4u);
+    return AUDIO_STAGE_PROGRESS;
+}
+
+audio_status_t vorbis_decoder_benchmark(const char *filename, vorbis_benchmark_t *result) {
+    if (filename == NULL || result == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->clock_hz = clock_get_hz(clk_sys);
+    vorbis_decoder_release_cache();
+    memPeak = memCurrent;
+
+    vorbis_decoder_t decoder;
+    uint32_t start = system_get_time_us();
+    audio_status_t status = vorbis_decoder_open(filename, &decoder);
+    result->open_cold_us = system_get_time_us() - start;
+    if (status != AUDIO_OK) {
+        return status;
+    }
+    result->sample_rate = decoder->info.sample_rate;
+
+    int16_t pcm[BENCHMARK_PCM_FRAMES * 2];
+    uint64_t frames = 0;
+    uint64_t busy = 0;
+    for (;;) {
+        uint16_t got;
+        start = system_get_time_us();
+        status = vorbis_decoder_read_pcm(decoder, pcm, BENCHMARK_PCM_FRAMES, &got);
+        busy += system_get_time_us() - start;
+        if (status != AUDIO_OK) {
+            break;
+        }
+        frames += got;
+    }
+    vorbis_decoder_close(decoder);
+    if (status != AUDIO_ERROR_BUSY) {
+        return status;
+    }
+
+    // The second open finds the file parked (when the cache is on)
+    start = system_get_time_us();
+    status = vorbis_decoder_open(filename, &decoder);
+    result->open_cached_us = system_get_time_us() - start;
+    if (status == AUDIO_OK) {
+        vorbis_decoder_close(decoder);
+    }
+
+    result->busy_us = (uint32_t)busy;
+    result->peak_bytes = memPeak;
+    if (frames > 0 && result->sample_rate > 0) {
+        result->audio_ms = (uint32_t)(frames * 1000u / result->sample_rate);
+        result->us_per_second = (uint32_t)(busy * result->sample_rate / frames);
+        uint64_t mcps = (uint64_t)result->us_per_second * (result->clock_hz / 100000u) / 1000000u;
+        result->mcps_x10 = (mcps > UINT16_MAX) ? UINT16_MAX : (uint16_t)mcps;
+    }
+    return status;
+}
+
+void *vorbis_mem_malloc(size_t size) {
+    if (memCurrent + size + sizeof(mem_header_t) > VORBIS_DECODER_HEAP_BUDGET) {
+        memRefused = 1;
+        return NULL;
+    }
+    mem_header_t *header = (mem_header_t *)pvPortMalloc(size + sizeof(mem_header_t));
+    if (header == NULL) {
+        memRefused = 1;
+        return NULL;
+    }
+    header->size = (uint32_t)size;
+    memCurrent += (uint32_t)(size + sizeof(mem_header_t));
+    if (memCurrent > memPeak) {
+        memPeak = memCurrent;
+    }
+    return header + 1;
+}
+
+void *vorbis_mem_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *pointer = vorbis_mem_malloc(count * size);
+    if (pointer != NULL) {
+        memset(pointer, 0, count * size);
+    }
+    return pointer;
+}
+
+void *vorbis_mem_realloc(void *pointer, size_t size) {
+    if (pointer == NULL) {
+        return vorbis_mem_malloc(size);
+    }
+    // The FreeRTOS heap has no realloc: move the block
+    mem_header_t *old = (mem_header_t *)pointer - 1;
+    if (size <= old->size) {
+        return pointer;
+    }
+    void *bigger = vorbis_mem_malloc(size);
+    if (bigger != NULL) {
+        memcpy(bigger, pointer, old->size);
+        vorbis_mem_free(pointer);
+    }
+    return bigger;
+}
+
+void vorbis_mem_free(void *pointer) {
+    if (pointer == NULL) {
+        return;
+    }
+    mem_header_t *header = (mem_header_t *)pointer - 1;
+    memCurrent -= header->size + (uint32_t)sizeof(mem_header_t);
+    vPortFree(header);
+}
+
+static size_t file_read(void *ptr, size_t size, size_t nmemb, void *datasource) {
+    struct vorbis_decoder_s *decoder = (struct vorbis_decoder_s *)datasource;
+    size_t got = 0;
+    if (size == 0 || audio_telemetry_read(decoder->file, ptr, size * nmemb, &got) != FS_OK) {
+        return 0;
+    }
+    return got / size;
+}
+
+static int file_seek(void *datasource, ogg_int64_t offset, int whence) {
+    struct vorbis_decoder_s *decoder = (struct vorbis_decoder_s *)datasource;
+    fs_seek_origin_t origin = (whence == SEEK_CUR) ? FS_SEEK_CUR : (whence == SEEK_END) ? FS_SEEK_END : FS_SEEK_SET;
+    return (fs_seek(decoder->file, (int32_t)offset, origin) == FS_OK) ? 0 : -1;
+}
+
+static int file_close(void *datasource) {
+    struct vorbis_decoder_s *decoder = (struct vorbis_decoder_s *)datasource;
+    fs_close(decoder->file);
+    return 0;
+}
+
+static long file_tell(void *datasource) {
+    struct vorbis_decoder_s *decoder = (struct vorbis_decoder_s *)datasource;
+    uint32_t position;
+    if (fs_tell(decoder->file, &position) != FS_OK) {
+        return -1;
+    }
+    return (long)position;
+}
+
+static void destroy_decoder(struct vorbis_decoder_s *decoder) {
+    // ov_clear frees Tremor's state and closes the file through file_close
+    ov_clear(&decoder->vf);
+    vorbis_mem_free(decoder);
+}
@@ -0,0 +1,565 @@
+#include "audio/wav_reader.h"
+#include "audio/audio_telemetry.h"
+#include "audio/dsp_kernels.h"
+#include "drivers/audio_output.h"
+#include "FreeRTOS.h"
+#include <string.h>
+
+#define WAV_SECTOR_BYTES        512
+#define WAV_FORMAT_EXTENSIBLE   0xFFFE
+#define WAV_FORMAT_HEADER_BYTES 52      // Enough for EXTENSIBLE's sub-format and MS ADPCM's predictor table
+#define WAV_MS_COEF_OFFSET      22      // Where MS ADPCM's predictor table starts in "fmt "
+#define WAV_MS_PREDICTORS       7
+
+struct wav_reader_s {
+    fs_file_t file;
+    wav_info_t info;
+    uint32_t position;      // File offset of the next read
+    uint32_t remaining;     // Sound bytes not read yet
+    uint8_t direct;         // Goes straight into the output buffers
+    uint8_t realign;        // The next direct buffer may start with silence to reach a sector boundary
+    uint16_t skip;          // ADPCM frames still to throw away after a seek
+    uint8_t *block;         // One ADPCM block (NULL for PCM)
+    adpcm_decoder_t adpcm;
+    uint8_t bounce[WAV_READER_BOUNCE_BYTES];
+};
+
+// The standard MS ADPCM predictor pairs, the only ones the decoder knows
+static const int16_t msStandardCoefs[WAV_MS_PREDICTORS * 2] = {
+    256, 0, 512, -256, 0, 0, 192, 64, 240, 0, 460, -208, 392, -232
+};
+
+// Function declarations for internal functions
+static uint16_t read_le16(const uint8_t *data);
+static uint32_t read_le32(const uint8_t *data);
+static audio_status_t read_exact(fs_file_t file, void *buffer, uint32_t size);
+static audio_status_t parse_format(const uint8_t *format, uint32_t size, wav_info_t *info);
+static void finish_info(wav_info_t *info, uint32_t data_bytes);
+static audio_status_t read_adpcm(wav_reader_t reader, uint32_t *dst, uint16_t max_frames, uint16_t *frames);
+static int16_t read_sample(const uint8_t *data, uint8_t bytes);
+
+audio_status_t wav_parse_header(fs_file_t file, uint32_t file_size, wav_info_t *info) {
+    if (info == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    uint8_t header[WAV_FORMAT_HEADER_BYTES];
+    audio_status_t status = read_exact(file, header, 12);
+    if (status != AUDIO_OK) {
+        return status;
+    }
+    if (memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+        return AUDIO_ERROR_FORMAT;
+    }
+
+    uint32_t position = 12;
+    uint8_t haveFormat = 0;
+    memset(info, 0, sizeof(*info));
+    for (;;) {
+        status = read_exact(file, header, 8);
+        if (status != AUDIO_OK) {
+            // Ran off the end without meeting "data"
+            return (status == AUDIO_ERROR_IO) ? status : AUDIO_ERROR_FORMAT;
+        }
+        uint32_t size = read_le32(header + 4);
+        uint32_t pad = size & 1u;    // Odd chunks are padded to even, whatever part of them we read
+        position += 8;
+
+        if (memcmp(header, "fmt ", 4) == 0) {
+            if (size < 16) {
+                return AUDIO_ERROR_FORMAT;
+            }
+            uint32_t take = (size < sizeof(header)) ? size : (uint32_t)sizeof(header);
+            status = read_exact(file, header, take);
+            if (status != AUDIO_OK) {
+                return status;
+            }
+            status = parse_format(header, take, info);
+            if (status != AUDIO_OK) {
+                return status;
+            }
+            haveFormat = 1;
+            position += take;
+            size -= take;
+        } else if (memcmp(header, "data", 4) == 0) {
+            if (!haveFormat) {
+                return AUDIO_ERROR_FORMAT;
+            }
+            info->data_offset = position;
+            // Streamed files leave the size at 0 or all ones; truncated files claim too much
+            uint32_t available = (file_size > position) ? file_size - position : 0;
+            if (size == 0 || size > available) {
+                size = available;
+            }
+            finish_info(info, size);
+            return AUDIO_OK;
+        }
+
+        // Skip the rest of the chunk and its pad byte
+        if (size > (uint32_t)INT32_MAX - pad) {
+            return AUDIO_ERROR_FORMAT;
+        }
+        size += pad;
+        if (size > 0) {
+            if (fs_seek(file, (int32_t)size, FS_SEEK_CUR) != FS_OK) {
+                return AUDIO_ERROR_FORMAT;
+            }
+            position += size;
+        }
+    }
+}
+
+audio_status_t wav_parse_buffer(const void *data, uint32_t size, wav_info_t *info) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    if (bytes == NULL || info == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (size < 12 || memcmp(bytes, "RIFF", 4) != 0 || memcmp(bytes + 8, "WAVE", 4) != 0) {
+        return AUDIO_ERROR_FORMAT;
+    }
+
+    uint32_t position = 12;
+    uint8_t haveFormat = 0;
+    memset(info, 0, sizeof(*info));
+    while (size - position >= 8) {
+        const uint8_t *chunk = bytes + position;
+        uint32_t chunkSize = read_le32(chunk + 4);
+        position += 8;
+        uint32_t available = size - position;
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (chunkSize > available) {
+                return AUDIO_ERROR_FORMAT;
+            }
+            audio_status_t status = parse_format(chunk + 8, chunkSize, info);
+            if (status != AUDIO_OK) {
+                return status;
+            }
+            haveFormat = 1;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat) {
+                return AUDIO_ERROR_FORMAT;
+            }
+            info->data_offset = position;
+            finish_info(info, (chunkSize == 0 || chunkSize > available) ? available : chunkSize);
+            return AUDIO_OK;
+        }
+
+        // Skip the chunk and its pad byte (checked apart, so a size of 0xFFFFFFFF can't wrap to 0)
+        uint32_t pad = chunkSize & 1u;
+        if (chunkSize > available || pad > available - chunkSize) {
+            break;
+        }
+        position += chunkSize + pad;
+    }
+    return AUDIO_ERROR_FORMAT;
+}
+
+audio_status_t wav_reader_open(const char *filename, audio_format_t format, wav_reader_t *reader) {
+    if (filename == NULL || reader == NULL ||
+        (format != AUDIO_FORMAT_WAV && format != AUDIO_FORMAT_RAW_PCM)) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    fs_file_info_t stat;
+    if (fs_stat(filename, &stat) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+
+    struct wav_reader_s *wav = (struct wav_reader_s *)pvPortMalloc(sizeof(struct wav_reader_s));
+    if (wav == NULL) {
+        return AUDIO_ERROR_MEMORY;
+    }
+    memset(wav, 0, sizeof(*wav));
+
+    if (fs_open(filename, FS_READ, &wav->file) != FS_OK) {
+        vPortFree(wav);
+        return AUDIO_ERROR_IO;
+    }
+
+    uint32_t outputRate = audio_output_get_sample_rate();
+    if (format == AUDIO_FORMAT_RAW_PCM) {
+        // No header to read: it is whatever the output plays
+        wav->info.sample_rate = outputRate;
+        wav->info.channels = 2;
+        wav->info.bits_per_sample = 16;
+        wav->info.block_align = 4;
+        wav->info.format_tag = WAV_FORMAT_PCM;
+        wav->info.samples_per_block = 1;
+        wav->info.data_offset = 0;
+        finish_info(&wav->info, stat.size);
+    } else {
+        audio_status_t status = wav_parse_header(wav->file, stat.size, &wav->info);
+        if (status != AUDIO_OK) {
+            wav_reader_close(wav);
+            return status;
+        }
+    }
+
+    if (wav->info.format_tag != WAV_FORMAT_PCM) {
+        wav->block = (uint8_t *)pvPortMalloc(wav->info.block_align);
+        if (wav->block == NULL) {
+            wav_reader_close(wav);
+            return AUDIO_ERROR_MEMORY;
+        }
+        adpcm_format_t adpcm = {
+            .type = (wav->info.format_tag == WAV_FORMAT_IMA_ADPCM) ? ADPCM_IMA : ADPCM_MS,
+            .channels = (uint8_t)wav->info.channels,
+            .block_align = wav->info.block_align,
+            .samples_per_block = wav->info.samples_per_block,
+        };
+        adpcm_decoder_init(&wav->adpcm, &adpcm);
+    }
+
+    wav->position = wav->info.data_offset;
+    wav->remaining = wav->info.data_bytes;
+    wav->direct = (wav->info.format_tag == WAV_FORMAT_PCM &&
+                   wav->info.bits_per_sample == 16 && wav->info.channels == 2 &&
+                   wav->info.block_align == 4 && wav->info.sample_rate == outputRate &&
+                   outputRate != 0 && (wav->info.data_offset % 4u) == 0);
+    wav->realign = 1;
+
+    *reader = wav;
+    return AUDIO_OK;
+}
+
+void wav_reader_close(wav_reader_t reader) {
+    if (reader == NULL) {
+        return;
+    }
+    fs_close(reader->file);
+    if (reader->block != NULL) {
+        vPortFree(reader->block);
+    }
+    vPortFree(reader);
+}
+
+audio_status_t wav_reader_get_info(wav_reader_t reader, wav_info_t *info) {
+    if (reader == NULL || info == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    *info = reader->info;
+    return AUDIO_OK;
+}
+
+uint8_t wav_reader_is_direct(wav_reader_t reader) {
+    return (reader != NULL) ? reader->direct : 0;
+}
+
+audio_status_t wav_reader_pump(wav_reader_t reader, uint16_t *filled) {
+    if (reader == NULL || filled == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (!reader->direct) {
+        return AUDIO_ERROR_FORMAT;
+    }
+
+    while (reader->remaining > 0) {
+        int16_t *buffer;
+        uint16_t frames;
+        if (audio_output_acquire_buffer(&buffer, &frames) != AUDIO_OK || *filled >= frames) {
+            return AUDIO_OK;    // Every buffer is queued; come back after audio_output_wait()
+        }
+
+        uint32_t offset = (uint32_t)*filled * 4u;
+        uint32_t bytes = (uint32_t)frames * 4u - offset;
+        if (reader->realign && offset == 0 && audio_output_queued_buffers() == 0) {
+            // Nothing is playing ahead of us, so a little silence costs nothing: read up to the next
+            // sector boundary into the end of the buffer, and every later read is whole sectors
+            uint32_t head = (WAV_SECTOR_BYTES - (reader->position % WAV_SECTOR_BYTES)) % WAV_SECTOR_BYTES;
+            if (head > 0 && head < bytes && head < reader->remaining) {
+                offset = bytes - head;
+                memset(buffer, 0, offset);
+                bytes = head;
+            }
+        }
+        reader->realign = 0;
+        if (bytes > reader->remaining) {
+            bytes = reader->remaining;
+        }
+
+        size_t got = 0;
+        fs_status_t fsStatus = audio_telemetry_read(reader->file, (uint8_t *)buffer + offset, bytes, &got);
+        got &= ~(size_t)3u;
+        reader->position += (uint32_t)got;
+        reader->remaining -= (uint32_t)got;
+        if (fsStatus != FS_OK || got < bytes) {
+            reader->remaining = 0;    // Whatever arrived still plays
+        }
+
+        *filled = (uint16_t)((offset + got) / 4u);
+        if (*filled == frames) {
+            // The same in-place steps as the output worker; each returns at once when it has nothing to do
+            audio_mix_effects(buffer, frames);
+            audio_process_dsp(buffer, frames);
+            audio_tap_feed(buffer, frames);
+            audio_output_commit_buffer(frames);
+            *filled = 0;
+        }
+
+        if (fsStatus != FS_OK) {
+            return AUDIO_ERROR_IO;
+        }
+    }
+    return AUDIO_ERROR_BUSY;    // A part-filled buffer is left for whoever plays next
+}
+
+audio_status_t wav_reader_seek(wav_reader_t reader, uint32_t position_ms) {
+    if (reader == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    uint64_t frame = (uint64_t)position_ms * reader->info.sample_rate / 1000u;
+    uint32_t skip = 0;
+    if (reader->block != NULL) {
+        // Blocks only decode from their start: land on the block and throw away the frames before ours
+        skip = (uint32_t)(frame % reader->info.samples_per_block);
+        frame /= reader->info.samples_per_block;
+    }
+    uint64_t offset = frame * reader->info.block_align;
+    if (offset >= reader->info.data_bytes) {
+        offset = reader->info.data_bytes;
+        skip = 0;
+    }
+    uint32_t position = reader->info.data_offset + (uint32_t)offset;
+    if (position > (uint32_t)INT32_MAX || fs_seek(reader->file, (int32_t)position, FS_SEEK_SET) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+    reader->position = position;
+    reader->remaining = reader->info.data_bytes - (uint32_t)offset;
+    reader->realign = 1;
+    reader->skip = (uint16_t)skip;
+    if (reader->block != NULL) {
+        adpcm_format_t format = reader->adpcm.format;
+        adpcm_decoder_init(&reader->adpcm, &format);
+    }
+    return AUDIO_OK;
+}
+
+audio_status_t wav_reader_read_pcm(wav_reader_t reader, int16_t *pcm, uint16_t max_frames, uint16_t *frames) {
+    if (reader == NULL || pcm == NULL || frames == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    *frames = 0;
+    if (reader->block != NULL) {
+        return read_adpcm(reader, (uint32_t *)pcm, max_frames, frames);
+    }
+    if (reader->remaining == 0) {
+        return AUDIO_ERROR_BUSY;
+    }
+
+    uint32_t frameBytes = reader->info.block_align;
+    uint32_t count = sizeof(reader->bounce) / frameBytes;
+    if (count == 0) {
+        return AUDIO_ERROR_FORMAT;    // One frame is bigger than the bounce buffer
+    }
+    if (count > max_frames) {
+        count = max_frames;
+    }
+    if (count > reader->remaining / frameBytes) {
+        count = reader->remaining / frameBytes;
+    }
+    if (count == 0) {
+        return AUDIO_OK;
+    }
+
+    size_t got = 0;
+    if (audio_telemetry_read(reader->file, reader->bounce, count * frameBytes, &got) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+    count = (uint32_t)got / frameBytes;
+    reader->position += (uint32_t)got;
+    reader->remaining -= (uint32_t)got;
+    if (count == 0) {
+        reader->remaining = 0;    // The file is shorter than it said
+        return AUDIO_ERROR_BUSY;
+    }
+
+    uint8_t sampleBytes = (uint8_t)(reader->info.bits_per_sample / 8u);
+    uint32_t rightOffset = (reader->info.channels > 1) ? sampleBytes : 0;
+    const uint8_t *src = reader->bounce;
+    uint32_t *dst = (uint32_t *)pcm;
+    for (uint32_t i = 0; i < count; i++) {
+        dst[i] = dsp_pack16x2(read_sample(src, sampleBytes), read_sample(src + rightOffset, sampleBytes));
+        src += frameBytes;
+    }
+    *frames = (uint16_t)count;
+    return AUDIO_OK;
+}
+
+audio_stage_result_t audio_stage_decode_wav(void *context, spsc_ring_t *input, spsc_ring_t *output) {
+    (void)input;
+    wav_reader_t reader = (wav_reader_t)context;
+    if (reader == NULL || output == NULL) {
+        return AUDIO_STAGE_ERROR;
+    }
+
+    uint32_t space;
+    int16_t *dst = (int16_t *)spsc_ring_write_ptr(output, &space);
+    uint32_t room = space / 4u;
+    if (room == 0 && (reader->remaining > 0 || !adpcm_decoder_block_done(&reader->adpcm))) {
+        return AUDIO_STAGE_BLOCKED;
+    }
+    uint16_t frames = 0;
+    audio_status_t status = wav_reader_read_pcm(reader, dst, (room > UINT16_MAX) ? UINT16_MAX : (uint16_t)room, &frames);
+    if (status == AUDIO_ERROR_BUSY) {
+        return AUDIO_STAGE_DONE;
+    }
+    if (status != AUDIO_OK) {
+        return AUDIO_STAGE_ERROR;
+    }
+    spsc_ring_write_commit(output, (uint32_t)frames * 4u);
+    return AUDIO_STAGE_PROGRESS;
+}
+
+// Little-endian helpers - WAV stores everything low byte first
+static uint16_t read_le16(const uint8_t *data) {
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+static uint32_t read_le32(const uint8_t *data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// Reads exactly size bytes; AUDIO_ERROR_FORMAT if the file ends first
+static audio_status_t read_exact(fs_file_t file, void *buffer, uint32_t size) {
+    size_t got = 0;
+    if (fs_read(file, buffer, size, &got) != FS_OK) {
+        return AUDIO_ERROR_IO;
+    }
+    return (got == size) ? AUDIO_OK : AUDIO_ERROR_FORMAT;
+}
+
+// Checks a "fmt " chunk (size bytes of it at format) and fills in what it says
+static audio_status_t parse_format(const uint8_t *format, uint32_t size, wav_info_t *info) {
+    if (size < 16) {
+        return AUDIO_ERROR_FORMAT;
+    }
+    uint16_t tag = read_le16(format);
+    if (tag == WAV_FORMAT_EXTENSIBLE) {
+        // The real format is the first two bytes of the sub-format GUID
+        tag = (size >= 26) ? read_le16(format + 24) : 0;
+    }
+    info->format_tag = tag;
+    info->channels = read_le16(format + 2);
+    info->sample_rate = read_le32(format + 4);
+    info->block_align = read_le16(format + 12);
+    info->bits_per_sample = read_le16(format + 14);
+    if (info->channels == 0 || info->sample_rate == 0) {
+        return AUDIO_ERROR_FORMAT;
+    }
+
+    if (tag == WAV_FORMAT_IMA_ADPCM || tag == WAV_FORMAT_MS_ADPCM) {
+        adpcm_type_t type = (tag == WAV_FORMAT_IMA_ADPCM) ? ADPCM_IMA : ADPCM_MS;
+        if (info->bits_per_sample != 4 || info->channels > 2 || info->block_align > WAV_ADPCM_MAX_BLOCK) {
+            return AUDIO_ERROR_FORMAT;
+        }
+        uint16_t perBlock = adpcm_samples_per_block(type, (uint8_t)info->channels, info->block_align);
+        if (perBlock == 0) {
+            return AUDIO_ERROR_FORMAT;
+        }
+        // Some encoders fill blocks less than the room allows, and say so
+        uint16_t declared = (size >= 20) ? read_le16(format + 18) : 0;
+        info->samples_per_block = (declared > 0 && declared < perBlock) ? declared : perBlock;
+        if (type == ADPCM_MS) {
+            // Only the standard predictors can be decoded; every encoder we know of writes them
+            if (size < WAV_MS_COEF_OFFSET + WAV_MS_PREDICTORS * 4u ||
+                read_le16(format + 20) < WAV_MS_PREDICTORS) {
+                return AUDIO_ERROR_FORMAT;
+            }
+            for (uint32_t i = 0; i < WAV_MS_PREDICTORS * 2u; i++) {
+                if ((int16_t)read_le16(format + WAV_MS_COEF_OFFSET + 2u * i) != msStandardCoefs[i]) {
+                    return AUDIO_ERROR_FORMAT;
+                }
+            }
+        }
+        return AUDIO_OK;
+    }
+
+    uint16_t sampleBytes = (uint16_t)((info->bits_per_sample + 7u) / 8u);
+    if (tag != WAV_FORMAT_PCM || sampleBytes == 0 || sampleBytes > 4 ||
+        info->block_align < sampleBytes * info->channels) {
+        return AUDIO_ERROR_FORMAT;
+    }
+    // Containers are whole bytes: a 20-bit file is read as 24-bit
+    info->bits_per_sample = (uint16_t)(sampleBytes * 8u);
+    info->samples_per_block = 1;
+    return AUDIO_OK;
+}
+
+// Sets data_bytes and total_frames once the size of "data" is known
+static void finish_info(wav_info_t *info, uint32_t data_bytes) {
+    if (info->format_tag == WAV_FORMAT_PCM) {
+        info->data_bytes = data_bytes - (data_bytes % info->block_align);
+        info->total_frames = info->data_bytes / info->block_align;
+        return;
+    }
+    // ADPCM keeps a short last block: it still holds whole frames
+    adpcm_format_t format = {
+        .type = (info->format_tag == WAV_FORMAT_IMA_ADPCM) ? ADPCM_IMA : ADPCM_MS,
+        .channels = (uint8_t)info->channels,
+        .block_align = info->block_align,
+        .samples_per_block = info->samples_per_block,
+    };
+    info->data_bytes = data_bytes;
+    info->total_frames = (data_bytes / info->block_align) * info->samples_per_block +
+                         adpcm_block_frames(&format, data_bytes % info->block_align);
+}
+
+// Decodes the current ADPCM block, reading the next one from the file when it runs out
+static audio_status_t read_adpcm(wav_reader_t reader, uint32_t *dst, uint16_t max_frames, uint16_t *frames) {
+    if (max_frames == 0) {
+        return AUDIO_OK;
+    }
+
+    uint16_t count = 0;
+    while (count == 0) {
+        if (adpcm_decoder_block_done(&reader->adpcm)) {
+            if (reader->remaining == 0) {
+                return AUDIO_ERROR_BUSY;
+            }
+            uint32_t bytes = (reader->remaining < reader->info.block_align) ? reader->remaining : reader->info.block_align;
+            size_t got = 0;
+            if (audio_telemetry_read(reader->file, reader->block, bytes, &got) != FS_OK) {
+                return AUDIO_ERROR_IO;
+            }
+            reader->position += (uint32_t)got;
+            reader->remaining -= (uint32_t)got;
+            if (got < bytes) {
+                reader->remaining = 0;    // The file is shorter than it said
+            }
+            if (adpcm_decoder_start_block(&reader->adpcm, reader->block, (uint32_t)got) != AUDIO_OK) {
+                // A last block too short for its header is just the end; one in the middle is broken
+                return (reader->remaining == 0) ? AUDIO_ERROR_BUSY : AUDIO_ERROR_FORMAT;
+            }
+        }
+
+        if (reader->skip > 0) {
+            // Decode and drop the frames before where the seek asked for
+            uint16_t dropped = adpcm_decoder_read(&reader->adpcm, dst, (reader->skip < max_frames) ? reader->skip : max_frames);
+            reader->skip = (uint16_t)(reader->skip - dropped);
+            continue;
+        }
+        count = adpcm_decoder_read(&reader->adpcm, dst, max_frames);
+    }
+
+    *frames = count;
+    return AUDIO_OK;
+}
+
+// One little-endian sample of 1-4 bytes, rounded to 16 bits (8-bit WAV is unsigned)
+static int16_t read_sample(const uint8_t *data, uint8_t bytes) {
+    switch (bytes) {
+        case 1:
+            return (int16_t)(((int32_t)data[0] - 128) << 8);
+        case 2:
+            return (int16_t)read_le16(data);
+        case 3: {
+            int32_t value = (int32_t)(((uint32_t)data[0] << 8) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 24)) >> 8;
+            return dsp_ssat16(((value >> 7) + 1) >> 1);
+        }
+        default: {
+            int32_t value = (int32_t)read_le32(data);
+            return dsp_ssat16(((value >> 15) + 1) >> 1);
+        }
+    }
+}
@@ -2,6 +2,7 @@
 #include "os_config.h"
 #include "FreeRTOS.h"
 #include "task.h"
+#include "hardware/timer.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -16,6 +17,18 @@ static uint32_t freeHeapSize = 0;
 static uint32_t lastPerformanceCheck = 0;
 static const uint32_t PERFORMANCE_CHECK_INTERVAL = 1000; // ms
 
+// Input-to-photon latency tracing
+typedef enum {
+    LATENCY_IDLE = 0,        // Nothing waiting
+    LATENCY_INPUT,           // A button changed, no redraw yet
+    LATENCY_INVALIDATED      // A redraw started, waiting for the flush
+} latency_state_t;
+
+static volatile latency_state_t latencyState = LATENCY_IDLE;
+static volatile uint32_t latencyInputUs = 0;
+static volatile uint32_t latencyInvalidateUs = 0;
+static system_latency_stats_t latencyStats;
+
 // Function declarations for internal functions
 static uint8_t calculate_cpu_usage(void);
 static void memory_saving_mode(void);
@@ -90,6 +103,106 @@ uint32_t system_get_uptime(void) {
     return systemUptime;
 }
 
+uint32_t system_get_time_us(void) {
+    // 1 MHz system timer, readable from any core or interrupt
+    return time_us_32();
+}
+
+void system_latency_mark_input(uint32_t timestamp_us) {
+    if (!SYSTEM_ENABLE_LATENCY_TRACE) {
+        return;
+    }
+
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    // A press already being drawn keeps its (earlier) start time
+    if (latencyState != LATENCY_INVALIDATED) {
+        latencyInputUs = timestamp_us;
+        latencyState = LATENCY_INPUT;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+void system_latency_mark_invalidate(void) {
+    if (!SYSTEM_ENABLE_LATENCY_TRACE || latencyState != LATENCY_INPUT) {
+        return;
+    }
+
+    uint32_t now = system_get_time_us();
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    if (latencyState == LATENCY_INPUT) {
+        latencyInvalidateUs = now;
+        latencyState = LATENCY_INVALIDATED;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+void system_latency_mark_flush(uint32_t frame_start_us) {
+    if (!SYSTEM_ENABLE_LATENCY_TRACE || latencyState != LATENCY_INVALIDATED) {
+        return;
+    }
+
+    uint32_t now = system_get_time_us();
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    // Only a redraw that started after the invalidate can have drawn the answer
+    if (latencyState == LATENCY_INVALIDATED && (int32_t)(frame_start_us - latencyInvalidateUs) >= 0) {
+        uint32_t latency = now - latencyInputUs;
+        uint32_t bucket = latency / SYSTEM_LATENCY_BUCKET_US;
+        if (bucket >= SYSTEM_LATENCY_BUCKETS) {
+            bucket = SYSTEM_LATENCY_BUCKETS - 1;
+        }
+
+        if (latencyStats.count == 0 || latency < latencyStats.min_us) {
+            latencyStats.min_us = latency;
+        }
+        if (latency > latencyStats.max_us) {
+            latencyStats.max_us = latency;
+        }
+        latencyStats.count++;
+        latencyStats.last_us = latency;
+        latencyStats.last_render_us = now - latencyInvalidateUs;
+        latencyStats.total_us += latency;
+        latencyStats.buckets[bucket]++;
+        latencyState = LATENCY_IDLE;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+void system_get_latency_stats(system_latency_stats_t *stats, uint8_t reset) {
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    if (stats != NULL) {
+        memcpy(stats, &latencyStats, sizeof(latencyStats));
+    }
+    if (reset) {
+        memset(&latencyStats, 0, sizeof(latencyStats));
+    }
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+uint32_t system_latency_percentile(const system_latency_stats_t *stats, uint8_t percent) {
+    if (stats == NULL || stats->count == 0) {
+        return 0;
+    }
+    if (percent > 100) {
+        percent = 100;
+    }
+
+    // Smallest bucket whose running total reaches the requested share
+    uint32_t target = (uint32_t)(((uint64_t)stats->count * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < SYSTEM_LATENCY_BUCKETS; i++) {
+        seen += stats->buckets[i];
+        if (seen >= target && seen > 0) {
+            // The overflow bucket has no upper edge, so report the real worst case
+            if (i == SYSTEM_LATENCY_BUCKETS - 1) {
+                return stats->max_us;
+            }
+            uint32_t edge = (i + 1) * SYSTEM_LATENCY_BUCKET_US;
+            return (edge < stats->max_us) ? edge : stats->max_us;
+        }
+    }
+    return stats->max_us;
+}
+
 uint8_t system_get_cpu_usage(void) {
     return cpuUtilization;
 }
@@ -0,0 +1,470 @@
+#include "drivers/audio_input.h"
+#include "audio/dsp_kernels.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+#include "hardware/adc.h"
+#include <math.h>
+#include <string.h>
+
+#define DISCARD  (-1)    // channelBuffer value while a channel fills the scratch word
+
+#define PDM_DECIMATION       64    // Microphone bits per sample
+#define PDM_WORDS_PER_FRAME  (PDM_DECIMATION / 32)
+#define PDM_CIC_GAIN_LOG2    24    // 4 stages x log2(64)
+#define PDM_CYCLES_PER_BIT   2
+
+// Hand-assembled PDM receiver (one bit per microphone clock, autopush every 32):
+//   wrap_target: nop          side 1
+//                in pins, 1   side 0    ; sample just before the falling edge
+// Side-set bit 0 is the microphone clock; two instructions per bit.
+static const uint16_t pdmInstructions[] = {
+    0xb042, 0x4001
+};
+static const struct pio_program pdmProgram = {
+    .instructions = pdmInstructions,
+    .length = 2,
+    .origin = -1
+};
+
+// Buffer ring: handed to the DMA in order at loadIndex, read in order from readIndex
+static uint32_t *ringBuffers[AUDIO_INPUT_BUFFER_COUNT];
+static uint8_t ringCount = 0;
+static uint16_t ringFrames = 0;
+static uint32_t ringTransfers = 0;
+static volatile uint8_t loadIndex = 0;
+static volatile uint8_t readIndex = 0;
+static volatile uint8_t readyCount = 0;
+static volatile uint8_t freeCount = 0;
+
+// DMA state
+static int dmaChannel[2] = { -1, -1 };
+static dma_channel_config channelConfig[2];
+static volatile int8_t channelBuffer[2] = { DISCARD, DISCARD };
+static uint32_t scratchWord = 0;
+static volatile uint8_t running = 0;
+static uint8_t irqInstalled = 0;
+static volatile TaskHandle_t waitingTask = NULL;
+static audio_input_stats_t inputStats;
+
+// Source hardware
+static audio_input_source_t inputSource = AUDIO_INPUT_PDM;
+static PIO pdmPio;
+static int pdmStateMachine = -1;
+static uint pdmOffset = 0;
+static uint8_t adcClaimed = 0;
+
+// Conversion state (kept across buffers)
+static uint32_t cicIntegrator[4];
+static uint32_t cicDelay[4];
+static int32_t dcMean = 0;       // Running mean of the input, Q8
+static int32_t gainQ8 = 256;
+
+// Function declarations for internal functions
+static void dma_irq_handler(void);
+static void load_channel(uint8_t index);
+static audio_status_t setup_pdm(volatile void **source, uint *dreq, uint32_t sample_rate);
+static audio_status_t setup_adc(volatile void **source, uint *dreq, uint32_t sample_rate);
+static void release_source(void);
+static void reset_ring(void);
+static void reset_filters(void);
+static void convert_pdm(const uint32_t *words, int16_t *pcm, uint16_t frames);
+static void convert_adc(const uint16_t *samples, int16_t *pcm, uint16_t frames);
+static int16_t finish_sample(int32_t sample);
+
+audio_status_t audio_input_init(const audio_record_config_t *config) {
+    if (config == NULL || config->sample_rate < AUDIO_SAMPLE_RATE_8K || config->sample_rate > AUDIO_SAMPLE_RATE_48K ||
+        config->gain_db > 40 || config->source > AUDIO_INPUT_ADC) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (ringCount != 0) {
+        audio_input_deinit();
+    }
+
+    // PDM buffers hold 64 bits per sample, ADC buffers one 16-bit result
+    uint32_t bytes = (config->source == AUDIO_INPUT_PDM) ?
+        (uint32_t)AUDIO_INPUT_BUFFER_FRAMES * PDM_WORDS_PER_FRAME * 4u : (uint32_t)AUDIO_INPUT_BUFFER_FRAMES * 2u;
+    for (uint8_t i = 0; i < AUDIO_INPUT_BUFFER_COUNT; i++) {
+        ringBuffers[i] = pvPortMalloc(bytes);
+        if (ringBuffers[i] == NULL) {
+            for (uint8_t j = 0; j < i; j++) {
+                vPortFree(ringBuffers[j]);
+                ringBuffers[j] = NULL;
+            }
+            return AUDIO_ERROR_MEMORY;
+        }
+    }
+    ringCount = AUDIO_INPUT_BUFFER_COUNT;
+    ringFrames = AUDIO_INPUT_BUFFER_FRAMES;
+    inputSource = config->source;
+    gainQ8 = (int32_t)(powf(10.0f, (float)config->gain_db / 20.0f) * 256.0f + 0.5f);
+    reset_ring();
+    reset_filters();
+    memset(&inputStats, 0, sizeof(inputStats));
+
+    dmaChannel[0] = dma_claim_unused_channel(false);
+    dmaChannel[1] = dma_claim_unused_channel(false);
+    if (dmaChannel[0] < 0 || dmaChannel[1] < 0) {
+        audio_input_deinit();
+        return AUDIO_ERROR_INIT;
+    }
+
+    volatile void *source = NULL;
+    uint dreq = 0;
+    audio_status_t status = (inputSource == AUDIO_INPUT_PDM) ?
+        setup_pdm(&source, &dreq, config->sample_rate) : setup_adc(&source, &dreq, config->sample_rate);
+    if (status != AUDIO_OK) {
+        audio_input_deinit();
+        return status;
+    }
+
+    // Two channels chained to each other: A fills, then B, then A again...
+    for (uint8_t i = 0; i < 2; i++) {
+        dma_channel_config c = dma_channel_get_default_config((uint)dmaChannel[i]);
+        channel_config_set_transfer_data_size(&c, (inputSource == AUDIO_INPUT_PDM) ? DMA_SIZE_32 : DMA_SIZE_16);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        channel_config_set_dreq(&c, dreq);
+        channel_config_set_chain_to(&c, (uint)dmaChannel[i ^ 1]);
+        channelConfig[i] = c;
+        dma_channel_configure((uint)dmaChannel[i], &c, &scratchWord, source, ringTransfers, false);
+        dma_irqn_set_channel_enabled(AUDIO_INPUT_DMA_IRQ, (uint)dmaChannel[i], true);
+    }
+
+    irq_add_shared_handler(DMA_IRQ_0 + AUDIO_INPUT_DMA_IRQ, dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0 + AUDIO_INPUT_DMA_IRQ, true);
+    irqInstalled = 1;
+    return AUDIO_OK;
+}
+
+void audio_input_deinit(void) {
+    audio_input_stop();
+
+    for (uint8_t i = 0; i < 2; i++) {
+        if (dmaChannel[i] >= 0) {
+            dma_irqn_set_channel_enabled(AUDIO_INPUT_DMA_IRQ, (uint)dmaChannel[i], false);
+            dma_channel_unclaim((uint)dmaChannel[i]);
+            dmaChannel[i] = -1;
+        }
+    }
+    if (irqInstalled) {
+        irq_remove_handler(DMA_IRQ_0 + AUDIO_INPUT_DMA_IRQ, dma_irq_handler);
+        irqInstalled = 0;
+    }
+    release_source();
+
+    for (uint8_t i = 0; i < ringCount; i++) {
+        vPortFree(ringBuffers[i]);
+        ringBuffers[i] = NULL;
+    }
+    ringCount = 0;
+    ringFrames = 0;
+}
+
+audio_status_t audio_input_start(void) {
+    if (ringCount == 0 || dmaChannel[0] < 0) {
+        return AUDIO_ERROR_INIT;
+    }
+    if (running) {
+        return AUDIO_OK;
+    }
+
+    load_channel(0);
+    load_channel(1);
+    running = 1;
+
+    dma_channel_start((uint)dmaChannel[0]);
+    if (inputSource == AUDIO_INPUT_PDM) {
+        pio_sm_set_enabled(pdmPio, (uint)pdmStateMachine, true);
+    } else {
+        adc_run(true);
+    }
+    return AUDIO_OK;
+}
+
+void audio_input_stop(void) {
+    if (!running) {
+        return;
+    }
+    running = 0;
+
+    if (inputSource == AUDIO_INPUT_PDM) {
+        pio_sm_set_enabled(pdmPio, (uint)pdmStateMachine, false);
+        pio_sm_clear_fifos(pdmPio, (uint)pdmStateMachine);
+    } else {
+        adc_run(false);
+        adc_fifo_drain();
+    }
+
+    // Aborting can raise a stray completion, so mask it while we do
+    for (uint8_t i = 0; i < 2; i++) {
+        dma_irqn_set_channel_enabled(AUDIO_INPUT_DMA_IRQ, (uint)dmaChannel[i], false);
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+        dma_channel_abort((uint)dmaChannel[i]);
+        dma_irqn_acknowledge_channel(AUDIO_INPUT_DMA_IRQ, (uint)dmaChannel[i]);
+        dma_irqn_set_channel_enabled(AUDIO_INPUT_DMA_IRQ, (uint)dmaChannel[i], true);
+    }
+
+    taskENTER_CRITICAL();
+    reset_ring();
+    taskEXIT_CRITICAL();
+    reset_filters();
+
+    if (waitingTask != NULL) {
+        xTaskNotifyGive(waitingTask);
+    }
+}
+
+audio_status_t audio_input_wait(uint32_t timeout_ms) {
+    if (readyCount > 0) {
+        return AUDIO_OK;
+    }
+
+    waitingTask = xTaskGetCurrentTaskHandle();
+    if (readyCount == 0) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    }
+    waitingTask = NULL;
+    return (readyCount > 0) ? AUDIO_OK : AUDIO_ERROR_TIMEOUT;
+}
+
+uint16_t audio_input_read(int16_t *pcm, uint16_t max_frames) {
+    if (pcm == NULL || ringCount == 0 || readyCount == 0 || max_frames < ringFrames) {
+        return 0;
+    }
+
+    // Single consumer: readIndex only moves here, and the DMA won't touch the buffer until it is freed
+    const uint32_t *buffer = ringBuffers[readIndex];
+    if (inputSource == AUDIO_INPUT_PDM) {
+        convert_pdm(buffer, pcm, ringFrames);
+    } else {
+        convert_adc((const uint16_t *)buffer, pcm, ringFrames);
+    }
+
+    taskENTER_CRITICAL();
+    readIndex = (uint8_t)((readIndex + 1) % ringCount);
+    readyCount--;
+    freeCount++;
+    taskEXIT_CRITICAL();
+    return ringFrames;
+}
+
+uint16_t audio_input_buffer_frames(void) {
+    return ringFrames;
+}
+
+void audio_input_get_stats(audio_input_stats_t *stats, uint8_t reset) {
+    taskENTER_CRITICAL();
+    if (stats != NULL) {
+        *stats = inputStats;
+        stats->queued_buffers = readyCount;
+    }
+    if (reset) {
+        memset(&inputStats, 0, sizeof(inputStats));
+    }
+    taskEXIT_CRITICAL();
+}
+
+// A channel just filled its buffer (its partner is already filling the next):
+// queue the buffer and load the channel with the next free one.
+static void dma_irq_handler(void) {
+    BaseType_t woken = pdFALSE;
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+
+    for (uint8_t i = 0; i < 2; i++) {
+        if (dmaChannel[i] < 0 || !dma_irqn_get_channel_status(AUDIO_INPUT_DMA_IRQ, (uint)dmaChannel[i])) {
+            continue;
+        }
+        dma_irqn_acknowledge_channel(AUDIO_INPUT_DMA_IRQ, (uint)dmaChannel[i]);
+
+        if (channelBuffer[i] != DISCARD) {
+            readyCount++;
+            inputStats.buffers_captured++;
+        }
+        if (running) {
+            load_channel(i);
+        }
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+
+    if (waitingTask != NULL) {
+        vTaskNotifyGiveFromISR(waitingTask, &woken);
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+// Point a (stopped) channel at the next free buffer, or at the scratch word.
+// It starts on its own when its partner finishes.
+static void load_channel(uint8_t index) {
+    uint ch = (uint)dmaChannel[index];
+    volatile void *target;
+
+    if (freeCount > 0) {
+        channelBuffer[index] = (int8_t)loadIndex;
+        target = ringBuffers[loadIndex];
+        loadIndex = (uint8_t)((loadIndex + 1) % ringCount);
+        freeCount--;
+        channel_config_set_write_increment(&channelConfig[index], true);
+    } else {
+        // Nowhere to put it: keep the microphone paced into the scratch word for one buffer's time
+        channelBuffer[index] = DISCARD;
+        target = &scratchWord;
+        channel_config_set_write_increment(&channelConfig[index], false);
+        if (running) {
+            inputStats.overruns++;
+        }
+    }
+
+    dma_channel_set_config(ch, &channelConfig[index], false);
+    dma_channel_set_write_addr(ch, target, false);
+    dma_channel_set_trans_count(ch, ringTransfers, false);
+}
+
+static audio_status_t setup_pdm(volatile void **source, uint *dreq, uint32_t sample_rate) {
+    pdmPio = AUDIO_INPUT_PDM_PIO ? pio1 : pio0;
+    pdmStateMachine = pio_claim_unused_sm(pdmPio, false);
+    if (pdmStateMachine < 0) {
+        return AUDIO_ERROR_INIT;
+    }
+    if (!pio_can_add_program(pdmPio, &pdmProgram)) {
+        pio_sm_unclaim(pdmPio, (uint)pdmStateMachine);
+        pdmStateMachine = -1;
+        return AUDIO_ERROR_INIT;
+    }
+    pdmOffset = pio_add_program(pdmPio, &pdmProgram);
+    uint sm = (uint)pdmStateMachine;
+
+    pio_gpio_init(pdmPio, AUDIO_INPUT_PDM_CLOCK_PIN);
+    pio_gpio_init(pdmPio, AUDIO_INPUT_PDM_DATA_PIN);
+
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, pdmOffset, pdmOffset + pdmProgram.length - 1);
+    sm_config_set_sideset(&c, 1, false, false);
+    sm_config_set_sideset_pins(&c, AUDIO_INPUT_PDM_CLOCK_PIN);
+    sm_config_set_in_pins(&c, AUDIO_INPUT_PDM_DATA_PIN);
+    sm_config_set_in_shift(&c, false, true, 32);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    pio_sm_init(pdmPio, sm, pdmOffset, &c);
+    pio_sm_set_consistent_pindirs(pdmPio, sm, AUDIO_INPUT_PDM_CLOCK_PIN, 1, true);
+    pio_sm_set_consistent_pindirs(pdmPio, sm, AUDIO_INPUT_PDM_DATA_PIN, 1, false);
+
+    // 8.8 fixed-point divider so one microphone bit takes exactly two PIO cycles
+    uint32_t divider = (uint32_t)(((uint64_t)clock_get_hz(clk_sys) * 256u) /
+                                  ((uint64_t)sample_rate * PDM_DECIMATION * PDM_CYCLES_PER_BIT));
+    pio_sm_set_clkdiv_int_frac(pdmPio, sm, (uint16_t)(divider >> 8), (uint8_t)(divider & 0xFF));
+
+    ringTransfers = (uint32_t)ringFrames * PDM_WORDS_PER_FRAME;
+    *source = &pdmPio->rxf[sm];
+    *dreq = pio_get_dreq(pdmPio, sm, false);
+    return AUDIO_OK;
+}
+
+static audio_status_t setup_adc(volatile void **source, uint *dreq, uint32_t sample_rate) {
+    if (AUDIO_INPUT_ADC_PIN < ADC_BASE_PIN || AUDIO_INPUT_ADC_PIN >= ADC_BASE_PIN + NUM_ADC_CHANNELS - 1) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    adc_init();
+    adc_gpio_init(AUDIO_INPUT_ADC_PIN);
+    adc_select_input(AUDIO_INPUT_ADC_PIN - ADC_BASE_PIN);
+    adc_fifo_setup(true, true, 1, false, false);
+
+    // One conversion every (1 + div) ADC clocks
+    adc_set_clkdiv((float)clock_get_hz(clk_adc) / (float)sample_rate - 1.0f);
+    adcClaimed = 1;
+
+    ringTransfers = ringFrames;
+    *source = &adc_hw->fifo;
+    *dreq = DREQ_ADC;
+    return AUDIO_OK;
+}
+
+static void release_source(void) {
+    if (pdmStateMachine >= 0) {
+        pio_sm_set_enabled(pdmPio, (uint)pdmStateMachine, false);
+        pio_remove_program(pdmPio, &pdmProgram, pdmOffset);
+        pio_sm_unclaim(pdmPio, (uint)pdmStateMachine);
+        pdmStateMachine = -1;
+    }
+    if (adcClaimed) {
+        adc_run(false);
+        adc_fifo_setup(false, false, 0, false, false);
+        adc_fifo_drain();
+        adcClaimed = 0;
+    }
+}
+
+static void reset_ring(void) {
+    loadIndex = 0;
+    readIndex = 0;
+    readyCount = 0;
+    freeCount = ringCount;
+    channelBuffer[0] = DISCARD;
+    channelBuffer[1] = DISCARD;
+}
+
+static void reset_filters(void) {
+    memset(cicIntegrator, 0, sizeof(cicIntegrator));
+    memset(cicDelay, 0, sizeof(cicDelay));
+    dcMean = 0;
+}
+
+// 4th-order CIC, decimating 64 bits to one sample. The integrators wrap on purpose: the combs
+// undo the wrap as long as the result fits, and 64^4 = 2^24 does.
+static void convert_pdm(const uint32_t *words, int16_t *pcm, uint16_t frames) {
+    uint32_t i0 = cicIntegrator[0];
+    uint32_t i1 = cicIntegrator[1];
+    uint32_t i2 = cicIntegrator[2];
+    uint32_t i3 = cicIntegrator[3];
+
+    for (uint16_t f = 0; f < frames; f++) {
+        for (uint8_t w = 0; w < PDM_WORDS_PER_FRAME; w++) {
+            uint32_t bits = *words++;
+            for (uint8_t b = 0; b < 32; b++) {
+                // First bit in is the most significant; bits count as 0/1 here, +-1 after the combs
+                i0 += bits >> 31;
+                i1 += i0;
+                i2 += i1;
+                i3 += i2;
+                bits <<= 1;
+            }
+        }
+
+        uint32_t value = i3;
+        for (uint8_t s = 0; s < 4; s++) {
+            uint32_t delayed = cicDelay[s];
+            cicDelay[s] = value;
+            value -= delayed;
+        }
+
+        // 0..2^24 ones-count-weighted -> -2^24..2^24, then down to 16 bits
+        int32_t sample = ((int32_t)value * 2 - (1 << PDM_CIC_GAIN_LOG2)) >> (PDM_CIC_GAIN_LOG2 + 1 - 16);
+        pcm[f] = finish_sample(sample);
+    }
+
+    cicIntegrator[0] = i0;
+    cicIntegrator[1] = i1;
+    cicIntegrator[2] = i2;
+    cicIntegrator[3] = i3;
+}
+
+static void convert_adc(const uint16_t *samples, int16_t *pcm, uint16_t frames) {
+    for (uint16_t f = 0; f < frames; f++) {
+        // 12-bit unsigned -> 16-bit signed
+        pcm[f] = finish_sample(((int32_t)(samples[f] & 0x0FFF) - 2048) << 4);
+    }
+}
+
+// DC removal (subtract a slow running mean, about 10 Hz at 16 kHz), then gain and clip
+static int16_t finish_sample(int32_t sample) {
+    dcMean += sample - (dcMean >> 8);
+    int32_t centered = sample - (dcMean >> 8);
+    return (int16_t)dsp_ssat16((centered * gainQ8) >> 8);
+}
@@ -0,0 +1,490 @@
+#include "drivers/audio_output.h"
+#include "audio/audio_telemetry.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include <stdatomic.h>
+#if AUDIO_OUTPUT_USE_I2S
+#include "hardware/pio.h"
+#else
+#include "hardware/pwm.h"
+#endif
+#include <string.h>
+
+#define SILENCE  (-1)    // channelBuffer value while a channel plays the silence word
+
+#if AUDIO_OUTPUT_USE_I2S
+// Hand-assembled I2S transmitter (16-bit stereo, one 32-bit FIFO word per frame):
+//   bitloop1:    out pins, 1      side 0b10
+//                jmp x-- bitloop1 side 0b11
+//                out pins, 1      side 0b00
+//                set x, 14        side 0b01
+//   bitloop0:    out pins, 1      side 0b00
+//                jmp x-- bitloop0 side 0b01
+//                out pins, 1      side 0b10
+//   entry_point: set x, 14        side 0b11
+// Side-set bit 0 is BCLK, bit 1 is LRCLK; two instructions per bit.
+static const uint16_t i2sInstructions[] = {
+    0x7001, 0x1840, 0x6001, 0xe82e, 0x6001, 0x0844, 0x7001, 0xf82e
+};
+static const struct pio_program i2sProgram = {
+    .instructions = i2sInstructions,
+    .length = 8,
+    .origin = -1
+};
+#define I2S_ENTRY_POINT   7
+#define I2S_CYCLES_PER_FRAME 64   // 32 bits x 2 instructions
+#endif
+
+// Buffer ring: filled in order at writeIndex, played in order from queueIndex
+static uint32_t *ringBuffers[AUDIO_OUTPUT_MAX_BUFFERS];
+static uint8_t ringCount = 0;
+static uint16_t ringFrames = 0;
+static volatile uint8_t writeIndex = 0;
+static volatile uint8_t queueIndex = 0;
+static volatile uint8_t readyCount = 0;
+static volatile uint8_t freeCount = 0;
+
+// DMA state
+static int dmaChannel[2] = { -1, -1 };
+static dma_channel_config channelConfig[2];
+static volatile int8_t channelBuffer[2] = { SILENCE, SILENCE };
+static uint32_t silenceWord = 0;
+static volatile uint8_t running = 0;
+static uint8_t irqInstalled = 0;
+static volatile TaskHandle_t waitingTask = NULL;
+static atomic_uint_least8_t wakePending;    // audio_output_wake() came while nobody was waiting
+static volatile uint8_t streaming = 0;      // A stream is feeding us: silence now is an underrun (not idle, paused or draining)
+static audio_output_stats_t outputStats;
+static uint32_t outputRate = 0;
+
+#if AUDIO_OUTPUT_USE_I2S
+static PIO i2sPio;
+static int i2sStateMachine = -1;
+static uint i2sOffset = 0;
+#else
+static uint pwmSlice = 0;
+static uint32_t pwmTop = 0;
+#endif
+
+// Function declarations for internal functions
+static void dma_irq_handler(void);
+static void load_channel(uint8_t index);
+static audio_status_t setup_output(volatile void **target, uint *dreq);
+static void release_output(void);
+static void reset_ring(void);
+static uint8_t sample_rate_valid(uint32_t rate);
+
+audio_status_t audio_output_init(const audio_config_t *config) {
+    if (config == NULL || !sample_rate_valid(config->sample_rate)) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (ringCount != 0) {
+        audio_output_deinit();
+    }
+
+    uint8_t count = config->buffer_count ? config->buffer_count : AUDIO_DEFAULT_BUFFER_COUNT;
+    uint16_t frames = config->buffer_size ? config->buffer_size : AUDIO_DEFAULT_BUFFER_FRAMES;
+    if (count < 2 || count > AUDIO_OUTPUT_MAX_BUFFERS) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        ringBuffers[i] = pvPortMalloc((size_t)frames * sizeof(uint32_t));
+        if (ringBuffers[i] == NULL) {
+            for (uint8_t j = 0; j < i; j++) {
+                vPortFree(ringBuffers[j]);
+                ringBuffers[j] = NULL;
+            }
+            return AUDIO_ERROR_MEMORY;
+        }
+    }
+    ringCount = count;
+    ringFrames = frames;
+    outputRate = config->sample_rate;
+    reset_ring();
+    memset(&outputStats, 0, sizeof(outputStats));
+
+    dmaChannel[0] = dma_claim_unused_channel(false);
+    dmaChannel[1] = dma_claim_unused_channel(false);
+    if (dmaChannel[0] < 0 || dmaChannel[1] < 0) {
+        audio_output_deinit();
+        return AUDIO_ERROR_INIT;
+    }
+
+    volatile void *target = NULL;
+    uint dreq = 0;
+    audio_status_t status = setup_output(&target, &dreq);
+    if (status != AUDIO_OK) {
+        audio_output_deinit();
+        return status;
+    }
+
+    // Two channels chained to each other: A plays, then B, then A again...
+    for (uint8_t i = 0; i < 2; i++) {
+        dma_channel_config c = dma_channel_get_default_config((uint)dmaChannel[i]);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, true);
+        channel_config_set_write_increment(&c, false);
+        channel_config_set_dreq(&c, dreq);
+        channel_config_set_chain_to(&c, (uint)dmaChannel[i ^ 1]);
+        channelConfig[i] = c;
+        dma_channel_configure((uint)dmaChannel[i], &c, target, &silenceWord, ringFrames, false);
+        dma_irqn_set_channel_enabled(AUDIO_OUTPUT_DMA_IRQ, (uint)dmaChannel[i], true);
+    }
+
+    irq_add_shared_handler(DMA_IRQ_0 + AUDIO_OUTPUT_DMA_IRQ, dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0 + AUDIO_OUTPUT_DMA_IRQ, true);
+    irqInstalled = 1;
+    return AUDIO_OK;
+}
+
+void audio_output_deinit(void) {
+    audio_output_stop();
+
+    for (uint8_t i = 0; i < 2; i++) {
+        if (dmaChannel[i] >= 0) {
+            dma_irqn_set_channel_enabled(AUDIO_OUTPUT_DMA_IRQ, (uint)dmaChannel[i], false);
+            dma_channel_unclaim((uint)dmaChannel[i]);
+            dmaChannel[i] = -1;
+        }
+    }
+    if (irqInstalled) {
+        irq_remove_handler(DMA_IRQ_0 + AUDIO_OUTPUT_DMA_IRQ, dma_irq_handler);
+        irqInstalled = 0;
+    }
+    release_output();
+
+    for (uint8_t i = 0; i < ringCount; i++) {
+        vPortFree(ringBuffers[i]);
+        ringBuffers[i] = NULL;
+    }
+    ringCount = 0;
+    ringFrames = 0;
+}
+
+audio_status_t audio_output_start(void) {
+    if (ringCount == 0 || dmaChannel[0] < 0) {
+        return AUDIO_ERROR_INIT;
+    }
+    if (running) {
+        return AUDIO_OK;
+    }
+
+    // Load both channels before running is set, so a cold start isn't counted as an underrun
+    load_channel(0);
+    load_channel(1);
+    running = 1;
+
+#if AUDIO_OUTPUT_USE_I2S
+    pio_sm_set_enabled(i2sPio, (uint)i2sStateMachine, true);
+#else
+    pwm_set_enabled(pwmSlice, true);
+#endif
+    dma_channel_start((uint)dmaChannel[0]);
+    return AUDIO_OK;
+}
+
+void audio_output_stop(void) {
+    if (!running) {
+        return;
+    }
+    running = 0;
+
+    // Aborting can raise a stray completion, so mask it while we do
+    for (uint8_t i = 0; i < 2; i++) {
+        dma_irqn_set_channel_enabled(AUDIO_OUTPUT_DMA_IRQ, (uint)dmaChannel[i], false);
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+        dma_channel_abort((uint)dmaChannel[i]);
+        dma_irqn_acknowledge_channel(AUDIO_OUTPUT_DMA_IRQ, (uint)dmaChannel[i]);
+        dma_irqn_set_channel_enabled(AUDIO_OUTPUT_DMA_IRQ, (uint)dmaChannel[i], true);
+    }
+
+#if AUDIO_OUTPUT_USE_I2S
+    pio_sm_set_enabled(i2sPio, (uint)i2sStateMachine, false);
+    pio_sm_clear_fifos(i2sPio, (uint)i2sStateMachine);
+#else
+    pwm_set_both_levels(pwmSlice, (uint16_t)(silenceWord & 0xFFFF), (uint16_t)(silenceWord & 0xFFFF));
+#endif
+
+    taskENTER_CRITICAL();
+    reset_ring();
+    taskEXIT_CRITICAL();
+
+    if (waitingTask != NULL) {
+        xTaskNotifyGive(waitingTask);
+    }
+}
+
+audio_status_t audio_output_wait(uint32_t timeout_ms) {
+    if (freeCount > 0 && running) {
+        return AUDIO_OK;
+    }
+
+    // A stopped engine hands nothing back, so sleep until someone has new work instead of spinning
+    waitingTask = xTaskGetCurrentTaskHandle();
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_exchange(&wakePending, 0) && (freeCount == 0 || !running)) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    }
+    waitingTask = NULL;
+    return (freeCount > 0) ? AUDIO_OK : AUDIO_ERROR_TIMEOUT;
+}
+
+void audio_output_wake(void) {
+    atomic_store(&wakePending, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    TaskHandle_t task = waitingTask;
+    if (task == NULL) {
+        return;    // The refill task is awake; it sees wakePending before it sleeps again
+    }
+    if (xPortIsInsideInterrupt()) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(task, &woken);
+        portYIELD_FROM_ISR(woken);
+    } else {
+        xTaskNotifyGive(task);
+    }
+}
+
+uint8_t audio_output_drain(void) {
+    streaming = 0;
+    return (ringCount != 0 && freeCount == ringCount) ? 1 : 0;
+}
+
+audio_status_t audio_output_acquire_buffer(int16_t **buffer, uint16_t *frames) {
+    if (buffer == NULL || frames == NULL) {
+        return AUDIO_ERROR_PARAM;
+    }
+    if (ringCount == 0) {
+        return AUDIO_ERROR_INIT;
+    }
+    if (freeCount == 0) {
+        return AUDIO_ERROR_BUSY;
+    }
+
+    // Single producer: writeIndex only moves in commit
+    *buffer = (int16_t *)ringBuffers[writeIndex];
+    *frames = ringFrames;
+    return AUDIO_OK;
+}
+
+audio_status_t audio_output_commit_buffer(uint16_t frames) {
+    if (ringCount == 0) {
+        return AUDIO_ERROR_INIT;
+    }
+    if (freeCount == 0 || frames > ringFrames) {
+        return AUDIO_ERROR_PARAM;
+    }
+
+    uint32_t *words = ringBuffers[writeIndex];
+    if (frames < ringFrames) {
+        memset(&words[frames], 0, (size_t)(ringFrames - frames) * sizeof(uint32_t));
+    }
+
+#if !AUDIO_OUTPUT_USE_I2S
+    // PWM wants unsigned duty levels: one compare word per frame, left in the low half
+    const int16_t *samples = (const int16_t *)words;
+    for (uint16_t i = 0; i < ringFrames; i++) {
+        uint32_t left = ((uint32_t)(samples[2 * i] + 32768) * (pwmTop + 1)) >> 16;
+        uint32_t right = ((uint32_t)(samples[2 * i + 1] + 32768) * (pwmTop + 1)) >> 16;
+        words[i] = left | (right << 16);
+    }
+#endif
+
+    taskENTER_CRITICAL();
+    writeIndex = (uint8_t)((writeIndex + 1) % ringCount);
+    freeCount--;
+    readyCount++;
+    streaming = 1;
+    taskEXIT_CRITICAL();
+    return AUDIO_OK;
+}
+
+uint8_t audio_output_free_buffers(void) {
+    return freeCount;
+}
+
+uint8_t audio_output_queued_buffers(void) {
+    return readyCount;
+}
+
+uint8_t audio_output_is_running(void) {
+    return running;
+}
+
+uint32_t audio_output_get_sample_rate(void) {
+    return outputRate;
+}
+
+void audio_output_get_stats(audio_output_stats_t *stats, uint8_t reset) {
+    taskENTER_CRITICAL();
+    if (stats != NULL) {
+        *stats = outputStats;
+        stats->queued_buffers = readyCount;
+        stats->buffer_count = ringCount;
+        stats->latency_us = (outputRate == 0) ? 0 :
+            (uint32_t)((uint64_t)ringCount * ringFrames * 1000000u / outputRate);
+    }
+    if (reset) {
+        memset(&outputStats, 0, sizeof(outputStats));
+    }
+    taskEXIT_CRITICAL();
+}
+
+// A channel just finished its buffer (its partner is already playing):
+// hand the buffer back and load the channel with the next one in line.
+static void dma_irq_handler(void) {
+    BaseType_t woken = pdFALSE;
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+
+    for (uint8_t i = 0; i < 2; i++) {
+        if (dmaChannel[i] < 0 || !dma_irqn_get_channel_status(AUDIO_OUTPUT_DMA_IRQ, (uint)dmaChannel[i])) {
+            continue;
+        }
+        dma_irqn_acknowledge_channel(AUDIO_OUTPUT_DMA_IRQ, (uint)dmaChannel[i]);
+
+        if (channelBuffer[i] != SILENCE) {
+            freeCount++;
+            outputStats.buffers_played++;
+        }
+        if (running) {
+            load_channel(i);
+        }
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+
+    if (waitingTask != NULL) {
+        vTaskNotifyGiveFromISR(waitingTask, &woken);
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+// Point a (stopped) channel at the next ready buffer, or at the silence word.
+// It starts on its own when its partner finishes.
+static void load_channel(uint8_t index) {
+    uint ch = (uint)dmaChannel[index];
+    const uint32_t *source;
+
+    if (readyCount > 0) {
+        channelBuffer[index] = (int8_t)queueIndex;
+        source = ringBuffers[queueIndex];
+        queueIndex = (uint8_t)((queueIndex + 1) % ringCount);
+        readyCount--;
+        channel_config_set_read_increment(&channelConfig[index], true);
+    } else {
+        // Nothing ready: keep the clocks running on silence for one buffer's time
+        channelBuffer[index] = SILENCE;
+        source = &silenceWord;
+        channel_config_set_read_increment(&channelConfig[index], false);
+        if (running && streaming) {
+            outputStats.underruns++;
+            audio_telemetry_note_underrun();
+        }
+    }
+
+    dma_channel_set_config(ch, &channelConfig[index], false);
+    dma_channel_set_read_addr(ch, source, false);
+    dma_channel_set_trans_count(ch, ringFrames, false);
+}
+
+static audio_status_t setup_output(volatile void **target, uint *dreq) {
+    uint32_t sysHz = clock_get_hz(clk_sys);
+
+#if AUDIO_OUTPUT_USE_I2S
+    i2sPio = AUDIO_I2S_PIO ? pio1 : pio0;
+    i2sStateMachine = pio_claim_unused_sm(i2sPio, false);
+    if (i2sStateMachine < 0) {
+        return AUDIO_ERROR_INIT;
+    }
+    if (!pio_can_add_program(i2sPio, &i2sProgram)) {
+        pio_sm_unclaim(i2sPio, (uint)i2sStateMachine);
+        i2sStateMachine = -1;
+        return AUDIO_ERROR_INIT;
+    }
+    i2sOffset = pio_add_program(i2sPio, &i2sProgram);
+    uint sm = (uint)i2sStateMachine;
+
+    pio_gpio_init(i2sPio, AUDIO_I2S_DATA_PIN);
+    pio_gpio_init(i2sPio, AUDIO_I2S_CLOCK_PIN_BASE);
+    pio_gpio_init(i2sPio, AUDIO_I2S_CLOCK_PIN_BASE + 1);
+
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, i2sOffset, i2sOffset + i2sProgram.length - 1);
+    sm_config_set_sideset(&c, 2, false, false);
+    sm_config_set_out_pins(&c, AUDIO_I2S_DATA_PIN, 1);
+    sm_config_set_sideset_pins(&c, AUDIO_I2S_CLOCK_PIN_BASE);
+    sm_config_set_out_shift(&c, false, true, 32);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+    pio_sm_init(i2sPio, sm, i2sOffset + I2S_ENTRY_POINT, &c);
+    pio_sm_set_consistent_pindirs(i2sPio, sm, AUDIO_I2S_DATA_PIN, 1, true);
+    pio_sm_set_consistent_pindirs(i2sPio, sm, AUDIO_I2S_CLOCK_PIN_BASE, 2, true);
+
+    // 8.8 fixed-point divider so one frame takes exactly 64 PIO cycles
+    uint32_t divider = (uint32_t)(((uint64_t)sysHz * 256u) / ((uint64_t)outputRate * I2S_CYCLES_PER_FRAME));
+    pio_sm_set_clkdiv_int_frac(i2sPio, sm, (uint16_t)(divider >> 8), (uint8_t)(divider & 0xFF));
+
+    silenceWord = 0;
+    *target = &i2sPio->txf[sm];
+    *dreq = pio_get_dreq(i2sPio, sm, true);
+#else
+    gpio_set_function(AUDIO_PWM_PIN, GPIO_FUNC_PWM);
+    gpio_set_function(AUDIO_PWM_PIN + 1, GPIO_FUNC_PWM);
+    pwmSlice = pwm_gpio_to_slice_num(AUDIO_PWM_PIN);
+
+    // One PWM period per sample: the wrap paces the DMA, the period sets the resolution
+    uint32_t period = sysHz / outputRate;
+    uint32_t divider = 1;
+    while (period / divider > 65536u) {
+        divider++;
+    }
+    pwmTop = period / divider - 1;
+
+    pwm_config c = pwm_get_default_config();
+    pwm_config_set_clkdiv_int(&c, divider);
+    pwm_config_set_wrap(&c, (uint16_t)pwmTop);
+    pwm_init(pwmSlice, &c, false);
+
+    uint32_t middle = (pwmTop + 1) / 2;
+    silenceWord = middle | (middle << 16);
+    pwm_set_both_levels(pwmSlice, (uint16_t)middle, (uint16_t)middle);
+
+    *target = &pwm_hw->slice[pwmSlice].cc;
+    *dreq = pwm_get_dreq(pwmSlice);
+#endif
+
+    return AUDIO_OK;
+}
+
+static void release_output(void) {
+#if AUDIO_OUTPUT_USE_I2S
+    if (i2sStateMachine >= 0) {
+        pio_sm_set_enabled(i2sPio, (uint)i2sStateMachine, false);
+        pio_remove_program(i2sPio, &i2sProgram, i2sOffset);
+        pio_sm_unclaim(i2sPio, (uint)i2sStateMachine);
+        i2sStateMachine = -1;
+    }
+#else
+    pwm_set_enabled(pwmSlice, false);
+#endif
+}
+
+static void reset_ring(void) {
+    writeIndex = 0;
+    queueIndex = 0;
+    readyCount = 0;
+    freeCount = ringCount;
+    streaming = 0;
+    channelBuffer[0] = SILENCE;
+    channelBuffer[1] = SILENCE;
+}
+
+static uint8_t sample_rate_valid(uint32_t rate) {
+    return rate >= AUDIO_SAMPLE_RATE_8K && rate <= AUDIO_SAMPLE_RATE_48K;
+}
@@ -0,0 +1,228 @@
+#include "gui/gui_capture.h"
+#include "drivers/display.h"
+#include "fs/fs_manager.h"
+#include "core/system.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include <string.h>
+
+#define BMP_HEADER_SIZE   66      // File header + BITMAPINFOHEADER + RGB565 masks
+
+// Step mode state (written from other tasks, read by guiTask)
+static volatile uint8_t stepMode = 0;
+static volatile uint32_t pendingSteps = 0;
+static uint32_t stepFrameMs = 16;
+static uint32_t virtualTimeMs = 0;
+
+// Frame timing (written by guiTask, read by anyone: only touched in a critical section)
+static gui_frame_stats_t frameStats;
+
+// The lock guiTask draws under
+static SemaphoreHandle_t displayLock = NULL;
+
+// One band of pixels read back from the panel
+static uint16_t bandBuffer[GUI_CAPTURE_BAND_ROWS * GUI_CAPTURE_MAX_WIDTH];
+
+// Function declarations for internal functions
+static gui_status_t file_write(void *context, const void *data, size_t size);
+static void put_u16(uint8_t *p, uint16_t value);
+static void put_u32(uint8_t *p, uint32_t value);
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t size);
+
+void gui_capture_set_display_lock(SemaphoreHandle_t lock) {
+    displayLock = lock;
+}
+
+gui_status_t gui_capture_to_file(const char *path, uint32_t *crc) {
+    if (path == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    fs_file_t file;
+    if (fs_open(path, FS_CREATE_ALWAYS, &file) != FS_OK) {
+        return GUI_ERROR_PARAM;
+    }
+
+    gui_status_t status = gui_capture_to_sink(file_write, file, crc);
+    if (fs_close(file) != FS_OK && status == GUI_OK) {
+        status = GUI_ERROR_PARAM;
+    }
+    return status;
+}
+
+gui_status_t gui_capture_to_sink(gui_capture_write_t write, void *context, uint32_t *crc) {
+    if (write == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    uint16_t width = display_get_width();
+    uint16_t height = display_get_height();
+    if (width == 0 || height == 0) {
+        return GUI_ERROR_NO_DISPLAY;
+    }
+    if (width > GUI_CAPTURE_MAX_WIDTH) {
+        return GUI_ERROR_PARAM;
+    }
+
+    uint32_t rowBytes = (uint32_t)width * 2;
+    uint32_t paddedRow = (rowBytes + 3) & ~3u;
+    uint32_t imageSize = paddedRow * height;
+
+    // Top-down 16-bit BMP with RGB565 bit masks
+    uint8_t header[BMP_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    header[0] = 'B';
+    header[1] = 'M';
+    put_u32(header + 2, BMP_HEADER_SIZE + imageSize);
+    put_u32(header + 10, BMP_HEADER_SIZE);
+    put_u32(header + 14, 40);
+    put_u32(header + 18, width);
+    put_u32(header + 22, (uint32_t)(-(int32_t)height));
+    put_u16(header + 26, 1);
+    put_u16(header + 28, 16);
+    put_u32(header + 30, 3);            // BI_BITFIELDS
+    put_u32(header + 34, imageSize);
+    put_u32(header + 38, 2835);         // 72 DPI
+    put_u32(header + 42, 2835);
+    put_u32(header + 54, 0xF800);
+    put_u32(header + 58, 0x07E0);
+    put_u32(header + 62, 0x001F);
+
+    gui_status_t status = write(context, header, sizeof(header));
+    uint32_t checksum = 0xFFFFFFFFu;
+    static const uint8_t padding[3] = { 0, 0, 0 };
+
+    // One lock for the whole picture: no frame is drawn between two bands
+    if (displayLock != NULL) {
+        xSemaphoreTake(displayLock, portMAX_DELAY);
+    }
+    for (uint16_t y = 0; y < height && status == GUI_OK; y += GUI_CAPTURE_BAND_ROWS) {
+        uint16_t rows = (uint16_t)((height - y < GUI_CAPTURE_BAND_ROWS) ? (height - y) : GUI_CAPTURE_BAND_ROWS);
+        if (display_read_rect(0, y, width, rows, (uint8_t *)bandBuffer) != DISPLAY_OK) {
+            status = GUI_ERROR_NO_DISPLAY;
+            break;
+        }
+
+        checksum = crc32_update(checksum, (const uint8_t *)bandBuffer, rowBytes * rows);
+
+        if (paddedRow == rowBytes) {
+            status = write(context, bandBuffer, rowBytes * rows);
+        } else {
+            for (uint16_t r = 0; r < rows && status == GUI_OK; r++) {
+                status = write(context, bandBuffer + (uint32_t)r * width, rowBytes);
+                if (status == GUI_OK) {
+                    status = write(context, padding, paddedRow - rowBytes);
+                }
+            }
+        }
+    }
+    if (displayLock != NULL) {
+        xSemaphoreGive(displayLock);
+    }
+
+    if (crc != NULL) {
+        *crc = ~checksum;
+    }
+    return status;
+}
+
+void gui_capture_set_step_mode(uint8_t enable, uint32_t frame_ms) {
+    taskENTER_CRITICAL();
+    stepFrameMs = (frame_ms == 0) ? 16 : frame_ms;
+    if (enable && !stepMode) {
+        // Continue the pretend clock from where the real one is
+        virtualTimeMs = system_get_uptime();
+    }
+    pendingSteps = 0;
+    stepMode = enable ? 1 : 0;
+    taskEXIT_CRITICAL();
+}
+
+void gui_capture_step(uint32_t frames) {
+    taskENTER_CRITICAL();
+    pendingSteps += frames;
+    taskEXIT_CRITICAL();
+}
+
+uint8_t gui_capture_frame_due(void) {
+    if (!stepMode) {
+        return 1;
+    }
+
+    uint8_t due = 0;
+    taskENTER_CRITICAL();
+    if (pendingSteps > 0) {
+        pendingSteps--;
+        virtualTimeMs += stepFrameMs;
+        due = 1;
+    }
+    taskEXIT_CRITICAL();
+    return due;
+}
+
+uint8_t gui_capture_steps_done(void) {
+    return pendingSteps == 0;
+}
+
+uint32_t gui_capture_get_time_ms(void) {
+    return stepMode ? virtualTimeMs : system_get_uptime();
+}
+
+void gui_capture_record_frame(uint32_t render_us) {
+    taskENTER_CRITICAL();
+    frameStats.frames++;
+    frameStats.last_us = render_us;
+    frameStats.total_us += render_us;
+    if (render_us > frameStats.max_us) {
+        frameStats.max_us = render_us;
+    }
+    taskEXIT_CRITICAL();
+}
+
+void gui_capture_get_frame_stats(gui_frame_stats_t *stats, uint8_t reset) {
+    taskENTER_CRITICAL();
+    if (stats != NULL) {
+        *stats = frameStats;
+    }
+    if (reset) {
+        memset(&frameStats, 0, sizeof(frameStats));
+    }
+    taskEXIT_CRITICAL();
+}
+
+static gui_status_t file_write(void *context, const void *data, size_t size) {
+    size_t written = 0;
+    if (fs_write((fs_file_t)context, data, size, &written) != FS_OK || written != size) {
+        return GUI_ERROR_MEMORY;
+    }
+    return GUI_OK;
+}
+
+static void put_u16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+// CRC-32 (IEEE), half a byte at a time to keep the table at 16 entries
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t size) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return crc;
+}
@@ -0,0 +1,374 @@
+#include "gui/gui_focus.h"
+#include "gui/gui_manager.h"
+#include "os_config.h"
+#include <stdint.h>
+#include <string.h>
+
+// Node indices are stored in uint8_t; two values are reserved for the hash table
+#define FOCUS_NONE          0xFF
+#define FOCUS_TOMBSTONE     0xFE
+#define FOCUS_HASH_SIZE     (GUI_FOCUS_MAX_NODES * 2)
+#define FOCUS_HASH_MASK     (FOCUS_HASH_SIZE - 1)
+#define FOCUS_SPATIAL_DIRS  4
+#define FOCUS_SCORE_NONE    UINT32_MAX
+
+_Static_assert(GUI_FOCUS_MAX_NODES < FOCUS_TOMBSTONE, "GUI_FOCUS_MAX_NODES must fit in a uint8_t index");
+_Static_assert((GUI_FOCUS_MAX_NODES & (GUI_FOCUS_MAX_NODES - 1)) == 0, "GUI_FOCUS_MAX_NODES must be a power of two");
+
+typedef struct {
+    gui_element_t element;
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint8_t neighbor[FOCUS_SPATIAL_DIRS];   // Best candidate per direction (node index)
+    uint32_t score[FOCUS_SPATIAL_DIRS];     // Score of that candidate, lower is closer
+    uint8_t stale;                          // Bitmask of directions that must be rescanned
+    uint8_t next;                           // Next/prev order (creation order)
+    uint8_t prev;
+    uint8_t used;
+} focus_node_t;
+
+// Graph state for the active screen
+static focus_node_t nodes[GUI_FOCUS_MAX_NODES];
+static uint8_t hashTable[FOCUS_HASH_SIZE];
+static uint8_t tombstoneCount = 0;
+static uint8_t orderHead = FOCUS_NONE;
+static uint8_t orderTail = FOCUS_NONE;
+static gui_element_t graphScreen = NULL;
+
+// Function declarations for internal functions
+static uint32_t hash_element(gui_element_t element);
+static uint8_t find_node(gui_element_t element);
+static uint8_t insert_node(gui_element_t element);
+static void rebuild_hash(void);
+static uint32_t focus_score(const focus_node_t *from, const focus_node_t *to, uint8_t dir);
+static void recompute_direction(uint8_t index, uint8_t dir);
+
+void gui_focus_graph_reset(gui_element_t screen) {
+    memset(nodes, 0, sizeof(nodes));
+    memset(hashTable, FOCUS_NONE, sizeof(hashTable));
+    tombstoneCount = 0;
+    orderHead = FOCUS_NONE;
+    orderTail = FOCUS_NONE;
+    graphScreen = screen;
+}
+
+gui_element_t gui_focus_graph_screen(void) {
+    return graphScreen;
+}
+
+gui_status_t gui_focus_graph_update(gui_element_t element, int16_t x, int16_t y, uint16_t width, uint16_t height) {
+    if (element == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    uint8_t index = find_node(element);
+    if (index == FOCUS_NONE) {
+        index = insert_node(element);
+        if (index == FOCUS_NONE) {
+            return GUI_ERROR_MEMORY;
+        }
+    } else {
+        // The node moved: every link that pointed at it may no longer be the best
+        for (uint8_t j = 0; j < GUI_FOCUS_MAX_NODES; j++) {
+            if (!nodes[j].used || j == index) {
+                continue;
+            }
+            for (uint8_t d = 0; d < FOCUS_SPATIAL_DIRS; d++) {
+                if (nodes[j].neighbor[d] == index) {
+                    nodes[j].stale |= (uint8_t)(1u << d);
+                }
+            }
+        }
+    }
+
+    focus_node_t *node = &nodes[index];
+    node->x = x;
+    node->y = y;
+    node->width = width;
+    node->height = height;
+    for (uint8_t d = 0; d < FOCUS_SPATIAL_DIRS; d++) {
+        node->neighbor[d] = FOCUS_NONE;
+        node->score[d] = FOCUS_SCORE_NONE;
+    }
+    node->stale = 0;
+
+    // One pass rebuilds this node's links and offers it to every other node
+    for (uint8_t j = 0; j < GUI_FOCUS_MAX_NODES; j++) {
+        if (!nodes[j].used || j == index) {
+            continue;
+        }
+        focus_node_t *other = &nodes[j];
+        for (uint8_t d = 0; d < FOCUS_SPATIAL_DIRS; d++) {
+            uint32_t score = focus_score(node, other, d);
+            if (score < node->score[d]) {
+                node->score[d] = score;
+                node->neighbor[d] = j;
+            }
+
+            if (other->stale & (1u << d)) {
+                continue; // Will be rescanned when followed
+            }
+            score = focus_score(other, node, d);
+            if (score < other->score[d]) {
+                other->score[d] = score;
+                other->neighbor[d] = index;
+            }
+        }
+    }
+
+    return GUI_OK;
+}
+
+gui_status_t gui_focus_graph_remove(gui_element_t element) {
+    uint8_t index = find_node(element);
+    if (index == FOCUS_NONE) {
+        return GUI_ERROR_PARAM;
+    }
+
+    for (uint8_t j = 0; j < GUI_FOCUS_MAX_NODES; j++) {
+        if (!nodes[j].used || j == index) {
+            continue;
+        }
+        for (uint8_t d = 0; d < FOCUS_SPATIAL_DIRS; d++) {
+            if (nodes[j].neighbor[d] == index) {
+                nodes[j].neighbor[d] = FOCUS_NONE;
+                nodes[j].score[d] = FOCUS_SCORE_NONE;
+                nodes[j].stale |= (uint8_t)(1u << d);
+            }
+        }
+    }
+
+    // Unlink from the next/prev order
+    focus_node_t *node = &nodes[index];
+    if (node->prev != FOCUS_NONE) {
+        nodes[node->prev].next = node->next;
+    } else {
+        orderHead = node->next;
+    }
+    if (node->next != FOCUS_NONE) {
+        nodes[node->next].prev = node->prev;
+    } else {
+        orderTail = node->prev;
+    }
+
+    // Leave a tombstone so later probes keep walking past this slot
+    uint32_t slot = hash_element(element);
+    for (uint32_t probe = 0; probe < FOCUS_HASH_SIZE; probe++) {
+        if (hashTable[slot] == index) {
+            hashTable[slot] = FOCUS_TOMBSTONE;
+            tombstoneCount++;
+            break;
+        }
+        slot = (slot + 1) & FOCUS_HASH_MASK;
+    }
+
+    memset(node, 0, sizeof(*node));
+    return GUI_OK;
+}
+
+gui_element_t gui_focus_graph_neighbor(gui_element_t element, gui_focus_dir_t dir) {
+    uint8_t index = find_node(element);
+    if (index == FOCUS_NONE || dir >= GUI_FOCUS_DIR_COUNT) {
+        return NULL;
+    }
+
+    focus_node_t *node = &nodes[index];
+    uint8_t target;
+
+    if (dir == GUI_FOCUS_NEXT) {
+        target = (node->next != FOCUS_NONE) ? node->next : orderHead;
+    } else if (dir == GUI_FOCUS_PREV) {
+        target = (node->prev != FOCUS_NONE) ? node->prev : orderTail;
+    } else {
+        if (node->stale & (1u << dir)) {
+            recompute_direction(index, (uint8_t)dir);
+        }
+        target = node->neighbor[dir];
+    }
+
+    if (target == FOCUS_NONE || target == index) {
+        return NULL;
+    }
+    return nodes[target].element;
+}
+
+gui_element_t gui_focus_graph_first(void) {
+    return (orderHead != FOCUS_NONE) ? nodes[orderHead].element : NULL;
+}
+
+gui_status_t gui_focus_move(gui_focus_dir_t dir) {
+    if (dir >= GUI_FOCUS_DIR_COUNT) {
+        return GUI_ERROR_PARAM;
+    }
+
+    // A map left over from another screen would send the spotlight off the page
+    if (graphScreen == NULL || graphScreen != gui_get_active_screen()) {
+        return GUI_ERROR_PARAM;
+    }
+
+    gui_element_t current = gui_get_focused_element();
+    gui_element_t target = (current != NULL) ? gui_focus_graph_neighbor(current, dir) : NULL;
+
+    // Nothing focused yet (or focus is outside the graph): start at the front of the line
+    if (target == NULL && (current == NULL || find_node(current) == FOCUS_NONE)) {
+        target = gui_focus_graph_first();
+    }
+    if (target == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    return gui_focus_element(target);
+}
+
+static uint32_t hash_element(gui_element_t element) {
+    uint32_t h = (uint32_t)((uintptr_t)element >> 2) * 2654435761u;
+    return (h ^ (h >> 16)) & FOCUS_HASH_MASK;
+}
+
+static uint8_t find_node(gui_element_t element) {
+    if (element == NULL) {
+        return FOCUS_NONE;
+    }
+
+    uint32_t slot = hash_element(element);
+    for (uint32_t probe = 0; probe < FOCUS_HASH_SIZE; probe++) {
+        uint8_t entry = hashTable[slot];
+        if (entry == FOCUS_NONE) {
+            return FOCUS_NONE;
+        }
+        if (entry != FOCUS_TOMBSTONE && nodes[entry].element == element) {
+            return entry;
+        }
+        slot = (slot + 1) & FOCUS_HASH_MASK;
+    }
+    return FOCUS_NONE;
+}
+
+static uint8_t insert_node(gui_element_t element) {
+    uint8_t index = FOCUS_NONE;
+    for (uint8_t i = 0; i < GUI_FOCUS_MAX_NODES; i++) {
+        if (!nodes[i].used) {
+            index = i;
+            break;
+        }
+    }
+    if (index == FOCUS_NONE) {
+        return FOCUS_NONE;
+    }
+
+    if (tombstoneCount >= GUI_FOCUS_MAX_NODES / 2) {
+        rebuild_hash();
+    }
+
+    uint32_t slot = hash_element(element);
+    while (hashTable[slot] != FOCUS_NONE && hashTable[slot] != FOCUS_TOMBSTONE) {
+        slot = (slot + 1) & FOCUS_HASH_MASK;
+    }
+    if (hashTable[slot] == FOCUS_TOMBSTONE) {
+        tombstoneCount--;
+    }
+    hashTable[slot] = index;
+
+    focus_node_t *node = &nodes[index];
+    node->element = element;
+    node->used = 1;
+    node->next = FOCUS_NONE;
+    node->prev = orderTail;
+    if (orderTail != FOCUS_NONE) {
+        nodes[orderTail].next = index;
+    } else {
+        orderHead = index;
+    }
+    orderTail = index;
+
+    return index;
+}
+
+static void rebuild_hash(void) {
+    memset(hashTable, FOCUS_NONE, sizeof(hashTable));
+    tombstoneCount = 0;
+
+    for (uint8_t i = 0; i < GUI_FOCUS_MAX_NODES; i++) {
+        if (!nodes[i].used) {
+            continue;
+        }
+        uint32_t slot = hash_element(nodes[i].element);
+        while (hashTable[slot] != FOCUS_NONE) {
+            slot = (slot + 1) & FOCUS_HASH_MASK;
+        }
+        hashTable[slot] = i;
+    }
+}
+
+// Lower is better. Candidates must lie beyond the center of the source in the
+// requested direction; overlap on the cross axis beats a shorter but diagonal jump.
+static uint32_t focus_score(const focus_node_t *from, const focus_node_t *to, uint8_t dir) {
+    int32_t fromLeft = from->x, fromRight = from->x + from->width;
+    int32_t fromTop = from->y, fromBottom = from->y + from->height;
+    int32_t toLeft = to->x, toRight = to->x + to->width;
+    int32_t toTop = to->y, toBottom = to->y + to->height;
+
+    // Doubled centers keep everything in integers
+    int32_t fromCx = fromLeft + fromRight, fromCy = fromTop + fromBottom;
+    int32_t toCx = toLeft + toRight, toCy = toTop + toBottom;
+
+    int32_t major, gap, offset;
+    switch (dir) {
+        case GUI_FOCUS_UP:
+            if (toCy >= fromCy) return FOCUS_SCORE_NONE;
+            major = fromTop - toBottom;
+            gap = (toLeft > fromRight) ? toLeft - fromRight : (fromLeft > toRight) ? fromLeft - toRight : 0;
+            offset = toCx - fromCx;
+            break;
+        case GUI_FOCUS_DOWN:
+            if (toCy <= fromCy) return FOCUS_SCORE_NONE;
+            major = toTop - fromBottom;
+            gap = (toLeft > fromRight) ? toLeft - fromRight : (fromLeft > toRight) ? fromLeft - toRight : 0;
+            offset = toCx - fromCx;
+            break;
+        case GUI_FOCUS_LEFT:
+            if (toCx >= fromCx) return FOCUS_SCORE_NONE;
+            major = fromLeft - toRight;
+            gap = (toTop > fromBottom) ? toTop - fromBottom : (fromTop > toBottom) ? fromTop - toBottom : 0;
+            offset = toCy - fromCy;
+            break;
+        case GUI_FOCUS_RIGHT:
+            if (toCx <= fromCx) return FOCUS_SCORE_NONE;
+            major = toLeft - fromRight;
+            gap = (toTop > fromBottom) ? toTop - fromBottom : (fromTop > toBottom) ? fromTop - toBottom : 0;
+            offset = toCy - fromCy;
+            break;
+        default:
+            return FOCUS_SCORE_NONE;
+    }
+
+    if (major < 0) {
+        major = 0; // Overlapping on the travel axis counts as touching
+    }
+    if (offset < 0) {
+        offset = -offset;
+    }
+
+    return (uint32_t)major * 4u + (uint32_t)gap * 8u + (uint32_t)offset / 2u;
+}
+
+static void recompute_direction(uint8_t index, uint8_t dir) {
+    focus_node_t *node = &nodes[index];
+    node->neighbor[dir] = FOCUS_NONE;
+    node->score[dir] = FOCUS_SCORE_NONE;
+
+    for (uint8_t j = 0; j < GUI_FOCUS_MAX_NODES; j++) {
+        if (!nodes[j].used || j == index) {
+            continue;
+        }
+        uint32_t score = focus_score(node, &nodes[j], dir);
+        if (score < node->score[dir]) {
+            node->score[dir] = score;
+            node->neighbor[dir] = j;
+        }
+    }
+
+    node->stale &= (uint8_t)~(1u << dir);
+}
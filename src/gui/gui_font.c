@@ -0,0 +1,492 @@
+#include "gui/gui_font.h"
+#include "fs/fs_manager.h"
+#include "drivers/display.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include <string.h>
+
+#define FONT_MAGIC            "PFNT"
+#define FONT_VERSION          1
+#define FONT_HEADER_SIZE      16
+#define FONT_DIR_ENTRY_SIZE   12
+#define FONT_GLYPH_DESC_SIZE  8
+#define FONT_PAGE_SHIFT       6      // 64 codepoints per page
+#define FONT_PAGE_MASK_SIZE   8
+#define FONT_MAX_CELL_WIDTH   64     // Wider glyph cells are clipped
+#define UTF8_REPLACEMENT      0xFFFD
+
+typedef struct {
+    uint8_t used;
+    const uint8_t *flash;        // Whole font in XIP flash, or NULL for a file font
+    uint32_t flashSize;          // Bytes of the flash image
+    fs_file_t file;
+    uint8_t bpp;
+    uint8_t lineHeight;
+    uint8_t baseline;
+    uint16_t pageCount;
+    uint32_t fallback;
+    const uint8_t *directory;    // page_count directory entries (flash or RAM copy)
+    uint8_t *ramDirectory;       // Owned copy for file fonts
+    uint16_t *pageHash;          // Directory index + 1, 0 = empty slot
+    uint16_t hashMask;
+} font_t;
+
+typedef struct {
+    uint8_t font;
+    uint16_t dirIndex;
+    uint8_t valid;
+    uint32_t lastUsed;
+    uint32_t size;               // Bytes of data that belong to the page
+    uint8_t data[GUI_FONT_PAGE_MAX_BYTES];
+} page_slot_t;
+
+// Font state
+static font_t fonts[GUI_FONT_MAX_FONTS];
+static page_slot_t pageSlots[GUI_FONT_PAGE_CACHE_SLOTS];
+static uint32_t pageUseCounter = 0;
+static uint16_t cellLine[FONT_MAX_CELL_WIDTH];
+
+// Function declarations for internal functions
+static uint16_t read_u16(const uint8_t *p);
+static uint32_t read_u32(const uint8_t *p);
+static uint64_t read_u64(const uint8_t *p);
+static gui_status_t font_setup(font_t *f, const uint8_t *header);
+static gui_status_t build_page_hash(font_t *f);
+static int32_t find_page(const font_t *f, uint16_t page);
+static const uint8_t *load_page(uint8_t fontId, font_t *f, uint16_t dirIndex, uint32_t *pageSize);
+static uint8_t lookup_glyph(uint8_t fontId, font_t *f, uint32_t codepoint, gui_glyph_t *glyph);
+static uint8_t glyph_level(const gui_glyph_t *glyph, int32_t col, int32_t row);
+static uint16_t to_rgb565(display_color_t color);
+
+uint32_t gui_utf8_next(const char **text) {
+    const uint8_t *p = (const uint8_t *)*text;
+    uint32_t cp;
+    uint8_t extra;
+
+    if (p[0] == 0) {
+        return 0;
+    }
+
+    if (p[0] < 0x80) {
+        *text += 1;
+        return p[0];
+    } else if ((p[0] & 0xE0) == 0xC0) {
+        cp = p[0] & 0x1F;
+        extra = 1;
+    } else if ((p[0] & 0xF0) == 0xE0) {
+        cp = p[0] & 0x0F;
+        extra = 2;
+    } else if ((p[0] & 0xF8) == 0xF0) {
+        cp = p[0] & 0x07;
+        extra = 3;
+    } else {
+        *text += 1;
+        return UTF8_REPLACEMENT;
+    }
+
+    for (uint8_t i = 1; i <= extra; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            *text += i; // Resynchronize on the offending byte
+            return UTF8_REPLACEMENT;
+        }
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    *text += extra + 1;
+
+    // Reject overlong forms, surrogates and out-of-range values
+    static const uint32_t minimum[4] = { 0, 0x80, 0x800, 0x10000 };
+    if (cp < minimum[extra] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        return UTF8_REPLACEMENT;
+    }
+    return cp;
+}
+
+gui_status_t gui_font_register_flash(uint8_t font, const uint8_t *data, uint32_t size) {
+    if (font >= GUI_FONT_MAX_FONTS || data == NULL || size < FONT_HEADER_SIZE) {
+        return GUI_ERROR_PARAM;
+    }
+
+    gui_font_unregister(font);
+    font_t *f = &fonts[font];
+
+    gui_status_t status = font_setup(f, data);
+    if (status != GUI_OK) {
+        return status;
+    }
+    if (FONT_HEADER_SIZE + (uint32_t)f->pageCount * FONT_DIR_ENTRY_SIZE > size) {
+        return GUI_ERROR_PARAM;
+    }
+
+    f->flash = data;
+    f->flashSize = size;
+    f->directory = data + FONT_HEADER_SIZE;
+    status = build_page_hash(f);
+    if (status != GUI_OK) {
+        gui_font_unregister(font);
+        return status;
+    }
+    f->used = 1;
+    return GUI_OK;
+}
+
+gui_status_t gui_font_register_file(uint8_t font, const char *path) {
+    if (font >= GUI_FONT_MAX_FONTS || path == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    gui_font_unregister(font);
+    font_t *f = &fonts[font];
+
+    fs_file_t file;
+    if (fs_open(path, FS_READ, &file) != FS_OK) {
+        return GUI_ERROR_PARAM;
+    }
+
+    uint8_t header[FONT_HEADER_SIZE];
+    size_t got = 0;
+    gui_status_t status = GUI_ERROR_PARAM;
+    if (fs_read(file, header, sizeof(header), &got) == FS_OK && got == sizeof(header)) {
+        status = font_setup(f, header);
+    }
+
+    if (status == GUI_OK) {
+        // The directory stays in RAM; pages are read when first needed
+        size_t dirBytes = (size_t)f->pageCount * FONT_DIR_ENTRY_SIZE;
+        f->ramDirectory = pvPortMalloc(dirBytes);
+        if (f->ramDirectory == NULL) {
+            status = GUI_ERROR_MEMORY;
+        } else if (fs_read(file, f->ramDirectory, dirBytes, &got) != FS_OK || got != dirBytes) {
+            status = GUI_ERROR_PARAM;
+        } else {
+            f->directory = f->ramDirectory;
+            status = build_page_hash(f);
+        }
+    }
+
+    if (status != GUI_OK) {
+        fs_close(file);
+        gui_font_unregister(font);
+        return status;
+    }
+
+    f->file = file;
+    f->used = 1;
+    return GUI_OK;
+}
+
+void gui_font_unregister(uint8_t font) {
+    if (font >= GUI_FONT_MAX_FONTS) {
+        return;
+    }
+
+    font_t *f = &fonts[font];
+    if (f->file != NULL) {
+        fs_close(f->file);
+    }
+    if (f->ramDirectory != NULL) {
+        vPortFree(f->ramDirectory);
+    }
+    if (f->pageHash != NULL) {
+        vPortFree(f->pageHash);
+    }
+    memset(f, 0, sizeof(*f));
+
+    for (uint8_t i = 0; i < GUI_FONT_PAGE_CACHE_SLOTS; i++) {
+        if (pageSlots[i].valid && pageSlots[i].font == font) {
+            pageSlots[i].valid = 0;
+        }
+    }
+}
+
+gui_status_t gui_font_get_glyph(uint8_t font, uint32_t codepoint, gui_glyph_t *glyph) {
+    if (font >= GUI_FONT_MAX_FONTS || !fonts[font].used || glyph == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    font_t *f = &fonts[font];
+    if (lookup_glyph(font, f, codepoint, glyph)) {
+        return GUI_OK;
+    }
+    if (codepoint != f->fallback && lookup_glyph(font, f, f->fallback, glyph)) {
+        return GUI_OK;
+    }
+    return GUI_ERROR_PARAM;
+}
+
+gui_status_t gui_font_measure(uint8_t font, const char *text, uint16_t *width, uint16_t *height) {
+    if (font >= GUI_FONT_MAX_FONTS || !fonts[font].used || text == NULL || width == NULL || height == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    uint32_t total = 0;
+    uint32_t cp;
+    gui_glyph_t glyph;
+    while ((cp = gui_utf8_next(&text)) != 0) {
+        if (gui_font_get_glyph(font, cp, &glyph) == GUI_OK) {
+            total += glyph.advance;
+        }
+    }
+
+    *width = (total > UINT16_MAX) ? UINT16_MAX : (uint16_t)total;
+    *height = fonts[font].lineHeight;
+    return GUI_OK;
+}
+
+gui_status_t gui_font_draw_text(uint16_t x, uint16_t y, const char *text, uint8_t font, display_color_t color, display_color_t bg_color) {
+    if (font >= GUI_FONT_MAX_FONTS || !fonts[font].used || text == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    // Every depth is folded onto 16 shades, blended once per call
+    uint16_t palette[16];
+    for (uint32_t level = 0; level < 16; level++) {
+        uint32_t a = level * 17u;
+        display_color_t mixed;
+        mixed.r = (uint8_t)((bg_color.r * (255u - a) + color.r * a) / 255u);
+        mixed.g = (uint8_t)((bg_color.g * (255u - a) + color.g * a) / 255u);
+        mixed.b = (uint8_t)((bg_color.b * (255u - a) + color.b * a) / 255u);
+        palette[level] = to_rgb565(mixed);
+    }
+
+    uint8_t lineHeight = fonts[font].lineHeight;
+    uint32_t cp;
+    gui_glyph_t glyph;
+
+    while ((cp = gui_utf8_next(&text)) != 0) {
+        if (gui_font_get_glyph(font, cp, &glyph) != GUI_OK) {
+            continue;
+        }
+
+        uint16_t cell = (glyph.advance > FONT_MAX_CELL_WIDTH) ? FONT_MAX_CELL_WIDTH : glyph.advance;
+        uint8_t shift = (glyph.bpp >= 4) ? (uint8_t)(glyph.bpp - 4) : 0;
+        uint8_t scale = (glyph.bpp == 1) ? 15 : (glyph.bpp == 2) ? 5 : 1;
+
+        for (uint8_t row = 0; row < lineHeight; row++) {
+            for (uint16_t col = 0; col < cell; col++) {
+                uint8_t level = glyph_level(&glyph, (int32_t)col - glyph.x_offset, (int32_t)row - glyph.y_offset);
+                cellLine[col] = palette[(uint8_t)((level >> shift) * scale)];
+            }
+            display_draw_bitmap(x, (uint16_t)(y + row), cell, 1, (const uint8_t *)cellLine);
+        }
+        x = (uint16_t)(x + glyph.advance);
+    }
+
+    return GUI_OK;
+}
+
+void gui_font_rasterize(const char *text, uint8_t font, uint8_t *coverage, uint16_t width, uint16_t height) {
+    if (font >= GUI_FONT_MAX_FONTS || !fonts[font].used || text == NULL || coverage == NULL) {
+        return;
+    }
+
+    int32_t penX = 0;
+    uint32_t cp;
+    gui_glyph_t glyph;
+
+    while ((cp = gui_utf8_next(&text)) != 0 && penX < width) {
+        if (gui_font_get_glyph(font, cp, &glyph) != GUI_OK) {
+            continue;
+        }
+
+        uint8_t maxLevel = (uint8_t)((1u << glyph.bpp) - 1);
+        for (int32_t row = 0; row < glyph.height; row++) {
+            int32_t py = row + glyph.y_offset;
+            if (py < 0 || py >= height) {
+                continue;
+            }
+            for (int32_t col = 0; col < glyph.width; col++) {
+                int32_t px = penX + glyph.x_offset + col;
+                if (px < 0 || px >= width) {
+                    continue;
+                }
+                uint8_t level = glyph_level(&glyph, col, row);
+                if (level != 0) {
+                    coverage[py * width + px] = (uint8_t)((level * 255u) / maxLevel);
+                }
+            }
+        }
+        penX += glyph.advance;
+    }
+}
+
+static uint16_t read_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t read_u64(const uint8_t *p) {
+    return (uint64_t)read_u32(p) | ((uint64_t)read_u32(p + 4) << 32);
+}
+
+static gui_status_t font_setup(font_t *f, const uint8_t *header) {
+    if (memcmp(header, FONT_MAGIC, 4) != 0 || header[4] != FONT_VERSION) {
+        return GUI_ERROR_PARAM;
+    }
+
+    uint8_t bpp = header[5];
+    if (bpp != 1 && bpp != 2 && bpp != 4 && bpp != 8) {
+        return GUI_ERROR_PARAM;
+    }
+
+    f->bpp = bpp;
+    f->lineHeight = header[6];
+    f->baseline = header[7];
+    f->pageCount = read_u16(header + 8);
+    f->fallback = read_u32(header + 12);
+
+    if (f->pageCount == 0 || f->pageCount > GUI_FONT_MAX_PAGES) {
+        return GUI_ERROR_PARAM;
+    }
+    return GUI_OK;
+}
+
+static gui_status_t build_page_hash(font_t *f) {
+    // At most half full, so probes stay short
+    uint32_t size = 1;
+    while (size < (uint32_t)f->pageCount * 2) {
+        size <<= 1;
+    }
+
+    f->pageHash = pvPortMalloc(size * sizeof(uint16_t));
+    if (f->pageHash == NULL) {
+        return GUI_ERROR_MEMORY;
+    }
+    memset(f->pageHash, 0, size * sizeof(uint16_t));
+    f->hashMask = (uint16_t)(size - 1);
+
+    for (uint16_t i = 0; i < f->pageCount; i++) {
+        uint16_t page = read_u16(f->directory + (uint32_t)i * FONT_DIR_ENTRY_SIZE);
+        uint32_t slot = ((uint32_t)page * 2654435761u >> 16) & f->hashMask;
+        while (f->pageHash[slot] != 0) {
+            slot = (slot + 1) & f->hashMask;
+        }
+        f->pageHash[slot] = (uint16_t)(i + 1);
+    }
+    return GUI_OK;
+}
+
+static int32_t find_page(const font_t *f, uint16_t page) {
+    uint32_t slot = ((uint32_t)page * 2654435761u >> 16) & f->hashMask;
+    for (;;) {
+        uint16_t entry = f->pageHash[slot];
+        if (entry == 0) {
+            return -1;
+        }
+        if (read_u16(f->directory + (uint32_t)(entry - 1) * FONT_DIR_ENTRY_SIZE) == page) {
+            return entry - 1;
+        }
+        slot = (slot + 1) & f->hashMask;
+    }
+}
+
+// The page's bytes and how many there are; NULL if the directory entry points outside the font
+static const uint8_t *load_page(uint8_t fontId, font_t *f, uint16_t dirIndex, uint32_t *pageSize) {
+    const uint8_t *entry = f->directory + (uint32_t)dirIndex * FONT_DIR_ENTRY_SIZE;
+    uint32_t offset = read_u32(entry + 4);
+    uint32_t size = read_u32(entry + 8);
+    if (size < FONT_PAGE_MASK_SIZE) {
+        return NULL;
+    }
+
+    if (f->flash != NULL) {
+        if (offset > f->flashSize || size > f->flashSize - offset) {
+            return NULL;
+        }
+        *pageSize = size;
+        return f->flash + offset; // Executed in place, nothing to load
+    }
+
+    page_slot_t *slot = NULL;
+    for (uint8_t i = 0; i < GUI_FONT_PAGE_CACHE_SLOTS; i++) {
+        if (pageSlots[i].valid && pageSlots[i].font == fontId && pageSlots[i].dirIndex == dirIndex) {
+            pageSlots[i].lastUsed = ++pageUseCounter;
+            *pageSize = pageSlots[i].size;
+            return pageSlots[i].data;
+        }
+        if (slot == NULL || !pageSlots[i].valid ||
+            (slot->valid && pageSlots[i].lastUsed < slot->lastUsed)) {
+            slot = &pageSlots[i];
+        }
+    }
+
+    if (size > GUI_FONT_PAGE_MAX_BYTES) {
+        return NULL;
+    }
+
+    size_t got = 0;
+    slot->valid = 0;
+    if (fs_seek(f->file, (int32_t)offset, FS_SEEK_SET) != FS_OK ||
+        fs_read(f->file, slot->data, size, &got) != FS_OK || got != size) {
+        return NULL;
+    }
+
+    slot->font = fontId;
+    slot->dirIndex = dirIndex;
+    slot->size = size;
+    slot->valid = 1;
+    slot->lastUsed = ++pageUseCounter;
+    *pageSize = size;
+    return slot->data;
+}
+
+static uint8_t lookup_glyph(uint8_t fontId, font_t *f, uint32_t codepoint, gui_glyph_t *glyph) {
+    int32_t dirIndex = find_page(f, (uint16_t)(codepoint >> FONT_PAGE_SHIFT));
+    if (dirIndex < 0) {
+        return 0;
+    }
+
+    uint32_t size = 0;
+    const uint8_t *page = load_page(fontId, f, (uint16_t)dirIndex, &size);
+    if (page == NULL) {
+        return 0;
+    }
+
+    uint64_t mask = read_u64(page);
+    uint32_t bit = codepoint & ((1u << FONT_PAGE_SHIFT) - 1);
+    if (!((mask >> bit) & 1u)) {
+        return 0;
+    }
+
+    // Rank of the glyph among the page's present glyphs
+    uint32_t rank = (uint32_t)__builtin_popcountll(mask & ((1ull << bit) - 1));
+    uint16_t glyphCount = read_u16(f->directory + (uint32_t)dirIndex * FONT_DIR_ENTRY_SIZE + 2);
+    uint32_t bitmapStart = FONT_PAGE_MASK_SIZE + (uint32_t)glyphCount * FONT_GLYPH_DESC_SIZE;
+    if (rank >= glyphCount || bitmapStart > size) {
+        return 0; // The descriptors don't fit in the page
+    }
+    const uint8_t *desc = page + FONT_PAGE_MASK_SIZE + rank * FONT_GLYPH_DESC_SIZE;
+
+    // A damaged font must not send the drawing code outside the page
+    uint32_t rowBytes = ((uint32_t)desc[0] * f->bpp + 7) / 8;
+    uint32_t bitmapOffset = bitmapStart + read_u16(desc + 6);
+    if (bitmapOffset > size || rowBytes * desc[1] > size - bitmapOffset) {
+        return 0;
+    }
+
+    glyph->width = desc[0];
+    glyph->height = desc[1];
+    glyph->x_offset = (int8_t)desc[2];
+    glyph->y_offset = (int8_t)desc[3];
+    glyph->advance = desc[4];
+    glyph->bpp = f->bpp;
+    glyph->bitmap = page + bitmapOffset;
+    return 1;
+}
+
+static uint8_t glyph_level(const gui_glyph_t *glyph, int32_t col, int32_t row) {
+    if (col < 0 || row < 0 || col >= glyph->width || row >= glyph->height) {
+        return 0;
+    }
+    uint32_t rowBytes = ((uint32_t)glyph->width * glyph->bpp + 7) / 8;
+    uint32_t bitPos = (uint32_t)col * glyph->bpp;
+    uint8_t byte = glyph->bitmap[(uint32_t)row * rowBytes + (bitPos >> 3)];
+    uint8_t shift = (uint8_t)(8 - glyph->bpp - (bitPos & 7));
+    return (uint8_t)((byte >> shift) & ((1u << glyph->bpp) - 1));
+}
+
+static uint16_t to_rgb565(display_color_t color) {
+    return (uint16_t)(((color.r & 0xF8) << 8) | ((color.g & 0xFC) << 3) | (color.b >> 3));
+}
@@ -0,0 +1,482 @@
+#include "gui/gui_gauge.h"
+#include "drivers/display.h"
+#include "os_config.h"
+#include <stddef.h>
+
+#define SPAN_MIN   (-32767)
+#define SPAN_MAX   32767
+
+// Inclusive clip box in screen coordinates
+typedef struct {
+    int32_t x0, y0, x1, y1;
+} clip_t;
+
+// Quarter-wave sine, Q15, 256 steps per quarter turn (plus the end point)
+static const int16_t sineTable[GUI_ANGLE_FULL / 4 + 1] = {
+    0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809, 2009, 2210,
+    2410, 2611, 2811, 3012, 3212, 3412, 3612, 3811, 4011, 4210, 4410, 4609,
+    4808, 5007, 5205, 5404, 5602, 5800, 5998, 6195, 6393, 6590, 6786, 6983,
+    7179, 7375, 7571, 7767, 7962, 8157, 8351, 8545, 8739, 8933, 9126, 9319,
+    9512, 9704, 9896, 10087, 10278, 10469, 10659, 10849, 11039, 11228, 11417, 11605,
+    11793, 11980, 12167, 12353, 12539, 12725, 12910, 13094, 13279, 13462, 13645, 13828,
+    14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269, 15446, 15623, 15800, 15976,
+    16151, 16325, 16499, 16673, 16846, 17018, 17189, 17360, 17530, 17700, 17869, 18037,
+    18204, 18371, 18537, 18703, 18868, 19032, 19195, 19357, 19519, 19680, 19841, 20000,
+    20159, 20317, 20475, 20631, 20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856,
+    22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027, 23170, 23311, 23452, 23592,
+    23731, 23870, 24007, 24143, 24279, 24413, 24547, 24680, 24811, 24942, 25072, 25201,
+    25329, 25456, 25582, 25708, 25832, 25955, 26077, 26198, 26319, 26438, 26556, 26674,
+    26790, 26905, 27019, 27133, 27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001,
+    28105, 28208, 28310, 28411, 28510, 28609, 28706, 28803, 28898, 28992, 29085, 29177,
+    29268, 29358, 29447, 29534, 29621, 29706, 29791, 29874, 29956, 30037, 30117, 30195,
+    30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783, 30852, 30919, 30985, 31050,
+    31113, 31176, 31237, 31297, 31356, 31414, 31470, 31526, 31580, 31633, 31685, 31736,
+    31785, 31833, 31880, 31926, 31971, 32014, 32057, 32098, 32137, 32176, 32213, 32250,
+    32285, 32318, 32351, 32382, 32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+    32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717, 32728, 32737, 32745, 32752,
+    32757, 32761, 32765, 32766, 32767,
+};
+
+// Function declarations for internal functions
+static void draw_arc(int32_t cx, int32_t cy, uint16_t radius, uint16_t thickness,
+                     uint16_t start, uint16_t sweep, display_color_t color, const clip_t *clip);
+static void draw_span(int32_t x0, int32_t x1, int32_t y, display_color_t color, const clip_t *clip);
+static uint8_t half_plane(int32_t k, int32_t m, int32_t *lo, int32_t *hi);
+static int32_t floor_div(int32_t m, int32_t k);
+static uint32_t isqrt(uint32_t value);
+static void fill_triangle(const int32_t *x, const int32_t *y, display_color_t color, const clip_t *clip);
+static void screen_clip(clip_t *clip);
+static uint16_t sweep_steps(uint16_t degrees);
+static uint16_t gauge_angle(const gui_gauge_t *gauge, int32_t value);
+static void gauge_draw_ring(const gui_gauge_t *gauge, const clip_t *clip);
+static void gauge_draw_needle(gui_gauge_t *gauge, const clip_t *clip);
+
+int16_t gui_sin(uint16_t angle) {
+    uint16_t a = angle & (GUI_ANGLE_FULL - 1);
+    uint16_t index = a & (GUI_ANGLE_FULL / 4 - 1);
+
+    switch (a / (GUI_ANGLE_FULL / 4)) {
+        case 0:  return sineTable[index];
+        case 1:  return sineTable[GUI_ANGLE_FULL / 4 - index];
+        case 2:  return (int16_t)-sineTable[index];
+        default: return (int16_t)-sineTable[GUI_ANGLE_FULL / 4 - index];
+    }
+}
+
+int16_t gui_cos(uint16_t angle) {
+    return gui_sin((uint16_t)(angle + GUI_ANGLE_FULL / 4));
+}
+
+gui_status_t gui_draw_arc(int16_t x_center, int16_t y_center, uint16_t radius, uint16_t thickness,
+                          int16_t start_angle, uint16_t sweep_angle, display_color_t color) {
+    if (radius == 0 || thickness == 0 || sweep_angle == 0) {
+        return GUI_ERROR_PARAM;
+    }
+
+    clip_t clip;
+    screen_clip(&clip);
+    draw_arc(x_center, y_center, radius, thickness, GUI_ANGLE_FROM_DEGREES(start_angle),
+             sweep_steps(sweep_angle), color, &clip);
+    return GUI_OK;
+}
+
+gui_status_t gui_gauge_draw(gui_gauge_t *gauge) {
+    if (gauge == NULL || gauge->radius == 0 || gauge->thickness == 0 || gauge->sweep_angle == 0) {
+        return GUI_ERROR_PARAM;
+    }
+
+    if (gauge->value < gauge->min_value || gauge->value > gauge->max_value) {
+        gauge->value = gauge->min_value;
+    }
+    gauge->value_angle = gauge_angle(gauge, gauge->value);
+
+    clip_t clip;
+    screen_clip(&clip);
+    gauge_draw_ring(gauge, &clip);
+    gauge_draw_needle(gauge, &clip);
+    gauge->drawn = 1;
+    return GUI_OK;
+}
+
+gui_status_t gui_gauge_set_value(gui_gauge_t *gauge, int32_t value) {
+    if (gauge == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    if (value < gauge->min_value) value = gauge->min_value;
+    if (value > gauge->max_value) value = gauge->max_value;
+
+    uint16_t oldAngle = gauge->value_angle;
+    uint16_t newAngle = gauge_angle(gauge, value);
+    gauge->value = value;
+    if (!gauge->drawn) {
+        gauge->value_angle = newAngle;
+        return GUI_OK;
+    }
+    if (newAngle == oldAngle) {
+        return GUI_OK;
+    }
+    gauge->value_angle = newAngle;
+
+    clip_t clip;
+    screen_clip(&clip);
+    uint16_t start = GUI_ANGLE_FROM_DEGREES(gauge->start_angle);
+
+    // Only the slice of ring between the old and new value changes color
+    if (newAngle > oldAngle) {
+        draw_arc(gauge->x_center, gauge->y_center, gauge->radius, gauge->thickness,
+                 (uint16_t)(start + oldAngle), (uint16_t)(newAngle - oldAngle), gauge->fill_color, &clip);
+    } else {
+        draw_arc(gauge->x_center, gauge->y_center, gauge->radius, gauge->thickness,
+                 (uint16_t)(start + newAngle), (uint16_t)(oldAngle - newAngle), gauge->track_color, &clip);
+    }
+
+    if (gauge->needle_length == 0) {
+        return GUI_OK;
+    }
+
+    // Wipe the old needle's box and put back whatever the ring had there
+    gui_rect_t box = gauge->needle_box;
+    if (box.width > 0 && box.height > 0) {
+        clip_t old = { box.x, box.y, box.x + box.width - 1, box.y + box.height - 1 };
+        if (old.x0 < clip.x0) old.x0 = clip.x0;
+        if (old.y0 < clip.y0) old.y0 = clip.y0;
+        if (old.x1 > clip.x1) old.x1 = clip.x1;
+        if (old.y1 > clip.y1) old.y1 = clip.y1;
+        if (old.x0 <= old.x1 && old.y0 <= old.y1) {
+            display_draw_rect((uint16_t)old.x0, (uint16_t)old.y0, (uint16_t)(old.x1 - old.x0 + 1),
+                              (uint16_t)(old.y1 - old.y0 + 1), gauge->bg_color, 1);
+            gauge_draw_ring(gauge, &old);
+        }
+    }
+
+    gauge_draw_needle(gauge, &clip);
+    return GUI_OK;
+}
+
+gui_status_t gui_spinner_draw(gui_spinner_t *spinner) {
+    if (spinner == NULL || spinner->radius == 0 || spinner->thickness == 0) {
+        return GUI_ERROR_PARAM;
+    }
+
+    clip_t clip;
+    screen_clip(&clip);
+    uint16_t length = sweep_steps(spinner->arc_length);
+    draw_arc(spinner->x_center, spinner->y_center, spinner->radius, spinner->thickness,
+             0, GUI_ANGLE_FULL, spinner->track_color, &clip);
+    if (length > 0) {
+        draw_arc(spinner->x_center, spinner->y_center, spinner->radius, spinner->thickness,
+                 spinner->angle, length, spinner->color, &clip);
+    }
+    spinner->drawn = 1;
+    return GUI_OK;
+}
+
+gui_status_t gui_spinner_step(gui_spinner_t *spinner, uint32_t elapsed_ms) {
+    if (spinner == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    // degrees/s * ms -> binary angle steps, carrying the fraction to the next call
+    uint64_t moved = (uint64_t)spinner->speed * elapsed_ms * GUI_ANGLE_FULL + spinner->remainder;
+    uint32_t steps = (uint32_t)((moved / 360000u) % GUI_ANGLE_FULL);
+    spinner->remainder = (uint32_t)(moved % 360000u);
+    if (steps == 0) {
+        return GUI_OK;
+    }
+
+    uint16_t oldAngle = spinner->angle;
+    spinner->angle = (uint16_t)((oldAngle + steps) & (GUI_ANGLE_FULL - 1));
+    if (!spinner->drawn) {
+        return GUI_OK;
+    }
+
+    clip_t clip;
+    screen_clip(&clip);
+    uint16_t length = sweep_steps(spinner->arc_length);
+    if (length == 0) {
+        return GUI_OK;
+    }
+
+    if (steps >= length) {
+        // Jumped further than the arc is long - nothing overlaps
+        draw_arc(spinner->x_center, spinner->y_center, spinner->radius, spinner->thickness,
+                 oldAngle, length, spinner->track_color, &clip);
+        draw_arc(spinner->x_center, spinner->y_center, spinner->radius, spinner->thickness,
+                 spinner->angle, length, spinner->color, &clip);
+    } else {
+        // Paint the new head, then clear the tail that was left behind
+        draw_arc(spinner->x_center, spinner->y_center, spinner->radius, spinner->thickness,
+                 (uint16_t)(oldAngle + length), (uint16_t)steps, spinner->color, &clip);
+        draw_arc(spinner->x_center, spinner->y_center, spinner->radius, spinner->thickness,
+                 oldAngle, (uint16_t)steps, spinner->track_color, &clip);
+    }
+    return GUI_OK;
+}
+
+// Row-by-row ring fill. On each row the ring is at most two runs of x, and
+// the start/end rays become half-planes, which on a single row are just
+// "x <= bound" or "x >= bound" - so no angle is ever computed per pixel.
+static void draw_arc(int32_t cx, int32_t cy, uint16_t radius, uint16_t thickness,
+                     uint16_t start, uint16_t sweep, display_color_t color, const clip_t *clip) {
+    if (sweep == 0 || radius == 0) {
+        return;
+    }
+
+    uint8_t full = (sweep >= GUI_ANGLE_FULL);
+    uint16_t end = (uint16_t)(start + sweep);
+    int32_t s0 = gui_sin(start), c0 = gui_cos(start);
+    int32_t s1 = gui_sin(end), c1 = gui_cos(end);
+
+    // (r + 0.5)^2 and (inner - 0.5)^2, so edges land on pixel centers
+    int32_t inner = (int32_t)radius - (int32_t)thickness;
+    int32_t outer2 = (int32_t)radius * radius + radius;
+    int32_t inner2 = (inner > 0) ? inner * inner - inner : -1;
+
+    int32_t rowStart = cy - radius, rowEnd = cy + radius;
+    if (rowStart < clip->y0) rowStart = clip->y0;
+    if (rowEnd > clip->y1) rowEnd = clip->y1;
+
+    for (int32_t y = rowStart; y <= rowEnd; y++) {
+        int32_t dy = y - cy;
+        int32_t dy2 = dy * dy;
+        if (dy2 > outer2) {
+            continue;
+        }
+
+        // The ring on this row: [-xo, -xi - 1] and [xi + 1, xo], or one run if the hole is missed
+        int32_t xo = (int32_t)isqrt((uint32_t)(outer2 - dy2));
+        int32_t ringLo[2], ringHi[2];
+        uint8_t ringCount;
+        if (inner2 >= dy2) {
+            int32_t xi = (int32_t)isqrt((uint32_t)(inner2 - dy2));
+            ringLo[0] = -xo;     ringHi[0] = -xi - 1;
+            ringLo[1] = xi + 1;  ringHi[1] = xo;
+            ringCount = 2;
+        } else {
+            ringLo[0] = -xo;     ringHi[0] = xo;
+            ringCount = 1;
+        }
+
+        // The angular range on this row
+        int32_t sectorLo[2], sectorHi[2];
+        uint8_t sectorCount = 0;
+        if (full) {
+            sectorLo[0] = SPAN_MIN;
+            sectorHi[0] = SPAN_MAX;
+            sectorCount = 1;
+        } else {
+            int32_t aLo, aHi, bLo, bHi;
+            uint8_t a = half_plane(s0, c0 * dy, &aLo, &aHi);     // Clockwise of the start ray
+            uint8_t b = half_plane(-s1, -c1 * dy, &bLo, &bHi);   // Counter-clockwise of the end ray
+            if (sweep <= GUI_ANGLE_FULL / 2) {
+                // Narrow sector: inside both half-planes
+                if (a && b) {
+                    sectorLo[0] = (aLo > bLo) ? aLo : bLo;
+                    sectorHi[0] = (aHi < bHi) ? aHi : bHi;
+                    sectorCount = (sectorLo[0] <= sectorHi[0]) ? 1 : 0;
+                }
+            } else {
+                // Wide sector: inside either half-plane
+                if (a) {
+                    sectorLo[sectorCount] = aLo;
+                    sectorHi[sectorCount++] = aHi;
+                }
+                if (b) {
+                    sectorLo[sectorCount] = bLo;
+                    sectorHi[sectorCount++] = bHi;
+                }
+                if (sectorCount == 2 && sectorLo[1] <= sectorHi[0] + 1 && sectorLo[0] <= sectorHi[1] + 1) {
+                    sectorLo[0] = (sectorLo[0] < sectorLo[1]) ? sectorLo[0] : sectorLo[1];
+                    sectorHi[0] = (sectorHi[0] > sectorHi[1]) ? sectorHi[0] : sectorHi[1];
+                    sectorCount = 1;
+                }
+            }
+        }
+
+        for (uint8_t r = 0; r < ringCount; r++) {
+            for (uint8_t s = 0; s < sectorCount; s++) {
+                int32_t lo = (ringLo[r] > sectorLo[s]) ? ringLo[r] : sectorLo[s];
+                int32_t hi = (ringHi[r] < sectorHi[s]) ? ringHi[r] : sectorHi[s];
+                if (lo <= hi) {
+                    draw_span(cx + lo, cx + hi, y, color, clip);
+                }
+            }
+        }
+    }
+}
+
+static void draw_span(int32_t x0, int32_t x1, int32_t y, display_color_t color, const clip_t *clip) {
+    if (x0 < clip->x0) x0 = clip->x0;
+    if (x1 > clip->x1) x1 = clip->x1;
+    if (x0 > x1 || y < clip->y0 || y > clip->y1) {
+        return;
+    }
+    display_draw_rect((uint16_t)x0, (uint16_t)y, (uint16_t)(x1 - x0 + 1), 1, color, 1);
+}
+
+// Solve k * x <= m for x. Returns 0 if no x works on this row.
+static uint8_t half_plane(int32_t k, int32_t m, int32_t *lo, int32_t *hi) {
+    *lo = SPAN_MIN;
+    *hi = SPAN_MAX;
+    if (k > 0) {
+        *hi = floor_div(m, k);
+    } else if (k < 0) {
+        *lo = -floor_div(m, -k);
+    } else if (m < 0) {
+        return 0;
+    }
+    return 1;
+}
+
+static int32_t floor_div(int32_t m, int32_t k) {
+    return (m >= 0) ? m / k : -((-m + k - 1) / k);
+}
+
+static uint32_t isqrt(uint32_t value) {
+    uint32_t result = 0;
+    uint32_t bit = 1u << 30;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return result;
+}
+
+static void fill_triangle(const int32_t *x, const int32_t *y, display_color_t color, const clip_t *clip) {
+    int32_t top = y[0], bottom = y[0];
+    for (uint8_t i = 1; i < 3; i++) {
+        if (y[i] < top) top = y[i];
+        if (y[i] > bottom) bottom = y[i];
+    }
+    if (top < clip->y0) top = clip->y0;
+    if (bottom > clip->y1) bottom = clip->y1;
+
+    for (int32_t row = top; row <= bottom; row++) {
+        int32_t left = SPAN_MAX, right = SPAN_MIN;
+        for (uint8_t i = 0; i < 3; i++) {
+            uint8_t j = (uint8_t)((i + 1) % 3);
+            int32_t ya = y[i], yb = y[j];
+            if ((row < ya && row < yb) || (row > ya && row > yb)) {
+                continue;
+            }
+            int32_t xa, xb;
+            if (ya == yb) {
+                xa = x[i];
+                xb = x[j];
+            } else {
+                xa = xb = x[i] + (row - ya) * (x[j] - x[i]) / (yb - ya);
+            }
+            if (xa > xb) { int32_t t = xa; xa = xb; xb = t; }
+            if (xa < left) left = xa;
+            if (xb > right) right = xb;
+        }
+        if (left <= right) {
+            draw_span(left, right, row, color, clip);
+        }
+    }
+}
+
+static void screen_clip(clip_t *clip) {
+    clip->x0 = 0;
+    clip->y0 = 0;
+    clip->x1 = (int32_t)display_get_width() - 1;
+    clip->y1 = (int32_t)display_get_height() - 1;
+}
+
+static uint16_t sweep_steps(uint16_t degrees) {
+    return (degrees >= 360) ? GUI_ANGLE_FULL : (uint16_t)((uint32_t)degrees * GUI_ANGLE_FULL / 360);
+}
+
+static uint16_t gauge_angle(const gui_gauge_t *gauge, int32_t value) {
+    int64_t range = (int64_t)gauge->max_value - gauge->min_value;
+    if (range <= 0) {
+        return 0;
+    }
+    return (uint16_t)(((int64_t)value - gauge->min_value) * sweep_steps(gauge->sweep_angle) / range);
+}
+
+static void gauge_draw_ring(const gui_gauge_t *gauge, const clip_t *clip) {
+    uint16_t start = GUI_ANGLE_FROM_DEGREES(gauge->start_angle);
+    uint16_t sweep = sweep_steps(gauge->sweep_angle);
+
+    draw_arc(gauge->x_center, gauge->y_center, gauge->radius, gauge->thickness,
+             start, gauge->value_angle, gauge->fill_color, clip);
+    draw_arc(gauge->x_center, gauge->y_center, gauge->radius, gauge->thickness,
+             (uint16_t)(start + gauge->value_angle), (uint16_t)(sweep - gauge->value_angle), gauge->track_color, clip);
+
+    if (gauge->ticks == 0) {
+        return;
+    }
+
+    // Ticks sit just inside the ring
+    int32_t inner = (int32_t)gauge->radius - gauge->thickness - 2;
+    int32_t length = (gauge->thickness < 4) ? 4 : gauge->thickness;
+    if (inner <= length) {
+        return;
+    }
+    for (uint8_t i = 0; i < gauge->ticks; i++) {
+        uint16_t angle = (uint16_t)(start + ((gauge->ticks > 1) ? (uint32_t)sweep * i / (gauge->ticks - 1) : 0));
+        int32_t c = gui_cos(angle), s = gui_sin(angle);
+        int32_t x0 = gauge->x_center + ((inner * c) >> 15);
+        int32_t y0 = gauge->y_center + ((inner * s) >> 15);
+        int32_t x1 = gauge->x_center + (((inner - length) * c) >> 15);
+        int32_t y1 = gauge->y_center + (((inner - length) * s) >> 15);
+
+        // Whole ticks are redrawn when they touch the clip box; they only ever cover themselves
+        int32_t minX = (x0 < x1) ? x0 : x1, maxX = (x0 < x1) ? x1 : x0;
+        int32_t minY = (y0 < y1) ? y0 : y1, maxY = (y0 < y1) ? y1 : y0;
+        if (maxX < clip->x0 || minX > clip->x1 || maxY < clip->y0 || minY > clip->y1 || minX < 0 || minY < 0) {
+            continue;
+        }
+        display_draw_line((uint16_t)x0, (uint16_t)y0, (uint16_t)x1, (uint16_t)y1, gauge->tick_color);
+    }
+}
+
+static void gauge_draw_needle(gui_gauge_t *gauge, const clip_t *clip) {
+    gauge->needle_box.width = 0;
+    gauge->needle_box.height = 0;
+    if (gauge->needle_length == 0) {
+        return;
+    }
+
+    uint16_t angle = (uint16_t)(GUI_ANGLE_FROM_DEGREES(gauge->start_angle) + gauge->value_angle);
+    int32_t c = gui_cos(angle), s = gui_sin(angle);
+    int32_t half = (gauge->needle_width > 1) ? gauge->needle_width / 2 : 1;
+    int32_t cx = gauge->x_center, cy = gauge->y_center;
+
+    // A thin triangle from a base across the hub out to the tip
+    int32_t x[3], y[3];
+    x[0] = cx + ((gauge->needle_length * c + 16384) >> 15);
+    y[0] = cy + ((gauge->needle_length * s + 16384) >> 15);
+    x[1] = cx - ((half * s + 16384) >> 15);
+    y[1] = cy + ((half * c + 16384) >> 15);
+    x[2] = cx + ((half * s + 16384) >> 15);
+    y[2] = cy - ((half * c + 16384) >> 15);
+    fill_triangle(x, y, gauge->needle_color, clip);
+
+    int32_t hub = half + 1;
+    draw_arc(cx, cy, (uint16_t)hub, (uint16_t)hub, 0, GUI_ANGLE_FULL, gauge->needle_color, clip);
+
+    // Remember what we covered so the next move can wipe just this
+    int32_t minX = cx - hub, maxX = cx + hub, minY = cy - hub, maxY = cy + hub;
+    for (uint8_t i = 0; i < 3; i++) {
+        if (x[i] < minX) minX = x[i];
+        if (x[i] > maxX) maxX = x[i];
+        if (y[i] < minY) minY = y[i];
+        if (y[i] > maxY) maxY = y[i];
+    }
+    gauge->needle_box.x = (int16_t)minX;
+    gauge->needle_box.y = (int16_t)minY;
+    gauge->needle_box.width = (uint16_t)(maxX - minX + 1);
+    gauge->needle_box.height = (uint16_t)(maxY - minY + 1);
+}
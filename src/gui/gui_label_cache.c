@@ -0,0 +1,241 @@
+#include "gui/gui_label_cache.h"
+#include "gui/gui_font.h"
+#include "drivers/display.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include <string.h>
+
+_Static_assert(GUI_LABEL_CACHE_BPP == 1 || GUI_LABEL_CACHE_BPP == 4, "GUI_LABEL_CACHE_BPP must be 1 or 4");
+
+#define LABEL_LEVELS      (1u << GUI_LABEL_CACHE_BPP)
+#define LABEL_ROW_BYTES(w) ((uint32_t)(((w) * GUI_LABEL_CACHE_BPP + 7) / 8))
+
+typedef struct {
+    uint32_t hash;          // FNV-1a of the text
+    uint32_t check;         // Second, independent hash to reject collisions
+    uint16_t length;
+    uint16_t width;
+    uint16_t height;
+    uint8_t font;
+    uint32_t lastUsed;
+    uint32_t bytes;
+    uint8_t *bitmap;        // Packed alpha rows, MSB first, each row byte-aligned
+} label_entry_t;
+
+// Cache state
+static label_entry_t entries[GUI_LABEL_CACHE_ENTRIES];
+static gui_label_rasterizer_t labelRasterizer = NULL;
+static uint32_t usedBytes = 0;
+static uint32_t useCounter = 0;
+
+// One expanded RGB565 row, handed to display_draw_bitmap
+static uint16_t lineBuffer[GUI_LABEL_MAX_WIDTH];
+
+// Function declarations for internal functions
+static label_entry_t *find_entry(uint32_t hash, uint32_t check, uint16_t length, uint8_t font);
+static label_entry_t *create_entry(const char *text, uint32_t hash, uint32_t check, uint16_t length, uint8_t font);
+static void free_entry(label_entry_t *entry);
+static uint8_t make_room(uint32_t bytes);
+static uint16_t to_rgb565(display_color_t color);
+static void build_palette(uint16_t *palette, display_color_t color, display_color_t bg_color);
+
+gui_status_t gui_label_cache_init(gui_label_rasterizer_t rasterizer) {
+    if (rasterizer == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+    gui_label_cache_clear();
+    labelRasterizer = rasterizer;
+    return GUI_OK;
+}
+
+void gui_label_cache_clear(void) {
+    for (uint8_t i = 0; i < GUI_LABEL_CACHE_ENTRIES; i++) {
+        free_entry(&entries[i]);
+    }
+    useCounter = 0;
+}
+
+gui_status_t gui_label_cache_draw(int16_t x, int16_t y, const char *text, uint8_t font, display_color_t color, display_color_t bg_color) {
+    if (text == NULL || labelRasterizer == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    // Hash once: FNV-1a for the key, djb2 as an independent check
+    uint32_t hash = 2166136261u, check = 5381u;
+    uint16_t length = 0;
+    for (const char *p = text; *p != '\0'; p++, length++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+        check = check * 33u + (uint8_t)*p;
+    }
+
+    label_entry_t *entry = find_entry(hash, check, length, font);
+    if (entry == NULL) {
+        entry = create_entry(text, hash, check, length, font);
+        if (entry == NULL) {
+            return GUI_ERROR_MEMORY;
+        }
+    }
+    entry->lastUsed = ++useCounter;
+
+    // Clip against the top-left corner; the driver clips the rest
+    uint16_t skipCols = (x < 0) ? (uint16_t)(-x) : 0;
+    uint16_t skipRows = (y < 0) ? (uint16_t)(-y) : 0;
+    if (skipCols >= entry->width || skipRows >= entry->height) {
+        return GUI_OK;
+    }
+    uint16_t visible = entry->width - skipCols;
+
+    uint16_t palette[LABEL_LEVELS];
+    build_palette(palette, color, bg_color);
+
+    uint32_t rowBytes = LABEL_ROW_BYTES(entry->width);
+    for (uint16_t row = skipRows; row < entry->height; row++) {
+        const uint8_t *src = entry->bitmap + row * rowBytes;
+        for (uint16_t col = 0; col < visible; col++) {
+            uint16_t c = col + skipCols;
+#if GUI_LABEL_CACHE_BPP == 1
+            uint8_t level = (src[c >> 3] >> (7 - (c & 7))) & 0x01;
+#else
+            uint8_t level = (c & 1) ? (src[c >> 1] & 0x0F) : (src[c >> 1] >> 4);
+#endif
+            lineBuffer[col] = palette[level];
+        }
+        display_draw_bitmap((uint16_t)(x + skipCols), (uint16_t)(y + row), visible, 1, (const uint8_t *)lineBuffer);
+    }
+
+    return GUI_OK;
+}
+
+uint32_t gui_label_cache_memory_used(void) {
+    return usedBytes;
+}
+
+static label_entry_t *find_entry(uint32_t hash, uint32_t check, uint16_t length, uint8_t font) {
+    for (uint8_t i = 0; i < GUI_LABEL_CACHE_ENTRIES; i++) {
+        label_entry_t *entry = &entries[i];
+        if (entry->bitmap != NULL && entry->hash == hash && entry->check == check &&
+            entry->length == length && entry->font == font) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static label_entry_t *create_entry(const char *text, uint32_t hash, uint32_t check, uint16_t length, uint8_t font) {
+    // Registered UTF-8 fonts measure themselves; the built-in ones go through the driver
+    uint16_t width = 0, height = 0;
+    if (gui_font_measure(font, text, &width, &height) != GUI_OK &&
+        display_measure_text(text, font, &width, &height) != DISPLAY_OK) {
+        return NULL;
+    }
+    if (width == 0 || height == 0 || width > GUI_LABEL_MAX_WIDTH) {
+        return NULL;
+    }
+
+    uint32_t rowBytes = LABEL_ROW_BYTES(width);
+    uint32_t bytes = rowBytes * height;
+    if (bytes > GUI_LABEL_CACHE_BUDGET_BYTES) {
+        return NULL;
+    }
+
+    // Coverage scratch lives only while we pack it
+    uint8_t *coverage = pvPortMalloc((uint32_t)width * height);
+    if (coverage == NULL) {
+        return NULL;
+    }
+    memset(coverage, 0, (uint32_t)width * height);
+    labelRasterizer(text, font, coverage, width, height);
+
+    // Allocate before evicting, so running out of heap never costs a good entry
+    uint8_t *bitmap = pvPortMalloc(bytes);
+    if (bitmap == NULL) {
+        vPortFree(coverage);
+        return NULL;
+    }
+    memset(bitmap, 0, bytes);
+
+    for (uint16_t row = 0; row < height; row++) {
+        const uint8_t *src = coverage + (uint32_t)row * width;
+        uint8_t *dst = bitmap + row * rowBytes;
+        for (uint16_t col = 0; col < width; col++) {
+#if GUI_LABEL_CACHE_BPP == 1
+            if (src[col] >= 128) {
+                dst[col >> 3] |= (uint8_t)(0x80 >> (col & 7));
+            }
+#else
+            uint8_t level = src[col] >> 4;
+            dst[col >> 1] |= (col & 1) ? level : (uint8_t)(level << 4);
+#endif
+        }
+    }
+    vPortFree(coverage);
+
+    // Only now trim the cache to the budget, then take a free entry or the least recently drawn one
+    make_room(bytes);
+    label_entry_t *entry = NULL;
+    for (uint8_t i = 0; i < GUI_LABEL_CACHE_ENTRIES; i++) {
+        if (entries[i].bitmap == NULL) {
+            entry = &entries[i];
+            break;
+        }
+        if (entry == NULL || entries[i].lastUsed < entry->lastUsed) {
+            entry = &entries[i];
+        }
+    }
+    free_entry(entry);
+
+    entry->hash = hash;
+    entry->check = check;
+    entry->length = length;
+    entry->width = width;
+    entry->height = height;
+    entry->font = font;
+    entry->bytes = bytes;
+    entry->bitmap = bitmap;
+    usedBytes += bytes;
+
+    return entry;
+}
+
+static void free_entry(label_entry_t *entry) {
+    if (entry->bitmap != NULL) {
+        vPortFree(entry->bitmap);
+        usedBytes -= entry->bytes;
+    }
+    memset(entry, 0, sizeof(*entry));
+}
+
+static uint8_t make_room(uint32_t bytes) {
+    while (usedBytes + bytes > GUI_LABEL_CACHE_BUDGET_BYTES) {
+        label_entry_t *victim = NULL;
+        for (uint8_t i = 0; i < GUI_LABEL_CACHE_ENTRIES; i++) {
+            if (entries[i].bitmap == NULL) {
+                continue;
+            }
+            if (victim == NULL || entries[i].lastUsed < victim->lastUsed) {
+                victim = &entries[i];
+            }
+        }
+        if (victim == NULL) {
+            return 0;
+        }
+        free_entry(victim);
+    }
+    return 1;
+}
+
+static uint16_t to_rgb565(display_color_t color) {
+    return (uint16_t)(((color.r & 0xF8) << 8) | ((color.g & 0xFC) << 3) | (color.b >> 3));
+}
+
+// Blend fg over bg once per alpha level, so each pixel is a single table lookup
+static void build_palette(uint16_t *palette, display_color_t color, display_color_t bg_color) {
+    for (uint32_t level = 0; level < LABEL_LEVELS; level++) {
+        uint32_t a = (level * 255u) / (LABEL_LEVELS - 1);
+        display_color_t mixed;
+        mixed.r = (uint8_t)((bg_color.r * (255u - a) + color.r * a) / 255u);
+        mixed.g = (uint8_t)((bg_color.g * (255u - a) + color.g * a) / 255u);
+        mixed.b = (uint8_t)((bg_color.b * (255u - a) + color.b * a) / 255u);
+        palette[level] = to_rgb565(mixed);
+    }
+}
@@ -0,0 +1,443 @@
+#include "gui/gui_layout.h"
+#include "gui/gui_manager.h"
+#include "gui/gui_font.h"
+#include "drivers/display.h"
+#include "os_config.h"
+#include <string.h>
+
+#define AXIS_X 0
+#define AXIS_Y 1
+
+// Node flags
+#define NODE_USED           0x01
+#define NODE_MEASURE_DIRTY  0x02   // Measured size must be recomputed
+#define NODE_LAYOUT_DIRTY   0x04   // Children must be arranged again
+#define NODE_APPLIED        0x08   // Position/size have been pushed to the element once
+
+struct gui_layout_node_s {
+    gui_element_t element;
+    struct gui_layout_node_s *parent;
+    struct gui_layout_node_s *firstChild;
+    struct gui_layout_node_s *lastChild;
+    struct gui_layout_node_s *nextSibling;
+    uint8_t flags;
+    uint8_t direction;
+    uint8_t justify;
+    uint8_t align;
+    uint8_t grow;
+    uint8_t gap;
+    uint8_t padding[4];     // left, top, right, bottom
+    uint16_t fixed[2];      // 0 = size to content
+    uint16_t content[2];    // Intrinsic content size (text, image)
+    uint16_t measured[2];   // Cached measurement
+    int16_t pos[2];         // Last arranged position, relative to the parent element
+    uint16_t size[2];       // Last arranged size
+};
+
+// Layout state
+static struct gui_layout_node_s nodes[GUI_LAYOUT_MAX_NODES];
+static gui_layout_node_t dirtyRoots[GUI_LAYOUT_MAX_DIRTY_ROOTS];
+static uint8_t dirtyRootCount = 0;
+static uint8_t dirtyOverflow = 0;
+
+// Function declarations for internal functions
+static uint8_t is_boundary(gui_layout_node_t node);
+static gui_layout_node_t tree_root(gui_layout_node_t node);
+static void invalidate(gui_layout_node_t node);
+static void add_dirty_root(gui_layout_node_t node);
+static void measure(gui_layout_node_t node);
+static void arrange(gui_layout_node_t node, int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t force);
+static void layout_children(gui_layout_node_t node);
+
+gui_layout_node_t gui_layout_create(gui_element_t element, gui_layout_node_t parent) {
+    gui_layout_node_t node = NULL;
+    for (uint8_t i = 0; i < GUI_LAYOUT_MAX_NODES; i++) {
+        if (!(nodes[i].flags & NODE_USED)) {
+            node = &nodes[i];
+            break;
+        }
+    }
+    if (node == NULL) {
+        return NULL;
+    }
+
+    memset(node, 0, sizeof(*node));
+    node->element = element;
+    node->flags = NODE_USED | NODE_MEASURE_DIRTY | NODE_LAYOUT_DIRTY;
+    node->justify = GUI_ALIGN_START;
+    node->align = GUI_ALIGN_START;
+
+    if (parent != NULL) {
+        node->parent = parent;
+        if (parent->lastChild != NULL) {
+            parent->lastChild->nextSibling = node;
+        } else {
+            parent->firstChild = node;
+        }
+        parent->lastChild = node;
+    }
+
+    invalidate(node);
+    return node;
+}
+
+void gui_layout_delete(gui_layout_node_t node) {
+    if (node == NULL || !(node->flags & NODE_USED)) {
+        return;
+    }
+
+    while (node->firstChild != NULL) {
+        gui_layout_delete(node->firstChild);
+    }
+
+    gui_layout_node_t parent = node->parent;
+    if (parent != NULL) {
+        gui_layout_node_t prev = NULL;
+        for (gui_layout_node_t c = parent->firstChild; c != NULL; prev = c, c = c->nextSibling) {
+            if (c == node) {
+                if (prev != NULL) {
+                    prev->nextSibling = node->nextSibling;
+                } else {
+                    parent->firstChild = node->nextSibling;
+                }
+                if (parent->lastChild == node) {
+                    parent->lastChild = prev;
+                }
+                break;
+            }
+        }
+    }
+
+    for (uint8_t i = 0; i < dirtyRootCount; i++) {
+        if (dirtyRoots[i] == node) {
+            dirtyRoots[i] = dirtyRoots[--dirtyRootCount];
+            break;
+        }
+    }
+
+    memset(node, 0, sizeof(*node));
+    if (parent != NULL) {
+        invalidate(parent);
+    }
+}
+
+gui_status_t gui_layout_set_direction(gui_layout_node_t node, gui_layout_dir_t dir) {
+    if (node == NULL || dir > GUI_LAYOUT_COLUMN) {
+        return GUI_ERROR_PARAM;
+    }
+    node->direction = (uint8_t)dir;
+    invalidate(node);
+    return GUI_OK;
+}
+
+gui_status_t gui_layout_set_padding(gui_layout_node_t node, uint8_t left, uint8_t top, uint8_t right, uint8_t bottom) {
+    if (node == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+    node->padding[0] = left;
+    node->padding[1] = top;
+    node->padding[2] = right;
+    node->padding[3] = bottom;
+    invalidate(node);
+    return GUI_OK;
+}
+
+gui_status_t gui_layout_set_gap(gui_layout_node_t node, uint8_t gap) {
+    if (node == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+    node->gap = gap;
+    invalidate(node);
+    return GUI_OK;
+}
+
+gui_status_t gui_layout_set_align(gui_layout_node_t node, gui_align_t justify, gui_align_t align) {
+    if (node == NULL || justify == GUI_ALIGN_STRETCH || align == GUI_ALIGN_SPACE_BETWEEN) {
+        return GUI_ERROR_PARAM;
+    }
+    node->justify = (uint8_t)justify;
+    node->align = (uint8_t)align;
+    node->flags |= NODE_LAYOUT_DIRTY;
+    add_dirty_root(node);
+    return GUI_OK;
+}
+
+gui_status_t gui_layout_set_grow(gui_layout_node_t node, uint8_t grow) {
+    if (node == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+    node->grow = grow;
+    if (node->parent != NULL) {
+        node->parent->flags |= NODE_LAYOUT_DIRTY;
+        add_dirty_root(node->parent);
+    }
+    return GUI_OK;
+}
+
+gui_status_t gui_layout_set_fixed_size(gui_layout_node_t node, uint16_t width, uint16_t height) {
+    if (node == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+    // Invalidate while the old size still decides where the boundary is
+    invalidate(node);
+    node->fixed[AXIS_X] = width;
+    node->fixed[AXIS_Y] = height;
+    invalidate(node);
+    return GUI_OK;
+}
+
+gui_status_t gui_layout_set_content_size(gui_layout_node_t node, uint16_t width, uint16_t height) {
+    if (node == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+    if (node->content[AXIS_X] == width && node->content[AXIS_Y] == height) {
+        return GUI_OK; // Same footprint, nothing moves
+    }
+    node->content[AXIS_X] = width;
+    node->content[AXIS_Y] = height;
+    invalidate(node);
+    return GUI_OK;
+}
+
+void gui_layout_text_changed(gui_element_t element, const char *text, uint8_t font) {
+    if (element == NULL || text == NULL) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < GUI_LAYOUT_MAX_NODES; i++) {
+        if ((nodes[i].flags & NODE_USED) && nodes[i].element == element) {
+            // Registered UTF-8 fonts measure themselves; the built-in ones go through the driver
+            uint16_t width = 0, height = 0;
+            if (gui_font_measure(font, text, &width, &height) == GUI_OK ||
+                display_measure_text(text, font, &width, &height) == DISPLAY_OK) {
+                gui_layout_set_content_size(&nodes[i], width, height);
+            }
+            return;
+        }
+    }
+}
+
+void gui_layout_update(void) {
+    if (dirtyOverflow) {
+        // Too many separate changes: lay out every tree from its root
+        dirtyRootCount = 0;
+        dirtyOverflow = 0;
+        for (uint8_t i = 0; i < GUI_LAYOUT_MAX_NODES; i++) {
+            if ((nodes[i].flags & NODE_USED) && nodes[i].parent == NULL) {
+                nodes[i].flags |= NODE_LAYOUT_DIRTY;
+                add_dirty_root(&nodes[i]);
+            }
+        }
+    }
+
+    while (dirtyRootCount > 0) {
+        gui_layout_node_t node = dirtyRoots[--dirtyRootCount];
+
+        measure(node);
+        if (node->parent == NULL) {
+            // Tree roots keep their fixed size (normally the screen size)
+            arrange(node, 0, 0, node->measured[AXIS_X], node->measured[AXIS_Y], 0);
+        } else if (node->flags & NODE_APPLIED) {
+            // A fixed-size container: its own rectangle is unchanged, redo its inside
+            layout_children(node);
+        } else {
+            // Never placed yet: the parent has to place it
+            node->parent->flags |= NODE_LAYOUT_DIRTY;
+            add_dirty_root(tree_root(node));
+        }
+    }
+}
+
+// A node whose size can't depend on its children stops invalidation from spreading
+static uint8_t is_boundary(gui_layout_node_t node) {
+    return (node->parent == NULL) || (node->fixed[AXIS_X] != 0 && node->fixed[AXIS_Y] != 0 && node->grow == 0);
+}
+
+static gui_layout_node_t tree_root(gui_layout_node_t node) {
+    while (node->parent != NULL) {
+        node = node->parent;
+    }
+    return node;
+}
+
+static void invalidate(gui_layout_node_t node) {
+    node->flags |= NODE_MEASURE_DIRTY | NODE_LAYOUT_DIRTY;
+
+    while (!is_boundary(node)) {
+        node = node->parent;
+        node->flags |= NODE_MEASURE_DIRTY | NODE_LAYOUT_DIRTY;
+    }
+
+    add_dirty_root(node);
+}
+
+static void add_dirty_root(gui_layout_node_t node) {
+    for (uint8_t i = 0; i < dirtyRootCount; i++) {
+        if (dirtyRoots[i] == node) {
+            return;
+        }
+    }
+    if (dirtyRootCount < GUI_LAYOUT_MAX_DIRTY_ROOTS) {
+        dirtyRoots[dirtyRootCount++] = node;
+    } else {
+        dirtyOverflow = 1;
+    }
+}
+
+static void measure(gui_layout_node_t node) {
+    if (!(node->flags & NODE_MEASURE_DIRTY)) {
+        return; // Cached
+    }
+
+    uint32_t size[2] = { node->content[AXIS_X], node->content[AXIS_Y] };
+
+    if (node->firstChild != NULL) {
+        uint8_t main = (node->direction == GUI_LAYOUT_COLUMN) ? AXIS_Y : AXIS_X;
+        uint8_t cross = main ^ 1;
+        uint32_t sum = 0, largest[2] = { 0, 0 }, count = 0;
+
+        for (gui_layout_node_t c = node->firstChild; c != NULL; c = c->nextSibling) {
+            measure(c);
+            sum += c->measured[main];
+            if (c->measured[AXIS_X] > largest[AXIS_X]) largest[AXIS_X] = c->measured[AXIS_X];
+            if (c->measured[AXIS_Y] > largest[AXIS_Y]) largest[AXIS_Y] = c->measured[AXIS_Y];
+            count++;
+        }
+
+        if (node->direction == GUI_LAYOUT_NONE) {
+            if (largest[AXIS_X] > size[AXIS_X]) size[AXIS_X] = largest[AXIS_X];
+            if (largest[AXIS_Y] > size[AXIS_Y]) size[AXIS_Y] = largest[AXIS_Y];
+        } else {
+            sum += (uint32_t)node->gap * (count - 1);
+            if (sum > size[main]) size[main] = sum;
+            if (largest[cross] > size[cross]) size[cross] = largest[cross];
+        }
+    }
+
+    size[AXIS_X] += node->padding[0] + node->padding[2];
+    size[AXIS_Y] += node->padding[1] + node->padding[3];
+
+    for (uint8_t axis = 0; axis < 2; axis++) {
+        if (node->fixed[axis] != 0) {
+            size[axis] = node->fixed[axis];
+        }
+        node->measured[axis] = (size[axis] > UINT16_MAX) ? UINT16_MAX : (uint16_t)size[axis];
+    }
+
+    node->flags &= (uint8_t)~NODE_MEASURE_DIRTY;
+}
+
+static void arrange(gui_layout_node_t node, int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t force) {
+    uint8_t applied = (node->flags & NODE_APPLIED) != 0;
+    uint8_t moved = !applied || node->pos[AXIS_X] != x || node->pos[AXIS_Y] != y;
+    uint8_t resized = !applied || node->size[AXIS_X] != width || node->size[AXIS_Y] != height;
+
+    node->pos[AXIS_X] = x;
+    node->pos[AXIS_Y] = y;
+    node->size[AXIS_X] = width;
+    node->size[AXIS_Y] = height;
+    node->flags |= NODE_APPLIED;
+
+    if (node->element != NULL) {
+        if (moved) {
+            gui_set_position(node->element, x, y);
+        }
+        if (resized) {
+            gui_set_size(node->element, width, height);
+        }
+    }
+
+    // Children of an element are relative to it and don't care where it moved;
+    // children of an invisible group share the group's parent and must follow it
+    uint8_t groupMoved = (node->element == NULL) && moved;
+    if (resized || groupMoved || force || (node->flags & NODE_LAYOUT_DIRTY)) {
+        layout_children(node);
+    }
+}
+
+static void layout_children(gui_layout_node_t node) {
+    node->flags &= (uint8_t)~NODE_LAYOUT_DIRTY;
+    if (node->firstChild == NULL) {
+        return;
+    }
+
+    // Where (0,0) of the inner area sits in the coordinates children are placed in
+    int32_t originX = node->padding[0];
+    int32_t originY = node->padding[1];
+    if (node->element == NULL) {
+        originX += node->pos[AXIS_X];
+        originY += node->pos[AXIS_Y];
+    }
+
+    int32_t inner[2];
+    inner[AXIS_X] = (int32_t)node->size[AXIS_X] - node->padding[0] - node->padding[2];
+    inner[AXIS_Y] = (int32_t)node->size[AXIS_Y] - node->padding[1] - node->padding[3];
+    if (inner[AXIS_X] < 0) inner[AXIS_X] = 0;
+    if (inner[AXIS_Y] < 0) inner[AXIS_Y] = 0;
+
+    if (node->direction == GUI_LAYOUT_NONE) {
+        for (gui_layout_node_t c = node->firstChild; c != NULL; c = c->nextSibling) {
+            arrange(c, (int16_t)originX, (int16_t)originY, c->measured[AXIS_X], c->measured[AXIS_Y], 0);
+        }
+        return;
+    }
+
+    uint8_t main = (node->direction == GUI_LAYOUT_COLUMN) ? AXIS_Y : AXIS_X;
+    uint8_t cross = main ^ 1;
+
+    // Space left over after every child got its measured size
+    int32_t used = 0, count = 0, totalGrow = 0;
+    for (gui_layout_node_t c = node->firstChild; c != NULL; c = c->nextSibling) {
+        used += c->measured[main];
+        totalGrow += c->grow;
+        count++;
+    }
+    used += (int32_t)node->gap * (count - 1);
+    int32_t freeSpace = inner[main] - used;
+
+    int32_t offset = 0, spacing = node->gap;
+    if (freeSpace > 0 && totalGrow == 0) {
+        if (node->justify == GUI_ALIGN_CENTER) {
+            offset = freeSpace / 2;
+        } else if (node->justify == GUI_ALIGN_END) {
+            offset = freeSpace;
+        } else if (node->justify == GUI_ALIGN_SPACE_BETWEEN && count > 1) {
+            spacing += freeSpace / (count - 1);
+        }
+    }
+
+    int32_t growLeft = (freeSpace > 0) ? freeSpace : 0;
+    int32_t growersLeft = totalGrow;
+
+    for (gui_layout_node_t c = node->firstChild; c != NULL; c = c->nextSibling) {
+        int32_t mainSize = c->measured[main];
+        if (c->grow > 0 && growersLeft > 0) {
+            // Hand out the free space by weight; the last grower absorbs rounding
+            int32_t share = (growersLeft == c->grow) ? growLeft : (growLeft * c->grow) / growersLeft;
+            mainSize += share;
+            growLeft -= share;
+            growersLeft -= c->grow;
+        }
+
+        int32_t crossSize = c->measured[cross];
+        int32_t crossOffset = 0;
+        if (node->align == GUI_ALIGN_STRETCH && c->fixed[cross] == 0) {
+            crossSize = inner[cross];
+        } else if (node->align == GUI_ALIGN_CENTER) {
+            crossOffset = (inner[cross] - crossSize) / 2;
+        } else if (node->align == GUI_ALIGN_END) {
+            crossOffset = inner[cross] - crossSize;
+        }
+
+        int32_t pos[2];
+        pos[main] = offset;
+        pos[cross] = crossOffset;
+        uint16_t size[2];
+        size[main] = (uint16_t)mainSize;
+        size[cross] = (uint16_t)((crossSize < 0) ? 0 : crossSize);
+
+        arrange(c, (int16_t)(originX + pos[AXIS_X]), (int16_t)(originY + pos[AXIS_Y]), size[AXIS_X], size[AXIS_Y], 0);
+
+        offset += mainSize + spacing;
+    }
+}
@@ -0,0 +1,382 @@
+#include "gui/gui_snapshot.h"
+#include "drivers/display.h"
+#include "os_config.h"
+#include "FreeRTOS.h"
+#include <string.h>
+
+// Row packets: header bit 7 set = run of ((h & 0x7F) + 1) copies of one pixel,
+// clear = (h + 1) literal pixels. Pixels are stored little-endian.
+#define RLE_RUN_FLAG      0x80
+#define RLE_MAX_PACKET    128
+
+// Rows read back from the display per band while capturing
+#define CAPTURE_BAND_ROWS 16
+
+typedef struct snapshot_chunk_s {
+    struct snapshot_chunk_s *next;
+    uint16_t y;
+    uint16_t rows;
+    uint32_t size;
+    uint8_t data[];
+} snapshot_chunk_t;
+
+typedef struct {
+    gui_element_t screen;
+    uint16_t width;
+    uint16_t height;
+    uint16_t rowsCaptured;
+    uint8_t complete;
+    uint8_t dirtyCount;
+    uint32_t bytes;
+    uint32_t lastUsed;
+    gui_rect_t dirty[GUI_SNAPSHOT_MAX_DIRTY];
+    snapshot_chunk_t *head;
+    snapshot_chunk_t *tail;
+} snapshot_slot_t;
+
+// Album state
+static snapshot_slot_t slots[GUI_SNAPSHOT_SLOTS];
+static snapshot_slot_t *capturing = NULL;
+static uint32_t usedBytes = 0;
+static uint32_t useCounter = 0;
+
+// One decoded row, handed to display_draw_bitmap (and one read-back row when no band fits)
+static uint16_t lineBuffer[GUI_SNAPSHOT_MAX_WIDTH];
+
+// Function declarations for internal functions
+static snapshot_slot_t *find_slot(gui_element_t screen);
+static void free_slot(snapshot_slot_t *slot);
+static uint8_t make_room(uint32_t bytes);
+static uint32_t encode_row(const uint16_t *row, uint16_t width, uint8_t *out);
+static const uint8_t *decode_row(const uint8_t *in, uint16_t width, uint16_t *row);
+
+gui_status_t gui_snapshot_begin(gui_element_t screen, uint16_t width, uint16_t height) {
+    if (!GUI_ENABLE_SNAPSHOT_CACHE || screen == NULL || width == 0 || height == 0 ||
+        width > GUI_SNAPSHOT_MAX_WIDTH) {
+        return GUI_ERROR_PARAM;
+    }
+
+    if (capturing != NULL) {
+        free_slot(capturing); // Abandon an unfinished capture
+        capturing = NULL;
+    }
+
+    snapshot_slot_t *slot = find_slot(screen);
+    if (slot == NULL) {
+        // Take an empty slot, or the least recently shown one
+        for (uint8_t i = 0; i < GUI_SNAPSHOT_SLOTS; i++) {
+            if (slots[i].screen == NULL) {
+                slot = &slots[i];
+                break;
+            }
+            if (slot == NULL || slots[i].lastUsed < slot->lastUsed) {
+                slot = &slots[i];
+            }
+        }
+    }
+    free_slot(slot);
+
+    slot->screen = screen;
+    slot->width = width;
+    slot->height = height;
+    slot->lastUsed = ++useCounter;
+    capturing = slot;
+
+    return GUI_OK;
+}
+
+gui_status_t gui_snapshot_add_band(uint16_t y, uint16_t rows, const uint16_t *pixels, uint16_t stride) {
+    if (capturing == NULL || pixels == NULL || rows == 0) {
+        return GUI_ERROR_PARAM;
+    }
+    if (y != capturing->rowsCaptured || y + rows > capturing->height || stride < capturing->width) {
+        // Bands must arrive top to bottom without gaps
+        free_slot(capturing);
+        capturing = NULL;
+        return GUI_ERROR_PARAM;
+    }
+
+    // First pass sizes the chunk, second pass fills it
+    uint32_t size = 0;
+    for (uint16_t r = 0; r < rows; r++) {
+        size += encode_row(pixels + (uint32_t)r * stride, capturing->width, NULL);
+    }
+
+    uint32_t bytes = sizeof(snapshot_chunk_t) + size;
+    snapshot_chunk_t *chunk = NULL;
+    if (make_room(bytes)) {
+        chunk = pvPortMalloc(bytes);
+    }
+    if (chunk == NULL) {
+        free_slot(capturing);
+        capturing = NULL;
+        return GUI_ERROR_MEMORY;
+    }
+
+    uint8_t *out = chunk->data;
+    for (uint16_t r = 0; r < rows; r++) {
+        out += encode_row(pixels + (uint32_t)r * stride, capturing->width, out);
+    }
+    chunk->next = NULL;
+    chunk->y = y;
+    chunk->rows = rows;
+    chunk->size = size;
+
+    if (capturing->tail != NULL) {
+        capturing->tail->next = chunk;
+    } else {
+        capturing->head = chunk;
+    }
+    capturing->tail = chunk;
+    capturing->bytes += bytes;
+    capturing->rowsCaptured += rows;
+    usedBytes += bytes;
+
+    return GUI_OK;
+}
+
+gui_status_t gui_snapshot_end(void) {
+    if (capturing == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    snapshot_slot_t *slot = capturing;
+    capturing = NULL;
+
+    if (slot->rowsCaptured != slot->height) {
+        free_slot(slot);
+        return GUI_ERROR_PARAM;
+    }
+
+    slot->complete = 1;
+    slot->dirtyCount = 0;
+    return GUI_OK;
+}
+
+gui_status_t gui_snapshot_capture(gui_element_t screen) {
+    uint16_t width = display_get_width();
+    uint16_t height = display_get_height();
+    gui_status_t status = gui_snapshot_begin(screen, width, height);
+    if (status != GUI_OK) {
+        return status;
+    }
+
+    // Read back a band at a time; fall back to single rows when the heap is tight
+    uint16_t bandRows = CAPTURE_BAND_ROWS;
+    uint16_t *band = pvPortMalloc((uint32_t)width * bandRows * sizeof(uint16_t));
+    if (band == NULL) {
+        band = lineBuffer;
+        bandRows = 1;
+    }
+
+    for (uint16_t y = 0; y < height && status == GUI_OK; y += bandRows) {
+        uint16_t rows = (height - y < bandRows) ? (uint16_t)(height - y) : bandRows;
+        if (display_read_rect(0, y, width, rows, (uint8_t *)band) != DISPLAY_OK) {
+            status = GUI_ERROR_PARAM;
+            break;
+        }
+        status = gui_snapshot_add_band(y, rows, band, width);
+    }
+
+    if (band != lineBuffer) {
+        vPortFree(band);
+    }
+    if (status != GUI_OK) {
+        if (capturing != NULL) {
+            free_slot(capturing);
+            capturing = NULL;
+        }
+        return status;
+    }
+    return gui_snapshot_end();
+}
+
+void gui_snapshot_mark_dirty(gui_element_t screen, const gui_rect_t *rect) {
+    snapshot_slot_t *slot = find_slot(screen);
+    if (slot == NULL || !slot->complete || rect == NULL) {
+        return;
+    }
+
+    if (slot->dirtyCount < GUI_SNAPSHOT_MAX_DIRTY) {
+        slot->dirty[slot->dirtyCount++] = *rect;
+        return;
+    }
+
+    // Out of room: fold everything into one bounding box
+    int32_t left = rect->x, top = rect->y;
+    int32_t right = rect->x + rect->width, bottom = rect->y + rect->height;
+    for (uint8_t i = 0; i < slot->dirtyCount; i++) {
+        const gui_rect_t *r = &slot->dirty[i];
+        if (r->x < left) left = r->x;
+        if (r->y < top) top = r->y;
+        if (r->x + r->width > right) right = r->x + r->width;
+        if (r->y + r->height > bottom) bottom = r->y + r->height;
+    }
+
+    // If most of the screen changed the photo is not worth blitting
+    uint32_t area = (uint32_t)(right - left) * (uint32_t)(bottom - top);
+    if (area * 2 >= (uint32_t)slot->width * slot->height) {
+        free_slot(slot);
+        return;
+    }
+
+    slot->dirty[0].x = (int16_t)left;
+    slot->dirty[0].y = (int16_t)top;
+    slot->dirty[0].width = (uint16_t)(right - left);
+    slot->dirty[0].height = (uint16_t)(bottom - top);
+    slot->dirtyCount = 1;
+}
+
+void gui_snapshot_drop(gui_element_t screen) {
+    for (uint8_t i = 0; i < GUI_SNAPSHOT_SLOTS; i++) {
+        if (slots[i].screen != NULL && (screen == NULL || slots[i].screen == screen)) {
+            if (capturing == &slots[i]) {
+                capturing = NULL;
+            }
+            free_slot(&slots[i]);
+        }
+    }
+}
+
+uint8_t gui_snapshot_has(gui_element_t screen) {
+    snapshot_slot_t *slot = find_slot(screen);
+    return (slot != NULL && slot->complete) ? 1 : 0;
+}
+
+gui_status_t gui_snapshot_restore(gui_element_t screen, gui_rect_t *dirty, uint8_t *dirty_count) {
+    snapshot_slot_t *slot = find_slot(screen);
+    if (slot == NULL || !slot->complete || dirty == NULL || dirty_count == NULL) {
+        return GUI_ERROR_PARAM;
+    }
+
+    for (snapshot_chunk_t *chunk = slot->head; chunk != NULL; chunk = chunk->next) {
+        const uint8_t *in = chunk->data;
+        for (uint16_t r = 0; r < chunk->rows; r++) {
+            in = decode_row(in, slot->width, lineBuffer);
+            display_draw_bitmap(0, chunk->y + r, slot->width, 1, (const uint8_t *)lineBuffer);
+        }
+    }
+
+    memcpy(dirty, slot->dirty, slot->dirtyCount * sizeof(gui_rect_t));
+    *dirty_count = slot->dirtyCount;
+
+    // The screen is live again; its next snapshot is taken when we leave it
+    free_slot(slot);
+    return GUI_OK;
+}
+
+uint32_t gui_snapshot_memory_used(void) {
+    return usedBytes;
+}
+
+static snapshot_slot_t *find_slot(gui_element_t screen) {
+    if (screen == NULL) {
+        return NULL;
+    }
+    for (uint8_t i = 0; i < GUI_SNAPSHOT_SLOTS; i++) {
+        if (slots[i].screen == screen) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+static void free_slot(snapshot_slot_t *slot) {
+    snapshot_chunk_t *chunk = slot->head;
+    while (chunk != NULL) {
+        snapshot_chunk_t *next = chunk->next;
+        vPortFree(chunk);
+        chunk = next;
+    }
+    usedBytes -= slot->bytes;
+    memset(slot, 0, sizeof(*slot));
+}
+
+// Evict least recently shown snapshots until the budget has room
+static uint8_t make_room(uint32_t bytes) {
+    while (usedBytes + bytes > GUI_SNAPSHOT_BUDGET_BYTES) {
+        snapshot_slot_t *victim = NULL;
+        for (uint8_t i = 0; i < GUI_SNAPSHOT_SLOTS; i++) {
+            if (slots[i].screen == NULL || &slots[i] == capturing) {
+                continue;
+            }
+            if (victim == NULL || slots[i].lastUsed < victim->lastUsed) {
+                victim = &slots[i];
+            }
+        }
+        if (victim == NULL) {
+            return 0;
+        }
+        free_slot(victim);
+    }
+    return 1;
+}
+
+// Returns the encoded size; writes only when out is not NULL
+static uint32_t encode_row(const uint16_t *row, uint16_t width, uint8_t *out) {
+    uint32_t size = 0;
+    uint16_t i = 0;
+
+    while (i < width) {
+        uint16_t run = 1;
+        while (i + run < width && run < RLE_MAX_PACKET && row[i + run] == row[i]) {
+            run++;
+        }
+
+        if (run >= 2) {
+            if (out != NULL) {
+                out[size] = (uint8_t)(RLE_RUN_FLAG | (run - 1));
+                out[size + 1] = (uint8_t)(row[i] & 0xFF);
+                out[size + 2] = (uint8_t)(row[i] >> 8);
+            }
+            size += 3;
+            i += run;
+            continue;
+        }
+
+        // Literal packet: stop before the next pair of equal pixels
+        uint16_t count = 1;
+        while (i + count < width && count < RLE_MAX_PACKET &&
+               !(i + count + 1 < width && row[i + count] == row[i + count + 1])) {
+            count++;
+        }
+        if (out != NULL) {
+            out[size] = (uint8_t)(count - 1);
+            for (uint16_t k = 0; k < count; k++) {
+                out[size + 1 + 2 * k] = (uint8_t)(row[i + k] & 0xFF);
+                out[size + 2 + 2 * k] = (uint8_t)(row[i + k] >> 8);
+            }
+        }
+        size += 1 + 2u * count;
+        i += count;
+    }
+
+    return size;
+}
+
+static const uint8_t *decode_row(const uint8_t *in, uint16_t width, uint16_t *row) {
+    uint16_t i = 0;
+
+    while (i < width) {
+        uint8_t header = *in++;
+        uint16_t count = (uint16_t)((header & 0x7F) + 1);
+        if (i + count > width) {
+            count = width - i; // Corrupt data: never write past the line
+        }
+
+        if (header & RLE_RUN_FLAG) {
+            uint16_t pixel = (uint16_t)(in[0] | (in[1] << 8));
+            in += 2;
+            for (uint16_t k = 0; k < count; k++) {
+                row[i++] = pixel;
+            }
+        } else {
+            for (uint16_t k = 0; k < count; k++) {
+                row[i++] = (uint16_t)(in[0] | (in[1] << 8));
+                in += 2;
+            }
+        }
+    }
+
+    return in;
+}
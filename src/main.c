@@ -10,14 +10,21 @@
 #include "drivers/sd_card.h"  /* This lets us read and save files */
 #include "drivers/display.h"  /* This helps us show pictures on screen */
 #include "drivers/audio.h"    /* This lets us play sounds */
+#include "drivers/audio_output.h" /* This moves sounds to the speaker without stopping */
+#include "audio/audio_pipeline.h" /* This plays sound effects when no song is playing */
 #include "fs/fs_manager.h"    /* This keeps our files organized */
 #include "gui/gui_manager.h"  /* This makes the screen look nice */
+#if OS_CONFIG_ENABLE_GUI
+#include "gui/gui_capture.h"  /* This takes screen photos and times our drawing */
+#endif
 #include "core/system.h"      /* This controls the whole system */
 
 /* ===== Special helpers for our different jobs ===== */
 /* Think of these as name tags for different workers */
 // Task handles
+#if OS_CONFIG_ENABLE_GUI
 static TaskHandle_t guiTaskHandle = NULL;      /* The worker who draws on screen */
+#endif
 static TaskHandle_t fsTaskHandle = NULL;       /* The worker who organizes files */
 static TaskHandle_t audioTaskHandle = NULL;    /* The worker who plays sounds */
 static TaskHandle_t systemTaskHandle = NULL;   /* The boss worker who checks on everything */
@@ -26,7 +33,9 @@ static TaskHandle_t systemTaskHandle = NULL;   /* The boss worker who checks on
 /* These are like tickets that say "it's my turn to use this toy" */
 // Semaphores for resource access
 static SemaphoreHandle_t sdCardMutex;    /* Ticket for using the memory card */
+#if OS_CONFIG_ENABLE_GUI
 static SemaphoreHandle_t displayMutex;   /* Ticket for drawing on the screen */
+#endif
 static SemaphoreHandle_t audioMutex;     /* Ticket for playing sounds */
 
 /* ===== The Boss Job ===== */
@@ -43,7 +52,8 @@ static void systemTask(void *pvParameters) {
 }
 
 /* ===== The Drawing Job ===== */
-// GUI task - handles display and user interface
+// GUI task - handles display and user interface (not built at all without a screen)
+#if OS_CONFIG_ENABLE_GUI
 static void guiTask(void *pvParameters) {
     /* Try to turn on the screen */
     if (display_init() != DISPLAY_OK) {
@@ -56,12 +66,18 @@ static void guiTask(void *pvParameters) {
     
     /* Keep drawing forever */
     while (1) {
-        xSemaphoreTake(displayMutex, portMAX_DELAY);  /* Get the ticket to use the screen */
-        gui_update();                                  /* Draw new pictures */
-        xSemaphoreGive(displayMutex);                  /* Give the ticket back so others can use the screen */
+        if (gui_capture_frame_due()) {                 /* In step mode we only draw when asked */
+            xSemaphoreTake(displayMutex, portMAX_DELAY);  /* Get the ticket to use the screen */
+            uint32_t start = system_get_time_us();        /* Start the stopwatch */
+            gui_update();                                 /* Draw new pictures */
+            system_latency_mark_flush(start);             /* If a waiting press was drawn, stop its stopwatch */
+            gui_capture_record_frame(system_get_time_us() - start);  /* Write down how long it took */
+            xSemaphoreGive(displayMutex);                 /* Give the ticket back so others can use the screen */
+        }
         vTaskDelay(pdMS_TO_TICKS(16));                 /* Take a tiny nap (16ms) - this makes about 60 pictures every second */
     }
 }
+#endif /* OS_CONFIG_ENABLE_GUI */
 
 /* ===== The File Organizing Job ===== */
 // Filesystem task - handles SD card operations
@@ -100,12 +116,20 @@ static void audioTask(void *pvParameters) {
         return;
     }
     
-    /* Keep playing sounds forever */
+    /* Build the buffer belt to the speaker with the sizes the settings ask for */
+    audio_config_t config;
+    if (audio_get_config(&config) != AUDIO_OK || audio_output_init(&config) != AUDIO_OK) {
+        vTaskDelete(NULL);       /* No belt, no sound - stop this job */
+        return;
+    }
+    
+    /* Keep playing sounds forever - the DMA feeds the speaker, we just refill its buffers */
     while (1) {
+        audio_output_wait(AUDIO_OUTPUT_WAIT_MS);     /* Sleep until the speaker hands back an empty buffer */
         xSemaphoreTake(audioMutex, portMAX_DELAY);  /* Get the ticket to use the speaker */
-        audio_update();                              /* Make the next sound */
+        audio_update();                              /* Fill every empty buffer with the next sounds */
+        audio_pipeline_pump_effects();               /* No song? Then button clicks get the speaker to themselves */
         xSemaphoreGive(audioMutex);                  /* Give the ticket back so others can use the speaker */
-        vTaskDelay(pdMS_TO_TICKS(5));                /* Take a very tiny nap (5ms) to make smooth sounds */
     }
 }
 
@@ -114,7 +138,9 @@ static void audioTask(void *pvParameters) {
 static void buttonCallback(uint8_t button_id, button_event_t event) {
     /* Check what happened to the button */
     if (event == BUTTON_PRESSED) {
+        system_latency_mark_input(system_get_time_us());  /* Start the button-to-screen stopwatch */
         gui_handle_button_press(button_id);     /* Tell the screen someone pressed a button */
+        system_latency_mark_invalidate();       /* The screen knows now - the next redraw answers it */
     } else if (event == BUTTON_RELEASED) {
         gui_handle_button_release(button_id);   /* Tell the screen someone let go of a button */
     } else if (event == BUTTON_LONG_PRESS) {
@@ -130,7 +156,10 @@ int main(void) {
     
     /* Make the tickets for sharing toys */
     sdCardMutex = xSemaphoreCreateMutex();    /* Make a ticket for using the memory card */
+#if OS_CONFIG_ENABLE_GUI
     displayMutex = xSemaphoreCreateMutex();   /* Make a ticket for using the screen */
+    gui_capture_set_display_lock(displayMutex);  /* Screenshots wait for the same ticket */
+#endif
     audioMutex = xSemaphoreCreateMutex();     /* Make a ticket for using the speaker */
     
     /* Hire workers for different jobs */
@@ -144,10 +173,10 @@ int main(void) {
     /* ⬆️ Hire a worker to play sounds */
     
     /* Only hire a drawing worker if we have a screen */
-    if (OS_CONFIG_ENABLE_GUI) {
-        xTaskCreate(guiTask, "GUI", GUI_TASK_STACK_SIZE, NULL, GUI_TASK_PRIORITY, &guiTaskHandle);
-        /* ⬆️ Hire a worker to draw pictures */
-    }
+#if OS_CONFIG_ENABLE_GUI
+    xTaskCreate(guiTask, "GUI", GUI_TASK_STACK_SIZE, NULL, GUI_TASK_PRIORITY, &guiTaskHandle);
+    /* ⬆️ Hire a worker to draw pictures */
+#endif
     
     /* Start all the workers on their jobs! */
     vTaskStartScheduler();
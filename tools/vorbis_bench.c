@@ -0,0 +1,144 @@
+/*
+ * PC-side Ogg Vorbis benchmark
+ * Decodes a file with the same Tremor build the firmware uses and prints the same
+ * numbers as vorbis_decoder_benchmark(): CPU time per second of sound, open time and
+ * peak heap. Build from the repository root:
+ *
+ *   cc -O2 -c -Ilib/tremor -Dmalloc=vorbis_mem_malloc -Dcalloc=vorbis_mem_calloc
+ *      -Drealloc=vorbis_mem_realloc -Dfree=vorbis_mem_free lib/tremor/[a-z]*.c
+ *   cc -O2 -Ilib/tremor tools/vorbis_bench.c *.o -o vorbis_bench
+ *   ./vorbis_bench song.ogg
+ */
+
+#define _POSIX_C_SOURCE 200809L    // clock_gettime
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ivorbiscodec.h"
+#include "ivorbisfile.h"
+
+// Same bookkeeping as the firmware's counting allocator, on the PC heap
+typedef struct {
+    size_t size;
+    size_t reserved;
+} mem_header_t;
+
+static size_t memCurrent = 0;
+static size_t memPeak = 0;
+
+void *vorbis_mem_malloc(size_t size);
+void *vorbis_mem_calloc(size_t count, size_t size);
+void *vorbis_mem_realloc(void *pointer, size_t size);
+void vorbis_mem_free(void *pointer);
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s file.ogg\n", argv[0]);
+        return 1;
+    }
+    FILE *file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    OggVorbis_File vf;
+    uint64_t start = now_us();
+    if (ov_open(file, &vf, NULL, 0) != 0) {
+        fprintf(stderr, "%s: not an Ogg Vorbis file\n", argv[1]);
+        fclose(file);
+        return 1;
+    }
+    uint64_t openUs = now_us() - start;
+    size_t setupBytes = memCurrent;
+    vorbis_info *vi = ov_info(&vf, -1);
+
+    char pcm[4096];
+    uint64_t bytes = 0;
+    uint64_t busy = 0;
+    int bitstream;
+    for (;;) {
+        start = now_us();
+        long got = ov_read(&vf, pcm, sizeof(pcm), &bitstream);
+        busy += now_us() - start;
+        if (got == 0) {
+            break;
+        }
+        if (got > 0) {
+            bytes += (uint64_t)got;
+        } else if (got != OV_HOLE) {
+            fprintf(stderr, "decode error %ld\n", got);
+            break;
+        }
+    }
+
+    uint64_t frames = bytes / (2u * (uint64_t)vi->channels);
+    printf("file            %s\n", argv[1]);
+    printf("format          %ld Hz, %d channel(s)\n", vi->rate, vi->channels);
+    printf("audio           %.2f s\n", (double)frames / (double)vi->rate);
+    printf("open            %llu us\n", (unsigned long long)openUs);
+    printf("decode          %llu us\n", (unsigned long long)busy);
+    if (frames > 0) {
+        printf("us per second   %llu\n", (unsigned long long)(busy * (uint64_t)vi->rate / frames));
+    }
+    printf("setup heap      %zu bytes\n", setupBytes);
+    printf("peak heap       %zu bytes\n", memPeak);
+
+    ov_clear(&vf);    // Also closes the file
+    return 0;
+}
+
+void *vorbis_mem_malloc(size_t size) {
+    mem_header_t *header = (mem_header_t *)malloc(size + sizeof(mem_header_t));
+    if (header == NULL) {
+        return NULL;
+    }
+    header->size = size;
+    memCurrent += size + sizeof(mem_header_t);
+    if (memCurrent > memPeak) {
+        memPeak = memCurrent;
+    }
+    return header + 1;
+}
+
+void *vorbis_mem_calloc(size_t count, size_t size) {
+    void *pointer = vorbis_mem_malloc(count * size);
+    if (pointer != NULL) {
+        memset(pointer, 0, count * size);
+    }
+    return pointer;
+}
+
+void *vorbis_mem_realloc(void *pointer, size_t size) {
+    if (pointer == NULL) {
+        return vorbis_mem_malloc(size);
+    }
+    mem_header_t *old = (mem_header_t *)pointer - 1;
+    if (size <= old->size) {
+        return pointer;
+    }
+    void *bigger = vorbis_mem_malloc(size);
+    if (bigger != NULL) {
+        memcpy(bigger, pointer, old->size);
+        vorbis_mem_free(pointer);
+    }
+    return bigger;
+}
+
+void vorbis_mem_free(void *pointer) {
+    if (pointer == NULL) {
+        return;
+    }
+    mem_header_t *header = (mem_header_t *)pointer - 1;
+    memCurrent -= header->size + sizeof(mem_header_t);
+    free(header);
+}